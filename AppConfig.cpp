@@ -0,0 +1,208 @@
+#include "AppConfig.h"
+
+#include <stdexcept>
+
+namespace
+{
+    const char* NextValue( int argc, char** argv, int& i )
+    {
+        if( i + 1 >= argc )
+            throw std::runtime_error( std::string( "Missing value for " ) + argv[i] );
+        return argv[++i];
+    }
+
+    uint32_t ParseUint( const std::string& option, const char* value )
+    {
+        try{
+            size_t parsed = 0;
+            const unsigned long result = std::stoul( value, &parsed );
+            if( parsed == std::string( value ).size() && result <= UINT32_MAX )
+                return static_cast<uint32_t>( result );
+        }
+        catch( std::exception& )
+        {
+        }
+        throw std::runtime_error( "Invalid value for " + option + ": " + value );
+    }
+
+    double ParseDouble( const std::string& option, const char* value )
+    {
+        try{
+            size_t parsed = 0;
+            const double result = std::stod( value, &parsed );
+            if( parsed == std::string( value ).size() && result >= 0.0 )
+                return result;
+        }
+        catch( std::exception& )
+        {
+        }
+        throw std::runtime_error( "Invalid value for " + option + ": " + value );
+    }
+
+    const VkPresentModeKHR PresentModes[] = {
+        VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR
+    };
+
+    VkPresentModeKHR ParsePresentMode( const std::string& option, const char* value )
+    {
+        for( auto presentMode : PresentModes )
+        {
+            if( ToString( presentMode ) == std::string( value ) )
+                return presentMode;
+        }
+        throw std::runtime_error( "Invalid value for " + option + ": " + value + " (immediate, mailbox, fifo, fifo-relaxed)" );
+    }
+}
+
+const char* ToString( VkPresentModeKHR presentMode )
+{
+    switch( presentMode )
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:     return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:       return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:          return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:  return "fifo-relaxed";
+    default:                                return "unknown";
+    }
+}
+
+AppConfig AppConfig::Parse( int argc, char** argv )
+{
+    AppConfig config;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        const std::string arg = argv[i];
+
+        if( arg == "--compact-vertices" )
+            config.vertexFormat = VertexFormat::Compact;
+        else if( arg == "--no-mesh-optimize" )
+            config.optimizeMeshes = false;
+        else if( arg == "--optimize-overdraw" )
+            config.optimizeOverdraw = true;
+        else if( arg == "--headless" )
+            config.headless = true;
+        else if( arg == "--frames" )
+            config.frameCount = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--readback" )
+            config.readbackPath = NextValue( argc, argv, i );
+        else if( arg == "--no-validation" )
+            config.validation = false;
+        else if( arg == "--hot-reload" )
+            config.hotReload = true;
+        else if( arg == "--pipeline-cache" )
+            config.pipelineCachePath = NextValue( argc, argv, i );
+        else if( arg == "--no-pipeline-cache" )
+            config.pipelineCachePath.clear();
+        else if( arg == "--present-mode" )
+            config.presentMode = ParsePresentMode( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--frames-in-flight" )
+            config.framesInFlight = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--swapchain-images" )
+            config.swapchainImages = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--target-frame-ms" )
+            config.targetFrameMs = ParseDouble( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--dynamic-recording" )
+            config.dynamicRecording = true;
+        else if( arg == "--record-threads" )
+            config.recordThreads = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--gpu-driven" )
+            config.gpuDriven = true;
+        else if( arg == "--bindless" )
+            config.bindless = true;
+        else if( arg == "--no-draw-sort" )
+            config.sortDraws = false;
+        else if( arg == "--depth-prepass" )
+            config.depthPrepass = true;
+        else if( arg == "--occlusion-cull" )
+            config.occlusionCull = true;
+        else if( arg == "--objects" )
+            config.sceneObjects = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--instances" )
+            config.sceneInstances = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--triangles" )
+            config.sceneTriangles = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--layers" )
+            config.sceneLayers = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--mesh" )
+            config.meshPath = NextValue( argc, argv, i );
+        else if( arg == "--animate" )
+            config.animate = true;
+        else if( arg == "--texture" )
+            config.texturePaths.push_back( NextValue( argc, argv, i ) );
+        else if( arg == "--texture-budget-mb" )
+            config.textureBudgetMb = ParseUint( arg, NextValue( argc, argv, i ) );
+        else if( arg == "--profile" )
+            config.profile = true;
+        else if( arg == "--profile-interval" )
+        {
+            config.profileInterval = ParseUint( arg, NextValue( argc, argv, i ) );
+            config.profile = true;
+        }
+        else if( arg == "--profile-out" )
+        {
+            config.profileOutput = NextValue( argc, argv, i );
+            config.profile = true;
+        }
+        else
+            throw std::runtime_error( "Unknown option: " + arg + "\n" + Usage() );
+    }
+
+    if( config.sceneObjects > 0 && config.sceneInstances > 0 )
+        throw std::runtime_error( "--objects and --instances are separate scenes, pick one" );
+    if( !config.meshPath.empty() && (config.sceneObjects > 0 || config.sceneInstances > 0) )
+        throw std::runtime_error( "--mesh replaces the synthetic scene, drop --objects / --instances" );
+    if( config.sceneLayers == 0 || (config.sceneLayers > 1 && config.sceneObjects == 0) )
+        throw std::runtime_error( "--layers stacks the --objects scene, it needs --objects and at least 1 layer" );
+
+    if( config.occlusionCull && !config.gpuDriven )
+        throw std::runtime_error( "--occlusion-cull culls in the --gpu-driven compute pass, it needs --gpu-driven" );
+
+    if( config.framesInFlight == 0 || config.framesInFlight > MaxFramesInFlight )
+        throw std::runtime_error( "--frames-in-flight must be 1.." + std::to_string( MaxFramesInFlight ) );
+
+    if( !config.readbackPath.empty() && !config.headless )
+        throw std::runtime_error( "--readback needs --headless" );
+
+    if( config.headless && config.frameCount == 0 )
+        config.frameCount = DefaultHeadlessFrames;
+
+    return config;
+}
+
+std::string AppConfig::Usage()
+{
+    return "usage: TriangleApp [options]\n"
+           "  --compact-vertices     half-float positions + unorm8 colors (12 byte vertices)\n"
+           "  --no-mesh-optimize     upload meshes without vertex cache / fetch reordering\n"
+           "  --optimize-overdraw    also sort triangle clusters to reduce overdraw\n"
+           "  --headless             render into offscreen images (no window, surface or swapchain)\n"
+           "  --frames N             stop after N frames (headless default: 100)\n"
+           "  --readback FILE.ppm    write the last rendered frame to disk\n"
+           "  --no-validation        don't enable the validation layer\n"
+           "  --hot-reload           watch the shader sources, recompile (glslc) and swap the pipeline in while running\n"
+           "  --pipeline-cache FILE  where the pipeline cache is loaded from / saved to (default pipeline_cache.bin)\n"
+           "  --no-pipeline-cache    compile every pipeline from scratch, don't touch the cache file\n"
+           "  --present-mode MODE    immediate, mailbox (default), fifo or fifo-relaxed; fifo when unsupported\n"
+           "  --frames-in-flight N   frames the CPU may queue ahead of the GPU (default 2, 1 = lowest latency)\n"
+           "  --swapchain-images N   swapchain image count (default: the surface minimum + 1)\n"
+           "  --target-frame-ms MS   frame limiter: pace frames to MS, sampling input as late as possible\n"
+           "  --dynamic-recording    record per frame from resettable per-frame pools (skipped while the scene is unchanged)\n"
+           "  --record-threads N     record the draws in secondary command buffers on N threads\n"
+           "  --gpu-driven           cull on the GPU (compute) and draw with one indirect call per geometry page\n"
+           "  --bindless             descriptor indexing: one set of resource arrays, draws only push indices\n"
+           "  --no-draw-sort         draw in mesh order (default: sorted front to back, then by texture)\n"
+           "  --depth-prepass        depth-only pass first, so every pixel is shaded once\n"
+           "  --occlusion-cull       with --gpu-driven: skip objects hidden behind last frame's depth (Hi-Z pyramid)\n"
+           "  --objects N            synthetic scene: N grid objects instead of the quad\n"
+           "  --instances N          synthetic scene: one grid, N instances in a single draw call\n"
+           "  --triangles M          triangles per synthetic object (default 2)\n"
+           "  --layers L             stack the --objects in L full screen layers, listed back to front (overdraw)\n"
+           "  --mesh FILE.mesh       load a mesh file made by MeshConverter (same vertex format as the run)\n"
+           "  --animate              move the objects every frame (per-object transforms, nothing re-recorded)\n"
+           "  --texture FILE.ktx2    texture the meshes (repeatable, the meshes take the textures in turn)\n"
+           "  --texture-budget-mb N  resident texture data the mip streaming may keep (default 256)\n"
+           "  --profile              report CPU phase / GPU frame time / input->GPU done percentiles at exit\n"
+           "  --profile-interval N   also print a rolling report every N frames\n"
+           "  --profile-out FILE     write the profile: .json summary or .csv per frame\n";
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utilities.h"
+
+// runtime options, filled from the command line
+struct AppConfig
+{
+public:
+    // throws std::runtime_error on an unknown or malformed option
+    static AppConfig Parse( int argc, char** argv );
+    static std::string Usage();
+
+public:
+    static constexpr uint32_t DefaultHeadlessFrames = 100;
+    static constexpr uint32_t DefaultFramesInFlight = 2;
+    static constexpr uint32_t MaxFramesInFlight = 8;
+    static constexpr const char* DefaultPipelineCachePath = "pipeline_cache.bin";
+    static constexpr uint32_t DefaultTextureBudgetMb = 256;
+
+public:
+    VertexFormat vertexFormat = VertexFormat::Full;     // --compact-vertices
+    bool optimizeMeshes = true;         // --no-mesh-optimize
+    bool optimizeOverdraw = false;      // --optimize-overdraw
+
+    bool headless = false;              // --headless: offscreen images, no window / surface / swapchain
+    uint32_t frameCount = 0;            // --frames N: stop after N frames (0 = until the window closes; headless default 100)
+    std::string readbackPath;           // --readback FILE.ppm: write the last frame to disk
+    bool validation = true;             // --no-validation
+    bool hotReload = false;             // --hot-reload: recompile shaders/*.vert|frag with glslc when they change
+    std::string pipelineCachePath = DefaultPipelineCachePath;   // --pipeline-cache FILE, --no-pipeline-cache (empty: not persisted)
+
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;    // --present-mode: falls back to FIFO when the surface lacks it
+    uint32_t framesInFlight = DefaultFramesInFlight;    // --frames-in-flight N: frames the CPU may run ahead of the GPU
+    uint32_t swapchainImages = 0;       // --swapchain-images N: requested image count (0 = minImageCount + 1), clamped to the surface
+    double targetFrameMs = 0.0;         // --target-frame-ms MS: frame limiter (0 = off)
+
+    bool dynamicRecording = false;      // --dynamic-recording: record every frame from per frame-slot pools (no SIMULTANEOUS_USE)
+    uint32_t recordThreads = 0;         // --record-threads N: record secondary command buffers on N workers (0 = main thread)
+    bool gpuDriven = false;             // --gpu-driven: compute frustum culling + indirect draws (shaders/cull.spv)
+    bool bindless = false;              // --bindless: buffers (and textures) in descriptor indexing arrays (shaders/bindless_vert.spv)
+    bool sortDraws = true;              // --no-draw-sort: draw in mesh order instead of front to back (see DrawSorter)
+    bool depthPrepass = false;          // --depth-prepass: lay down depth with a vertex-only pass, then shade with depth equal to it
+    bool occlusionCull = false;         // --occlusion-cull: also cull against last frame's Hi-Z pyramid (see HiZPyramid), needs --gpu-driven
+
+    uint32_t sceneObjects = 0;          // --objects N: synthetic scene of N grids instead of the quad
+    uint32_t sceneTriangles = 2;        // --triangles M: triangles per synthetic object
+    uint32_t sceneLayers = 1;           // --layers L: the synthetic objects stacked in L full screen layers, back to front (overdraw L)
+    uint32_t sceneInstances = 0;        // --instances N: one synthetic grid drawn N times by a single instanced draw
+    std::string meshPath;               // --mesh FILE.mesh: a converted mesh file (tools/MeshConverter) instead of the quad
+    bool animate = false;               // --animate: move every object each frame (transform memcpy, no re-recording)
+    std::vector<std::string> texturePaths;  // --texture FILE.ktx2 (repeatable): meshes take them in turn (none: white)
+    uint32_t textureBudgetMb = DefaultTextureBudgetMb;  // --texture-budget-mb N: resident texel data the streamer may keep
+
+    bool profile = false;               // --profile: CPU phase + GPU timestamp percentiles
+    uint32_t profileInterval = 0;       // --profile-interval N: rolling report every N frames (implies --profile)
+    std::string profileOutput;          // --profile-out FILE: .json summary or .csv per frame (implies --profile)
+};
+
+// the --present-mode spelling
+const char* ToString( VkPresentModeKHR presentMode );
@@ -0,0 +1,206 @@
+#include "BindlessTable.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+const std::vector<const char*> BindlessTable::DeviceExtensions {
+    VK_KHR_MAINTENANCE3_EXTENSION_NAME,     // required by descriptor indexing on 1.0
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+};
+
+BindlessTable::Support BindlessTable::Query( VkInstance instance, VkPhysicalDevice physicalDevice )
+{
+    Support support;
+
+    // instance extension commands: only there when VK_KHR_get_physical_device_properties2 is enabled
+    auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+        vkGetInstanceProcAddr( instance, "vkGetPhysicalDeviceFeatures2KHR" ) );
+    auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+        vkGetInstanceProcAddr( instance, "vkGetPhysicalDeviceProperties2KHR" ) );
+    if( getFeatures2 == nullptr || getProperties2 == nullptr )
+        return support;
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties( physicalDevice, nullptr, &extensionCount, nullptr );
+    std::vector<VkExtensionProperties> extensions( extensionCount );
+    vkEnumerateDeviceExtensionProperties( physicalDevice, nullptr, &extensionCount, extensions.data() );
+    for( const char* required : DeviceExtensions )
+    {
+        const bool found = std::any_of( extensions.begin(), extensions.end(),
+            [required]( const VkExtensionProperties& extension ) { return std::strcmp( extension.extensionName, required ) == 0; } );
+        if( !found )
+            return support;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexingFeatures;
+    getFeatures2( physicalDevice, &features );
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+    indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexingProperties;
+    getProperties2( physicalDevice, &properties );
+
+    // arrays indexed by a push constant (dynamically uniform), partially bound, written after binding
+    const bool usable = features.features.shaderStorageBufferArrayDynamicIndexing
+                        && features.features.shaderSampledImageArrayDynamicIndexing
+                        && indexingFeatures.runtimeDescriptorArray
+                        && indexingFeatures.descriptorBindingPartiallyBound
+                        && indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+                        && indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind
+                        && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+    if( !usable )
+        return support;
+
+    support.available = true;
+    support.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    support.features.runtimeDescriptorArray = VK_TRUE;
+    support.features.descriptorBindingPartiallyBound = VK_TRUE;
+    support.features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    support.features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    support.features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    support.features.shaderSampledImageArrayNonUniformIndexing = indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+    support.features.shaderStorageBufferArrayNonUniformIndexing = indexingFeatures.shaderStorageBufferArrayNonUniformIndexing;
+    support.maxBuffers = std::min( indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                    indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers );
+    support.maxTextures = std::min( indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                    indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages );
+    return support;
+}
+
+void BindlessTable::Init( VkDevice device, DescriptorLayoutCache& layouts, const Support& support,
+                            uint32_t bufferCapacity, uint32_t textureCapacity )
+{
+    if( !support.available )
+        throw std::runtime_error( "Bindless descriptors need VK_EXT_descriptor_indexing!" );
+
+    _device = device;
+    _bufferCapacity = std::max<uint32_t>( 1, std::min( bufferCapacity, support.maxBuffers ) );
+    _textureCapacity = std::max<uint32_t>( 1, std::min( textureCapacity, support.maxTextures ) );
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings( 2 );
+    bindings[0].binding = BufferBinding;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = _bufferCapacity;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].binding = TextureBinding;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = _textureCapacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    const VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+                                                    | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+                                                    | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+    _setLayout = layouts.Get( bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT, { bindingFlags, bindingFlags } );
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _bufferCapacity };
+    poolSizes[1] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _textureCapacity };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = static_cast<uint32_t>( poolSizes.size() );
+    poolInfo.pPoolSizes = poolSizes.data();
+    if( vkCreateDescriptorPool( _device, &poolInfo, nullptr, &_descriptorPool )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create bindless descriptor pool!" );
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_setLayout;
+    if( vkAllocateDescriptorSets( _device, &allocInfo, &_set )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to allocate bindless descriptor set!" );
+    }
+}
+
+void BindlessTable::Destroy()
+{
+    vkDestroyDescriptorPool( _device, _descriptorPool, nullptr );     // descriptor set too
+    _descriptorPool = VK_NULL_HANDLE;
+    _set = VK_NULL_HANDLE;
+    _bufferCount = _textureCount = 0;
+    _freeBuffers.clear();
+    _freeTextures.clear();
+}
+
+uint32_t BindlessTable::AddBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range )
+{
+    const uint32_t slot = TakeSlot( _bufferCount, _bufferCapacity, _freeBuffers, "buffer" );
+
+    const VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = BufferBinding;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets( _device, 1, &write, 0, nullptr );
+    return slot;
+}
+
+uint32_t BindlessTable::AddTexture( VkImageView imageView, VkSampler sampler )
+{
+    const uint32_t slot = TakeSlot( _textureCount, _textureCapacity, _freeTextures, "texture" );
+    WriteTexture( slot, imageView, sampler );
+    return slot;
+}
+
+void BindlessTable::UpdateTexture( uint32_t slot, VkImageView imageView, VkSampler sampler )
+{
+    WriteTexture( slot, imageView, sampler );
+}
+
+void BindlessTable::RemoveBuffer( uint32_t slot )
+{
+    _freeBuffers.push_back( slot );     // partially bound: the stale descriptor is never read
+}
+
+void BindlessTable::RemoveTexture( uint32_t slot )
+{
+    _freeTextures.push_back( slot );
+}
+
+uint32_t BindlessTable::TakeSlot( uint32_t& count, uint32_t capacity, std::vector<uint32_t>& freeSlots, const char* what )
+{
+    if( !freeSlots.empty() )
+    {
+        const uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    if( count == capacity )
+        throw std::runtime_error( std::string( "Bindless " ) + what + " array is full (" + std::to_string( capacity ) + ")!" );
+    return count++;
+}
+
+void BindlessTable::WriteTexture( uint32_t slot, VkImageView imageView, VkSampler sampler )
+{
+    const VkDescriptorImageInfo imageInfo{ sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _set;
+    write.dstBinding = TextureBinding;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets( _device, 1, &write, 0, nullptr );
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "DescriptorAllocator.h"
+
+// Bindless resources (VK_EXT_descriptor_indexing): one descriptor set holding every buffer
+// (binding 0, storage buffers) and texture (binding 1, combined image samplers) in large arrays.
+// It is bound once per command buffer; shaders index the arrays with what a draw pushes, so
+// changing resources between draws is a push constant, never a descriptor bind or a new set.
+//
+// The bindings are partially bound and update-after-bind: slots are written while command buffers
+// using the set are pending (UPDATE_UNUSED_WHILE_PENDING), as long as those don't read the slot.
+// A removed slot is reused by the next Add: only remove what no frame in flight reads anymore.
+class BindlessTable
+{
+public:
+    // what the device offers; the features to enable are filled in when it is usable
+    struct Support
+    {
+        bool available = false;
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT features{};   // chain into VkDeviceCreateInfo::pNext
+        uint32_t maxBuffers = 0;        // maxDescriptorSetUpdateAfterBindStorageBuffers
+        uint32_t maxTextures = 0;       // maxDescriptorSetUpdateAfterBindSampledImages
+    };
+
+public:
+    // needs VK_KHR_get_physical_device_properties2 enabled on the instance;
+    // enable DeviceExtensions and Support::features on the device when available
+    static Support Query( VkInstance instance, VkPhysicalDevice physicalDevice );
+
+    // capacities are clamped to the device limits
+    void Init( VkDevice device, DescriptorLayoutCache& layouts, const Support& support,
+                uint32_t bufferCapacity = DefaultBufferCapacity, uint32_t textureCapacity = DefaultTextureCapacity );
+    void Destroy();
+
+    // slot index, for the shader; throws std::runtime_error when the array is full
+    uint32_t AddBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range );
+    uint32_t AddTexture( VkImageView imageView, VkSampler sampler );
+    // rewrites a slot in place (e.g. a texture whose resident mips changed)
+    void UpdateTexture( uint32_t slot, VkImageView imageView, VkSampler sampler );
+    void RemoveBuffer( uint32_t slot );
+    void RemoveTexture( uint32_t slot );
+
+    VkDescriptorSetLayout GetSetLayout() const { return _setLayout; }
+    VkDescriptorSet GetSet() const { return _set; }
+    uint32_t GetBufferCount() const { return _bufferCount - static_cast<uint32_t>( _freeBuffers.size() ); }
+    uint32_t GetTextureCount() const { return _textureCount - static_cast<uint32_t>( _freeTextures.size() ); }
+
+public:
+    static const std::vector<const char*> DeviceExtensions;
+    static constexpr uint32_t Set = 1;              // set index in the graphics pipeline layout
+    static constexpr uint32_t BufferBinding = 0;
+    static constexpr uint32_t TextureBinding = 1;
+    static constexpr uint32_t DefaultBufferCapacity = 1024;
+    static constexpr uint32_t DefaultTextureCapacity = 4096;
+
+private:
+    // next slot of an array: a removed one first, then the end
+    static uint32_t TakeSlot( uint32_t& count, uint32_t capacity, std::vector<uint32_t>& freeSlots, const char* what );
+    void WriteTexture( uint32_t slot, VkImageView imageView, VkSampler sampler );
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _setLayout = VK_NULL_HANDLE;      // owned by the layout cache
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;      // UPDATE_AFTER_BIND: a pool of its own
+    VkDescriptorSet _set = VK_NULL_HANDLE;
+
+    uint32_t _bufferCapacity = 0;
+    uint32_t _textureCapacity = 0;
+    uint32_t _bufferCount = 0;      // slots ever handed out (high water mark)
+    uint32_t _textureCount = 0;
+    std::vector<uint32_t> _freeBuffers;
+    std::vector<uint32_t> _freeTextures;
+};
@@ -0,0 +1,185 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "utilities.h"
+
+std::ostream& operator<<( std::ostream& os, const DescriptorStats& stats )
+{
+    os << "descriptors: " << stats.layoutCount << " set layouts (" << stats.layoutHits << " cache hits), "
+       << stats.poolCount << " pools, " << stats.setsAllocated << " sets allocated, " << stats.poolResets << " pool resets";
+    if( stats.bindlessBuffers > 0 || stats.bindlessTextures > 0 )
+        os << ", bindless: " << stats.bindlessBuffers << " buffers, " << stats.bindlessTextures << " textures";
+    return os;
+}
+
+
+void DescriptorLayoutCache::Init( VkDevice device )
+{
+    _device = device;
+}
+
+void DescriptorLayoutCache::Destroy()
+{
+    for( auto& layout : _layouts )
+        vkDestroyDescriptorSetLayout( _device, layout.second, nullptr );
+    _layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::Get( const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+                                                    VkDescriptorSetLayoutCreateFlags flags,
+                                                    const std::vector<VkDescriptorBindingFlagsEXT>& bindingFlags )
+{
+    if( !bindingFlags.empty() && bindingFlags.size() != bindings.size() )
+        throw std::runtime_error( "Descriptor binding flags don't match the bindings!" );
+
+    // the key doesn't depend on the order the bindings were listed in
+    std::vector<uint32_t> order( bindings.size() );
+    for( uint32_t i = 0; i < order.size(); ++i )
+        order[i] = i;
+    std::sort( order.begin(), order.end(), [&bindings]( uint32_t a, uint32_t b ) { return bindings[a].binding < bindings[b].binding; } );
+
+    Hasher hasher;
+    hasher.Add( flags );
+    for( uint32_t i : order )
+    {
+        const auto& binding = bindings[i];
+        if( binding.pImmutableSamplers != nullptr )
+            throw std::runtime_error( "Immutable samplers are not supported by the descriptor layout cache!" );
+
+        hasher.Add( binding.binding );
+        hasher.Add( binding.descriptorType );
+        hasher.Add( binding.descriptorCount );
+        hasher.Add( binding.stageFlags );
+        hasher.Add( bindingFlags.empty() ? VkDescriptorBindingFlagsEXT( 0 ) : bindingFlags[i] );
+    }
+
+    const uint64_t key = hasher.Get();
+    auto found = _layouts.find( key );
+    if( found != _layouts.end() )
+    {
+        ++_hits;
+        return found->second;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    flagsInfo.bindingCount = static_cast<uint32_t>( bindingFlags.size() );
+    flagsInfo.pBindingFlags = bindingFlags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = bindingFlags.empty() ? nullptr : &flagsInfo;    // VK_EXT_descriptor_indexing
+    layoutInfo.flags = flags;
+    layoutInfo.bindingCount = static_cast<uint32_t>( bindings.size() );
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout;
+    if( vkCreateDescriptorSetLayout( _device, &layoutInfo, nullptr, &layout )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create descriptor set layout!" );
+    }
+
+    _layouts.emplace( key, layout );
+    return layout;
+}
+
+
+const DescriptorAllocator::PoolRatio DescriptorAllocator::PoolRatios[] = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+};
+
+void DescriptorAllocator::Init( VkDevice device, uint32_t setsPerPool )
+{
+    _device = device;
+    _setsPerPool = std::max<uint32_t>( 1, setsPerPool );
+}
+
+void DescriptorAllocator::Destroy()
+{
+    for( auto pool : _usedPools )
+        vkDestroyDescriptorPool( _device, pool, nullptr );     // their sets too
+    for( auto pool : _freePools )
+        vkDestroyDescriptorPool( _device, pool, nullptr );
+    _usedPools.clear();
+    _freePools.clear();
+    _currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate( VkDescriptorSetLayout layout )
+{
+    if( _currentPool == VK_NULL_HANDLE )
+        _currentPool = TakePool();
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _currentPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    VkResult result = vkAllocateDescriptorSets( _device, &allocInfo, &set );
+
+    // the pool is full (1.0 drivers may report it as fragmented): continue in the next one
+    if( result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL )
+    {
+        _currentPool = TakePool();
+        allocInfo.descriptorPool = _currentPool;
+        result = vkAllocateDescriptorSets( _device, &allocInfo, &set );
+    }
+    if( result != VK_SUCCESS )
+        throw std::runtime_error( "Failed to allocate descriptor set!" );
+
+    ++_setsAllocated;
+    return set;
+}
+
+void DescriptorAllocator::Reset()
+{
+    for( auto pool : _usedPools )
+    {
+        vkResetDescriptorPool( _device, pool, 0 );
+        _freePools.push_back( pool );
+    }
+    if( !_usedPools.empty() )
+        ++_resets;
+    _usedPools.clear();
+    _currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::TakePool()
+{
+    if( !_freePools.empty() )
+    {
+        VkDescriptorPool pool = _freePools.back();
+        _freePools.pop_back();
+        _usedPools.push_back( pool );
+        return pool;
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for( const auto& ratio : PoolRatios )
+        poolSizes.push_back( { ratio.type, std::max<uint32_t>( 1, static_cast<uint32_t>( ratio.perSet * _setsPerPool ) ) } );
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = _setsPerPool;
+    poolInfo.poolSizeCount = static_cast<uint32_t>( poolSizes.size() );
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    VkDescriptorPool pool;
+    if( vkCreateDescriptorPool( _device, &poolInfo, nullptr, &pool )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create descriptor pool!" );
+    }
+
+    _setsPerPool = std::min( _setsPerPool * 2, MaxSetsPerPool );
+    _usedPools.push_back( pool );
+    return pool;
+}
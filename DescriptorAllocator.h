@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+struct DescriptorStats
+{
+    uint32_t layoutCount = 0;       // distinct set layouts created
+    uint32_t layoutHits = 0;        // layout requests answered from the cache
+    uint32_t poolCount = 0;         // pools created, every allocator together
+    uint32_t setsAllocated = 0;
+    uint32_t poolResets = 0;        // per frame allocators: vkResetDescriptorPool calls
+    uint32_t bindlessBuffers = 0;   // --bindless: slots in use
+    uint32_t bindlessTextures = 0;
+};
+
+std::ostream& operator<<( std::ostream& os, const DescriptorStats& stats );
+
+
+// Descriptor set layouts keyed by a hash of their bindings (and flags), so every user asking for
+// the same layout gets the same handle: pipeline layouts built from them stay compatible and
+// nothing is created twice. The cache owns the layouts.
+class DescriptorLayoutCache
+{
+public:
+    void Init( VkDevice device );
+    void Destroy();
+
+    // bindings in any order (pImmutableSamplers has to be null); bindingFlags empty or one per binding
+    VkDescriptorSetLayout Get( const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+                                VkDescriptorSetLayoutCreateFlags flags = 0,
+                                const std::vector<VkDescriptorBindingFlagsEXT>& bindingFlags = {} );
+
+    uint32_t GetLayoutCount() const { return static_cast<uint32_t>( _layouts.size() ); }
+    uint32_t GetHits() const { return _hits; }
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    std::unordered_map<uint64_t, VkDescriptorSetLayout> _layouts;
+    uint32_t _hits = 0;
+};
+
+
+// Descriptor sets from a growing list of pools: when the current pool runs out, the next one is
+// taken (or created, each twice as big as the last). Reset() hands every set back at once with
+// vkResetDescriptorPool; the pools are kept for reuse, so a per frame allocator stops creating
+// pools after the first frames. Sets are never freed one by one.
+// Not thread safe: one allocator per frame slot (or per thread).
+class DescriptorAllocator
+{
+public:
+    // setsPerPool: size of the first pool (descriptors per set type: see PoolRatios)
+    void Init( VkDevice device, uint32_t setsPerPool = DefaultSetsPerPool );
+    void Destroy();
+
+    VkDescriptorSet Allocate( VkDescriptorSetLayout layout );
+    // every set allocated so far becomes invalid; the caller makes sure the GPU is done with them
+    void Reset();
+
+    uint32_t GetPoolCount() const { return static_cast<uint32_t>( _usedPools.size() + _freePools.size() ); }
+    uint32_t GetSetsAllocated() const { return _setsAllocated; }
+    uint32_t GetResets() const { return _resets; }
+
+public:
+    static constexpr uint32_t DefaultSetsPerPool = 64;
+    static constexpr uint32_t MaxSetsPerPool = 4096;
+
+    // descriptors of a type per set, on average: a pool for N sets has N * ratio of each
+    struct PoolRatio
+    {
+        VkDescriptorType type;
+        float perSet;
+    };
+    static const PoolRatio PoolRatios[];
+
+private:
+    VkDescriptorPool TakePool();
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    uint32_t _setsPerPool = DefaultSetsPerPool;     // size of the next pool created
+    VkDescriptorPool _currentPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> _usedPools;       // allocated from since the last Reset (current included)
+    std::vector<VkDescriptorPool> _freePools;       // reset, ready to be taken
+    uint32_t _setsAllocated = 0;
+    uint32_t _resets = 0;
+};
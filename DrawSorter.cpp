@@ -0,0 +1,76 @@
+#include "DrawSorter.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+std::ostream& operator<<( std::ostream& os, const DrawSortStats& stats )
+{
+    os << "draw sort: " << stats.sortCount << " sorts of " << stats.drawCount << " draws, "
+       << stats.radixPasses << " radix passes (" << stats.skippedPasses << " skipped), " << stats.sortMs << " ms";
+    return os;
+}
+
+uint64_t DrawSorter::MakeKey( uint32_t pipeline, float depth, uint32_t material )
+{
+    constexpr uint32_t DepthMax = (1u << DepthBits) - 1;
+    const float clamped = std::isnan( depth ) ? 1.0f : std::clamp( depth, 0.0f, 1.0f );
+    const uint64_t depthBits = static_cast<uint64_t>( std::lround( clamped * float(DepthMax) ) );
+
+    return (uint64_t(pipeline & ((1u << PipelineBits) - 1)) << (DepthBits + MaterialBits))
+         | (depthBits << MaterialBits)
+         | uint64_t(material & ((1u << MaterialBits) - 1));
+}
+
+const std::vector<uint32_t>& DrawSorter::Sort( const std::vector<uint64_t>& keys )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    const size_t count = keys.size();
+    _keys = keys;
+    _keysScratch.resize( count );
+    _order.resize( count );
+    _orderScratch.resize( count );
+    for( size_t i = 0; i < count; ++i )
+        _order[i] = static_cast<uint32_t>( i );
+
+    for( uint32_t pass = 0; pass < KeyBytes; ++pass )
+    {
+        const uint32_t shift = pass * 8;
+        std::array<size_t, 256> offsets{};
+        for( uint64_t key : _keys )
+            ++offsets[(key >> shift) & 0xFF];
+
+        // every key has the same byte: the order wouldn't change
+        if( count == 0 || offsets[(_keys[0] >> shift) & 0xFF] == count )
+        {
+            ++_stats.skippedPasses;
+            continue;
+        }
+
+        // histogram -> first slot of each bucket
+        size_t sum = 0;
+        for( auto& offset : offsets )
+        {
+            const size_t bucket = offset;
+            offset = sum;
+            sum += bucket;
+        }
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            const size_t slot = offsets[(_keys[i] >> shift) & 0xFF]++;
+            _keysScratch[slot] = _keys[i];
+            _orderScratch[slot] = _order[i];
+        }
+        _keys.swap( _keysScratch );
+        _order.swap( _orderScratch );
+        ++_stats.radixPasses;
+    }
+
+    ++_stats.sortCount;
+    _stats.drawCount = static_cast<uint32_t>( count );
+    _stats.sortMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    return _order;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+struct DrawSortStats
+{
+    uint32_t sortCount = 0;
+    uint32_t drawCount = 0;         // of the last sort
+    uint32_t radixPasses = 0;       // summed over every sort
+    uint32_t skippedPasses = 0;     // byte equal in every key: nothing to move
+    double sortMs = 0.0;            // summed over every sort
+};
+
+std::ostream& operator<<( std::ostream& os, const DrawSortStats& stats );
+
+
+// Orders draws by a 64-bit key with an LSD radix sort (8 bits per pass, stable).
+// Key, most significant first:
+//      pipeline (8 bits)       draws of a pipeline together, so it is bound once
+//      depth (24 bits)         front to back inside a pipeline: early-z rejects what is behind the first draws
+//      material (16 bits)      ties in depth (coplanar draws) grouped by what they bind, in submission order otherwise
+// The top 16 bits are left 0, so a sort is at most 6 passes; passes whose byte is the same in every key
+// (one pipeline, a flat scene) are skipped after the histogram.
+class DrawSorter
+{
+public:
+    // depth: clip space z / w, 0 (near) .. 1 (far), clamped
+    static uint64_t MakeKey( uint32_t pipeline, float depth, uint32_t material );
+
+    // the draw indices (0 .. keys.size() - 1) in key order; valid until the next Sort
+    const std::vector<uint32_t>& Sort( const std::vector<uint64_t>& keys );
+
+    const DrawSortStats& GetStats() const { return _stats; }
+
+public:
+    static constexpr uint32_t PipelineBits = 8;
+    static constexpr uint32_t DepthBits = 24;
+    static constexpr uint32_t MaterialBits = 16;
+    static constexpr uint32_t KeyBytes = (PipelineBits + DepthBits + MaterialBits) / 8;
+
+private:
+    // ping-pong buffers, kept between sorts
+    std::vector<uint64_t> _keys;
+    std::vector<uint64_t> _keysScratch;
+    std::vector<uint32_t> _order;
+    std::vector<uint32_t> _orderScratch;
+    DrawSortStats _stats;
+};
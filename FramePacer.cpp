@@ -0,0 +1,34 @@
+#include "FramePacer.h"
+
+#include <thread>
+
+void FramePacer::Init( double targetFrameMs )
+{
+    _period = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double, std::milli>( targetFrameMs ) );
+    _started = false;
+}
+
+double FramePacer::Wait()
+{
+    if( !IsEnabled() )
+        return 0.0;
+
+    const Clock::time_point start = Clock::now();
+    if( !_started || start > _deadline + _period )
+    {
+        // first frame, or too far behind to catch up: the schedule starts over from now
+        _deadline = start + _period;
+        _started = true;
+        return 0.0;
+    }
+
+    const auto spin = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double, std::milli>( FramePacer::SpinMs ) );
+    if( _deadline - start > spin )
+        std::this_thread::sleep_for( _deadline - start - spin );
+    while( Clock::now() < _deadline )
+        std::this_thread::yield();
+
+    const Clock::time_point end = Clock::now();
+    _deadline += _period;
+    return std::chrono::duration<double, std::milli>( end - start ).count();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Frame rate limiter: Wait() blocks until the next target frame boundary.
+// Called after the frame slot's fence and before input is sampled, so the sleep happens
+// while nothing is queued and the frame starts from the freshest input (lower latency
+// than letting the fence / acquire block with stale input already recorded).
+//
+// Deadlines advance by the target time each frame, so short frames make up for long ones;
+// a frame that overruns by more than a whole period restarts the schedule instead of bursting.
+class FramePacer
+{
+public:
+    // targetFrameMs = 0: disabled, Wait() returns immediately
+    void Init( double targetFrameMs );
+
+    // returns the time slept (ms)
+    double Wait();
+
+    bool IsEnabled() const { return _period.count() > 0; }
+
+public:
+    // sleep_for overshoots by up to a scheduler tick; the last stretch is spun instead
+    static constexpr double SpinMs = 1.0;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration _period{ 0 };
+    Clock::time_point _deadline{};
+    bool _started = false;
+};
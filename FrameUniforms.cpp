@@ -0,0 +1,107 @@
+#include "FrameUniforms.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace
+{
+    VkDeviceSize AlignUp( VkDeviceSize value, VkDeviceSize alignment )
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void FrameUniforms::Init( VkDevice device, MemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits, uint32_t sliceCount,
+                            DescriptorLayoutCache& layouts, DescriptorAllocator& descriptors )
+{
+    _device = device;
+    _allocator = &allocator;
+    _descriptors = &descriptors;
+    _uniformAlignment = std::max<VkDeviceSize>( 1, limits.minUniformBufferOffsetAlignment );
+    _storageAlignment = std::max<VkDeviceSize>( 1, limits.minStorageBufferOffsetAlignment );
+    _sliceCount = sliceCount;
+
+    // binding 0: camera (uniform), binding 1: object transforms (storage, the count isn't bounded by maxUniformBufferRange)
+    std::vector<VkDescriptorSetLayoutBinding> bindings( 2 );
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;     // the GPU-driven cull moves its spheres
+    _setLayout = layouts.Get( bindings );
+}
+
+void FrameUniforms::Allocate( uint32_t objectCapacity )
+{
+    _objectCapacity = std::max<uint32_t>( 1, objectCapacity );
+
+    // slice: camera | objects, each range starting at an offset the device accepts for its descriptor type
+    _objectsOffset = AlignUp( sizeof(CameraUniforms), _storageAlignment );
+    _sliceSize = AlignUp( _objectsOffset + VkDeviceSize(_objectCapacity) * sizeof(glm::mat4),
+                            std::max( _uniformAlignment, _storageAlignment ) );
+
+    // host visible, mapped by the allocator for the buffer's whole life
+    Buffer::Create( _device, *_allocator, _sliceSize * _sliceCount,
+                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _buffer, _allocation );
+
+    for( uint32_t slice = 0; slice < _sliceCount; ++slice )
+    {
+        Camera( slice )->viewProjection = glm::mat4( 1.0f );
+        glm::mat4* objects = Objects( slice );
+        for( uint32_t i = 0; i < _objectCapacity; ++i )
+            objects[i] = glm::mat4( 1.0f );
+    }
+
+    _sets.resize( _sliceCount );
+    for( auto& set : _sets )
+        set = _descriptors->Allocate( _setLayout );
+
+    // written once: the sets always point at their slice, only the slice contents change
+    for( uint32_t slice = 0; slice < _sliceCount; ++slice )
+    {
+        const VkDeviceSize sliceOffset = VkDeviceSize(slice) * _sliceSize;
+        std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+        bufferInfos[0] = { _buffer, sliceOffset, sizeof(CameraUniforms) };
+        bufferInfos[1] = GetObjectsInfo( slice );
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for( uint32_t i = 0; i < writes.size(); ++i )
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = _sets[slice];
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets( _device, static_cast<uint32_t>( writes.size() ), writes.data(), 0, nullptr );
+    }
+}
+
+void FrameUniforms::Destroy()
+{
+    if( _buffer != VK_NULL_HANDLE )
+        Buffer::Destroy( _device, *_allocator, _buffer, _allocation );
+    _buffer = VK_NULL_HANDLE;
+    _sets.clear();      // the allocator's pools own them
+}
+
+VkDescriptorBufferInfo FrameUniforms::GetObjectsInfo( uint32_t slice ) const
+{
+    return { _buffer, VkDeviceSize(slice) * _sliceSize + _objectsOffset, VkDeviceSize(_objectCapacity) * sizeof(glm::mat4) };
+}
+
+CameraUniforms* FrameUniforms::Camera( uint32_t slice ) const
+{
+    return reinterpret_cast<CameraUniforms*>( static_cast<char*>( _allocation.mapped ) + VkDeviceSize(slice) * _sliceSize );
+}
+
+glm::mat4* FrameUniforms::Objects( uint32_t slice ) const
+{
+    return reinterpret_cast<glm::mat4*>( static_cast<char*>( _allocation.mapped ) + VkDeviceSize(slice) * _sliceSize + _objectsOffset );
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "utilities.h"
+
+// set 0, binding 0 of the graphics pipeline (std140, see shaders/shader.vert)
+struct CameraUniforms
+{
+    glm::mat4 viewProjection;
+};
+
+// per draw: which transform the draw uses and, with --bindless, which buffer of the bindless array
+// holds the frame's transforms and which texture it samples; the texture coordinates come from the
+// position (meshes have none): xy * uvTransform.xy + uvTransform.zw maps the mesh's bounds to [0, 1]
+struct ObjectPushConstants
+{
+    uint32_t objectIndex;
+    uint32_t objectBuffer;
+    uint32_t textureIndex;
+    uint32_t padding;           // std430: the vec4 starts at 16
+    glm::vec4 uvTransform;
+};
+static_assert( sizeof(ObjectPushConstants) == 32, "ObjectPushConstants must match the shaders' push constant block" );
+
+
+// Per-frame shader data in one persistently mapped buffer: a slice per frame in flight, each holding
+// the camera (uniform buffer, binding 0) and one transform per object (storage buffer, binding 1),
+// with a descriptor set per slice. Draws only push their object index, so moving objects is a memcpy
+// into the slice of the frame being submitted: no buffer upload, no re-recording.
+// A slice may only be written once the GPU is done with the frame that last used it (its fence).
+class FrameUniforms
+{
+public:
+    // the set layout only: the pipeline layout is created before the object count is known
+    void Init( VkDevice device, MemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits, uint32_t sliceCount,
+                DescriptorLayoutCache& layouts, DescriptorAllocator& descriptors );
+    // the buffer and the descriptor sets, room for objectCapacity transforms per slice (every one identity)
+    void Allocate( uint32_t objectCapacity );
+    void Destroy();
+
+    VkDescriptorSetLayout GetSetLayout() const { return _setLayout; }
+    VkDescriptorSet GetSet( uint32_t slice ) const { return _sets[slice]; }
+    // the slice's transforms as binding 1 sees them (for registering them elsewhere, e.g. bindless)
+    VkDescriptorBufferInfo GetObjectsInfo( uint32_t slice ) const;
+    uint32_t GetObjectCapacity() const { return _objectCapacity; }
+    VkDeviceSize GetSliceSize() const { return _sliceSize; }
+
+    // the slice's mapped memory (host coherent: written data is visible to the next submission)
+    CameraUniforms* Camera( uint32_t slice ) const;
+    glm::mat4* Objects( uint32_t slice ) const;
+
+public:
+    // objectIndex for draws that push no transform: the instance's own objectIndex is used (GPU-driven indirect
+    // draws can't push one per draw), none there either means identity
+    static constexpr uint32_t NoObject = UINT32_MAX;
+    // one range for both stages: every vkCmdPushConstants passes PushConstantStages
+    static constexpr VkShaderStageFlags PushConstantStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    static constexpr VkPushConstantRange PushConstantRange = { PushConstantStages, 0, sizeof(ObjectPushConstants) };
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    MemoryAllocator* _allocator = nullptr;
+    DescriptorAllocator* _descriptors = nullptr;
+    VkDeviceSize _uniformAlignment = 1;     // limits.minUniformBufferOffsetAlignment
+    VkDeviceSize _storageAlignment = 1;     // limits.minStorageBufferOffsetAlignment
+    uint32_t _sliceCount = 0;
+    uint32_t _objectCapacity = 0;
+    VkDeviceSize _objectsOffset = 0;        // in a slice, after the camera
+    VkDeviceSize _sliceSize = 0;
+
+    VkBuffer _buffer = VK_NULL_HANDLE;
+    Allocation _allocation{};
+    VkDescriptorSetLayout _setLayout = VK_NULL_HANDLE;     // owned by the layout cache
+    std::vector<VkDescriptorSet> _sets;     // per slice, from the (never reset) descriptor allocator
+};
@@ -0,0 +1,301 @@
+#include "GeometryPool.h"
+
+#include <algorithm>
+
+#include "utilities.h"
+
+void GeometryPool::Init( VkDevice device, MemoryAllocator& allocator, uint32_t vertexStride,
+                            VkDeviceSize vertexPageSize, VkDeviceSize indexPageSize, VkDeviceSize instancePageSize )
+{
+    _device = device;
+    _allocator = &allocator;
+    _vertexStride = vertexStride;
+    _vertexPageSize = vertexPageSize;
+    _indexPageSize = indexPageSize;
+    _instancePageSize = instancePageSize;
+}
+
+void GeometryPool::Destroy()
+{
+    for( auto& page : _pages )
+        Buffer::Destroy( _device, *_allocator, page.buffer, page.allocation );
+    for( auto& instancePage : _instancePages )
+        Buffer::Destroy( _device, *_allocator, instancePage.buffer, instancePage.allocation );
+
+    _pages.clear();
+    _instancePages.clear();
+}
+
+Mesh GeometryPool::Add( StagingUploader& uploader, const void* vertices, uint32_t vertexCount,
+                        const uint32_t* indices, uint32_t indexCount )
+{
+    // every index is < vertexCount, so 16 bits are enough up to 65536 vertices
+    const VkIndexType indexType = vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+    VkDeviceSize vertexByteOffset = 0;
+    VkDeviceSize indexByteOffset = 0;
+    const Mesh mesh = Place( uploader, vertexCount, indexCount, indexType, vertexByteOffset, indexByteOffset );
+    const Page& page = _pages[mesh._page];
+
+    const VkDeviceSize vertexBytes = VkDeviceSize(vertexCount) * _vertexStride;
+    const VkDeviceSize indexBytes = VkDeviceSize(indexCount) * IndexSize( indexType );
+
+    uploader.Upload( vertices, vertexBytes, page.buffer, vertexByteOffset );
+
+    if( indexType == VK_INDEX_TYPE_UINT16 )
+    {
+        // the uploader copies into its ring right away, so the scratch can be reused immediately
+        _narrowIndices.resize( indexCount );
+        for( uint32_t i = 0; i < indexCount; ++i )
+            _narrowIndices[i] = static_cast<uint16_t>( indices[i] );
+
+        uploader.Upload( _narrowIndices.data(), indexBytes, page.buffer, page.indexRegionOffset + indexByteOffset );
+    }
+    else
+    {
+        uploader.Upload( indices, indexBytes, page.buffer, page.indexRegionOffset + indexByteOffset );
+    }
+
+    return mesh;
+}
+
+Mesh GeometryPool::Add( StagingUploader& uploader, const MappedFile& file, size_t vertexOffset, uint32_t vertexCount,
+                        size_t indexOffset, uint32_t indexCount, VkIndexType indexType )
+{
+    if( indexType != VK_INDEX_TYPE_UINT16 && indexType != VK_INDEX_TYPE_UINT32 )
+        throw std::runtime_error( "Unsupported index type in " + file.GetPath() + "!" );
+    if( indexType == VK_INDEX_TYPE_UINT16 && vertexCount > 65536 )
+        throw std::runtime_error( "16-bit indices can't address every vertex of a mesh in " + file.GetPath() + "!" );
+
+    VkDeviceSize vertexByteOffset = 0;
+    VkDeviceSize indexByteOffset = 0;
+    const Mesh mesh = Place( uploader, vertexCount, indexCount, indexType, vertexByteOffset, indexByteOffset );
+    const Page& page = _pages[mesh._page];
+
+    uploader.Upload( file, vertexOffset, VkDeviceSize(vertexCount) * _vertexStride, page.buffer, vertexByteOffset );
+    uploader.Upload( file, indexOffset, VkDeviceSize(indexCount) * IndexSize( indexType ),
+                        page.buffer, page.indexRegionOffset + indexByteOffset );
+
+    return mesh;
+}
+
+Mesh GeometryPool::Place( StagingUploader& uploader, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType,
+                            VkDeviceSize& vertexByteOffset, VkDeviceSize& indexByteOffset )
+{
+    const VkDeviceSize indexSize = IndexSize( indexType );
+    const VkDeviceSize vertexBytes = VkDeviceSize(vertexCount) * _vertexStride;
+    const VkDeviceSize indexBytes = VkDeviceSize(indexCount) * indexSize;
+
+    // the pipeline always reads binding 1: meshes without instances of their own use the identity
+    if( _instancePages.empty() )
+    {
+        InstanceData identity{};
+        identity.transform = glm::mat4( 1.0f );
+        identity.color = glm::vec4( 1.0f );
+
+        VkDeviceSize identityOffset = 0;
+        const uint32_t instancePage = CreateInstancePage( _instancePageSize );
+        _instancePages[instancePage].ranges.Allocate( sizeof(InstanceData), sizeof(InstanceData), identityOffset );
+        uploader.Upload( &identity, sizeof(InstanceData), _instancePages[instancePage].buffer, identityOffset );
+    }
+
+    // vertex ranges are aligned to the stride so that their offset is a whole number of vertices,
+    // index ranges to the index size so that their offset is a whole number of indices
+    uint32_t pageIndex = UINT32_MAX;
+
+    for( uint32_t i = 0; i < _pages.size(); ++i )
+    {
+        Page& page = _pages[i];
+        if( !page.vertexRanges.Allocate( vertexBytes, _vertexStride, vertexByteOffset ) )
+            continue;
+
+        if( !page.indexRanges.Allocate( indexBytes, indexSize, indexByteOffset ) )
+        {
+            page.vertexRanges.Free( vertexByteOffset, vertexBytes );
+            continue;
+        }
+
+        pageIndex = i;
+        break;
+    }
+
+    if( pageIndex == UINT32_MAX )
+    {
+        pageIndex = CreatePage( std::max( _vertexPageSize, vertexBytes ), std::max( _indexPageSize, indexBytes ) );
+
+        Page& page = _pages[pageIndex];
+        if( !page.vertexRanges.Allocate( vertexBytes, _vertexStride, vertexByteOffset ) ||
+            !page.indexRanges.Allocate( indexBytes, indexSize, indexByteOffset ) )
+        {
+            throw std::runtime_error( "Failed to place mesh in a fresh geometry page!" );
+        }
+    }
+
+    Page& page = _pages[pageIndex];
+    ++page.meshCount;
+    if( indexType == VK_INDEX_TYPE_UINT16 )
+        ++page.index16MeshCount;
+
+    Mesh mesh;
+    mesh._page = pageIndex;
+    mesh._vertexOffset = static_cast<int32_t>( vertexByteOffset / _vertexStride );
+    mesh._vertexCount = vertexCount;
+    mesh._firstIndex = static_cast<uint32_t>( indexByteOffset / indexSize );
+    mesh._indexCount = indexCount;
+    mesh._indexType = indexType;
+    return mesh;
+}
+
+void GeometryPool::Remove( Mesh& mesh )
+{
+    if( !mesh.IsValid() )
+        return;
+
+    // the GPU may still read the old ranges: only call this once the frames using the mesh are done
+    const VkDeviceSize indexSize = IndexSize( mesh._indexType );
+    Page& page = _pages[mesh._page];
+    page.vertexRanges.Free( VkDeviceSize(mesh._vertexOffset) * _vertexStride, VkDeviceSize(mesh._vertexCount) * _vertexStride );
+    page.indexRanges.Free( VkDeviceSize(mesh._firstIndex) * indexSize, VkDeviceSize(mesh._indexCount) * indexSize );
+    --page.meshCount;
+    if( mesh._indexType == VK_INDEX_TYPE_UINT16 )
+        --page.index16MeshCount;
+    FreeInstances( mesh );
+
+    mesh = Mesh{};
+}
+
+void GeometryPool::SetInstances( StagingUploader& uploader, Mesh& mesh, const std::vector<InstanceData>& instances )
+{
+    if( !mesh.IsValid() )
+        throw std::runtime_error( "Setting instances of a mesh that isn't in the geometry pool!" );
+
+    // the GPU may still read the old range: same rule as Remove()
+    FreeInstances( mesh );
+    if( instances.empty() )
+        return;
+
+    const VkDeviceSize bytes = VkDeviceSize(instances.size()) * sizeof(InstanceData);
+
+    // aligned to the element size, so the offset is a whole number of instances (firstInstance)
+    VkDeviceSize byteOffset = 0;
+    uint32_t instancePage = UINT32_MAX;
+    for( uint32_t i = 0; i < _instancePages.size(); ++i )
+    {
+        if( _instancePages[i].ranges.Allocate( bytes, sizeof(InstanceData), byteOffset ) )
+        {
+            instancePage = i;
+            break;
+        }
+    }
+
+    if( instancePage == UINT32_MAX )
+    {
+        instancePage = CreateInstancePage( std::max( _instancePageSize, bytes ) );
+        if( !_instancePages[instancePage].ranges.Allocate( bytes, sizeof(InstanceData), byteOffset ) )
+            throw std::runtime_error( "Failed to place instances in a fresh instance page!" );
+    }
+
+    mesh._instancePage = instancePage;
+    mesh._firstInstance = static_cast<uint32_t>( byteOffset / sizeof(InstanceData) );
+    mesh._instanceCount = static_cast<uint32_t>( instances.size() );
+
+    uploader.Upload( instances.data(), bytes, _instancePages[instancePage].buffer, byteOffset );
+}
+
+void GeometryPool::FreeInstances( Mesh& mesh )
+{
+    // the shared identity instance (page 0, slot 0) is never freed
+    const bool identity = mesh._instancePage == 0 && mesh._firstInstance == 0;
+    if( !identity && mesh._instanceCount > 0 )
+    {
+        _instancePages[mesh._instancePage].ranges.Free( VkDeviceSize(mesh._firstInstance) * sizeof(InstanceData),
+                                                        VkDeviceSize(mesh._instanceCount) * sizeof(InstanceData) );
+    }
+
+    mesh._instancePage = 0;
+    mesh._firstInstance = 0;
+    mesh._instanceCount = 1;
+}
+
+void GeometryPool::Bind( VkCommandBuffer commandBuffer, uint32_t page, VkIndexType indexType ) const
+{
+    const VkDeviceSize vertexOffset = 0;
+    vkCmdBindVertexBuffers( commandBuffer, 0, 1, &_pages[page].buffer, &vertexOffset );
+    vkCmdBindIndexBuffer( commandBuffer, _pages[page].buffer, _pages[page].indexRegionOffset, indexType );
+}
+
+void GeometryPool::BindInstances( VkCommandBuffer commandBuffer, uint32_t instancePage ) const
+{
+    const VkDeviceSize instanceOffset = 0;
+    vkCmdBindVertexBuffers( commandBuffer, 1, 1, &_instancePages[instancePage].buffer, &instanceOffset );
+}
+
+GeometryStats GeometryPool::GetStats() const
+{
+    GeometryStats stats{};
+    stats.pageCount = static_cast<uint32_t>( _pages.size() );
+
+    for( const auto& page : _pages )
+    {
+        stats.meshCount += page.meshCount;
+        stats.index16MeshCount += page.index16MeshCount;
+        stats.vertexBytesUsed += page.vertexRanges.GetUsed();
+        stats.indexBytesUsed += page.indexRanges.GetUsed();
+        stats.bytesReserved += page.allocation.size;
+    }
+
+    stats.instancePageCount = static_cast<uint32_t>( _instancePages.size() );
+    for( const auto& instancePage : _instancePages )
+    {
+        stats.instanceBytesUsed += instancePage.ranges.GetUsed();
+        stats.bytesReserved += instancePage.allocation.size;
+    }
+    stats.instanceCount = stats.instanceBytesUsed / sizeof(InstanceData);
+
+    return stats;
+}
+
+uint32_t GeometryPool::CreatePage( VkDeviceSize vertexBytes, VkDeviceSize indexBytes )
+{
+    Page page{};
+
+    // the index region must start on an index-size boundary to be bindable (4 covers both index types)
+    page.indexRegionOffset = RangeAllocator::AlignUp( vertexBytes, sizeof(uint32_t) );
+    page.vertexRanges = RangeAllocator( vertexBytes );
+    page.indexRanges = RangeAllocator( indexBytes );
+
+    VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    Buffer::Create( _device, *_allocator, page.indexRegionOffset + indexBytes, bufferUsage,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, page.buffer, page.allocation );
+
+    _pages.push_back( page );
+    return static_cast<uint32_t>( _pages.size() - 1 );
+}
+
+uint32_t GeometryPool::CreateInstancePage( VkDeviceSize bytes )
+{
+    InstancePage instancePage{};
+    instancePage.ranges = RangeAllocator( bytes );
+
+    Buffer::Create( _device, *_allocator, bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instancePage.buffer, instancePage.allocation );
+
+    _instancePages.push_back( instancePage );
+    return static_cast<uint32_t>( _instancePages.size() - 1 );
+}
+
+VkDeviceSize GeometryPool::IndexSize( VkIndexType indexType )
+{
+    return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+std::ostream& operator<<( std::ostream& os, const GeometryStats& stats )
+{
+    os << "geometry: " << stats.meshCount << " meshes (" << stats.index16MeshCount << " with 16-bit indices) in "
+       << stats.pageCount << " pages, "
+       << stats.vertexBytesUsed / 1024 << " KiB vertices + " << stats.indexBytesUsed / 1024 << " KiB indices + "
+       << stats.instanceCount << " instances in " << stats.instancePageCount << " pages (" << stats.instanceBytesUsed / 1024 << " KiB) / "
+       << stats.bytesReserved / 1024 << " KiB reserved";
+    return os;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MemoryAllocator.h"
+#include "RangeAllocator.h"
+#include "StagingUploader.h"
+#include "Mesh.h"
+#include "utilities.h"
+
+struct GeometryStats
+{
+    uint32_t pageCount = 0;
+    uint32_t meshCount = 0;
+    uint32_t index16MeshCount = 0;  // meshes stored with 16-bit indices
+    uint32_t instancePageCount = 0;
+    uint64_t instanceCount = 0;     // per-instance entries stored (the shared identity instance included)
+    VkDeviceSize vertexBytesUsed = 0;
+    VkDeviceSize indexBytesUsed = 0;
+    VkDeviceSize instanceBytesUsed = 0;
+    VkDeviceSize bytesReserved = 0;
+};
+
+std::ostream& operator<<( std::ostream& os, const GeometryStats& stats );
+
+
+// Packs the vertices and indices of many meshes into a few big device-local buffers ("pages").
+// Each page is one VkBuffer: vertex region first, index region after it, so binding a page
+// (one vkCmdBindVertexBuffers + one vkCmdBindIndexBuffer) covers every mesh stored in it.
+// Per-instance data (InstanceData, vertex binding 1) lives in separate instance pages the same way.
+class GeometryPool
+{
+public:
+    void Init( VkDevice device, MemoryAllocator& allocator, uint32_t vertexStride,
+                VkDeviceSize vertexPageSize = DefaultVertexPageSize, VkDeviceSize indexPageSize = DefaultIndexPageSize,
+                VkDeviceSize instancePageSize = DefaultInstancePageSize );
+    void Destroy();
+
+    // records the upload through the uploader; the data reaches the GPU on the next uploader Flush()
+    // indices are stored as uint16 when every index fits (vertexCount <= 65536), uint32 otherwise
+    Mesh Add( StagingUploader& uploader, const void* vertices, uint32_t vertexCount,
+                const uint32_t* indices, uint32_t indexCount );
+    template<typename V>
+    Mesh Add( StagingUploader& uploader, const std::vector<V>& vertices, const std::vector<uint32_t>& indices )
+    {
+        if( sizeof(V) != _vertexStride )
+            throw std::runtime_error( "Vertex type doesn't match the geometry pool stride!" );
+
+        return Add( uploader, vertices.data(), static_cast<uint32_t>( vertices.size() ),
+                    indices.data(), static_cast<uint32_t>( indices.size() ) );
+    }
+    // the same from a mapped file, where the vertices are already in the pool's layout and the indices
+    // in indexType: the ranges are streamed from the mapping into the staging ring, nothing is converted
+    Mesh Add( StagingUploader& uploader, const MappedFile& file, size_t vertexOffset, uint32_t vertexCount,
+                size_t indexOffset, uint32_t indexCount, VkIndexType indexType );
+    // frees the mesh's ranges, instances included
+    void Remove( Mesh& mesh );
+
+    // gives the mesh its own instances (replacing the previous ones); the mesh is then drawn
+    // instances.size() times with one draw call. Same upload rules as Add().
+    void SetInstances( StagingUploader& uploader, Mesh& mesh, const std::vector<InstanceData>& instances );
+
+    // binds the page buffer as vertex buffer (binding 0) and index buffer;
+    // 16 and 32-bit meshes share the index region, the index type selects how it is read
+    void Bind( VkCommandBuffer commandBuffer, uint32_t page, VkIndexType indexType ) const;
+    // binds an instance page as vertex buffer binding 1
+    void BindInstances( VkCommandBuffer commandBuffer, uint32_t instancePage ) const;
+
+    uint32_t GetPageCount() const { return static_cast<uint32_t>( _pages.size() ); }
+    GeometryStats GetStats() const;
+
+public:
+    static constexpr VkDeviceSize DefaultVertexPageSize = 32ULL * 1024 * 1024;
+    static constexpr VkDeviceSize DefaultIndexPageSize = 16ULL * 1024 * 1024;
+    static constexpr VkDeviceSize DefaultInstancePageSize = 8ULL * 1024 * 1024;    // ~100k instances
+
+private:
+    struct Page
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation{};
+        VkDeviceSize indexRegionOffset = 0;     // == vertex region size
+        RangeAllocator vertexRanges;
+        RangeAllocator indexRanges;
+        uint32_t meshCount = 0;
+        uint32_t index16MeshCount = 0;
+    };
+
+    struct InstancePage
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation{};
+        RangeAllocator ranges;
+    };
+
+    // reserves the vertex / index ranges of a new mesh (creating a page if none has room); the caller uploads
+    // into them (the uploader is only used for the shared identity instance, on the first call)
+    Mesh Place( StagingUploader& uploader, uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType,
+                VkDeviceSize& vertexByteOffset, VkDeviceSize& indexByteOffset );
+    uint32_t CreatePage( VkDeviceSize vertexBytes, VkDeviceSize indexBytes );
+    uint32_t CreateInstancePage( VkDeviceSize bytes );
+    void FreeInstances( Mesh& mesh );
+    static VkDeviceSize IndexSize( VkIndexType indexType );
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    MemoryAllocator* _allocator = nullptr;
+    uint32_t _vertexStride = 0;
+    VkDeviceSize _vertexPageSize = DefaultVertexPageSize;
+    VkDeviceSize _indexPageSize = DefaultIndexPageSize;
+    VkDeviceSize _instancePageSize = DefaultInstancePageSize;
+
+    std::vector<Page> _pages;
+    std::vector<InstancePage> _instancePages;   // page 0 starts with the shared identity instance
+    std::vector<uint16_t> _narrowIndices;   // scratch for the uint32 -> uint16 conversion
+};
@@ -0,0 +1,380 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+static_assert( sizeof(VkDrawIndexedIndirectCommand) == 20, "cull.comp writes 20 byte commands" );
+
+std::ostream& operator<<( std::ostream& os, const CullStats& stats )
+{
+    const double frames = stats.frames > 0 ? double(stats.frames) : 1.0;
+    os << "culling: " << stats.frames << " frames, per frame " << double(stats.objectsTested) / frames << " objects tested, "
+       << double(stats.frustumCulled) / frames << " frustum culled, " << double(stats.occlusionCulled) / frames
+       << " occlusion culled, " << double(stats.drawn) / frames << " drawn";
+    return os;
+}
+
+void GpuCuller::Init( VkDevice device, MemoryAllocator& allocator, DescriptorLayoutCache& layouts, DescriptorAllocator& descriptors,
+                        VkPipelineCache pipelineCache, const MappedFile& shaderCode,
+                        bool drawIndirectCount, bool multiDrawIndirect, bool drawIndirectFirstInstance,
+                        uint32_t frameSlots, VkDescriptorSetLayout transformsLayout, VkDescriptorSetLayout hiZLayout )
+{
+    _device = device;
+    _allocator = &allocator;
+    _descriptors = &descriptors;
+    _multiDrawIndirect = multiDrawIndirect;
+    _drawIndirectFirstInstance = drawIndirectFirstInstance;
+    _frameSlots = frameSlots;
+    _occlusion = hiZLayout != VK_NULL_HANDLE;
+
+    // extension command: not exported by the loader, has to be fetched from the device
+    if( drawIndirectCount )
+    {
+        _cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr( _device, "vkCmdDrawIndexedIndirectCountKHR" ) );
+    }
+
+    CreatePipeline( layouts, pipelineCache, shaderCode, transformsLayout, hiZLayout );
+}
+
+void GpuCuller::Destroy()
+{
+    if( _objectBuffer != VK_NULL_HANDLE )
+    {
+        Buffer::Destroy( _device, *_allocator, _objectBuffer, _objectAllocation );
+        Buffer::Destroy( _device, *_allocator, _drawBuffer, _drawAllocation );
+        Buffer::Destroy( _device, *_allocator, _countBuffer, _countAllocation );
+        Buffer::Destroy( _device, *_allocator, _statsBuffer, _statsAllocation );
+    }
+
+    vkDestroyPipeline( _device, _pipeline, nullptr );
+    vkDestroyPipelineLayout( _device, _pipelineLayout, nullptr );
+
+    _objects.clear();
+    _batches.clear();
+}
+
+void GpuCuller::Add( const Mesh& mesh, const glm::vec4& boundingSphere, uint32_t objectIndex )
+{
+    if( mesh.GetFirstInstance() != 0 && !_drawIndirectFirstInstance )
+        throw std::runtime_error( "GPU-driven instancing needs the drawIndirectFirstInstance feature!" );
+
+    _pendingMeshes.push_back( mesh );
+    _pendingSpheres.push_back( boundingSphere );
+    _pendingObjectIndices.push_back( objectIndex );
+}
+
+void GpuCuller::Build( StagingUploader& uploader )
+{
+    if( _pendingMeshes.empty() )
+        return;
+
+    // group by (page, index type, instance page): a batch has to be contiguous in the command buffer
+    std::vector<uint32_t> order( _pendingMeshes.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(), [this]( uint32_t a, uint32_t b ) {
+        const Mesh& meshA = _pendingMeshes[a];
+        const Mesh& meshB = _pendingMeshes[b];
+        if( meshA.GetPage() != meshB.GetPage() )
+            return meshA.GetPage() < meshB.GetPage();
+        if( meshA.GetIndexType() != meshB.GetIndexType() )
+            return meshA.GetIndexType() < meshB.GetIndexType();
+        return meshA.GetInstancePage() < meshB.GetInstancePage();
+    } );
+
+    _objects.resize( order.size() );
+    for( uint32_t i = 0; i < order.size(); ++i )
+    {
+        const Mesh& mesh = _pendingMeshes[order[i]];
+        if( _batches.empty() || _batches.back().page != mesh.GetPage() || _batches.back().indexType != mesh.GetIndexType() ||
+            _batches.back().instancePage != mesh.GetInstancePage() )
+        {
+            Batch batch;
+            batch.page = mesh.GetPage();
+            batch.indexType = mesh.GetIndexType();
+            batch.instancePage = mesh.GetInstancePage();
+            batch.firstCommand = i;
+            _batches.push_back( batch );
+        }
+        ++_batches.back().commandCount;
+
+        ObjectData& object = _objects[i];
+        object = ObjectData{};
+        object.sphere = _pendingSpheres[order[i]];
+        object.indexCount = mesh.GetIndexCount();
+        object.firstIndex = mesh.GetFirstIndex();
+        object.vertexOffset = mesh.GetVertexOffset();
+        object.batch = static_cast<uint32_t>( _batches.size() - 1 );
+        object.firstCommand = _batches.back().firstCommand;
+        object.instanceCount = mesh.GetInstanceCount();
+        object.firstInstance = mesh.GetFirstInstance();
+        object.objectIndex = _pendingObjectIndices[order[i]];
+    }
+    _pendingMeshes.clear();
+    _pendingSpheres.clear();
+    _pendingObjectIndices.clear();
+
+    const VkDeviceSize objectBytes = sizeof(ObjectData) * _objects.size();
+    Buffer::Create( _device, *_allocator, objectBytes,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _objectBuffer, _objectAllocation );
+    Buffer::Create( _device, *_allocator, sizeof(VkDrawIndexedIndirectCommand) * _objects.size(),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _drawBuffer, _drawAllocation );
+    Buffer::Create( _device, *_allocator, sizeof(uint32_t) * _batches.size(),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _countBuffer, _countAllocation );
+
+    // written by the GPU, read by the host after the slot's fence: small, so coherent host memory is fine
+    Buffer::Create( _device, *_allocator, sizeof(SlotStats) * _frameSlots,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _statsBuffer, _statsAllocation );
+    std::memset( _statsAllocation.mapped, 0, sizeof(SlotStats) * _frameSlots );
+
+    uploader.Upload( _objects.data(), objectBytes, _objectBuffer, 0 );
+
+    _pushConstants.objectCount = static_cast<uint32_t>( _objects.size() );
+    _pushConstants.compact = UsesDrawCount() ? 1 : 0;
+
+    CreateDescriptorSet();
+}
+
+void GpuCuller::SetViewProjection( const glm::mat4& viewProjection )
+{
+    _pushConstants.viewProjection = viewProjection;
+}
+
+void GpuCuller::SetOcclusion( VkDescriptorSet hiZSet, VkExtent2D depthExtent )
+{
+    _hiZSet = hiZSet;
+    _pushConstants.depthSize = glm::vec2( float(depthExtent.width), float(depthExtent.height) );
+}
+
+void GpuCuller::ReadStats( uint32_t frameSlot )
+{
+    if( _statsBuffer == VK_NULL_HANDLE )
+        return;
+
+    // every object lands in one of the counters: all zero means no cull ran in the slot since the last read
+    SlotStats& slot = static_cast<SlotStats*>( _statsAllocation.mapped )[frameSlot];
+    if( slot.frustumCulled + slot.occlusionCulled + slot.drawn == 0 )
+        return;
+
+    ++_stats.frames;
+    _stats.objectsTested += _objects.size();
+    _stats.frustumCulled += slot.frustumCulled;
+    _stats.occlusionCulled += slot.occlusionCulled;
+    _stats.drawn += slot.drawn;
+    slot = SlotStats{};
+}
+
+void GpuCuller::CmdCull( VkCommandBuffer commandBuffer, uint32_t frameSlot, VkDescriptorSet transformsSet ) const
+{
+    if( _objects.empty() )
+        return;
+
+    // the previous frame may still read (indirect) or write (cull) these buffers
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            0, 1, &barrier, 0, nullptr, 0, nullptr );
+
+    // the slot's counters start at 0 every frame (the host may not have read the last ones: then they're lost)
+    vkCmdFillBuffer( commandBuffer, _statsBuffer, VkDeviceSize(frameSlot) * sizeof(SlotStats), sizeof(SlotStats), 0 );
+    if( _pushConstants.compact )
+        vkCmdFillBuffer( commandBuffer, _countBuffer, 0, VK_WHOLE_SIZE, 0 );
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            0, 1, &barrier, 0, nullptr, 0, nullptr );
+
+    vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline );
+    const std::array<VkDescriptorSet, 3> sets = { _descriptorSet, transformsSet, _hiZSet };
+    vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, _occlusion ? 3 : 2, sets.data(), 0, nullptr );
+
+    PushConstants pushConstants = _pushConstants;
+    pushConstants.statsSlot = frameSlot;
+    vkCmdPushConstants( commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants );
+    vkCmdDispatch( commandBuffer, (_pushConstants.objectCount + WorkgroupSize - 1) / WorkgroupSize, 1, 1 );
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                            0, 1, &barrier, 0, nullptr, 0, nullptr );
+}
+
+void GpuCuller::CmdDraw( VkCommandBuffer commandBuffer, const GeometryPool& geometryPool ) const
+{
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+    for( uint32_t b = 0; b < _batches.size(); ++b )
+    {
+        const Batch& batch = _batches[b];
+        geometryPool.Bind( commandBuffer, batch.page, batch.indexType );
+        geometryPool.BindInstances( commandBuffer, batch.instancePage );
+
+        const VkDeviceSize offset = VkDeviceSize(batch.firstCommand) * stride;
+        if( _cmdDrawIndexedIndirectCount )
+        {
+            _cmdDrawIndexedIndirectCount( commandBuffer, _drawBuffer, offset,
+                                            _countBuffer, VkDeviceSize(b) * sizeof(uint32_t), batch.commandCount, stride );
+        }
+        else if( _multiDrawIndirect )
+        {
+            vkCmdDrawIndexedIndirect( commandBuffer, _drawBuffer, offset, batch.commandCount, stride );
+        }
+        else
+        {
+            // drawCount must be 1 without the feature: culled objects still cost a (zero instance) call
+            for( uint32_t i = 0; i < batch.commandCount; ++i )
+                vkCmdDrawIndexedIndirect( commandBuffer, _drawBuffer, offset + VkDeviceSize(i) * stride, 1, stride );
+        }
+    }
+}
+
+glm::vec4 GpuCuller::ComputeBoundingSphere( const std::vector<Vertex>& vertices )
+{
+    if( vertices.empty() )
+        return glm::vec4( 0.0f );
+
+    // center of the AABB, radius to the farthest vertex (not minimal, but cheap and tight for grids)
+    glm::vec3 lo = vertices[0].pos;
+    glm::vec3 hi = vertices[0].pos;
+    for( const auto& vertex : vertices )
+    {
+        lo = glm::min( lo, vertex.pos );
+        hi = glm::max( hi, vertex.pos );
+    }
+    const glm::vec3 center = (lo + hi) * 0.5f;
+
+    float radius = 0.0f;
+    for( const auto& vertex : vertices )
+        radius = std::max( radius, glm::length( vertex.pos - center ) );
+
+    return glm::vec4( center, radius );
+}
+
+glm::vec4 GpuCuller::ComputeBoundingSphere( const std::vector<Vertex>& vertices, const std::vector<InstanceData>& instances )
+{
+    const glm::vec4 local = ComputeBoundingSphere( vertices );
+    if( instances.empty() )
+        return local;
+
+    // each instance's sphere: transformed center, radius times the largest axis scale;
+    // then a sphere around all of them (AABB center again)
+    std::vector<glm::vec4> spheres( instances.size() );
+    for( size_t i = 0; i < instances.size(); ++i )
+    {
+        const glm::mat4& m = instances[i].transform;
+        const glm::vec4 center = m * glm::vec4( local.x, local.y, local.z, 1.0f );
+
+        float scale = 0.0f;
+        for( int axis = 0; axis < 3; ++axis )
+            scale = std::max( scale, glm::length( glm::vec3( m[axis].x, m[axis].y, m[axis].z ) ) );
+
+        spheres[i] = glm::vec4( center.x, center.y, center.z, local.w * scale );
+    }
+
+    glm::vec3 lo( spheres[0].x, spheres[0].y, spheres[0].z );
+    glm::vec3 hi = lo;
+    for( const auto& sphere : spheres )
+    {
+        lo = glm::min( lo, glm::vec3( sphere.x, sphere.y, sphere.z ) );
+        hi = glm::max( hi, glm::vec3( sphere.x, sphere.y, sphere.z ) );
+    }
+    const glm::vec3 center = (lo + hi) * 0.5f;
+
+    float radius = 0.0f;
+    for( const auto& sphere : spheres )
+        radius = std::max( radius, glm::length( glm::vec3( sphere.x, sphere.y, sphere.z ) - center ) + sphere.w );
+
+    return glm::vec4( center, radius );
+}
+
+void GpuCuller::CreatePipeline( DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const MappedFile& shaderCode,
+                                VkDescriptorSetLayout transformsLayout, VkDescriptorSetLayout hiZLayout )
+{
+    // set 0: objects (read), draw commands (write), draw counts (read/write), stats (read/write)
+    std::vector<VkDescriptorSetLayoutBinding> bindings( 4 );
+    for( uint32_t i = 0; i < bindings.size(); ++i )
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    _descriptorSetLayout = layouts.Get( bindings );
+    // set 1: the frame's transforms, set 2 (occlusion): the Hi-Z pyramid
+    const std::array<VkDescriptorSetLayout, 3> setLayouts = { _descriptorSetLayout, transformsLayout, hiZLayout };
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = hiZLayout != VK_NULL_HANDLE ? 3 : 2;
+    layoutInfo.pSetLayouts = setLayouts.data();
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    if( vkCreatePipelineLayout( _device, &layoutInfo, nullptr, &_pipelineLayout )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create cull pipeline layout!" );
+    }
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = shaderCode.Size();
+    moduleInfo.pCode = shaderCode.Spirv();
+    VkShaderModule shaderModule;
+    if( vkCreateShaderModule( _device, &moduleInfo, nullptr, &shaderModule )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create cull shader module!" );
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _pipelineLayout;
+
+    const VkResult result = vkCreateComputePipelines( _device, pipelineCache, 1, &pipelineInfo, nullptr, &_pipeline );
+    vkDestroyShaderModule( _device, shaderModule, nullptr );
+    if( result != VK_SUCCESS )
+        throw std::runtime_error( "Failed to create cull pipeline!" );
+}
+
+void GpuCuller::CreateDescriptorSet()
+{
+    _descriptorSet = _descriptors->Allocate( _descriptorSetLayout );
+
+    std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+    bufferInfos[0] = { _objectBuffer, 0, VK_WHOLE_SIZE };
+    bufferInfos[1] = { _drawBuffer, 0, VK_WHOLE_SIZE };
+    bufferInfos[2] = { _countBuffer, 0, VK_WHOLE_SIZE };
+    bufferInfos[3] = { _statsBuffer, 0, VK_WHOLE_SIZE };
+
+    std::array<VkWriteDescriptorSet, 4> writes{};
+    for( uint32_t i = 0; i < writes.size(); ++i )
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = _descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets( _device, static_cast<uint32_t>( writes.size() ), writes.data(), 0, nullptr );
+}
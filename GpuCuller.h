@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <ostream>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "GeometryPool.h"
+#include "MappedFile.h"
+#include "MemoryAllocator.h"
+#include "StagingUploader.h"
+#include "Mesh.h"
+#include "utilities.h"
+
+struct CullStats
+{
+    uint32_t frames = 0;            // culls read back
+    uint64_t objectsTested = 0;     // summed over every frame
+    uint64_t frustumCulled = 0;
+    uint64_t occlusionCulled = 0;   // inside the frustum, behind last frame's Hi-Z
+    uint64_t drawn = 0;
+};
+
+std::ostream& operator<<( std::ostream& os, const CullStats& stats );
+
+
+// GPU-driven drawing: every object's bounds and draw parameters live in a storage buffer,
+// a compute pass (shaders/cull.comp) frustum culls them and writes the VkDrawIndexedIndirectCommands,
+// and the render pass draws each geometry batch with a single indirect call.
+// The CPU records the same handful of commands whatever the object count.
+//
+// Objects are grouped into batches by (page, index type, instance page) since one indirect call
+// shares the bound buffers.
+// With VK_KHR_draw_indirect_count the visible commands of a batch are compacted and the GPU also writes
+// the draw count; without it every object keeps its slot and culled ones get instanceCount = 0.
+//
+// Each object's sphere is in its own space: the cull moves it with the object's transform from the frame's
+// FrameUniforms slice, the one the vertex shader reads.
+//
+// With occlusion (shaders/cull_occlusion.spv) an object inside the frustum is also tested against the
+// HiZPyramid of the previous frame. Each frame slot counts what it culled and drew in a host visible
+// buffer, read once the slot's fence has signalled (ReadStats).
+class GpuCuller
+{
+public:
+    // drawIndirectCount: the device has VK_KHR_draw_indirect_count enabled
+    // multiDrawIndirect: the feature is enabled (drawCount > 1), otherwise one call per object
+    // drawIndirectFirstInstance: the feature is enabled, needed for meshes with their own instances
+    // the set layout comes from layouts, the set (on Build) from descriptors
+    // frameSlots: frames in flight, each gets its own stats
+    // transformsLayout: set 1 of the pipeline, binding 1 the object transforms (FrameUniforms::GetSetLayout)
+    // hiZLayout: set 2 of the pipeline when shaderCode is the occlusion variant (HiZPyramid::GetReadLayout), else null
+    void Init( VkDevice device, MemoryAllocator& allocator, DescriptorLayoutCache& layouts, DescriptorAllocator& descriptors,
+                VkPipelineCache pipelineCache, const MappedFile& shaderCode,
+                bool drawIndirectCount, bool multiDrawIndirect, bool drawIndirectFirstInstance,
+                uint32_t frameSlots, VkDescriptorSetLayout transformsLayout, VkDescriptorSetLayout hiZLayout = VK_NULL_HANDLE );
+    void Destroy();
+
+    // collect every object first, then Build() once; an instanced mesh is one object
+    // (culled as a whole: the sphere has to enclose every instance); objectIndex: its transform
+    void Add( const Mesh& mesh, const glm::vec4& boundingSphere, uint32_t objectIndex );
+    // creates the buffers and records their upload; the data reaches the GPU on the next uploader Flush()
+    void Build( StagingUploader& uploader );
+
+    // frustum used by CmdCull; recorded as push constants, so set it before recording
+    void SetViewProjection( const glm::mat4& viewProjection );
+    // occlusion: the pyramid's read set and the size of the depth buffer it is built from; recorded too
+    void SetOcclusion( VkDescriptorSet hiZSet, VkExtent2D depthExtent );
+
+    // outside a render pass: reset the counts, cull, make the commands visible to the indirect stage
+    // (and the frame slot's stats to the host); transformsSet: the frame slot's transforms (FrameUniforms::GetSet)
+    void CmdCull( VkCommandBuffer commandBuffer, uint32_t frameSlot, VkDescriptorSet transformsSet ) const;
+    // inside the render pass, graphics pipeline bound: one indirect draw per batch
+    void CmdDraw( VkCommandBuffer commandBuffer, const GeometryPool& geometryPool ) const;
+
+    uint32_t GetObjectCount() const { return static_cast<uint32_t>( _objects.size() ); }
+    uint32_t GetBatchCount() const { return static_cast<uint32_t>( _batches.size() ); }
+    bool UsesDrawCount() const { return _cmdDrawIndexedIndirectCount != nullptr; }
+
+    // the slot's last cull has completed (its fence was waited on): adds its counts to the stats
+    void ReadStats( uint32_t frameSlot );
+    const CullStats& GetStats() const { return _stats; }
+
+    // sphere (xyz center, w radius) around the vertex positions
+    static glm::vec4 ComputeBoundingSphere( const std::vector<Vertex>& vertices );
+    // ... around every instance of them (no instances = the vertices as they are)
+    static glm::vec4 ComputeBoundingSphere( const std::vector<Vertex>& vertices, const std::vector<InstanceData>& instances );
+
+public:
+    static constexpr uint32_t WorkgroupSize = 64;   // local_size_x in cull.comp
+
+private:
+    // std430 layouts shared with cull.comp
+    struct ObjectData
+    {
+        glm::vec4 sphere;
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t batch;             // count slot
+        uint32_t firstCommand;      // first command slot of the batch
+        uint32_t instanceCount;
+        uint32_t firstInstance;
+        uint32_t objectIndex;       // into the transforms
+    };
+    // the matrix instead of its 6 planes: with the depth size the planes wouldn't fit in the 128 bytes
+    // every device has for push constants (the shader derives them)
+    struct PushConstants
+    {
+        glm::mat4 viewProjection;
+        uint32_t objectCount;
+        uint32_t compact;           // 1: append visible commands + count, 0: one slot per object
+        uint32_t statsSlot;         // frame slot
+        uint32_t pad;
+        glm::vec2 depthSize;        // occlusion: depth buffer extent in pixels
+    };
+    static_assert( sizeof(PushConstants) <= 128, "maxPushConstantsSize is at least 128" );
+    // per frame slot, in the stats buffer
+    struct SlotStats
+    {
+        uint32_t frustumCulled;
+        uint32_t occlusionCulled;
+        uint32_t drawn;
+        uint32_t pad;
+    };
+    struct Batch
+    {
+        uint32_t page = 0;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        uint32_t instancePage = 0;
+        uint32_t firstCommand = 0;
+        uint32_t commandCount = 0;  // max draws (= objects in the batch)
+    };
+
+    void CreatePipeline( DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const MappedFile& shaderCode,
+                            VkDescriptorSetLayout transformsLayout, VkDescriptorSetLayout hiZLayout );
+    void CreateDescriptorSet();
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    MemoryAllocator* _allocator = nullptr;
+    DescriptorAllocator* _descriptors = nullptr;
+    bool _multiDrawIndirect = false;
+    bool _drawIndirectFirstInstance = false;
+    PFN_vkCmdDrawIndexedIndirectCountKHR _cmdDrawIndexedIndirectCount = nullptr;
+
+    std::vector<Mesh> _pendingMeshes;
+    std::vector<glm::vec4> _pendingSpheres;
+    std::vector<uint32_t> _pendingObjectIndices;
+    std::vector<ObjectData> _objects;   // sorted by batch
+    std::vector<Batch> _batches;
+    PushConstants _pushConstants{};
+    CullStats _stats;
+
+    VkBuffer _objectBuffer = VK_NULL_HANDLE;
+    Allocation _objectAllocation{};
+    VkBuffer _drawBuffer = VK_NULL_HANDLE;     // VkDrawIndexedIndirectCommand per object
+    Allocation _drawAllocation{};
+    VkBuffer _countBuffer = VK_NULL_HANDLE;    // uint32 draw count per batch
+    Allocation _countAllocation{};
+    VkBuffer _statsBuffer = VK_NULL_HANDLE;    // SlotStats per frame slot, host visible
+    Allocation _statsAllocation{};
+    uint32_t _frameSlots = 0;
+
+    VkDescriptorSetLayout _descriptorSetLayout = VK_NULL_HANDLE;   // owned by the layout cache
+    VkDescriptorSet _descriptorSet = VK_NULL_HANDLE;
+    bool _occlusion = false;
+    VkDescriptorSet _hiZSet = VK_NULL_HANDLE;                      // owned by the HiZPyramid
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+};
@@ -8,6 +8,8 @@
 #include <cstring>
 #include <set>
 #include <array>
+#include <chrono>
+#include <cmath>
 
 #ifdef _DEBUG
 const bool enableValidationLayer = true;
@@ -15,39 +17,86 @@ const bool enableValidationLayer = true;
 const bool enableValidationLayer = false;
 #endif
 
+HelloTriangleApp::HelloTriangleApp( const AppConfig& config )
+    : _config( config )
+    , _enableValidation( enableValidationLayer && config.validation )
+{
+}
+
 void HelloTriangleApp::Run()
 {
+    auto start = std::chrono::steady_clock::now();
     InitWindow();
     InitVulkan();
+    _runStats.startupMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    std::cout << "startup: " << _runStats.startupMs << " ms (pipelines " << _runStats.pipelineMs << " ms, "
+              << (_pipelineCache.GetStats().warm ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
     MainLoop();
+    if( !_config.readbackPath.empty() )
+        SaveFrame( _config.readbackPath );
     Cleanup();
 }
 
 void HelloTriangleApp::InitVulkan()
 {
+    _profiler.Init( _config.profile, _config.profileInterval );
+
     CreateInstance();
-    if( enableValidationLayer ) SetupDebugMessenger();
-    CreateSurface();    // surface
+    if( _enableValidation ) SetupDebugMessenger();
+    if( !_config.headless )
+        CreateSurface();    // surface
 
     PickPhysicalDevice();   // physical device
     CreateLogicalDevice();  // logical device
+    _allocator.Init( _physicalDevice, _device );    // device memory blocks
+    _pipelineCache.Init( _physicalDevice, _device, _config.pipelineCachePath );     // pipeline cache (from disk when valid)
+    CreateDescriptors();    // layout cache, descriptor pools, bindless table
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties( _physicalDevice, &properties );
+        _frameUniforms.Init( _device, _allocator, properties.limits, _config.framesInFlight,
+                                _descriptorLayouts, _descriptorAllocator );     // set layout (the pipeline layout needs it)
+    }
+
+    // positions are already in clip space: the camera only flips y (Vulkan's clip space y points down)
+    _viewProjection = glm::mat4( 1.0f );
+    _viewProjection[1][1] = -1.0f;
 
-    CreateSwapchain();      // swapchain
-    CreateImageViews();     // image views
+    if( _config.headless )
+    {
+        CreateOffscreenTargets();   // offscreen images + image views
+    }
+    else
+    {
+        CreateSwapchain();      // swapchain
+        CreateImageViews();     // image views
+    }
+    _depthFormat = ChooseDepthFormat( _config.occlusionCull );
+    CreateDepthResources();     // depth image + view
     CreateRenderPass();     // render pass
-    CreateGraphicsPipeline(); // graphics pipeline
+    {
+        auto pipelineStart = std::chrono::steady_clock::now();
+        CreateGraphicsPipeline(); // graphics pipeline
+        _runStats.pipelineMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - pipelineStart ).count();
+    }
     CreateFramebuffers();   // framebuffers (swapchain framebuffer images)
     CreateCommandPool();    // command pool
+    CreateUploader();       // staging ring for buffer uploads
 
     CreateMeshFromVerteces();   // mesh
+    CreateFrameUniforms();      // camera + one transform per mesh, per frame in flight
+    CreateTextures();           // a texture per mesh (white without --texture), its tail resident
 
+    _profiler.InitGpu( _physicalDevice, _device, FindQueueFamilies( _physicalDevice ).graphicsFamily.value(),
+                        static_cast<uint32_t>( _config.dynamicRecording ? 1 : _swapchainImages.size() ) * _config.framesInFlight );     // timestamp queries, one pair per primary command buffer
     CreateCommandBuffers(); // command buffers
     CreateSyncObjects();     // semaphores and fences
 }
 
 void HelloTriangleApp::CreateInstance()
 {
-    if( enableValidationLayer && !CheckValidationErrorSupport())
+    if( _enableValidation && !CheckValidationErrorSupport())
         throw std::runtime_error( "Validation Layer requested, but not available!" );
 
     VkApplicationInfo appInfo;
@@ -62,7 +111,7 @@ void HelloTriangleApp::CreateInstance()
     instanceInfo.ppEnabledExtensionNames = extensions.data();
 
     VkDebugUtilsMessengerCreateInfoEXT messengerInfo;
-    if( enableValidationLayer )
+    if( _enableValidation )
     {
         instanceInfo.enabledLayerCount = static_cast<uint32_t>(validationLayerExtension.size());
         instanceInfo.ppEnabledLayerNames = validationLayerExtension.data();
@@ -82,26 +131,67 @@ void HelloTriangleApp::CreateInstance()
 
 void HelloTriangleApp::InitWindow()
 {
+    if( _config.headless )
+        return;     // no display needed (nor available on render nodes)
+
     glfwInit();
     glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
-    glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
+    glfwWindowHint( GLFW_RESIZABLE, GLFW_TRUE );
 
     _window = glfwCreateWindow( ScreenWidth, ScreenHeight, 
                                 "Triangle App", nullptr, nullptr );
+
+    // a resize doesn't always make the swapchain out-of-date (or suboptimal), so it is tracked here too
+    glfwSetWindowUserPointer( _window, this );
+    glfwSetFramebufferSizeCallback( _window, FramebufferResizeCallback );
+    glfwSetKeyCallback( _window, KeyCallback );
     
 }
 
+void HelloTriangleApp::FramebufferResizeCallback( GLFWwindow* window, int width, int height )
+{
+    auto app = reinterpret_cast<HelloTriangleApp*>( glfwGetWindowUserPointer( window ) );
+    app->_framebufferResized = true;
+}
+
 void HelloTriangleApp::MainLoop()
 {
-    while( !glfwWindowShouldClose( _window ) )
+    auto start = std::chrono::steady_clock::now();
+    uint32_t frame = 0;
+    _framePacer.Init( _config.targetFrameMs );
+    _profiler.Start();
+
+    while( _config.frameCount == 0 || frame < _config.frameCount )
     {
-        glfwPollEvents();
-        DrawFrame();
+        if( !_config.headless && glfwWindowShouldClose( _window ) )
+            break;
+
+        if( !DrawFrame() )
+            continue;   // nothing drawn (minimized / swapchain just recreated)
+        _profiler.EndFrame();
+        ++frame;
     }
 
     vkQueueWaitIdle( _graphicsQueue );
     vkDeviceWaitIdle( _device );
 
+    const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    _runStats.frameCount = frame;
+    _runStats.seconds = seconds;
+    _runStats.fps = seconds > 0.0 ? frame / seconds : 0.0;
+    std::cout << frame << " frames in " << seconds << " s (" << _runStats.fps << " fps)" << std::endl;
+    if( _config.dynamicRecording )
+        std::cout << "dynamic recording: draws re-recorded " << _runStats.rerecordCount << " times ("
+                  << _runStats.recordMs << " ms), reused in the other " << frame - _runStats.rerecordCount << " frames" << std::endl;
+
+    if( _profiler.IsEnabled() )
+    {
+        _runStats.profile = _profiler.Summarize();
+        std::cout << _runStats.profile << std::endl;
+        if( !_config.profileOutput.empty() )
+            _profiler.Write( _config.profileOutput );
+    }
+
 /*
  *  from :
  *      Rendering and presentation -> Setup
@@ -112,53 +202,190 @@ void HelloTriangleApp::MainLoop()
 
 void HelloTriangleApp::Cleanup()
 {
-    _vertexMesh.DestroyMeshesContent();
-    _indexMesh.DestroyMeshesContent();
-
-    for( size_t i = 0; i < HelloTriangleApp::MaxFrameInFlight; ++i )
+    _runStats.upload = _uploader.GetStats();
+    _runStats.geometry = _geometryPool.GetStats();
+    _runStats.memory = _allocator.GetStats();
+
+    _runStats.textures = _textureStreamer.GetStats();
+    std::cout << _runStats.textures << std::endl;
+    _textureStreamer.Destroy();
+
+    std::cout << _uploader.GetStats() << std::endl;
+    _uploader.Destroy();
+
+    std::cout << _geometryPool.GetStats() << std::endl;
+    _runStats.drawSort = _drawSorter.GetStats();
+    if( _config.sortDraws )
+        std::cout << _runStats.drawSort << std::endl;
+    _meshes.clear();
+    if( _config.gpuDriven )
+    {
+        for( uint32_t slot = 0; slot < _config.framesInFlight; ++slot )
+            _culler.ReadStats( slot );      // the device is idle: the last frames' counts too
+        _runStats.culling = _culler.GetStats();
+        std::cout << _runStats.culling << std::endl;
+        _culler.Destroy();
+    }
+    if( _config.occlusionCull )
+        _hiZ.Destroy();
+    _geometryPool.Destroy();
+    _frameUniforms.Destroy();
+    _runStats.descriptors = GetDescriptorStats();
+    std::cout << _runStats.descriptors << std::endl;
+
+    for( size_t i = 0; i < _config.framesInFlight; ++i )
     {
         vkDestroySemaphore( _device, _renderFinishedSemaphore[i], nullptr );   // render finished semaphore
         vkDestroySemaphore( _device, _imageAvailableSemaphore[i], nullptr );   // image available semaphore
         vkDestroyFence( _device, _inFlightFences[i], nullptr ); // in fligh fence
     }
 
+    DestroyRetired( true );   // the device is idle, every frame is done
     vkDestroyCommandPool( _device, _commandPool, nullptr ); // command pool & command buffers
+    DestroyFrameCommands();     // per frame pools (dynamic recording)
+    _recordThreadPool.Shutdown();
+    for( auto& workerPool : _workerCommandPools )
+        vkDestroyCommandPool( _device, workerPool, nullptr );   // worker pools & secondary command buffers
 
     for( auto& framebuffer : _swapchainFramebuffers )
     {
         vkDestroyFramebuffer( _device, framebuffer, nullptr );
     }
 
-    vkDestroyPipeline( _device, _graphicsPipeline, nullptr );
+    _shaderWatcher.Stop();
+    _runStats.pipelines = _pipelineLibrary.GetStats();
+    std::cout << _pipelineLibrary.GetStats() << std::endl;
+    _pipelineLibrary.Destroy();     // every pipeline (waits for background compiles)
+    _pipelineCache.Save();      // every pipeline of the run is in it by now
+    _pipelineCache.Destroy();
+    _runStats.pipelineCache = _pipelineCache.GetStats();
+    std::cout << _pipelineCache.GetStats() << std::endl;
     vkDestroyPipelineLayout( _device, _pipelineLayout, nullptr );   // pipeline layout
+    DestroyDescriptors();   // set layouts and pools (the sets go with them)
     vkDestroyRenderPass( _device, _renderPass, nullptr );
 
     for( auto& imageView : _swapchainImageViews )
     {
         vkDestroyImageView( _device, imageView, nullptr );  // image view
     }
-    vkDestroySwapchainKHR( _device, _swapchain, nullptr );  // swapchain
+    vkDestroyImageView( _device, _depthImageView, nullptr );
+    Image::Destroy( _device, _allocator, _depthImage, _depthAllocation );  // depth image
+    if( _config.headless )
+    {
+        for( size_t i = 0; i < _swapchainImages.size(); ++i )
+            Image::Destroy( _device, _allocator, _swapchainImages[i], _offscreenAllocations[i] );  // offscreen images
+    }
+    else
+        vkDestroySwapchainKHR( _device, _swapchain, nullptr );  // swapchain
+
+    _profiler.DestroyGpu();
+
+    // everything sub-allocated is gone by now
+    std::cout << _allocator.GetStats() << std::endl;
+    _allocator.Destroy();
+
     vkDestroyDevice( _device, nullptr );
 
-    vkDestroySurfaceKHR( _instance, _surface, nullptr );
+    if( !_config.headless )
+        vkDestroySurfaceKHR( _instance, _surface, nullptr );
 
-    if( enableValidationLayer )
+    if( _enableValidation )
         DestroyDebugUtilsMessengerEXT( _instance, _debugMessenger, nullptr );
     
     vkDestroyInstance( _instance, nullptr );
-    glfwDestroyWindow( _window );
 
-    glfwTerminate();
+    if( !_config.headless )
+    {
+        glfwDestroyWindow( _window );
+        glfwTerminate();
+    }
 }
 
 
-void HelloTriangleApp::DrawFrame()
+bool HelloTriangleApp::DrawFrame()
 {
-    vkWaitForFences( _device, 1, &_inFlightFences[currentFrame], VK_TRUE, UINT64_MAX );
-    vkResetFences( _device, 1, &_inFlightFences[currentFrame] );
+    // resized / out-of-date during an earlier frame
+    if( _swapchainDirty )
+    {
+        RecreateSwapchain();
+        if( _swapchainDirty )
+        {
+            glfwWaitEvents();   // minimized: nothing to draw into, sleep until something happens
+            return false;
+        }
+    }
+
+    // frames that finished rendering since the last look, then the wait (which times the slot's own if it had not)
+    PollFrameLatency();
+    {
+        Profiler::Scope scope( _profiler, ProfilePhase::FenceWait );
+        vkWaitForFences( _device, 1, &_inFlightFences[currentFrame], VK_TRUE, UINT64_MAX );
+    }
+    PollFrameLatency();
+
+    // the frame before the slot's last one is done as well: old swapchain resources it used can go
+    DestroyRetired( false );
+
+    // pace before sampling input, so the sleep isn't spent holding stale input
+    {
+        Profiler::Scope scope( _profiler, ProfilePhase::Pacing );
+        _framePacer.Wait();
+    }
+
+    if( !_config.headless )
+        glfwPollEvents();
+    const auto inputTime = std::chrono::steady_clock::now();
+
+    // a permutation asked for (input, hot reload) is used from the frame it is ready, never waited for
+    ApplyShaderReloads();
+    UpdateGraphicsPipeline();
+
+    // the slot's previous submission is done: its timestamps can be read, its uniform slice rewritten
+    if( _frameQuerySlot[currentFrame] != UINT32_MAX )
+    {
+        _profiler.CollectGpu( _frameQuerySlot[currentFrame] );
+        if( _config.gpuDriven )
+            _culler.ReadStats( static_cast<uint32_t>( currentFrame ) );     // ... and what its cull counted
+    }
+
+    {
+        Profiler::Scope scope( _profiler, ProfilePhase::Uniforms );
+        if( _config.animate )
+            AnimateObjects( std::chrono::duration<double>( inputTime - _animationStart ).count() );
+        UpdateFrameUniforms( currentFrame );
+    }
+
+    // everything uploaded since the last frame goes to the GPU in one submission (texture levels included)
+    {
+        Profiler::Scope scope( _profiler, ProfilePhase::Upload );
+        UpdateTextures( currentFrame );
+        _uploader.Flush();
+    }
 
     uint32_t imageIndex;
-    vkAcquireNextImageKHR( _device, _swapchain, UINT64_MAX, _imageAvailableSemaphore[currentFrame], VK_NULL_HANDLE, &imageIndex );
+    if( _config.headless )
+        imageIndex = static_cast<uint32_t>( currentFrame );    // one offscreen image per frame in flight, guarded by the fence above
+    else
+    {
+        VkResult acquireResult;
+        {
+            Profiler::Scope scope( _profiler, ProfilePhase::Acquire );
+            acquireResult = vkAcquireNextImageKHR( _device, _swapchain, UINT64_MAX, _imageAvailableSemaphore[currentFrame], VK_NULL_HANDLE, &imageIndex );
+        }
+
+        // out-of-date: nothing was acquired (the semaphore stays unsignalled), retry with a new swapchain;
+        // suboptimal: the image is usable, draw it and recreate after presenting
+        if( acquireResult == VK_ERROR_OUT_OF_DATE_KHR )
+        {
+            _swapchainDirty = true;
+            return false;
+        }
+        if( acquireResult != VK_SUBOPTIMAL_KHR )
+            ErrorCheck( acquireResult, "acquire swapchain image" );
+    }
+
+    // only reset once the frame is sure to be submitted: an early return must leave the fence signalled
+    vkResetFences( _device, 1, &_inFlightFences[currentFrame] );
 
     // --- submitting the command buffer ---
     VkSubmitInfo submitInfo{};
@@ -166,20 +393,43 @@ void HelloTriangleApp::DrawFrame()
     
     std::array<VkSemaphore, 1> waitSemaphores = { _imageAvailableSemaphore[currentFrame] };
     std::array<VkPipelineStageFlags, 1> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.waitSemaphoreCount = static_cast<uint32_t>( waitSemaphores.size() );
-    submitInfo.pWaitSemaphores = waitSemaphores.data();
-    submitInfo.pWaitDstStageMask = waitStages.data();
+    if( !_config.headless )     // nothing to wait for / signal without a swapchain
+    {
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>( waitSemaphores.size() );
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+    }
 
+    // dynamic: this slot's own command buffer, (re)recorded now; static: the one pre-recorded for this image and slot
+    const size_t staticIndex = size_t(imageIndex) * _config.framesInFlight + currentFrame;
+    VkCommandBuffer commandBuffer = _config.dynamicRecording ? RecordFrame( currentFrame, imageIndex ) : _commandBuffers[staticIndex];
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
+    submitInfo.pCommandBuffers = &commandBuffer;
 
     std::array<VkSemaphore, 1> signalSemaphores = { _renderFinishedSemaphore[currentFrame] };
-    submitInfo.signalSemaphoreCount = static_cast<uint32_t>( signalSemaphores.size() );
-    submitInfo.pSignalSemaphores = signalSemaphores.data();
+    if( !_config.headless )
+    {
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>( signalSemaphores.size() );
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+    }
 
-    ErrorCheck( vkQueueSubmit( _graphicsQueue, 1, &submitInfo, _inFlightFences[currentFrame] ), "submitting command buffer queue" );
+    {
+        Profiler::Scope scope( _profiler, ProfilePhase::Submit );
+        ErrorCheck( vkQueueSubmit( _graphicsQueue, 1, &submitInfo, _inFlightFences[currentFrame] ), "submitting command buffer queue" );
+    }
+    _lastImageIndex = imageIndex;
+    _frameQuerySlot[currentFrame] = static_cast<uint32_t>( _config.dynamicRecording ? currentFrame : staticIndex );
+    _frameInputTime[currentFrame] = inputTime;
+    _frameLatencyPending[currentFrame] = true;
+    ++_submittedFrames;
     // --------------------------------------
 
+    if( _config.headless )
+    {
+        currentFrame = ( currentFrame + 1 ) % _config.framesInFlight;
+        return true;
+    }
+
 
     // --- presentation ---
     VkPresentInfoKHR presentInfo{};
@@ -194,10 +444,21 @@ void HelloTriangleApp::DrawFrame()
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
 
-    ErrorCheck( vkQueuePresentKHR( _presentQueue, &presentInfo ), "submitting the result back to swapchain to have it eventually show up to the screen" );
+    VkResult presentResult;
+    {
+        Profiler::Scope scope( _profiler, ProfilePhase::Present );
+        presentResult = vkQueuePresentKHR( _presentQueue, &presentInfo );
+    }
+
+    // recreated at the start of the next frame
+    if( presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR || _framebufferResized )
+        _swapchainDirty = true;
+    else
+        ErrorCheck( presentResult, "submitting the result back to swapchain to have it eventually show up to the screen" );
     // --------------------
 
-    currentFrame = ++currentFrame % HelloTriangleApp::MaxFrameInFlight;
+    currentFrame = ++currentFrame % _config.framesInFlight;
+    return true;
 
 /*
  *  from :
@@ -213,6 +474,21 @@ void HelloTriangleApp::DrawFrame()
 */
 }
 
+void HelloTriangleApp::PollFrameLatency()
+{
+    // input sampled -> fence first seen signalled: the GPU has finished the frame (not when it is on screen);
+    // polled twice a frame, so late by at most the time between two looks
+    const auto now = std::chrono::steady_clock::now();
+    for( size_t slot = 0; slot < _frameLatencyPending.size(); ++slot )
+    {
+        if( !_frameLatencyPending[slot] || vkGetFenceStatus( _device, _inFlightFences[slot] ) != VK_SUCCESS )
+            continue;
+
+        _profiler.AddLatency( std::chrono::duration<double, std::milli>( now - _frameInputTime[slot] ).count() );
+        _frameLatencyPending[slot] = false;
+    }
+}
+
 void HelloTriangleApp::CreateSyncObjects()
 {
     // semaphore create info
@@ -225,12 +501,15 @@ void HelloTriangleApp::CreateSyncObjects()
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     // semaphore resize
-    _imageAvailableSemaphore.resize( HelloTriangleApp::MaxFrameInFlight );
-    _renderFinishedSemaphore.resize( HelloTriangleApp::MaxFrameInFlight );
+    _imageAvailableSemaphore.resize( _config.framesInFlight );
+    _renderFinishedSemaphore.resize( _config.framesInFlight );
     // fence resize
-    _inFlightFences.resize( HelloTriangleApp::MaxFrameInFlight );
+    _inFlightFences.resize( _config.framesInFlight );
+    _frameQuerySlot.assign( _config.framesInFlight, UINT32_MAX );
+    _frameInputTime.resize( _config.framesInFlight );
+    _frameLatencyPending.assign( _config.framesInFlight, false );
 
-    for( size_t i = 0; i < HelloTriangleApp::MaxFrameInFlight; ++i )
+    for( size_t i = 0; i < _config.framesInFlight; ++i )
     {
         ErrorCheck( vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_imageAvailableSemaphore[i]), "create image available semaphores" );
         ErrorCheck( vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_renderFinishedSemaphore[i]), "create render finished semaphore" );
@@ -265,7 +544,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL HelloTriangleApp::DebugCallback(
 
 void HelloTriangleApp::SetupDebugMessenger()
 {
-    if( !enableValidationLayer ) return;
+    if( !_enableValidation ) return;
 
     VkDebugUtilsMessengerCreateInfoEXT messengerInfo;
     PopulateDebugUtilsCreateInfo( messengerInfo );
@@ -311,6 +590,130 @@ void HelloTriangleApp::CreateSurface()
 }
 
 
+// --- Headless ---
+void HelloTriangleApp::CreateOffscreenTargets()
+{
+    // stands in for the swapchain: one image per frame in flight, the render pass leaves them in TRANSFER_SRC
+    _swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    _swapchainExtent = { HelloTriangleApp::ScreenWidth, HelloTriangleApp::ScreenHeight };
+
+    _swapchainImages.resize( _config.framesInFlight );
+    _offscreenAllocations.resize( _config.framesInFlight );
+    for( size_t i = 0; i < _swapchainImages.size(); ++i )
+    {
+        Image::Create( _device, _allocator, _swapchainExtent, _swapchainImageFormat,
+                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _swapchainImages[i], _offscreenAllocations[i] );
+    }
+
+    CreateImageViews();
+}
+
+void HelloTriangleApp::SaveFrame( const std::string& path )
+{
+    // headless only (swapchain images aren't TRANSFER_SRC); the device is idle here (end of MainLoop),
+    // copy the last image into a host visible buffer
+    const uint32_t width = _swapchainExtent.width;
+    const uint32_t height = _swapchainExtent.height;
+    const VkDeviceSize size = VkDeviceSize(width) * height * 4;
+
+    VkBuffer readbackBuffer;
+    Allocation readbackAllocation;
+    Buffer::Create( _device, _allocator, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    readbackBuffer, readbackAllocation );
+
+    VkCommandBufferAllocateInfo cmdAllocInfo{};
+    cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdAllocInfo.commandPool = _commandPool;
+    cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdAllocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    ErrorCheck( vkAllocateCommandBuffers( _device, &cmdAllocInfo, &commandBuffer ), "allocate readback command buffer" );
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    ErrorCheck( vkBeginCommandBuffer( commandBuffer, &beginInfo ), "begin readback command buffer" );
+
+    // color attachment writes -> transfer read (the layout is already TRANSFER_SRC)
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = _swapchainImages[_lastImageIndex];
+    imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            0, 0, nullptr, 0, nullptr, 1, &imageBarrier );
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;     // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { width, height, 1 };
+    vkCmdCopyImageToBuffer( commandBuffer, _swapchainImages[_lastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                            readbackBuffer, 1, &region );
+
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = readbackBuffer;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                            0, 0, nullptr, 1, &bufferBarrier, 0, nullptr );
+
+    ErrorCheck( vkEndCommandBuffer( commandBuffer ), "end readback command buffer" );
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    ErrorCheck( vkCreateFence( _device, &fenceInfo, nullptr, &fence ), "create readback fence" );
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    ErrorCheck( vkQueueSubmit( _graphicsQueue, 1, &submitInfo, fence ), "submit readback" );
+    vkWaitForFences( _device, 1, &fence, VK_TRUE, UINT64_MAX );
+
+    vkDestroyFence( _device, fence, nullptr );
+    vkFreeCommandBuffers( _device, _commandPool, 1, &commandBuffer );
+
+    // binary PPM (RGB); the alpha channel is dropped
+    std::ofstream out( path, std::ios::binary );
+    if( !out.is_open() )
+        throw std::runtime_error( "Failed to open " + path + " for writing!" );
+
+    out << "P6\n" << width << " " << height << "\n255\n";
+    const uint8_t* pixels = static_cast<const uint8_t*>( readbackAllocation.mapped );
+    std::vector<char> row( size_t(width) * 3 );
+    for( uint32_t y = 0; y < height; ++y )
+    {
+        const uint8_t* src = pixels + size_t(y) * width * 4;
+        for( uint32_t x = 0; x < width; ++x )
+        {
+            row[x * 3 + 0] = static_cast<char>( src[x * 4 + 0] );
+            row[x * 3 + 1] = static_cast<char>( src[x * 4 + 1] );
+            row[x * 3 + 2] = static_cast<char>( src[x * 4 + 2] );
+        }
+        out.write( row.data(), row.size() );
+    }
+
+    Buffer::Destroy( _device, _allocator, readbackBuffer, readbackAllocation );
+    std::cout << "frame written to " << path << std::endl;
+}
+
+
 // --- Physical Device ---
 void HelloTriangleApp::PickPhysicalDevice()
 {
@@ -344,6 +747,10 @@ bool HelloTriangleApp::IsDeviceSuitable( VkPhysicalDevice physicalDevice )
     // I just need vulkan works LOL, so I leave it like this.
     QueueFamilyIndices indices = FindQueueFamilies( physicalDevice );
 
+    // headless: any device with a graphics queue will do (lavapipe included)
+    if( _config.headless )
+        return indices.IsComplete();
+
     bool isExtensionSupported = CheckDeviceExtensionSupport( physicalDevice );
 
     bool swapChainAdequate = false;
@@ -374,23 +781,40 @@ QueueFamilyIndices HelloTriangleApp::FindQueueFamilies( VkPhysicalDevice physica
     std::vector<VkQueueFamilyProperties> propertiesQueueFamily( queueFamilyCount );
     vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &queueFamilyCount, propertiesQueueFamily.data() );
 
-    int i = 0;
+    uint32_t i = 0;
     for( const auto& property : propertiesQueueFamily )
     {
-        if( property.queueFlags & VK_QUEUE_GRAPHICS_BIT )
+        if( property.queueFlags & VK_QUEUE_GRAPHICS_BIT && !indices.graphicsFamily.has_value() )
             indices.graphicsFamily = i;
         
         // ntar disini diisi suatu code untuk queue family lainnya.
         // nah ini queue family lainnya :
         VkBool32 presentSupport = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR( physicalDevice, i, _surface, &presentSupport );
-        if( presentSupport )
+        if( !_config.headless )
+            vkGetPhysicalDeviceSurfaceSupportKHR( physicalDevice, i, _surface, &presentSupport );
+        if( presentSupport && !indices.presentFamily.has_value() )
             indices.presentFamily = i;
 
-        if( indices.IsComplete() )
-            break;
+        // transfer family: prefer a transfer-only family (the DMA engine), then anything without graphics
+        const bool isTransfer = property.queueFlags & VK_QUEUE_TRANSFER_BIT;
+        const bool isGraphics = property.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        const bool isCompute = property.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        if( isTransfer && !isGraphics && !isCompute )
+            indices.transferFamily = i;
+        else if( isTransfer && !isGraphics && !indices.transferFamily.has_value() )
+            indices.transferFamily = i;
+
+        ++i;
     }
 
+    // headless: nothing is presented, the "present" queue is just the graphics queue
+    if( _config.headless )
+        indices.presentFamily = indices.graphicsFamily;
+
+    // no dedicated transfer family: uploads go to the graphics queue
+    if( !indices.transferFamily.has_value() )
+        indices.transferFamily = indices.graphicsFamily;
+
     return indices;
 }
 
@@ -403,7 +827,7 @@ void HelloTriangleApp::CreateLogicalDevice()
 
     
     std::vector<VkDeviceQueueCreateInfo> logDevQueueInfos;  // queue infos
-    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };    
+    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value() };    
     float queuePriority = 1.0f;
 
     for( auto& queueFamily : uniqueQueueFamilies )
@@ -423,14 +847,67 @@ void HelloTriangleApp::CreateLogicalDevice()
      * ntar deviceFeatures nya kita isi disini
      */
 
+    std::vector<const char*> extensions;
+    if( !_config.headless )    // headless doesn't need VK_KHR_swapchain
+        extensions = deviceExtensions;
+
+    // wireframe permutation (windowed: toggled with W)
+    if( !_config.headless )
+    {
+        VkPhysicalDeviceFeatures supportedFeatures{};
+        vkGetPhysicalDeviceFeatures( _physicalDevice, &supportedFeatures );
+        _fillModeNonSolidEnabled = supportedFeatures.fillModeNonSolid == VK_TRUE;
+        deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+    }
+
+    // bindless: descriptor indexing (runtime arrays, partially bound, update after bind), else the per frame sets alone
+    if( _config.bindless )
+    {
+        _bindlessSupport = BindlessTable::Query( _instance, _physicalDevice );
+        _bindlessEnabled = _bindlessSupport.available;
+        if( _bindlessEnabled )
+        {
+            extensions.insert( extensions.end(), BindlessTable::DeviceExtensions.begin(), BindlessTable::DeviceExtensions.end() );
+            deviceFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+            deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        }
+        else
+            std::cout << "bindless: VK_EXT_descriptor_indexing not usable on this device, binding descriptor sets instead" << std::endl;
+    }
+
+    // BCn textures (--texture *.ktx2), when the device has them: the streamer checks the format support
+    if( !_config.texturePaths.empty() )
+    {
+        VkPhysicalDeviceFeatures supportedFeatures{};
+        vkGetPhysicalDeviceFeatures( _physicalDevice, &supportedFeatures );
+        deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    }
+
+    // GPU-driven: drawCount > 1 per indirect call, and the GPU written draw count when available
+    if( _config.gpuDriven )
+    {
+        VkPhysicalDeviceFeatures supportedFeatures{};
+        vkGetPhysicalDeviceFeatures( _physicalDevice, &supportedFeatures );
+        _multiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect == VK_TRUE;
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        _drawIndirectFirstInstanceEnabled = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+        _drawIndirectCountEnabled = IsDeviceExtensionAvailable( _physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME );
+        if( _drawIndirectCountEnabled )
+            extensions.push_back( VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME );
+    }
+
     VkDeviceCreateInfo deviceInfo{};
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceInfo.pNext = nullptr;
     deviceInfo.queueCreateInfoCount = static_cast<uint32_t>( logDevQueueInfos.size() ); // jumlah queue family
     deviceInfo.pQueueCreateInfos = logDevQueueInfos.data(); // vector queue family crete infos nya
     deviceInfo.pEnabledFeatures = &deviceFeatures;  // device features nya
+    if( _bindlessEnabled )
+        deviceInfo.pNext = &_bindlessSupport.features;
 
-    if( enableValidationLayer )
+    if( _enableValidation )
     {
         deviceInfo.enabledLayerCount = static_cast<uint32_t>( validationLayerExtension.size() );
         deviceInfo.ppEnabledLayerNames = validationLayerExtension.data();
@@ -438,8 +915,8 @@ void HelloTriangleApp::CreateLogicalDevice()
     else
         deviceInfo.enabledLayerCount = 0;
     
-    deviceInfo.enabledExtensionCount = static_cast<uint32_t>( deviceExtensions.size() );
-    deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    deviceInfo.enabledExtensionCount = static_cast<uint32_t>( extensions.size() );
+    deviceInfo.ppEnabledExtensionNames = extensions.data();
     
 
     ErrorCheck( vkCreateDevice( _physicalDevice, &deviceInfo, nullptr, &_device ), "create logical device" );
@@ -447,6 +924,7 @@ void HelloTriangleApp::CreateLogicalDevice()
     // create queue
     vkGetDeviceQueue( _device, indices.graphicsFamily.value(), 0, &_graphicsQueue );
     vkGetDeviceQueue( _device, indices.presentFamily.value(), 0, &_presentQueue );
+    vkGetDeviceQueue( _device, indices.transferFamily.value(), 0, &_transferQueue );
 
 
     /*
@@ -463,28 +941,374 @@ void HelloTriangleApp::CreateLogicalDevice()
 // --- Mesh ---
 void HelloTriangleApp::CreateMeshFromVerteces()
 {
-    // kotak
+    std::vector<MeshData> meshData;
 
-    _vertices.resize(4);
-    _vertices = {
-        {{ 0.5f, 0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f }},   // top right
-        {{ 0.5f, -0.5f, 0.0f }, {1.0f, 0.0f, 0.0f }},   // bottom right
-        {{ -0.5f, -0.5f, 0.0f }, {0.0f, 0.0f, 1.0f}},   // bottom left
-        {{ -0.5f, 0.5f, 0.0f }, {0.5f, 0.2f, 0.0f}}     // top left
-    };
+    std::vector<InstanceData> instances;
+
+    if( _config.sceneObjects > 0 )
+    {
+        // benchmark scene
+        meshData = SyntheticScene::Generate( _config.sceneObjects, _config.sceneTriangles, _config.sceneLayers );
+    }
+    else if( _config.sceneInstances > 0 )
+    {
+        // benchmark scene, instanced: the same tiles, one mesh
+        meshData.push_back( SyntheticScene::GenerateInstancedMesh( _config.sceneTriangles ) );
+        instances = SyntheticScene::GenerateInstances( _config.sceneInstances );
+    }
+    else if( _config.meshPath.empty() )
+    {
+        // kotak
+
+        _vertices.resize(4);
+        _vertices = {
+            {{ 0.5f, 0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f }},   // top right
+            {{ 0.5f, -0.5f, 0.0f }, {1.0f, 0.0f, 0.0f }},   // bottom right
+            {{ -0.5f, -0.5f, 0.0f }, {0.0f, 0.0f, 1.0f}},   // bottom left
+            {{ -0.5f, 0.5f, 0.0f }, {0.5f, 0.2f, 0.0f}}     // top left
+        };
+
+        _indices = {
+            0, 1, 2,
+            1, 2, 3
+        };
+
+        meshData.push_back( { _vertices, _indices } );
+    }
+
+    // note: the copies run on the transfer queue (a dedicated one when the device has it)
+    const bool compact = _config.vertexFormat == VertexFormat::Compact;
+    _geometryPool.Init( _device, _allocator, VertexLayout::Stride( _config.vertexFormat ) );
+
+    if( _config.gpuDriven )
+    {
+        auto pipelineStart = std::chrono::steady_clock::now();
+        if( _config.occlusionCull )
+        {
+            _hiZ.Init( _device, _allocator, _descriptorLayouts, _pipelineCache.Get(), *ReadFile( "shaders/hiz.spv" ),
+                        FindQueueFamilies( _physicalDevice ).graphicsFamily.value(), _graphicsQueue );
+            _hiZ.Resize( _swapchainExtent, _depthImageView );
+        }
+        _culler.Init( _device, _allocator, _descriptorLayouts, _descriptorAllocator, _pipelineCache.Get(),
+                        *ReadFile( _config.occlusionCull ? "shaders/cull_occlusion.spv" : "shaders/cull.spv" ),
+                        _drawIndirectCountEnabled, _multiDrawIndirectEnabled, _drawIndirectFirstInstanceEnabled,
+                        _config.framesInFlight, _frameUniforms.GetSetLayout(), _config.occlusionCull ? _hiZ.GetReadLayout() : VK_NULL_HANDLE );
+        _runStats.pipelineMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - pipelineStart ).count();
+    }
+
+    // GPU-driven: an indirect draw can't push its object's index, so every object gets instances of its own
+    // that carry it (the vertex shader reads it per instance, which takes a firstInstance per draw)
+    const bool objectInstances = _config.gpuDriven && _drawIndirectFirstInstanceEnabled;
+    if( _config.gpuDriven && _config.animate && !objectInstances )
+        throw std::runtime_error( "GPU-driven animation needs the drawIndirectFirstInstance feature!" );
+
+    // the mesh just added: its instances (none: the shared identity one) and, GPU-driven, its culler object
+    auto addObject = [&]( std::vector<InstanceData> meshInstances, const glm::vec4& boundingSphere )
+    {
+        const uint32_t objectIndex = static_cast<uint32_t>( _meshes.size() - 1 );
+        if( objectInstances )
+        {
+            if( meshInstances.empty() )
+                meshInstances.push_back( { glm::mat4( 1.0f ), glm::vec4( 1.0f ) } );
+            for( auto& instance : meshInstances )
+                instance.objectIndex = objectIndex;
+        }
+        if( !meshInstances.empty() )
+            _geometryPool.SetInstances( _uploader, _meshes.back(), meshInstances );
 
-    _indices = {
-        0, 1, 2,
-        1, 2, 3
+        if( _config.gpuDriven )
+            _culler.Add( _meshes.back(), boundingSphere, objectIndex );
     };
 
-    // note: queue for transfer usually is the same as queue for graphics
-    _vertexMesh = Mesh( _physicalDevice, _device, 
-                _graphicsQueue, _commandPool, 
-                Mesh::UsageBuffer::VERTEX_BUFFER, _vertices );
-    
-    _indexMesh = Mesh( _physicalDevice, _device, _graphicsQueue, _commandPool,
-                        Mesh::UsageBuffer::INDEX_BUFFER, _indices );
+    if( !_config.meshPath.empty() )
+    {
+        // converted offline (tools/MeshConverter): already optimized and in the pool's layout,
+        // the blobs are streamed from the file into the pages as they are
+        MeshFile::Contents contents = MeshFile::Load( _config.meshPath, _config.vertexFormat, _geometryPool, _uploader );
+        std::cout << contents.stats << std::endl;
+        _runStats.meshLoad = contents.stats;
+
+        for( size_t i = 0; i < contents.meshes.size(); ++i )
+        {
+            _meshes.push_back( contents.meshes[i] );
+            _meshBounds.push_back( contents.boundingSpheres[i] );
+            addObject( {}, contents.boundingSpheres[i] );
+        }
+    }
+
+    MeshOptimizeReport optimizeReport;
+    for( auto& data : meshData )
+    {
+        // reorder for the post-transform cache and vertex fetch before anything is uploaded
+        if( _config.optimizeMeshes )
+            optimizeReport.Merge( MeshOptimizer::Optimize( data.vertices, data.indices, _config.optimizeOverdraw ) );
+
+        if( compact )
+            _meshes.push_back( _geometryPool.Add( _uploader, VertexCompression::Compress( data.vertices ), data.indices ) );
+        else
+            _meshes.push_back( _geometryPool.Add( _uploader, data.vertices, data.indices ) );
+
+        _meshBounds.push_back( GpuCuller::ComputeBoundingSphere( data.vertices, instances ) );
+        addObject( instances, _meshBounds.back() );
+    }
+
+    if( _config.optimizeMeshes )
+        std::cout << optimizeReport << std::endl;
+
+    if( _config.gpuDriven )
+    {
+        _culler.Build( _uploader );
+
+        // the frustum of the camera the vertex shader transforms with
+        _culler.SetViewProjection( _viewProjection );
+        if( _config.occlusionCull )
+            _culler.SetOcclusion( _hiZ.GetReadSet(), _swapchainExtent );
+
+        std::cout << "gpu-driven: " << _culler.GetObjectCount() << " objects in " << _culler.GetBatchCount() << " indirect batches ("
+                  << (_culler.UsesDrawCount() ? "draw count" : _multiDrawIndirectEnabled ? "multi draw, zero instance culling" : "one call per object")
+                  << ")" << std::endl;
+    }
+
+    // one submission for all the meshes above
+    _uploader.Flush();
+
+    MarkSceneDirty();
+
+    _runStats.drawCalls = static_cast<uint32_t>( _meshes.size() * GetDrawPassCount() );
+    for( const auto& mesh : _meshes )
+        _runStats.trianglesPerFrame += uint64_t(mesh.GetIndexCount() / 3) * mesh.GetInstanceCount();
+}
+
+void HelloTriangleApp::CreateFrameUniforms()
+{
+    _frameUniforms.Allocate( static_cast<uint32_t>( _meshes.size() ) );
+    _objectTransforms.assign( _meshes.size(), glm::mat4( 1.0f ) );
+    _sliceTransformsVersion.assign( _config.framesInFlight, _transformsVersion );    // Allocate wrote identities
+
+    // bindless: the shader finds each slot's transforms in the buffer array instead of binding 1
+    if( _bindlessEnabled )
+    {
+        _frameObjectBuffers.resize( _config.framesInFlight );
+        for( uint32_t slot = 0; slot < _config.framesInFlight; ++slot )
+        {
+            const VkDescriptorBufferInfo objects = _frameUniforms.GetObjectsInfo( slot );
+            _frameObjectBuffers[slot] = _bindless.AddBuffer( objects.buffer, objects.offset, objects.range );
+        }
+    }
+    _animationStart = std::chrono::steady_clock::now();
+}
+
+void HelloTriangleApp::AnimateObjects( double seconds )
+{
+    // every object bobs up and down, each with its own phase
+    for( size_t i = 0; i < _objectTransforms.size(); ++i )
+        _objectTransforms[i][3].y = 0.05f * static_cast<float>( std::sin( 2.0 * seconds + 0.37 * double(i) ) );
+    ++_transformsVersion;
+}
+
+void HelloTriangleApp::UpdateFrameUniforms( size_t frameSlot )
+{
+    // the slot's fence has been waited on: the GPU is done reading its slice
+    const uint32_t slice = static_cast<uint32_t>( frameSlot );
+    _frameUniforms.Camera( slice )->viewProjection = _viewProjection;
+
+    // transforms: only when they changed since this slice last got them
+    if( _sliceTransformsVersion[frameSlot] != _transformsVersion )
+    {
+        std::memcpy( _frameUniforms.Objects( slice ), _objectTransforms.data(), _objectTransforms.size() * sizeof(glm::mat4) );
+        _sliceTransformsVersion[frameSlot] = _transformsVersion;
+    }
+}
+
+void HelloTriangleApp::CreateDescriptors()
+{
+    _descriptorLayouts.Init( _device );
+    _descriptorAllocator.Init( _device );
+    _frameDescriptors.resize( _config.framesInFlight );
+    for( auto& frameDescriptors : _frameDescriptors )
+        frameDescriptors.Init( _device );
+
+    if( _bindlessEnabled )
+        _bindless.Init( _device, _descriptorLayouts, _bindlessSupport );
+    else
+    {
+        // set 1: the draw's texture
+        std::vector<VkDescriptorSetLayoutBinding> bindings( 1 );
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        _textureSetLayout = _descriptorLayouts.Get( bindings );
+    }
+}
+
+void HelloTriangleApp::DestroyDescriptors()
+{
+    if( _bindlessEnabled )
+        _bindless.Destroy();
+    for( auto& frameDescriptors : _frameDescriptors )
+        frameDescriptors.Destroy();
+    _descriptorAllocator.Destroy();
+    _descriptorLayouts.Destroy();
+}
+
+void HelloTriangleApp::CmdBindFrameResources( VkCommandBuffer commandBuffer, size_t frameSlot ) const
+{
+    // once per command buffer: set 0 (and the bindless set 1), then the draws only push their indices
+    std::array<VkDescriptorSet, 2> sets = { _frameUniforms.GetSet( static_cast<uint32_t>( frameSlot ) ), _bindless.GetSet() };
+    vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
+                                0, _bindlessEnabled ? 2 : 1, sets.data(), 0, nullptr );
+}
+
+DescriptorStats HelloTriangleApp::GetDescriptorStats() const
+{
+    DescriptorStats stats;
+    stats.layoutCount = _descriptorLayouts.GetLayoutCount();
+    stats.layoutHits = _descriptorLayouts.GetHits();
+    stats.poolCount = _descriptorAllocator.GetPoolCount() + (_bindlessEnabled ? 1 : 0);
+    stats.setsAllocated = _descriptorAllocator.GetSetsAllocated() + (_bindlessEnabled ? 1 : 0);
+    for( const auto& frameDescriptors : _frameDescriptors )
+    {
+        stats.poolCount += frameDescriptors.GetPoolCount();
+        stats.setsAllocated += frameDescriptors.GetSetsAllocated();
+        stats.poolResets += frameDescriptors.GetResets();
+    }
+    if( _bindlessEnabled )
+    {
+        stats.bindlessBuffers = _bindless.GetBufferCount();
+        stats.bindlessTextures = _bindless.GetTextureCount();
+    }
+    return stats;
+}
+
+void HelloTriangleApp::CreateTextures()
+{
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies( _physicalDevice );
+    _textureStreamer.Init( _device, _physicalDevice, _allocator, _uploader,
+                            queueFamilyIndices.graphicsFamily.value(), _graphicsQueue,
+                            VkDeviceSize(_config.textureBudgetMb) << 20, _config.framesInFlight );
+
+    // one shader for every draw: the ones without a texture sample white
+    _whiteTexture = _textureStreamer.AddSolid( 0xFFFFFFFF );
+    std::vector<uint32_t> textures;
+    for( const auto& path : _config.texturePaths )
+        textures.push_back( _textureStreamer.Add( path ) );
+    if( _config.gpuDriven && !textures.empty() )
+        std::cout << "textures: the indirect draws can't push a texture per object, --gpu-driven draws untextured" << std::endl;
+
+    _meshTextures.resize( _meshes.size() );
+    for( size_t m = 0; m < _meshes.size(); ++m )
+        _meshTextures[m] = textures.empty() ? _whiteTexture : textures[m % textures.size()];
+
+    // a descriptor per frame slot: one slot's can be rewritten while the other slots' frames are in flight
+    const uint32_t textureCount = _textureStreamer.GetTextureCount();
+    const size_t descriptorCount = size_t(textureCount) * _config.framesInFlight;
+    _textureDescriptorVersions.assign( descriptorCount, 0 );
+    if( _bindlessEnabled )
+        _bindlessTextures.resize( descriptorCount );
+    else
+        _textureSets.resize( descriptorCount );
+
+    for( size_t slot = 0; slot < _config.framesInFlight; ++slot )
+    {
+        if( !_bindlessEnabled )
+        {
+            AllocateTextureSets( slot );
+            continue;
+        }
+
+        for( uint32_t texture = 0; texture < textureCount; ++texture )
+        {
+            const size_t index = texture * _config.framesInFlight + slot;
+            _bindlessTextures[index] = _bindless.AddTexture( _textureStreamer.GetView( texture ), _textureStreamer.GetSampler() );
+            _textureDescriptorVersions[index] = _textureStreamer.GetVersion( texture );
+        }
+    }
+}
+
+void HelloTriangleApp::UpdateTextures( size_t frameSlot )
+{
+    // every mesh drawn asks for what its size on screen needs: its texture spans its bounds, which are
+    // radius * extent pixels wide (positions are in clip space, where the screen is 2 wide)
+    if( !_config.gpuDriven )
+    {
+        const float screenSize = static_cast<float>( std::max( _swapchainExtent.width, _swapchainExtent.height ) );
+        for( size_t m = 0; m < _meshes.size(); ++m )
+            _textureStreamer.Request( _meshTextures[m], _meshBounds[m].w * screenSize );
+    }
+    _textureStreamer.Update( _submittedFrames );
+
+    // the slot's last frame is done: its descriptors can point at the new views
+    bool changed = false;
+    for( uint32_t texture = 0; texture < _textureStreamer.GetTextureCount(); ++texture )
+    {
+        const size_t index = texture * _config.framesInFlight + frameSlot;
+        if( _textureDescriptorVersions[index] == _textureStreamer.GetVersion( texture ) )
+            continue;
+
+        changed = true;
+        if( !_bindlessEnabled )
+            break;      // the slot's sets are replaced all at once below
+
+        _bindless.UpdateTexture( _bindlessTextures[index], _textureStreamer.GetView( texture ), _textureStreamer.GetSampler() );
+        _textureDescriptorVersions[index] = _textureStreamer.GetVersion( texture );
+    }
+
+    // plain sets are replaced by new ones from the slot's allocator, which invalidates the command buffers
+    // that bound the old ones (bindless slots are update-after-bind: nothing to re-record)
+    if( changed && !_bindlessEnabled )
+    {
+        AllocateTextureSets( frameSlot );
+        InvalidateFrameSlotCommandBuffers( frameSlot );
+    }
+}
+
+void HelloTriangleApp::AllocateTextureSets( size_t frameSlot )
+{
+    // every set of the slot goes back with one vkResetDescriptorPool: the slot's frames are done with them
+    DescriptorAllocator& descriptors = _frameDescriptors[frameSlot];
+    descriptors.Reset();
+
+    const uint32_t textureCount = _textureStreamer.GetTextureCount();
+    std::vector<VkDescriptorImageInfo> imageInfos( textureCount );
+    std::vector<VkWriteDescriptorSet> writes( textureCount );
+    for( uint32_t texture = 0; texture < textureCount; ++texture )
+    {
+        const size_t index = texture * _config.framesInFlight + frameSlot;
+        _textureSets[index] = descriptors.Allocate( _textureSetLayout );
+        _textureDescriptorVersions[index] = _textureStreamer.GetVersion( texture );
+
+        imageInfos[texture] = { _textureStreamer.GetSampler(), _textureStreamer.GetView( texture ), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        writes[texture].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[texture].dstSet = _textureSets[index];
+        writes[texture].dstBinding = 0;
+        writes[texture].descriptorCount = 1;
+        writes[texture].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[texture].pImageInfo = &imageInfos[texture];
+    }
+    vkUpdateDescriptorSets( _device, textureCount, writes.data(), 0, nullptr );
+}
+
+ObjectPushConstants HelloTriangleApp::GetObjectPushConstants( size_t frameSlot, uint32_t objectIndex, uint32_t texture, const glm::vec4& bounds ) const
+{
+    // the square around the bounding sphere maps to [0, 1]
+    const float scale = bounds.w > 0.0f ? 0.5f / bounds.w : 1.0f;
+
+    ObjectPushConstants constants{};
+    constants.objectIndex = objectIndex;
+    constants.objectBuffer = _bindlessEnabled ? _frameObjectBuffers[frameSlot] : 0;
+    constants.textureIndex = _bindlessEnabled ? _bindlessTextures[texture * _config.framesInFlight + frameSlot] : 0;
+    constants.uvTransform = glm::vec4( scale, scale, 0.5f - bounds.x * scale, 0.5f - bounds.y * scale );
+    return constants;
+}
+
+void HelloTriangleApp::CreateUploader()
+{
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies( _physicalDevice );
+
+    _uploader.Init( _device, _allocator,
+                    queueFamilyIndices.transferFamily.value(), _transferQueue,
+                    queueFamilyIndices.graphicsFamily.value(), _graphicsQueue );
 }
 
 
@@ -522,7 +1346,10 @@ VkExtent2D HelloTriangleApp::ChooseSwapchainExtent2D( const VkSurfaceCapabilitie
         return capabilities.currentExtent;
     
     
-    VkExtent2D actualExtent = { HelloTriangleApp::ScreenWidth, HelloTriangleApp::ScreenHeight };
+    // the window's size in pixels (not screen coordinates, they differ on high-dpi displays)
+    int width = 0, height = 0;
+    glfwGetFramebufferSize( _window, &width, &height );
+    VkExtent2D actualExtent = { static_cast<uint32_t>( width ), static_cast<uint32_t>( height ) };
 
     actualExtent.width = std::clamp( actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width );
     actualExtent.height = std::clamp( actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height );
@@ -555,12 +1382,14 @@ VkSurfaceFormatKHR HelloTriangleApp::ChooseSwapchainFormat( const std::vector<Vk
 
 VkPresentModeKHR HelloTriangleApp::ChooseSwapchainPresentMode( const std::vector<VkPresentModeKHR>& availablePresentModes )
 {
+    // --present-mode (mailbox by default)
     for( const auto& availablePresentMode : availablePresentModes )
     {
-        if( availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR )
+        if( availablePresentMode == _config.presentMode )
             return availablePresentMode;
     }
 
+    // FIFO is always supported
     return VK_PRESENT_MODE_FIFO_KHR;
 
     /*
@@ -569,7 +1398,7 @@ VkPresentModeKHR HelloTriangleApp::ChooseSwapchainPresentMode( const std::vector
     */
 }
 
-void HelloTriangleApp::CreateSwapchain()
+void HelloTriangleApp::CreateSwapchain( VkSwapchainKHR oldSwapchain )
 {
     SwapchainSupportDetails details = QuerySwapchainSupport( _physicalDevice );
     
@@ -577,7 +1406,9 @@ void HelloTriangleApp::CreateSwapchain()
     VkSurfaceFormatKHR surfaceFormat = ChooseSwapchainFormat( details.formats );
     VkPresentModeKHR presentMode = ChooseSwapchainPresentMode( details.presentModes );
 
-    uint32_t imageCount = details.surfaceCapabilities.minImageCount + 1;
+    // --swapchain-images, default min + 1 (so acquire doesn't wait on the driver), within the surface limits
+    uint32_t imageCount = _config.swapchainImages > 0 ? _config.swapchainImages : details.surfaceCapabilities.minImageCount + 1;
+    imageCount = std::max( imageCount, details.surfaceCapabilities.minImageCount );
     if( details.surfaceCapabilities.maxImageCount > 0 &&
         imageCount > details.surfaceCapabilities.maxImageCount )
     {
@@ -608,7 +1439,7 @@ void HelloTriangleApp::CreateSwapchain()
     if( indicesArr[0] != indicesArr[1] )
     {
         swapchainInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-        swapchainInfo.queueFamilyIndexCount = static_cast<uint32_t>( sizeof( indicesArr ) );
+        swapchainInfo.queueFamilyIndexCount = static_cast<uint32_t>( sizeof( indicesArr ) / sizeof( indicesArr[0] ) );
         swapchainInfo.pQueueFamilyIndices = indicesArr;
     }
     else
@@ -625,8 +1456,8 @@ void HelloTriangleApp::CreateSwapchain()
     swapchainInfo.presentMode = presentMode;
     // clipped
     swapchainInfo.clipped = VK_TRUE;
-    // old swap chain
-    swapchainInfo.oldSwapchain = VK_NULL_HANDLE;
+    // old swap chain (when recreating: lets the driver hand its resources over, it can't acquire anymore)
+    swapchainInfo.oldSwapchain = oldSwapchain;
     // ***************
 
     ErrorCheck( vkCreateSwapchainKHR( _device, &swapchainInfo, nullptr, &_swapchain), "create swapchain");
@@ -636,6 +1467,14 @@ void HelloTriangleApp::CreateSwapchain()
     _swapchainImages.resize( imageCount );
     vkGetSwapchainImagesKHR( _device, _swapchain, &imageCount, _swapchainImages.data() );
 
+    if( oldSwapchain == VK_NULL_HANDLE )
+    {
+        if( presentMode != _config.presentMode )
+            std::cout << "present mode " << ToString( _config.presentMode ) << " not supported by the surface, using fifo" << std::endl;
+        std::cout << "swapchain: " << imageCount << " images, " << ToString( presentMode ) << ", "
+                  << _config.framesInFlight << " frames in flight" << std::endl;
+    }
+
     // store the format and the extent to class member variable.
     _swapchainImageFormat = surfaceFormat.format;
     _swapchainExtent = extent;
@@ -691,6 +1530,139 @@ void HelloTriangleApp::CreateImageViews()
 
 // --- Shader and Graphics Pipeline ---
 
+void HelloTriangleApp::RecreateSwapchain()
+{
+    int width = 0, height = 0;
+    glfwGetFramebufferSize( _window, &width, &height );
+    if( width == 0 || height == 0 )
+    {
+        _swapchainDirty = true;     // minimized: no swapchain can be created, try again later
+        return;
+    }
+
+    // frames in flight may still render into / present the old images: everything built on the old
+    // swapchain is retired instead of destroyed (no vkDeviceWaitIdle) and goes once those frames are done
+    RetiredSwapchain retired;
+    retired.swapchain = _swapchain;
+    retired.imageViews = std::move( _swapchainImageViews );
+    retired.framebuffers = std::move( _swapchainFramebuffers );
+    retired.depthImage = _depthImage;
+    retired.depthAllocation = _depthAllocation;
+    retired.depthImageView = _depthImageView;
+    retired.lastFrame = _submittedFrames;
+    _swapchainImageViews.clear();
+    _swapchainFramebuffers.clear();
+    RetireCommandBuffers();     // recorded against the old framebuffers
+
+    // only the extent dependent state is rebuilt: the render pass and the pipeline (dynamic viewport/scissor) stay
+    CreateSwapchain( retired.swapchain );
+    CreateImageViews();
+    CreateDepthResources();
+    if( _config.occlusionCull )
+    {
+        // a new pyramid for the new depth buffer (cleared: nothing is occluded in the first frame after)
+        retired.hiZ = _hiZ.Resize( _swapchainExtent, _depthImageView );
+        _culler.SetOcclusion( _hiZ.GetReadSet(), _swapchainExtent );
+    }
+    CreateFramebuffers();
+    // the recorded draws set the old extent's viewport and scissor
+    if( _config.dynamicRecording )
+        MarkSceneDirty();           // each slot re-records its secondaries the next time it records
+    else
+        CreateCommandBuffers();
+
+    _retiredSwapchains.push_back( std::move( retired ) );
+    _swapchainDirty = false;
+    _framebufferResized = false;
+}
+
+void HelloTriangleApp::DestroyRetired( bool all )
+{
+    // after waiting on the current slot's fence every frame up to _submittedFrames - framesInFlight
+    // has completed (a fence also covers everything submitted before it); the last frame that may
+    // use a retired swapchain or command buffer is lastFrame - 1
+    auto isDone = [this, all]( uint64_t lastFrame ) { return all || lastFrame + _config.framesInFlight <= _submittedFrames + 1; };
+
+    while( !_retiredCommandBuffers.empty() && isDone( _retiredCommandBuffers.front().lastFrame ) )
+    {
+        RetiredCommandBuffers& retired = _retiredCommandBuffers.front();
+        for( size_t i = 0; i < retired.secondaryCommandBuffers.size(); ++i )
+            vkFreeCommandBuffers( _device, retired.secondaryCommandPools[i], 1, &retired.secondaryCommandBuffers[i] );
+        if( !retired.commandBuffers.empty() )
+            vkFreeCommandBuffers( _device, _commandPool, static_cast<uint32_t>( retired.commandBuffers.size() ), retired.commandBuffers.data() );
+
+        _retiredCommandBuffers.pop_front();
+    }
+
+    while( !_retiredSwapchains.empty() && isDone( _retiredSwapchains.front().lastFrame ) )
+    {
+        RetiredSwapchain& retired = _retiredSwapchains.front();
+        for( auto& framebuffer : retired.framebuffers )
+            vkDestroyFramebuffer( _device, framebuffer, nullptr );
+        for( auto& imageView : retired.imageViews )
+            vkDestroyImageView( _device, imageView, nullptr );
+        if( retired.depthImage != VK_NULL_HANDLE )
+        {
+            vkDestroyImageView( _device, retired.depthImageView, nullptr );
+            Image::Destroy( _device, _allocator, retired.depthImage, retired.depthAllocation );
+        }
+        _hiZ.DestroyTarget( retired.hiZ );
+        vkDestroySwapchainKHR( _device, retired.swapchain, nullptr );
+
+        _retiredSwapchains.pop_front();
+    }
+}
+
+VkFormat HelloTriangleApp::ChooseDepthFormat( bool sampled )
+{
+    // no stencil is used: plain 32-bit float first, then what the device has (one of the two D24S8 / D32S8
+    // is guaranteed for depth attachments, D16 always is)
+    // sampled: no stencil formats (a sampled view has a single aspect); D16 always can be sampled
+    const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM
+    };
+    for( VkFormat format : candidates )
+    {
+        const bool hasStencil = format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+        if( sampled && hasStencil )
+            continue;
+
+        VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if( sampled )
+            required |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties( _physicalDevice, format, &properties );
+        if( (properties.optimalTilingFeatures & required) == required )
+            return format;
+    }
+    throw std::runtime_error( "Failed to find a depth format!" );
+}
+
+void HelloTriangleApp::CreateDepthResources()
+{
+    // cleared at the start of the pass; only stored (and sampled) when the Hi-Z pyramid is built from it
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if( _config.occlusionCull )
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    Image::Create( _device, _allocator, _swapchainExtent, _depthFormat, usage,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthAllocation );
+
+    const bool hasStencil = _depthFormat == VK_FORMAT_D24_UNORM_S8_UINT || _depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT;
+
+    VkImageViewCreateInfo imageViewInfo{};
+    imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewInfo.image = _depthImage;
+    imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    imageViewInfo.format = _depthFormat;
+    imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+    imageViewInfo.subresourceRange.baseMipLevel = 0U;
+    imageViewInfo.subresourceRange.levelCount = 1U;
+    imageViewInfo.subresourceRange.baseArrayLayer = 0U;
+    imageViewInfo.subresourceRange.layerCount = 1U;
+    ErrorCheck( vkCreateImageView( _device, &imageViewInfo, nullptr, &_depthImageView ), "create depth image view" );
+}
+
 void HelloTriangleApp::CreateRenderPass()
 {
     // attachment description
@@ -698,41 +1670,72 @@ void HelloTriangleApp::CreateRenderPass()
     colorAttachmentDesc.format = _swapchainImageFormat;
     colorAttachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachmentDesc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;   // presented / read back, so it must be kept
     colorAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentDesc.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachmentDesc.finalLayout = _config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    // depth: cleared every frame, thrown away at the end (not read back, not presented),
+    // unless the Hi-Z pyramid is built from it after the pass
+    VkAttachmentDescription depthAttachmentDesc{};
+    depthAttachmentDesc.format = _depthFormat;
+    depthAttachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachmentDesc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachmentDesc.storeOp = _config.occlusionCull ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachmentDesc.finalLayout = _config.occlusionCull ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     // attachment reference { layout( location = 0 ) out vec4 outColot}
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     // subpass description
     VkSubpassDescription subpassDesc{};
     subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpassDesc.colorAttachmentCount = 1;
     subpassDesc.pColorAttachments = &colorAttachmentRef;
+    subpassDesc.pDepthStencilAttachment = &depthAttachmentRef;
 
-    // dependency
-    VkSubpassDependency dependency{};
+    // dependency (the depth image is shared by the frames in flight: the previous frame's depth writes
+    // have to be done before this one clears it, and so do its Hi-Z build's reads)
+    std::array<VkSubpassDependency, 2> dependencies{};
+    VkSubpassDependency& dependency = dependencies[0];
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    if( _config.occlusionCull )
+        dependency.srcStageMask |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    // --occlusion-cull: the depth written in the pass is sampled by the Hi-Z build (compute) after it
+    VkSubpassDependency& hiZDependency = dependencies[1];
+    hiZDependency.srcSubpass = 0;
+    hiZDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    hiZDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    hiZDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    hiZDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    hiZDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
     // render pass create info
+    const std::array<VkAttachmentDescription, 2> attachments = { colorAttachmentDesc, depthAttachmentDesc };
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachmentDesc;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>( attachments.size() );
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpassDesc;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = _config.occlusionCull ? 2 : 1;
+    renderPassInfo.pDependencies = dependencies.data();
 
     ErrorCheck( vkCreateRenderPass( _device, &renderPassInfo, nullptr, &_renderPass), "create render pass");
 /*
@@ -746,105 +1749,34 @@ void HelloTriangleApp::CreateRenderPass()
 
 void HelloTriangleApp::CreateGraphicsPipeline()
 {
-    // programable stage
-    // -----------------
-
-    auto vertShaderCode = ReadFile("shaders/vert.spv");
-    auto fragShaderCode = ReadFile("shaders/frag.spv");
-
-    VkShaderModule vertShaderModule = CreateShaderModule( vertShaderCode );
-    VkShaderModule fragShaderModule = CreateShaderModule( fragShaderCode );
-
-    // Vertex Pipeline Stage Info
-    VkPipelineShaderStageCreateInfo vertStageInfo{};
-    vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertStageInfo.module = vertShaderModule;
-    vertStageInfo.pName = "main";
-
-    // Fragment Pipeline Stage Info
-    VkPipelineShaderStageCreateInfo fragStageInfo{};
-    fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragStageInfo.module = fragShaderModule;
-    fragStageInfo.pName = "main";
-
-    // Shader Stages
-    // std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {
-    //     vertStageInfo, fragStageInfo
-    // };
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-        vertStageInfo, fragStageInfo
-    };
-
-    // -----------------
-
-
-
-    // fixed functions
-    // --------------
-
-    // vertex input
-    auto bindDesc = GetBindingDescription();
-    auto attDesc = GetAttributeDescription();
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = GetVertexInput( bindDesc, attDesc );
-
-    // input assembly
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = GetInputAssembly();
-    
-    // viewports & scissors
-    VkViewport viewport = GetViewport();
-    VkRect2D scissor = GetScissor();
-    VkPipelineViewportStateCreateInfo viewportInfo = GetViewPortScissors( viewport, scissor );
-
-    // rasterizer
-    VkPipelineRasterizationStateCreateInfo rasterizerInfo = GetRasterizer();
-
-    // multisampling
-    VkPipelineMultisampleStateCreateInfo multisampleInfo = GetMultisampling();
-    
-    // color blend
-    VkPipelineColorBlendAttachmentState colorblendAttachment = GetColorBlendAttachment();
-    VkPipelineColorBlendStateCreateInfo colorblendInfo = GetColorblending( colorblendAttachment );
-
-    // depth and stencil testing (we don't need it for now)
-    // 
-
-    // dynamic state (we don't need it too for now)
-    //
-
-    // pipeline layout
+    // pipeline layout (shared by every permutation)
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = GetPipelineLayout();
     ErrorCheck( vkCreatePipelineLayout( _device, &pipelineLayoutInfo, nullptr, &_pipelineLayout ), "create pipeline layout" );
 
-    // --------------
+    // the pipeline itself comes from the library: compiled here (nothing can be drawn without it),
+    // later permutations compile in the background
+    _pipelineLibrary.Init( _device, _pipelineCache.Get() );
+    _pipelineDesc = GetPipelineDesc();
+    _graphicsPipeline = _pipelineLibrary.Get( _pipelineDesc );
+    if( _config.depthPrepass )
+        _depthPrepassPipeline = _pipelineLibrary.Get( GetPrepassDesc( _pipelineDesc ) );
 
-    
-    // Pipeline create info
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-    // pipelineInfo.pTessellationState = nullptr;
-    pipelineInfo.pViewportState = &viewportInfo;
-    pipelineInfo.pRasterizationState = &rasterizerInfo;
-    pipelineInfo.pMultisampleState = &multisampleInfo;
-    // pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorblendInfo;
-    // pipelineInfo.pDynamicState = nullptr;
-    pipelineInfo.layout = _pipelineLayout;
-    pipelineInfo.renderPass = _renderPass;
-    pipelineInfo.subpass = 0;   // index of a subpass in renderPass
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;    // because there are none base pipeline we want to use
-
-    ErrorCheck( vkCreateGraphicsPipelines( _device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline), "create graphics pipeline" );
-
-    // destroy shader module
-    vkDestroyShaderModule( _device, vertShaderModule, nullptr );
-    vkDestroyShaderModule( _device, fragShaderModule, nullptr );
+    // warm up the wireframe permutation (W) so the first toggle doesn't wait for it
+    if( _fillModeNonSolidEnabled )
+    {
+        GraphicsPipelineDesc wireframeDesc = _pipelineDesc;
+        wireframeDesc.rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
+        _pipelineLibrary.Request( wireframeDesc );
+        if( _config.depthPrepass )
+            _pipelineLibrary.Request( GetPrepassDesc( wireframeDesc ) );
+    }
+
+    if( _config.hotReload )
+    {
+        _shaderWatcher.Start( "shaders", {
+            { _bindlessEnabled ? "shaders/bindless.vert" : "shaders/shader.vert", GetVertexShaderPath() },
+            { _bindlessEnabled ? "shaders/bindless.frag" : "shaders/shader.frag", GetFragmentShaderPath() } } );
+    }
 
 /*
  *  from :
@@ -861,81 +1793,181 @@ void HelloTriangleApp::CreateGraphicsPipeline()
  */
 }
 
-std::vector<char> HelloTriangleApp::ReadFile( const std::string& filename )
+GraphicsPipelineDesc HelloTriangleApp::GetPipelineDesc()
 {
-    std::ifstream in( filename, std::ios::ate | std::ios::binary );
-    
-    if( !in.is_open() )
-        throw std::runtime_error( "Failed to open spv file!" );
-    
-    size_t fileSize = static_cast<size_t>( in.tellg() ); // getting file size
-    std::vector<char> buffer( fileSize ); // this vector<char> will be used for storing the content of spv file
+    GraphicsPipelineDesc desc;
 
-    in.seekg( 0 );  // making file read from begining
-    in.read( buffer.data(), fileSize ); // read file and then store it at buffer
+    // programable stage
+    desc.vertexShader = ReadFile( GetVertexShaderPath() );
+    desc.fragmentShader = ReadFile( GetFragmentShaderPath() );
 
-    in.close();
+    // fixed functions
+    desc.bindings = GetBindingDescription( _config.vertexFormat );     // vertex input
+    desc.attributes = GetAttributeDescription( _config.vertexFormat );
+    desc.inputAssembly = GetInputAssembly();    // input assembly
+    desc.rasterizer = GetRasterizer();          // rasterizer
+    desc.rasterizer.polygonMode = _wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+    desc.multisample = GetMultisampling();      // multisampling
+    desc.depthStencil = GetDepthStencil();      // depth test
+    desc.colorBlendAttachment = GetColorBlendAttachment();     // color blend
+    desc.colorBlend = GetColorblending( desc.colorBlendAttachment );
+    desc.colorBlend.pAttachments = nullptr;     // the library points it at its own copy
+
+    // dynamic state: viewport and scissor follow the swapchain extent, so a resize keeps the pipeline
+    desc.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    desc.layout = _pipelineLayout;
+    desc.renderPass = _renderPass;
+    desc.subpass = 0;   // index of a subpass in renderPass
+    return desc;
+}
 
-    return buffer;
+GraphicsPipelineDesc HelloTriangleApp::GetPrepassDesc( const GraphicsPipelineDesc& desc )
+{
+    // same vertex stage (invariant gl_Position: the same depth), nothing shaded or written but depth;
+    // the shading pass then only passes where its depth is the one laid down here
+    GraphicsPipelineDesc prepass = desc;
+    prepass.fragmentShader = nullptr;
+    prepass.colorBlendAttachment.colorWriteMask = 0;
+    prepass.depthStencil.depthWriteEnable = VK_TRUE;
+    prepass.depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    return prepass;
+}
 
-/*
- *  from :
- *      Shader modules -> Loading a shader
- *      Conclusion (conclusion of all steps in graphics pipeline section)
- */
+void HelloTriangleApp::UpdateGraphicsPipeline()
+{
+    if( !_pipelineDescChanged )
+        return;
+
+    // not compiled yet: keep drawing with the current pipeline, ask again next frame
+    // (--depth-prepass: both of the pair, they are swapped together)
+    VkPipeline pipeline = _pipelineLibrary.Request( _pipelineDesc );
+    VkPipeline prepassPipeline = _config.depthPrepass ? _pipelineLibrary.Request( GetPrepassDesc( _pipelineDesc ) ) : VK_NULL_HANDLE;
+    if( pipeline == VK_NULL_HANDLE || (_config.depthPrepass && prepassPipeline == VK_NULL_HANDLE) )
+        return;
+
+    _pipelineDescChanged = false;
+    if( pipeline == _graphicsPipeline && prepassPipeline == _depthPrepassPipeline )
+        return;
+    _graphicsPipeline = pipeline;
+    _depthPrepassPipeline = prepassPipeline;
+
+    // the recorded command buffers bind the old pipeline
+    InvalidateCommandBuffers();
 }
 
-VkShaderModule HelloTriangleApp::CreateShaderModule( const std::vector<char>& code )
+void HelloTriangleApp::RetireCommandBuffers()
 {
-    VkShaderModuleCreateInfo moduleInfo{};
-    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleInfo.codeSize = code.size();
-    moduleInfo.pCode = reinterpret_cast<const uint32_t*>( code.data() );
+    // frames in flight may still execute them: freed once those are done (DestroyRetired)
+    RetiredCommandBuffers retired;
+    retired.commandBuffers = std::move( _commandBuffers );
+    retired.secondaryCommandBuffers = std::move( _secondaryCommandBuffers );
+    retired.secondaryCommandPools = std::move( _secondaryCommandPools );
+    retired.lastFrame = _submittedFrames;
+    _commandBuffers.clear();
+    _secondaryCommandBuffers.clear();
+    _secondaryCommandPools.clear();
+    _retiredCommandBuffers.push_back( std::move( retired ) );
+}
+
+void HelloTriangleApp::InvalidateCommandBuffers()
+{
+    if( _config.dynamicRecording )
+        MarkSceneDirty();
+    else
+    {
+        RetireCommandBuffers();
+        CreateCommandBuffers();
+    }
+}
 
-    VkShaderModule shaderModule;
-    ErrorCheck( vkCreateShaderModule( _device, &moduleInfo, nullptr, &shaderModule ), " create shader module" );
+void HelloTriangleApp::InvalidateFrameSlotCommandBuffers( size_t frameSlot )
+{
+    if( _config.dynamicRecording )
+    {
+        _frameCommands[frameSlot].recordedSceneVersion = UINT64_MAX;     // the other slots keep theirs
+        return;
+    }
 
-    return shaderModule;
+    // only the slot's frames ever submitted them and its fence has been waited on; they are still
+    // retired (not freed here) like the ones InvalidateCommandBuffers replaces
+    const size_t slotCount = _config.framesInFlight;
+    const size_t secondariesPerPrimary = _secondaryCommandBuffers.size() / _commandBuffers.size();
+    RetiredCommandBuffers retired;
+    retired.lastFrame = _submittedFrames;
+    for( size_t i = frameSlot; i < _commandBuffers.size(); i += slotCount )
+    {
+        retired.commandBuffers.push_back( _commandBuffers[i] );
+        for( size_t secondary = i * secondariesPerPrimary; secondary < (i + 1) * secondariesPerPrimary; ++secondary )
+        {
+            retired.secondaryCommandBuffers.push_back( _secondaryCommandBuffers[secondary] );
+            retired.secondaryCommandPools.push_back( _secondaryCommandPools[secondary] );
+        }
+    }
+    _retiredCommandBuffers.push_back( std::move( retired ) );
 
-/*
- *  from :
- *      Shader modules -> Creating shader module
- * 
- */
+    RecordFrameSlotCommandBuffers( frameSlot );
 }
 
-VkPipelineVertexInputStateCreateInfo HelloTriangleApp::GetVertexInput(
-    VkVertexInputBindingDescription& bindDesc, 
-    std::vector<VkVertexInputAttributeDescription>& attDesc
-    )
+void HelloTriangleApp::ApplyShaderReloads()
 {
-    VkPipelineVertexInputStateCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    createInfo.vertexBindingDescriptionCount = 1;
-    createInfo.pVertexBindingDescriptions = &bindDesc;
-    createInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attDesc.size());
-    createInfo.pVertexAttributeDescriptions = attDesc.data();
+    if( !_shaderWatcher.IsRunning() )
+        return;
+
+    for( auto& reloaded : _shaderWatcher.Poll() )
+    {
+        if( reloaded.spirv == GetVertexShaderPath() )
+            _pipelineDesc.vertexShader = std::move( reloaded.code );
+        else if( reloaded.spirv == GetFragmentShaderPath() )
+            _pipelineDesc.fragmentShader = std::move( reloaded.code );
+        else
+            continue;
+
+        // a new key: compiled in the background, swapped in by UpdateGraphicsPipeline at a frame boundary
+        _pipelineDescChanged = true;
+    }
+}
+
+void HelloTriangleApp::KeyCallback( GLFWwindow* window, int key, int scancode, int action, int mods )
+{
+    auto app = reinterpret_cast<HelloTriangleApp*>( glfwGetWindowUserPointer( window ) );
+    if( action != GLFW_PRESS )
+        return;
+
+    // W: wireframe toggle (a pipeline permutation; switched to once the library has it)
+    if( key == GLFW_KEY_W && app->_fillModeNonSolidEnabled )
+    {
+        app->_wireframe = !app->_wireframe;
+        app->_pipelineDesc.rasterizer.polygonMode = app->_wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+        app->_pipelineDescChanged = true;
+    }
+}
+
+std::shared_ptr<const MappedFile> HelloTriangleApp::ReadFile( const std::string& filename )
+{
+    // mmap instead of copying the file into a vector: shader modules read pCode from the mapping
+    return MappedFile::Open( filename );
 
-    return createInfo;
 /*
  *  from :
-    // color blend
-    VkPipelineColorBlendStateCreateInfo colorblendInfo = GetColorblending();
- *      Fixed functions -> Vertex input
- * 
- * 
- *  from udemy :
- *      vertex input
- * 
+ *      Shader modules -> Loading a shader
+ *      Conclusion (conclusion of all steps in graphics pipeline section)
  */
 }
 
-VkVertexInputBindingDescription HelloTriangleApp::GetBindingDescription()
+std::vector<VkVertexInputBindingDescription> HelloTriangleApp::GetBindingDescription( VertexFormat format )
 {
-    VkVertexInputBindingDescription bindingDesc{};
-    bindingDesc.binding = 0;
-    bindingDesc.stride = sizeof(Vertex);
-    bindingDesc.inputRate =  VK_VERTEX_INPUT_RATE_VERTEX;
+    std::vector<VkVertexInputBindingDescription> bindingDesc( 2 );
+
+    // per vertex: the geometry pool page
+    bindingDesc[0].binding = 0;
+    bindingDesc[0].stride = VertexLayout::Stride( format );
+    bindingDesc[0].inputRate =  VK_VERTEX_INPUT_RATE_VERTEX;
+
+    // per instance: an instance page (see GeometryPool::SetInstances)
+    bindingDesc[1].binding = 1;
+    bindingDesc[1].stride = sizeof(InstanceData);
+    bindingDesc[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
     return bindingDesc;
      
@@ -945,22 +1977,30 @@ VkVertexInputBindingDescription HelloTriangleApp::GetBindingDescription()
 */
 }
 
-std::vector<VkVertexInputAttributeDescription> HelloTriangleApp::GetAttributeDescription()
+std::vector<VkVertexInputAttributeDescription> HelloTriangleApp::GetAttributeDescription( VertexFormat format )
 {
-    std::vector<VkVertexInputAttributeDescription> attDesc( 2 );
-
-    // position attribute
-    attDesc[0].location = 0;
-    attDesc[0].binding = 0;
-    attDesc[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attDesc[0].offset = offsetof(Vertex, pos);
-
-    // color attribute
-    attDesc[1].location = 1;
-    attDesc[1].binding = 0;
-    attDesc[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attDesc[1].offset = offsetof(Vertex, col);
+    // per vertex (binding 0), see VertexLayout
+    std::vector<VkVertexInputAttributeDescription> attDesc = VertexLayout::Attributes( format );
 
+    // per instance (binding 1), the same for both vertex layouts: a mat4 takes 4 locations, one per column
+    std::vector<VkVertexInputAttributeDescription> instanceAttDesc( 6 );
+    for( uint32_t column = 0; column < 4; ++column )
+    {
+        instanceAttDesc[column].location = 2 + column;
+        instanceAttDesc[column].binding = 1;
+        instanceAttDesc[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        instanceAttDesc[column].offset = static_cast<uint32_t>( offsetof(InstanceData, transform) + column * sizeof(glm::vec4) );
+    }
+    instanceAttDesc[4].location = 6;
+    instanceAttDesc[4].binding = 1;
+    instanceAttDesc[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    instanceAttDesc[4].offset = offsetof(InstanceData, color);
+    instanceAttDesc[5].location = 7;
+    instanceAttDesc[5].binding = 1;
+    instanceAttDesc[5].format = VK_FORMAT_R32_UINT;
+    instanceAttDesc[5].offset = offsetof(InstanceData, objectIndex);
+
+    attDesc.insert( attDesc.end(), instanceAttDesc.begin(), instanceAttDesc.end() );
     return attDesc;
      
 /*
@@ -984,24 +2024,6 @@ VkPipelineInputAssemblyStateCreateInfo HelloTriangleApp::GetInputAssembly()
  */
 }
 
-VkPipelineViewportStateCreateInfo HelloTriangleApp::GetViewPortScissors( VkViewport& viewport, VkRect2D& scissor )
-{
-    // viewport + scissor
-    VkPipelineViewportStateCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    createInfo.viewportCount = 1;       // jumlah viewport
-    createInfo.pViewports = &viewport;  // viewport
-    createInfo.scissorCount = 1;        // jumlah scissor
-    createInfo.pScissors = &scissor;    // scissor
-
-    return createInfo;
-/*
- *  from :
- *      Fixed functions -> Viewports and scissors
- * 
- */
-}
-
 VkPipelineRasterizationStateCreateInfo HelloTriangleApp::GetRasterizer()
 {
     VkPipelineRasterizationStateCreateInfo createInfo{};
@@ -1057,6 +2079,29 @@ VkPipelineMultisampleStateCreateInfo HelloTriangleApp::GetMultisampling()
  */
 }
 
+VkPipelineDepthStencilStateCreateInfo HelloTriangleApp::GetDepthStencil()
+{
+    VkPipelineDepthStencilStateCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    createInfo.depthTestEnable = VK_TRUE;
+    createInfo.depthWriteEnable = VK_TRUE;
+
+    // or equal: coplanar draws (every flat synthetic object sits at z 0) keep overwriting in draw order
+    // as they did without a depth buffer
+    createInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    // --depth-prepass: the depth is final before shading (GetPrepassDesc), only the nearest surface passes
+    if( _config.depthPrepass )
+    {
+        createInfo.depthWriteEnable = VK_FALSE;
+        createInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    }
+    createInfo.depthBoundsTestEnable = VK_FALSE;
+    createInfo.stencilTestEnable = VK_FALSE;
+
+    return createInfo;
+}
+
 VkPipelineColorBlendStateCreateInfo HelloTriangleApp::GetColorblending( VkPipelineColorBlendAttachmentState& attachment )
 {
     VkPipelineColorBlendStateCreateInfo createInfo{};
@@ -1082,10 +2127,13 @@ VkPipelineLayoutCreateInfo HelloTriangleApp::GetPipelineLayout()
 {
     VkPipelineLayoutCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    createInfo.setLayoutCount = 0;  // optional
-    // createInfo.pSetLayouts = nullptr;   // optional
-    createInfo.pushConstantRangeCount = 0;  // optional
-    // createInfo.pPushConstantRanges = nullptr;   // optional
+    // set 0: camera + object transforms of the frame (see FrameUniforms), set 1: the bindless arrays or the draw's texture
+    _pipelineSetLayouts = { _frameUniforms.GetSetLayout(), _bindlessEnabled ? _bindless.GetSetLayout() : _textureSetLayout };
+
+    createInfo.setLayoutCount = static_cast<uint32_t>( _pipelineSetLayouts.size() );
+    createInfo.pSetLayouts = _pipelineSetLayouts.data();
+    createInfo.pushConstantRangeCount = 1;  // the draw's object index, texture mapping (+ bindless indices)
+    createInfo.pPushConstantRanges = &FrameUniforms::PushConstantRange;
 
     return createInfo;
 /*
@@ -1117,6 +2165,15 @@ VkRect2D HelloTriangleApp::GetScissor() const
     return scissor;
 }
 
+void HelloTriangleApp::SetViewportScissor( VkCommandBuffer commandBuffer ) const
+{
+    // dynamic state: not inherited by secondary command buffers, every command buffer that draws sets it
+    VkViewport viewport = GetViewport();
+    VkRect2D scissor = GetScissor();
+    vkCmdSetViewport( commandBuffer, 0, 1, &viewport );
+    vkCmdSetScissor( commandBuffer, 0, 1, &scissor );
+}
+
 VkPipelineColorBlendAttachmentState HelloTriangleApp::GetColorBlendAttachment() const
 {
     VkPipelineColorBlendAttachmentState colorAttachment{};
@@ -1140,12 +2197,32 @@ VkPipelineColorBlendAttachmentState HelloTriangleApp::GetColorBlendAttachment()
 
 std::vector<const char*> HelloTriangleApp::GetRequiredExtensions()
 {
-    uint32_t glfwExtensionsCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionsCount );
+    std::vector<const char*> extensions;
 
-    std::vector<const char*> extensions( glfwExtensions, glfwExtensions + glfwExtensionsCount );
+    // headless: no surface extensions (and no glfwInit to ask for them)
+    if( !_config.headless )
+    {
+        uint32_t glfwExtensionsCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions( &glfwExtensionsCount );
+        extensions.assign( glfwExtensions, glfwExtensions + glfwExtensionsCount );
+    }
     
-    extensions.push_back( VK_EXT_DEBUG_UTILS_EXTENSION_NAME );
+    if( _enableValidation )
+        extensions.push_back( VK_EXT_DEBUG_UTILS_EXTENSION_NAME );
+
+    // bindless: the descriptor indexing features are queried through vkGetPhysicalDeviceFeatures2KHR
+    if( _config.bindless )
+    {
+        uint32_t extensionCount = 0;
+        vkEnumerateInstanceExtensionProperties( nullptr, &extensionCount, nullptr );
+        std::vector<VkExtensionProperties> available( extensionCount );
+        vkEnumerateInstanceExtensionProperties( nullptr, &extensionCount, available.data() );
+        for( const auto& extension : available )
+        {
+            if( std::strcmp( extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME ) == 0 )
+                extensions.push_back( VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME );
+        }
+    }
 
     return extensions;
 }
@@ -1174,6 +2251,22 @@ bool HelloTriangleApp::CheckDeviceExtensionSupport( VkPhysicalDevice physicalDev
 }
 
 
+bool HelloTriangleApp::IsDeviceExtensionAvailable( VkPhysicalDevice physicalDevice, const char* name )
+{
+    uint32_t extensionCount = 0U;
+    vkEnumerateDeviceExtensionProperties( physicalDevice, nullptr, &extensionCount, nullptr );
+    std::vector<VkExtensionProperties> avaliableExtensions( extensionCount );
+    vkEnumerateDeviceExtensionProperties( physicalDevice, nullptr, &extensionCount, avaliableExtensions.data() );
+
+    for( const auto& extension : avaliableExtensions )
+    {
+        if( std::strcmp( extension.extensionName, name ) == 0 )
+            return true;
+    }
+    return false;
+}
+
+
 // --- command buffer and frame buffer ---
 
 void HelloTriangleApp::CreateFramebuffers()
@@ -1183,8 +2276,9 @@ void HelloTriangleApp::CreateFramebuffers()
 
     for( size_t i = 0; i < size_images; ++i )
     {
-        std::array<VkImageView, 1> attachment = {
-            _swapchainImageViews[i]
+        std::array<VkImageView, 2> attachment = {
+            _swapchainImageViews[i],
+            _depthImageView
         };
 
         VkFramebufferCreateInfo framebufferInfo{};
@@ -1211,65 +2305,382 @@ void HelloTriangleApp::CreateCommandPool()
 
     ErrorCheck( vkCreateCommandPool( _device, &commandPoolInfo, nullptr, &_commandPool), "create command pool" );
 
+    // one pool per recording thread
+    if( _config.recordThreads > 0 )
+    {
+        _recordThreadPool.Init( _config.recordThreads );
+
+        // dynamic recording keeps its worker pools per frame slot instead (CreateFrameCommands)
+        if( !_config.dynamicRecording )
+        {
+            _workerCommandPools.resize( _config.recordThreads );
+            for( auto& workerPool : _workerCommandPools )
+                ErrorCheck( vkCreateCommandPool( _device, &commandPoolInfo, nullptr, &workerPool ), "create worker command pool" );
+        }
+    }
+
 }
 
 void HelloTriangleApp::CreateCommandBuffers()
 {   
-    _commandBuffers.resize( _swapchainFramebuffers.size() );
-    const size_t size_commandBuffers = _commandBuffers.size();
-    
+    // dynamic mode records per frame (see RecordFrame), there is nothing to pre-record
+    if( _config.dynamicRecording )
+    {
+        CreateFrameCommands();
+        return;
+    }
+
+    auto recordStart = std::chrono::steady_clock::now();
+    SortDraws();
+
+    // one per (image, frame slot): the slot picks the uniform slice the draws read, so the slot's
+    // fence alone guards it (recording per image only would need the slice to follow the image)
+    _commandBuffers.assign( _swapchainFramebuffers.size() * _config.framesInFlight, VK_NULL_HANDLE );
+
+    // --- parallel path: the draws go into secondary command buffers, one per (image, frame slot, pass, slice) ---
+    const bool parallel = !_workerCommandPools.empty() && !_meshes.empty() && !_config.gpuDriven;
+    const size_t sliceCount = parallel ? std::min( _workerCommandPools.size(), _meshes.size() ) : 0;
+    const size_t secondariesPerPrimary = sliceCount * GetDrawPassCount();  // the pre-pass slices first
+    _secondaryCommandBuffers.assign( _commandBuffers.size() * secondariesPerPrimary, VK_NULL_HANDLE );
+    _secondaryCommandPools.assign( _commandBuffers.size() * secondariesPerPrimary, VK_NULL_HANDLE );
+
+    for( size_t frameSlot = 0; frameSlot < _config.framesInFlight; ++frameSlot )
+        RecordFrameSlotCommandBuffers( frameSlot );
+
+    _runStats.recordThreads = static_cast<uint32_t>( _workerCommandPools.size() );
+    _runStats.recordMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - recordStart ).count();
+}
+
+void HelloTriangleApp::RecordFrameSlotCommandBuffers( size_t frameSlot )
+{
+    // the layout CreateCommandBuffers sized: [image * slotCount + slot], secondaries per primary in a row
+    const size_t slotCount = _config.framesInFlight;
+    const size_t imageCount = _swapchainFramebuffers.size();
+    const size_t secondariesPerPrimary = _secondaryCommandBuffers.size() / _commandBuffers.size();
+    const size_t passCount = GetDrawPassCount();
+    const size_t sliceCount = secondariesPerPrimary / passCount;
+
     VkCommandBufferAllocateInfo cmdAllocInfo{};
     cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     cmdAllocInfo.commandPool = _commandPool;
     cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    cmdAllocInfo.commandBufferCount = static_cast<uint32_t>( size_commandBuffers );
-
-    ErrorCheck( vkAllocateCommandBuffers( _device, &cmdAllocInfo, _commandBuffers.data() ), "allocate command buffers" );
-
-    for( size_t i = 0; i < size_commandBuffers; ++i )
-    {
-        // --- begin ---
-        VkCommandBufferBeginInfo cmdBuf_beginInfo{};
-        cmdBuf_beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        cmdBuf_beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;  // before this it's assgin to zero, but someone in the chat said that it can fixed issue in rendering & presentation
-        cmdBuf_beginInfo.pInheritanceInfo = nullptr;    // optional
-
-        ErrorCheck( vkBeginCommandBuffer( _commandBuffers[i], &cmdBuf_beginInfo ), "begin recording command buffer" );
-        // -------------
-
-        // --- render pass ---
-        VkRenderPassBeginInfo renderpassBeginInfo{};
-        renderpassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderpassBeginInfo.renderPass = _renderPass;
-        renderpassBeginInfo.framebuffer = _swapchainFramebuffers[i];
-        renderpassBeginInfo.renderArea.offset = {0, 0};
-        renderpassBeginInfo.renderArea.extent = _swapchainExtent;
-        VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f }; // solid black
-        renderpassBeginInfo.clearValueCount = 1;
-        renderpassBeginInfo.pClearValues = &clearColor;
-        vkCmdBeginRenderPass( _commandBuffers[i], &renderpassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
-
-        // --- basic draw command ---
-        // bind pipeline
-        vkCmdBindPipeline( _commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline );
-        
-        // bind vertex buffer
-        std::array<VkBuffer, 1> vertexBuffers = { _vertexMesh.GetBuffer() };   // GetBuffer: GetVertexBuffer
-        std::array<VkDeviceSize, 1> offsets = { 0 };
-        vkCmdBindVertexBuffers( _commandBuffers[i], 0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(), offsets.data() ); // cmd vertex buffer"s" (with 's')
-        vkCmdBindIndexBuffer( _commandBuffers[i], _indexMesh.GetBuffer(), 0, VK_INDEX_TYPE_UINT32 ); // cmd index buffer (without 's')
+    cmdAllocInfo.commandBufferCount = 1;
+    for( size_t image = 0; image < imageCount; ++image )
+        ErrorCheck( vkAllocateCommandBuffers( _device, &cmdAllocInfo, &_commandBuffers[image * slotCount + frameSlot] ), "allocate command buffers" );
 
-        // draw
-        // vkCmdDraw( _commandBuffers[i], 3, 1, 0, 0 );     // before
-        // vkCmdDraw( _commandBuffers[i], static_cast<uint32_t>(vertexMesh.GetCount()), 1, 0, 0 );        // after; GetCount: GetVertexCount
-        vkCmdDrawIndexed( _commandBuffers[i], _indexMesh.GetCount(), 1, 0, 0, 0 );
-        // --------------------------
+    // each task allocates from the pool of the worker running it, so no pool is touched by two threads
+    if( secondariesPerPrimary > 0 )
+    {
+        _recordThreadPool.Dispatch( static_cast<uint32_t>( imageCount * secondariesPerPrimary ),
+            [this, frameSlot, slotCount, sliceCount, passCount, secondariesPerPrimary]( uint32_t task, uint32_t worker )
+            {
+                const size_t image = task / secondariesPerPrimary;
+                const size_t pass = task / sliceCount % passCount;
+                const size_t slice = task % sliceCount;
+                const size_t index = (image * slotCount + frameSlot) * secondariesPerPrimary + task % secondariesPerPrimary;
+
+                VkCommandBufferAllocateInfo secondaryAllocInfo{};
+                secondaryAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                secondaryAllocInfo.commandPool = _workerCommandPools[worker];
+                secondaryAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                secondaryAllocInfo.commandBufferCount = 1;
+                VkCommandBuffer commandBuffer;
+                ErrorCheck( vkAllocateCommandBuffers( _device, &secondaryAllocInfo, &commandBuffer ), "allocate secondary command buffer" );
+
+                RecordSlice( commandBuffer, 0, _swapchainFramebuffers[image], frameSlot, slice, sliceCount,
+                                pass + 1 < passCount );
+                _secondaryCommandBuffers[index] = commandBuffer;
+                _secondaryCommandPools[index] = _workerCommandPools[worker];
+            } );
+    }
 
-        // --- Finish recording ---
-        vkCmdEndRenderPass( _commandBuffers[i] );
-        ErrorCheck( vkEndCommandBuffer( _commandBuffers[i] ), "end recording command buffer" );
+    for( size_t image = 0; image < imageCount; ++image )
+    {
+        // no SIMULTANEOUS_USE: only the slot's frames submit it, one at a time behind the slot's fence
+        const size_t i = image * slotCount + frameSlot;
+        RecordPrimary( _commandBuffers[i], 0, image, frameSlot, static_cast<uint32_t>( i ),
+                        secondariesPerPrimary > 0 ? &_secondaryCommandBuffers[i * secondariesPerPrimary] : nullptr, secondariesPerPrimary );
     }
+}
+
+void HelloTriangleApp::RecordPrimary( VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags usage, size_t imageIndex, size_t frameSlot,
+                                        uint32_t querySlot, const VkCommandBuffer* pSecondaries, size_t secondaryCount )
+{
+    // --- begin ---
+    VkCommandBufferBeginInfo cmdBuf_beginInfo{};
+    cmdBuf_beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBuf_beginInfo.flags = usage;
+    cmdBuf_beginInfo.pInheritanceInfo = nullptr;    // optional
+
+    ErrorCheck( vkBeginCommandBuffer( commandBuffer, &cmdBuf_beginInfo ), "begin recording command buffer" );
+    // -------------
+
+    // --- render pass ---
+    VkRenderPassBeginInfo renderpassBeginInfo{};
+    renderpassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderpassBeginInfo.renderPass = _renderPass;
+    renderpassBeginInfo.framebuffer = _swapchainFramebuffers[imageIndex];
+    renderpassBeginInfo.renderArea.offset = {0, 0};
+    renderpassBeginInfo.renderArea.extent = _swapchainExtent;
+    std::array<VkClearValue, 2> clearValues{};
+    clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };   // solid black
+    clearValues[1].depthStencil = { 1.0f, 0 };              // far plane
+    renderpassBeginInfo.clearValueCount = static_cast<uint32_t>( clearValues.size() );
+    renderpassBeginInfo.pClearValues = clearValues.data();
+    _profiler.CmdBeginGpu( commandBuffer, querySlot );   // GPU time starts here
+
+    // --depth-prepass: every draw twice in the one subpass, depth only first (a second subpass would double
+    // the secondaries' inheritance variants for nothing: the depth attachment stays the same)
+    const size_t passCount = GetDrawPassCount();
+    if( _config.gpuDriven )
+    {
+        // compute, before the render pass; the spheres move with the slot's transforms
+        _culler.CmdCull( commandBuffer, static_cast<uint32_t>( frameSlot ), _frameUniforms.GetSet( static_cast<uint32_t>( frameSlot ) ) );
+
+        vkCmdBeginRenderPass( commandBuffer, &renderpassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+        SetViewportScissor( commandBuffer );
 
+        // one indirect call covers many objects: no per-object push, each instance carries its object's index
+        // (see CreateMeshFromVerteces); they all draw untextured
+        const ObjectPushConstants constants = GetObjectPushConstants( frameSlot, FrameUniforms::NoObject, _whiteTexture, glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f ) );
+        CmdBindFrameResources( commandBuffer, frameSlot );
+        if( !_bindlessEnabled )
+        {
+            vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
+                                        1, 1, &_textureSets[_whiteTexture * _config.framesInFlight + frameSlot], 0, nullptr );
+        }
+        vkCmdPushConstants( commandBuffer, _pipelineLayout, FrameUniforms::PushConstantStages, 0, sizeof(constants), &constants );
+        for( size_t pass = 0; pass < passCount; ++pass )
+        {
+            vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pass + 1 < passCount ? _depthPrepassPipeline : _graphicsPipeline );
+            _culler.CmdDraw( commandBuffer, _geometryPool );
+        }
+    }
+    else if( secondaryCount > 0 )
+    {
+        vkCmdBeginRenderPass( commandBuffer, &renderpassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+        vkCmdExecuteCommands( commandBuffer, static_cast<uint32_t>( secondaryCount ), pSecondaries );
+    }
+    else
+    {
+        vkCmdBeginRenderPass( commandBuffer, &renderpassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+        for( size_t pass = 0; pass < passCount; ++pass )
+            RecordDraws( commandBuffer, frameSlot, 0, _drawOrder.size(), pass + 1 < passCount );
+    }
+
+    // --- Finish recording ---
+    vkCmdEndRenderPass( commandBuffer );
+    if( _config.occlusionCull )
+        _hiZ.CmdBuild( commandBuffer );     // from this frame's depth, for the next frame's cull
+    _profiler.CmdEndGpu( commandBuffer, querySlot );
+    ErrorCheck( vkEndCommandBuffer( commandBuffer ), "end recording command buffer" );
+}
+
+void HelloTriangleApp::RecordSlice( VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags usage, VkFramebuffer framebuffer,
+                                    size_t frameSlot, size_t slice, size_t sliceCount, bool depthOnly )
+{
+    // framebuffer may be VK_NULL_HANDLE: then the slice can run inside any framebuffer of the render pass
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = _renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | usage;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    ErrorCheck( vkBeginCommandBuffer( commandBuffer, &beginInfo ), "begin recording secondary command buffer" );
+
+    // equal draw count per slice, consecutive runs of the draw order (the primary executes the slices in order)
+    const size_t firstDraw = _drawOrder.size() * slice / sliceCount;
+    const size_t lastDraw = _drawOrder.size() * (slice + 1) / sliceCount;
+    RecordDraws( commandBuffer, frameSlot, firstDraw, lastDraw, depthOnly );
+
+    ErrorCheck( vkEndCommandBuffer( commandBuffer ), "end recording secondary command buffer" );
+}
+
+void HelloTriangleApp::CreateFrameCommands()
+{
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies( _physicalDevice );
+
+    // primary: rewritten every frame -> transient pool, reset as a whole
+    VkCommandPoolCreateInfo primaryPoolInfo{};
+    primaryPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    primaryPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    primaryPoolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+    // secondaries: kept as long as the scene doesn't change, reset as a whole when it does
+    VkCommandPoolCreateInfo secondaryPoolInfo = primaryPoolInfo;
+    secondaryPoolInfo.flags = 0;
+
+    // without worker threads the slices are recorded inline, as worker 0
+    const size_t workerCount = std::max<size_t>( 1, _recordThreadPool.GetWorkerCount() );
+
+    _frameCommands.resize( _config.framesInFlight );
+    for( auto& frame : _frameCommands )
+    {
+        ErrorCheck( vkCreateCommandPool( _device, &primaryPoolInfo, nullptr, &frame.pool ), "create frame command pool" );
+
+        VkCommandBufferAllocateInfo cmdAllocInfo{};
+        cmdAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdAllocInfo.commandPool = frame.pool;
+        cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmdAllocInfo.commandBufferCount = 1;
+        ErrorCheck( vkAllocateCommandBuffers( _device, &cmdAllocInfo, &frame.primary ), "allocate frame command buffer" );
+
+        frame.workerPools.resize( workerCount );
+        frame.workerBuffers.resize( workerCount );
+        frame.workerBufferUsed.assign( workerCount, 0 );
+        for( auto& workerPool : frame.workerPools )
+            ErrorCheck( vkCreateCommandPool( _device, &secondaryPoolInfo, nullptr, &workerPool ), "create frame worker command pool" );
+    }
+
+    _runStats.recordThreads = _recordThreadPool.GetWorkerCount();
+}
+
+void HelloTriangleApp::DestroyFrameCommands()
+{
+    for( auto& frame : _frameCommands )
+    {
+        vkDestroyCommandPool( _device, frame.pool, nullptr );
+        for( auto& workerPool : frame.workerPools )
+            vkDestroyCommandPool( _device, workerPool, nullptr );
+    }
+    _frameCommands.clear();
+}
+
+VkCommandBuffer HelloTriangleApp::RecordFrame( size_t frameSlot, uint32_t imageIndex )
+{
+    // the slot's fence has been waited on: nothing recorded from its pools is pending anymore
+    FrameCommands& frame = _frameCommands[frameSlot];
+
+    // --- draws: only re-recorded when the scene changed since this slot last recorded them ---
+    if( frame.recordedSceneVersion != _sceneVersion )
+    {
+        auto recordStart = std::chrono::steady_clock::now();
+        SortDraws();
+
+        for( size_t worker = 0; worker < frame.workerPools.size(); ++worker )
+        {
+            vkResetCommandPool( _device, frame.workerPools[worker], 0 );    // buffers stay allocated, back to initial state
+            frame.workerBufferUsed[worker] = 0;
+        }
+
+        // GPU-driven: the draws are a few indirect calls recorded in the primary, no slices
+        const size_t sliceCount = _meshes.empty() || _config.gpuDriven ? 0 : std::min( frame.workerPools.size(), _meshes.size() );
+        const size_t passCount = GetDrawPassCount();
+        frame.secondaries.assign( sliceCount * passCount, VK_NULL_HANDLE );     // the pre-pass slices first
+
+        _recordThreadPool.Dispatch( static_cast<uint32_t>( frame.secondaries.size() ),
+            [this, &frame, frameSlot, sliceCount, passCount]( uint32_t task, uint32_t worker )
+            {
+                const size_t pass = task / sliceCount;
+                const size_t slice = task % sliceCount;
+
+                // reuse this worker's buffers from earlier recordings before allocating new ones
+                std::vector<VkCommandBuffer>& buffers = frame.workerBuffers[worker];
+                if( frame.workerBufferUsed[worker] == buffers.size() )
+                {
+                    VkCommandBufferAllocateInfo secondaryAllocInfo{};
+                    secondaryAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                    secondaryAllocInfo.commandPool = frame.workerPools[worker];
+                    secondaryAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                    secondaryAllocInfo.commandBufferCount = 1;
+                    buffers.push_back( VK_NULL_HANDLE );
+                    ErrorCheck( vkAllocateCommandBuffers( _device, &secondaryAllocInfo, &buffers.back() ), "allocate secondary command buffer" );
+                }
+                VkCommandBuffer commandBuffer = buffers[frame.workerBufferUsed[worker]++];
+
+                RecordSlice( commandBuffer, 0, VK_NULL_HANDLE, frameSlot, slice, sliceCount, pass + 1 < passCount );
+                frame.secondaries[task] = commandBuffer;
+            } );
+
+        frame.recordedSceneVersion = _sceneVersion;
+        ++_runStats.rerecordCount;
+        _runStats.recordMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - recordStart ).count();
+    }
+
+    // --- primary: a handful of commands, cheap enough to redo every frame (the image changes anyway) ---
+    vkResetCommandPool( _device, frame.pool, 0 );
+    RecordPrimary( frame.primary, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, imageIndex, frameSlot, static_cast<uint32_t>( frameSlot ),
+                    frame.secondaries.data(), frame.secondaries.size() );
+
+    return frame.primary;
+}
+
+void HelloTriangleApp::SortDraws()
+{
+    // GPU-driven: the culler's batches are the draws
+    _drawOrder.resize( _config.gpuDriven ? 0 : _meshes.size() );
+    for( size_t i = 0; i < _drawOrder.size(); ++i )
+        _drawOrder[i] = static_cast<uint32_t>( i );
+    if( !_config.sortDraws || _drawOrder.size() < 2 )
+        return;
+
+    // by the depth of each mesh's bounding sphere center with the transforms of now: the order is
+    // recorded, so it holds until the next re-record (the camera doesn't move, --animate only moves in y)
+    _drawKeys.resize( _drawOrder.size() );
+    for( size_t m = 0; m < _drawKeys.size(); ++m )
+    {
+        const glm::vec4& bounds = _meshBounds[m];
+        const glm::vec4 center = _viewProjection * _objectTransforms[m] * glm::vec4( bounds.x, bounds.y, bounds.z, 1.0f );
+        const float depth = center.w > 0.0f ? center.z / center.w : 1.0f;
+        _drawKeys[m] = DrawSorter::MakeKey( 0, depth, _meshTextures[m] );   // one opaque pipeline
+    }
+    _drawOrder = _drawSorter.Sort( _drawKeys );
+}
+
+void HelloTriangleApp::RecordDraws( VkCommandBuffer commandBuffer, size_t frameSlot, size_t firstDraw, size_t lastDraw, bool depthOnly )
+{
+    // --- basic draw command ---
+    // bind pipeline (depthOnly: the --depth-prepass one, which samples no texture)
+    vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthOnly ? _depthPrepassPipeline : _graphicsPipeline );
+    SetViewportScissor( commandBuffer );
+
+    // the frame slot's camera + transforms; what they contain changes without re-recording
+    CmdBindFrameResources( commandBuffer, frameSlot );
+    
+    // bind vertex + index buffer once per geometry page, then every mesh is just offsets into it
+    // (and again whenever the index type changes, 16 and 32-bit meshes share the page's index region)
+    uint32_t boundPage = UINT32_MAX;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    uint32_t boundInstancePage = UINT32_MAX;
+    uint32_t boundTexture = UINT32_MAX;
+    for( size_t draw = firstDraw; draw < lastDraw; ++draw )
+    {
+        const uint32_t m = _drawOrder[draw];
+        const Mesh& mesh = _meshes[m];
+        if( mesh.GetPage() != boundPage || mesh.GetIndexType() != boundIndexType )
+        {
+            boundPage = mesh.GetPage();
+            boundIndexType = mesh.GetIndexType();
+            _geometryPool.Bind( commandBuffer, boundPage, boundIndexType );
+        }
+        if( mesh.GetInstancePage() != boundInstancePage )
+        {
+            boundInstancePage = mesh.GetInstancePage();
+            _geometryPool.BindInstances( commandBuffer, boundInstancePage );
+        }
+
+        // the texture: its set (when it changes), with --bindless only an index in the push constants
+        const uint32_t texture = _meshTextures[m];
+        if( !_bindlessEnabled && !depthOnly && texture != boundTexture )
+        {
+            boundTexture = texture;
+            vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout,
+                                        1, 1, &_textureSets[texture * _config.framesInFlight + frameSlot], 0, nullptr );
+        }
+
+        // the mesh's transform is objects[m] of the slice, its texture mapping comes from its bounds
+        const ObjectPushConstants constants = GetObjectPushConstants( frameSlot, m, texture, _meshBounds[m] );
+        vkCmdPushConstants( commandBuffer, _pipelineLayout, FrameUniforms::PushConstantStages, 0, sizeof(constants), &constants );
+
+        // draw: every instance of the mesh in one call
+        vkCmdDrawIndexed( commandBuffer, mesh.GetIndexCount(), mesh.GetInstanceCount(), mesh.GetFirstIndex(),
+                            mesh.GetVertexOffset(), mesh.GetFirstInstance() );
+    }
+    // --------------------------
 }
 
 
@@ -3,6 +3,7 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <deque>
 #include <vector>
 #include <fstream>
 
@@ -15,14 +16,60 @@ const std::vector<const char*> deviceExtensions {
 };
 
 #include "utilities.h"
-#include "Mesh.h"
-
+#include "AppConfig.h"
+#include "BindlessTable.h"
+#include "DescriptorAllocator.h"
+#include "DrawSorter.h"
+#include "FramePacer.h"
+#include "FrameUniforms.h"
+#include "GeometryPool.h"
+#include "GpuCuller.h"
+#include "HiZPyramid.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+#include "Profiler.h"
+#include "ShaderWatcher.h"
+#include "SyntheticScene.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+
+// what a run did, for the benchmark harness
+struct RunStats
+{
+    uint32_t frameCount = 0;
+    double seconds = 0.0;
+    double fps = 0.0;
+    uint32_t drawCalls = 0;             // per frame
+    uint64_t trianglesPerFrame = 0;
+    uint32_t recordThreads = 0;         // 0 = recorded on the main thread
+    double recordMs = 0.0;              // time spent recording draws (static: once, dynamic: every re-record)
+    uint32_t rerecordCount = 0;         // dynamic recording: times a frame slot had to re-record its draws
+    double startupMs = 0.0;             // window + Vulkan initialisation, up to the first frame
+    double pipelineMs = 0.0;            // of which creating pipelines (what the pipeline cache saves)
+    PipelineCacheStats pipelineCache;
+    PipelineLibraryStats pipelines;
+    UploadStats upload;
+    GeometryStats geometry;
+    MeshLoadStats meshLoad;             // --mesh only
+    DescriptorStats descriptors;
+    TextureStats textures;
+    DrawSortStats drawSort;
+    CullStats culling;                  // --gpu-driven only
+    MemoryStats memory;                 // taken right before teardown
+    ProfileSummary profile;             // empty unless profiling is on
+};
 
 class HelloTriangleApp
 {
 public:
+    explicit HelloTriangleApp( const AppConfig& config = AppConfig{} );
     void Run();
 
+    const RunStats& GetRunStats() const { return _runStats; }
+
 private:
 // Main Method
     void InitVulkan();
@@ -55,6 +102,10 @@ private:
 // Surface
     void CreateSurface();
 
+// Headless (offscreen images instead of surface + swapchain)
+    void CreateOffscreenTargets();
+    void SaveFrame( const std::string& path );
+
 // Physical Device
     void PickPhysicalDevice();
     bool IsDeviceSuitable( VkPhysicalDevice physicalDevice );
@@ -67,36 +118,62 @@ private:
 
 // mesh
     void CreateMeshFromVerteces();
+    void CreateUploader();
+
+// per frame shader data (camera, object transforms)
+    void CreateFrameUniforms();     // after the meshes: one transform per mesh
+    void AnimateObjects( double seconds );  // --animate
+    void UpdateFrameUniforms( size_t frameSlot );   // after the slot's fence: memcpy into its slice
+
+// descriptors
+    void CreateDescriptors();       // layout cache, allocators, bindless table (before any pipeline layout)
+    void DestroyDescriptors();
+    void CmdBindFrameResources( VkCommandBuffer commandBuffer, size_t frameSlot ) const;   // sets + the slot's bindless indices
+    DescriptorStats GetDescriptorStats() const;
+
+// textures
+    void CreateTextures();          // after the frame uniforms: streamer, a texture per mesh, descriptors per frame slot
+    void UpdateTextures( size_t frameSlot );    // after the slot's fence: requests, residency, the slot's descriptors
+    void AllocateTextureSets( size_t frameSlot );  // without --bindless: the slot's sets, fresh from its allocator
+    ObjectPushConstants GetObjectPushConstants( size_t frameSlot, uint32_t objectIndex, uint32_t texture, const glm::vec4& bounds ) const;
 
 // Swapchain
     SwapchainSupportDetails QuerySwapchainSupport( VkPhysicalDevice physicalDevice );
     VkExtent2D ChooseSwapchainExtent2D( const VkSurfaceCapabilitiesKHR& capabilities );
     VkSurfaceFormatKHR ChooseSwapchainFormat( const std::vector<VkSurfaceFormatKHR>& avaliableFormats );
     VkPresentModeKHR ChooseSwapchainPresentMode( const std::vector<VkPresentModeKHR>& availablePresentModes );
-    void CreateSwapchain();
+    void CreateSwapchain( VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE );
     void CreateImageViews();
+    void RecreateSwapchain();
+    void DestroyRetired( bool all );     // retired swapchains and command buffers; all: only once the device is idle
+
+// depth buffer
+    VkFormat ChooseDepthFormat( bool sampled );     // sampled: the Hi-Z build reads it (--occlusion-cull)
+    void CreateDepthResources();    // after the image views: the swapchain extent
+    static void FramebufferResizeCallback( GLFWwindow* window, int width, int height );
+    static void KeyCallback( GLFWwindow* window, int key, int scancode, int action, int mods );
 
 // Shader and Graphics Pipeline
     void CreateRenderPass();
     void CreateGraphicsPipeline();
-    static std::vector<char> ReadFile( const std::string& filename );
-    VkShaderModule CreateShaderModule( const std::vector<char>& code );
-    VkPipelineVertexInputStateCreateInfo GetVertexInput(
-        VkVertexInputBindingDescription& bindDesc, 
-        std::vector<VkVertexInputAttributeDescription>& attDesc
-        );
-    VkVertexInputBindingDescription GetBindingDescription();
-    std::vector<VkVertexInputAttributeDescription> GetAttributeDescription();
+    GraphicsPipelineDesc GetPipelineDesc();     // the current permutation, from the Get* helpers below
+    static GraphicsPipelineDesc GetPrepassDesc( const GraphicsPipelineDesc& desc );    // --depth-prepass: its depth-only twin
+    void UpdateGraphicsPipeline();      // per frame: switch to _pipelineDesc once the library has it
+    void ApplyShaderReloads();          // per frame: hot reloaded SPIR-V goes into _pipelineDesc
+    static std::shared_ptr<const MappedFile> ReadFile( const std::string& filename );    // mapped, not copied
+    std::vector<VkVertexInputBindingDescription> GetBindingDescription( VertexFormat format );
+    std::vector<VkVertexInputAttributeDescription> GetAttributeDescription( VertexFormat format );
     VkPipelineInputAssemblyStateCreateInfo GetInputAssembly();
-    VkPipelineViewportStateCreateInfo GetViewPortScissors( VkViewport& viewport, VkRect2D& scissor );
     VkPipelineRasterizationStateCreateInfo GetRasterizer();
     VkPipelineMultisampleStateCreateInfo GetMultisampling();
+    VkPipelineDepthStencilStateCreateInfo GetDepthStencil();
     VkPipelineColorBlendStateCreateInfo GetColorblending( VkPipelineColorBlendAttachmentState& attachment );
     VkPipelineLayoutCreateInfo GetPipelineLayout();
 
     // Getter Function for Fixed Function in Graphics Pipeline
     VkViewport GetViewport() const;
     VkRect2D GetScissor() const;
+    void SetViewportScissor( VkCommandBuffer commandBuffer ) const;
     VkPipelineColorBlendAttachmentState GetColorBlendAttachment() const;
 
 
@@ -104,15 +181,34 @@ private:
     void CreateFramebuffers();
     void CreateCommandPool();
     void CreateCommandBuffers();
+    void RecordFrameSlotCommandBuffers( size_t frameSlot );    // static mode: the slot's primaries (one per image) and their secondaries
+    void RecordPrimary( VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags usage, size_t imageIndex, size_t frameSlot,
+                        uint32_t querySlot, const VkCommandBuffer* pSecondaries, size_t secondaryCount );
+    void RecordSlice( VkCommandBuffer commandBuffer, VkCommandBufferUsageFlags usage, VkFramebuffer framebuffer,
+                        size_t frameSlot, size_t slice, size_t sliceCount, bool depthOnly );
+    void RecordDraws( VkCommandBuffer commandBuffer, size_t frameSlot, size_t firstDraw, size_t lastDraw, bool depthOnly );   // of _drawOrder
+    size_t GetDrawPassCount() const { return _config.depthPrepass ? 2 : 1; }    // the draws are recorded once per pass
+    void SortDraws();   // before recording the draws: _drawOrder front to back, by texture where depth ties
+
+// per frame recording (dynamic scenes)
+    void CreateFrameCommands();
+    void DestroyFrameCommands();
+    VkCommandBuffer RecordFrame( size_t frameSlot, uint32_t imageIndex );
+    void MarkSceneDirty() { ++_sceneVersion; }     // call after anything the draws depend on changes
+    void RetireCommandBuffers();        // static mode: every command buffer, to be recorded again
+    void InvalidateCommandBuffers();    // what they bind changed: dynamic re-records, static ones are retired and recorded again
+    void InvalidateFrameSlotCommandBuffers( size_t frameSlot );    // ... only for what the slot's command buffers bind
 
 
 // rendering and presentation
-    void DrawFrame();
+    bool DrawFrame();   // false: no frame was submitted
+    void PollFrameLatency();    // the latency of every submitted frame whose fence has signalled since the last call
     void CreateSyncObjects();
 
 // Eextensions
     std::vector<const char*> GetRequiredExtensions();
     bool CheckDeviceExtensionSupport( VkPhysicalDevice physicalDevice );
+    static bool IsDeviceExtensionAvailable( VkPhysicalDevice physicalDevice, const char* name );
 
 
 // Populate Method
@@ -126,46 +222,185 @@ private:
 public:
     static constexpr int ScreenWidth = 800;
     static constexpr int ScreenHeight = 600;
-    static constexpr int MaxFrameInFlight = 2;
+    static constexpr const char* VertexShaderPath = "shaders/vert.spv";
+    static constexpr const char* BindlessVertexShaderPath = "shaders/bindless_vert.spv";    // --bindless
+    static constexpr const char* FragmentShaderPath = "shaders/frag.spv";
+    static constexpr const char* BindlessFragmentShaderPath = "shaders/bindless_frag.spv";    // --bindless
+private:
+    const char* GetVertexShaderPath() const { return _bindlessEnabled ? BindlessVertexShaderPath : VertexShaderPath; }
+    const char* GetFragmentShaderPath() const { return _bindlessEnabled ? BindlessFragmentShaderPath : FragmentShaderPath; }
+
+    size_t currentFrame = 0;   // this variable is for keep tracking the frame in flight (0 .. _config.framesInFlight-1)
+
 private:
-    size_t currentFrame = 0;   // this variable is for keep tracking the frame in flight
+    AppConfig _config;
+    bool _enableValidation = true;
+    RunStats _runStats;
 
 private:
     GLFWwindow* _window = nullptr;
     VkInstance _instance;
-    VkDebugUtilsMessengerEXT _debugMessenger;
+    VkDebugUtilsMessengerEXT _debugMessenger = VK_NULL_HANDLE;
     VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
     VkDevice _device;
 
+    // device memory (sub-allocated blocks)
+    MemoryAllocator _allocator;
+
+    // pipelines are created through it; persisted across runs (--pipeline-cache)
+    PipelineCache _pipelineCache;
+
+    // descriptors: layouts shared through the cache, persistent sets from _descriptorAllocator, the texture
+    // sets of a frame slot from the slot's allocator (reset and allocated again when one of them changes)
+    DescriptorLayoutCache _descriptorLayouts;
+    DescriptorAllocator _descriptorAllocator;
+    std::vector<DescriptorAllocator> _frameDescriptors;     // per frame slot
+    std::vector<VkDescriptorSetLayout> _pipelineSetLayouts;     // what GetPipelineLayout points at
+
+    // bindless (--bindless, VK_EXT_descriptor_indexing): set 1 of the graphics pipeline
+    BindlessTable _bindless;
+    BindlessTable::Support _bindlessSupport;        // its features are chained into the device create info
+    bool _bindlessEnabled = false;
+    std::vector<uint32_t> _frameObjectBuffers;      // per frame slot: bindless slot of its object transforms
+
+    // textures (--texture), mip levels streamed under --texture-budget-mb. A descriptor per texture and frame slot
+    // (set 1, or a bindless slot), replaced after the slot's fence when the texture's residency changed
+    TextureStreamer _textureStreamer;
+    uint32_t _whiteTexture = 0;                     // meshes without a texture
+    std::vector<uint32_t> _meshTextures;            // per mesh
+    VkDescriptorSetLayout _textureSetLayout = VK_NULL_HANDLE;   // set 1 without --bindless (owned by the layout cache)
+    std::vector<VkDescriptorSet> _textureSets;      // [texture * framesInFlight + frame slot], without --bindless
+    std::vector<uint32_t> _bindlessTextures;        // [texture * framesInFlight + frame slot], --bindless
+    std::vector<uint64_t> _textureDescriptorVersions;   // [texture * framesInFlight + frame slot]: view version written
+
+    // staging ring (all buffer uploads go through it)
+    StagingUploader _uploader;
+
+    // frame timings (CPU phases + GPU timestamps)
+    Profiler _profiler;
+    std::vector<uint32_t> _frameQuerySlot;      // per frame slot: timestamp slot of its last submission (UINT32_MAX = none)
+
+    // frame pacing (--target-frame-ms) and latency: when each slot's last frame sampled its input,
+    // and whether its fence is still to be seen signalled
+    FramePacer _framePacer;
+    std::vector<std::chrono::steady_clock::time_point> _frameInputTime;
+    std::vector<bool> _frameLatencyPending;
+
     // mesh
     std::vector<Vertex> _vertices;
     std::vector<uint32_t> _indices;
-    Mesh _vertexMesh;
-    Mesh _indexMesh;
+    GeometryPool _geometryPool;     // every mesh's vertices and indices live in its pages
+    std::vector<Mesh> _meshes;
+    std::vector<glm::vec4> _meshBounds;     // per mesh: bounding sphere (texture coordinates, size on screen)
+
+    // per frame camera + object transforms (set 0), a slice per frame slot; draws push their mesh index
+    FrameUniforms _frameUniforms;
+    glm::mat4 _viewProjection{ 1.0f };
+    std::vector<glm::mat4> _objectTransforms;       // per mesh, what the next frames will use
+    uint64_t _transformsVersion = 0;                // bumped whenever _objectTransforms changes
+    std::vector<uint64_t> _sliceTransformsVersion;  // per frame slot: the version its slice holds
+    std::chrono::steady_clock::time_point _animationStart;
+
+    // GPU-driven path (--gpu-driven): culling + indirect draws
+    GpuCuller _culler;
+    HiZPyramid _hiZ;        // --occlusion-cull: built from the depth buffer at the end of every frame
+    bool _drawIndirectCountEnabled = false;     // VK_KHR_draw_indirect_count
+    bool _multiDrawIndirectEnabled = false;
+    bool _drawIndirectFirstInstanceEnabled = false;
 
     // queue
     VkQueue _graphicsQueue;
     VkQueue _presentQueue;
+    VkQueue _transferQueue;     // may be the graphics queue
 
     // presentation
-    VkSurfaceKHR _surface;
+    VkSurfaceKHR _surface = VK_NULL_HANDLE;     // stays null in headless mode
 
     // swapchain
-    VkSwapchainKHR _swapchain;
-    std::vector<VkImage> _swapchainImages;  // swapchain image
+    VkSwapchainKHR _swapchain = VK_NULL_HANDLE;     // stays null in headless mode
+    std::vector<VkImage> _swapchainImages;  // swapchain image (offscreen images in headless mode)
+    std::vector<Allocation> _offscreenAllocations;  // headless only
+    uint32_t _lastImageIndex = 0;   // image the last submitted frame rendered into
     std::vector<VkImageView> _swapchainImageViews;   // swapchain image views
     VkFormat _swapchainImageFormat;     // swapchain format
     VkExtent2D _swapchainExtent;        // swapchain extent
 
+    // depth buffer, shared by every image: the render pass's external dependency orders the frames using it
+    VkFormat _depthFormat = VK_FORMAT_UNDEFINED;
+    VkImage _depthImage = VK_NULL_HANDLE;
+    Allocation _depthAllocation;
+    VkImageView _depthImageView = VK_NULL_HANDLE;
+
+    // swapchain recreation (resize / out-of-date / suboptimal)
+    bool _framebufferResized = false;   // set by the GLFW callback
+    bool _swapchainDirty = false;       // recreate before the next frame
+    uint64_t _submittedFrames = 0;
+    struct RetiredSwapchain
+    {
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+        std::vector<VkImageView> imageViews;
+        std::vector<VkFramebuffer> framebuffers;
+        VkImage depthImage = VK_NULL_HANDLE;
+        Allocation depthAllocation;
+        VkImageView depthImageView = VK_NULL_HANDLE;
+        HiZPyramid::Target hiZ;     // --occlusion-cull
+        uint64_t lastFrame = 0;     // _submittedFrames when retired: frames before it may use it
+    };
+    std::deque<RetiredSwapchain> _retiredSwapchains;
+    // static command buffers replaced (swapchain recreation, new pipeline, new descriptor sets) while
+    // frames in flight may still execute them
+    struct RetiredCommandBuffers
+    {
+        std::vector<VkCommandBuffer> commandBuffers;            // from _commandPool
+        std::vector<VkCommandBuffer> secondaryCommandBuffers;
+        std::vector<VkCommandPool> secondaryCommandPools;       // the pool of each secondary
+        uint64_t lastFrame = 0;     // _submittedFrames when retired: frames before it may use them
+    };
+    std::deque<RetiredCommandBuffers> _retiredCommandBuffers;
+
     // graphics pipeline section
     VkRenderPass _renderPass;   // render pass
     VkPipelineLayout _pipelineLayout;   // pipeline layout (see: fixed function)
-    VkPipeline _graphicsPipeline;   // graphics pipeline
+    VkPipeline _graphicsPipeline;   // graphics pipeline (owned by _pipelineLibrary)
+    VkPipeline _depthPrepassPipeline = VK_NULL_HANDLE;  // --depth-prepass: the same without fragment shader (owned by _pipelineLibrary)
+
+    // every pipeline permutation, keyed by its description; new ones compile in the background
+    PipelineLibrary _pipelineLibrary;
+    GraphicsPipelineDesc _pipelineDesc;     // wanted permutation
+    bool _pipelineDescChanged = false;      // _graphicsPipeline isn't _pipelineDesc's yet
+    bool _wireframe = false;                // W
+    bool _fillModeNonSolidEnabled = false;  // device feature, needed for wireframe
+    ShaderWatcher _shaderWatcher;           // --hot-reload
 
     // command buffer and frame buffer section
     std::vector<VkFramebuffer> _swapchainFramebuffers;
     VkCommandPool _commandPool;
-    std::vector<VkCommandBuffer> _commandBuffers;
+    std::vector<VkCommandBuffer> _commandBuffers;  // static recording: [image * framesInFlight + frame slot]
+
+    // parallel recording: each worker owns a command pool (pools are externally synchronized)
+    ThreadPool _recordThreadPool;
+    std::vector<VkCommandPool> _workerCommandPools;
+    std::vector<VkCommandBuffer> _secondaryCommandBuffers;     // [((image * framesInFlight + frame slot) * passCount + pass) * sliceCount + slice]
+    std::vector<VkCommandPool> _secondaryCommandPools;         // the worker pool each one came from
+
+    // dynamic recording: everything a frame slot records from, reset only after its fence
+    struct FrameCommands
+    {
+        VkCommandPool pool = VK_NULL_HANDLE;        // primary, reset every frame
+        VkCommandBuffer primary = VK_NULL_HANDLE;
+        std::vector<VkCommandPool> workerPools;     // secondaries, one pool per recording thread
+        std::vector<std::vector<VkCommandBuffer>> workerBuffers;    // allocated from workerPools[w], reused
+        std::vector<size_t> workerBufferUsed;       // per worker, during a re-record
+        std::vector<VkCommandBuffer> secondaries;   // per pass and slice, in execution order
+        uint64_t recordedSceneVersion = UINT64_MAX;
+    };
+    std::vector<FrameCommands> _frameCommands;
+    uint64_t _sceneVersion = 0;
+
+    // draw order of the recorded draws (mesh indices), sorted by DrawSorter keys unless --no-draw-sort
+    DrawSorter _drawSorter;
+    std::vector<uint64_t> _drawKeys;
+    std::vector<uint32_t> _drawOrder;
 
     // semaphores
     std::vector<VkSemaphore> _imageAvailableSemaphore;
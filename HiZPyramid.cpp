@@ -0,0 +1,334 @@
+#include "HiZPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "utilities.h"
+
+void HiZPyramid::Init( VkDevice device, MemoryAllocator& allocator, DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache,
+                        const MappedFile& shaderCode, uint32_t queueFamily, VkQueue queue )
+{
+    _device = device;
+    _allocator = &allocator;
+    _queue = queue;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    if( vkCreateCommandPool( _device, &poolInfo, nullptr, &_commandPool )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z command pool!" );
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if( vkAllocateCommandBuffers( _device, &allocInfo, &_commandBuffer )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to allocate Hi-Z command buffer!" );
+    }
+
+    // signalled: the first clear has nothing to wait for
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    if( vkCreateFence( _device, &fenceInfo, nullptr, &_fence )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z fence!" );
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if( vkCreateSampler( _device, &samplerInfo, nullptr, &_sampler )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z sampler!" );
+    }
+
+    CreatePipeline( layouts, pipelineCache, shaderCode );
+}
+
+void HiZPyramid::Destroy()
+{
+    DestroyTarget( _target );
+
+    vkDestroyPipeline( _device, _pipeline, nullptr );
+    vkDestroyPipelineLayout( _device, _pipelineLayout, nullptr );
+    vkDestroySampler( _device, _sampler, nullptr );
+    vkDestroyFence( _device, _fence, nullptr );
+    vkDestroyCommandPool( _device, _commandPool, nullptr );     // the clear command buffer too
+    _pipeline = VK_NULL_HANDLE;
+    _pipelineLayout = VK_NULL_HANDLE;
+    _sampler = VK_NULL_HANDLE;
+    _fence = VK_NULL_HANDLE;
+    _commandPool = VK_NULL_HANDLE;
+    _commandBuffer = VK_NULL_HANDLE;
+}
+
+HiZPyramid::Target HiZPyramid::Resize( VkExtent2D depthExtent, VkImageView depthView )
+{
+    Target old = _target;
+    _target = Target{};
+
+    Target& target = _target;
+    target.extent = { std::max<uint32_t>( 1, (depthExtent.width + 1) / 2 ), std::max<uint32_t>( 1, (depthExtent.height + 1) / 2 ) };
+    for( uint32_t size = std::max( target.extent.width, target.extent.height ); size > 0; size /= 2 )
+        ++target.levelCount;
+
+    Image::Create( _device, *_allocator, target.extent, Format,
+                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image, target.allocation, target.levelCount );
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = target.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = Format;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, target.levelCount, 0, 1 };
+    if( vkCreateImageView( _device, &viewInfo, nullptr, &target.view )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z image view!" );
+    }
+
+    target.levelViews.resize( target.levelCount, VK_NULL_HANDLE );
+    for( uint32_t level = 0; level < target.levelCount; ++level )
+    {
+        viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+        if( vkCreateImageView( _device, &viewInfo, nullptr, &target.levelViews[level] )
+            != VK_SUCCESS )
+        {
+            throw std::runtime_error( "Failed to create Hi-Z level view!" );
+        }
+    }
+
+    CreateDescriptorSets( target, depthView );
+    SubmitClear( target );
+    return old;
+}
+
+void HiZPyramid::DestroyTarget( Target& target )
+{
+    if( target.image == VK_NULL_HANDLE )
+        return;
+
+    vkDestroyDescriptorPool( _device, target.descriptorPool, nullptr );     // the sets go with it
+    for( auto& levelView : target.levelViews )
+        vkDestroyImageView( _device, levelView, nullptr );
+    vkDestroyImageView( _device, target.view, nullptr );
+    Image::Destroy( _device, *_allocator, target.image, target.allocation );
+    target = Target{};
+}
+
+void HiZPyramid::CmdBuild( VkCommandBuffer commandBuffer ) const
+{
+    if( _target.image == VK_NULL_HANDLE )
+        return;
+
+    // the previous build may still write the levels, this frame's cull (and the previous one's) read them;
+    // the depth buffer is made visible by the render pass's dependency to VK_SUBPASS_EXTERNAL
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            0, 1, &barrier, 0, nullptr, 0, nullptr );
+
+    vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline );
+
+    // each level reads the one before: a barrier between every dispatch; the last one also covers the next frame's cull
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    for( uint32_t level = 0; level < _target.levelCount; ++level )
+    {
+        const uint32_t width = std::max<uint32_t>( 1, _target.extent.width >> level );
+        const uint32_t height = std::max<uint32_t>( 1, _target.extent.height >> level );
+
+        vkCmdBindDescriptorSets( commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_target.reduceSets[level], 0, nullptr );
+        vkCmdDispatch( commandBuffer, (width + WorkgroupSize - 1) / WorkgroupSize, (height + WorkgroupSize - 1) / WorkgroupSize, 1 );
+        vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                0, 1, &barrier, 0, nullptr, 0, nullptr );
+    }
+}
+
+void HiZPyramid::CreatePipeline( DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const MappedFile& shaderCode )
+{
+    // reduce: binding 0 the source (depth buffer or level above), binding 1 the level written
+    std::vector<VkDescriptorSetLayoutBinding> bindings( 2 );
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    _reduceLayout = layouts.Get( bindings );
+
+    // read: the whole pyramid, for the cull
+    bindings.resize( 1 );
+    _readLayout = layouts.Get( bindings );
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &_reduceLayout;
+    if( vkCreatePipelineLayout( _device, &layoutInfo, nullptr, &_pipelineLayout )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z pipeline layout!" );
+    }
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = shaderCode.Size();
+    moduleInfo.pCode = shaderCode.Spirv();
+    VkShaderModule shaderModule;
+    if( vkCreateShaderModule( _device, &moduleInfo, nullptr, &shaderModule )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z shader module!" );
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _pipelineLayout;
+
+    const VkResult result = vkCreateComputePipelines( _device, pipelineCache, 1, &pipelineInfo, nullptr, &_pipeline );
+    vkDestroyShaderModule( _device, shaderModule, nullptr );
+    if( result != VK_SUCCESS )
+        throw std::runtime_error( "Failed to create Hi-Z pipeline!" );
+}
+
+void HiZPyramid::CreateDescriptorSets( Target& target, VkImageView depthView )
+{
+    // a pool of its own, sized for exactly this target's sets: it goes (with them) when the target does
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, target.levelCount + 1 };
+    poolSizes[1] = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, target.levelCount };
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = target.levelCount + 1;
+    poolInfo.poolSizeCount = static_cast<uint32_t>( poolSizes.size() );
+    poolInfo.pPoolSizes = poolSizes.data();
+    if( vkCreateDescriptorPool( _device, &poolInfo, nullptr, &target.descriptorPool )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create Hi-Z descriptor pool!" );
+    }
+
+    std::vector<VkDescriptorSetLayout> setLayouts( target.levelCount, _reduceLayout );
+    setLayouts.push_back( _readLayout );
+    std::vector<VkDescriptorSet> sets( setLayouts.size() );
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = target.descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>( sets.size() );
+    allocInfo.pSetLayouts = setLayouts.data();
+    if( vkAllocateDescriptorSets( _device, &allocInfo, sets.data() )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to allocate Hi-Z descriptor sets!" );
+    }
+    target.reduceSets.assign( sets.begin(), sets.end() - 1 );
+    target.readSet = sets.back();
+
+    // two image infos per level (source, destination) + the read set's
+    std::vector<VkDescriptorImageInfo> imageInfos( target.levelCount * 2 + 1 );
+    std::vector<VkWriteDescriptorSet> writes( imageInfos.size() );
+    for( uint32_t level = 0; level < target.levelCount; ++level )
+    {
+        VkDescriptorImageInfo& source = imageInfos[level * 2];
+        source.sampler = _sampler;
+        source.imageView = level == 0 ? depthView : target.levelViews[level - 1];
+        source.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo& destination = imageInfos[level * 2 + 1];
+        destination.imageView = target.levelViews[level];
+        destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    imageInfos.back() = { _sampler, target.view, VK_IMAGE_LAYOUT_GENERAL };
+
+    for( size_t i = 0; i < writes.size(); ++i )
+    {
+        const bool read = i + 1 == writes.size();
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = read ? target.readSet : target.reduceSets[i / 2];
+        writes[i].dstBinding = read ? 0 : static_cast<uint32_t>( i % 2 );
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = !read && i % 2 == 1 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[i].pImageInfo = &imageInfos[i];
+    }
+    vkUpdateDescriptorSets( _device, static_cast<uint32_t>( writes.size() ), writes.data(), 0, nullptr );
+}
+
+void HiZPyramid::SubmitClear( const Target& target )
+{
+    // the clear of the previous resize may still be pending: its command buffer is reused (begin resets it)
+    vkWaitForFences( _device, 1, &_fence, VK_TRUE, UINT64_MAX );
+    vkResetFences( _device, 1, &_fence );
+
+    VkCommandBuffer commandBuffer = _commandBuffer;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer( commandBuffer, &beginInfo );
+
+    // into GENERAL for good, every level at the far plane
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = target.image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, target.levelCount, 0, 1 };
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+    VkClearColorValue far{};
+    far.float32[0] = 1.0f;
+    vkCmdClearColorImage( commandBuffer, target.image, VK_IMAGE_LAYOUT_GENERAL, &far, 1, &barrier.subresourceRange );
+
+    // the frames are submitted to the same queue after this: the cull reads, the build overwrites
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+    vkEndCommandBuffer( commandBuffer );
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if( vkQueueSubmit( _queue, 1, &submitInfo, _fence )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to submit Hi-Z clear!" );
+    }
+}
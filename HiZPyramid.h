@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "MappedFile.h"
+#include "MemoryAllocator.h"
+
+// Hierarchical-Z: a mip chain of the depth buffer where every texel holds the farthest depth under it.
+// Level 0 is half the depth buffer (rounded up), each level half the one before (rounded down), to 1x1; one compute
+// dispatch per level (shaders/hiz.comp) reads the level above (the depth buffer for level 0).
+// Built at the end of a frame, it is what the next frame's cull (GpuCuller with occlusion) tests against:
+// an object whose nearest depth is behind the farthest depth of the texels covering it was hidden last frame.
+//
+// The pyramid stays in VK_IMAGE_LAYOUT_GENERAL (written as a storage image, sampled by the cull),
+// the depth buffer has to be in SHADER_READ_ONLY_OPTIMAL when CmdBuild runs (the render pass's final layout).
+class HiZPyramid
+{
+public:
+    // what belongs to one depth buffer size; replaced (not destroyed) on a resize
+    struct Target
+    {
+        VkImage image = VK_NULL_HANDLE;
+        Allocation allocation{};
+        VkImageView view = VK_NULL_HANDLE;              // every level: what the cull samples
+        std::vector<VkImageView> levelViews;            // one level each: written by its dispatch, read by the next
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> reduceSets;        // per level: source + destination
+        VkDescriptorSet readSet = VK_NULL_HANDLE;
+        VkExtent2D extent{};                            // level 0
+        uint32_t levelCount = 0;
+    };
+
+    // the set layouts come from layouts; the initial clear of a new pyramid is submitted to queue
+    void Init( VkDevice device, MemoryAllocator& allocator, DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache,
+                const MappedFile& shaderCode, uint32_t queueFamily, VkQueue queue );
+    // the device has to be idle
+    void Destroy();
+
+    // a pyramid for a depth buffer of depthExtent (sampled through depthView), cleared to the far plane (nothing
+    // is occluded before the first build); returns the one it replaces, for DestroyTarget once no frame uses it
+    Target Resize( VkExtent2D depthExtent, VkImageView depthView );
+    void DestroyTarget( Target& target );
+
+    // outside a render pass, after the depth buffer is written: every level, made visible to later compute reads
+    void CmdBuild( VkCommandBuffer commandBuffer ) const;
+
+    // set 2 of the cull pipeline: binding 0, the whole pyramid (combined image sampler, compute)
+    VkDescriptorSetLayout GetReadLayout() const { return _readLayout; }
+    VkDescriptorSet GetReadSet() const { return _target.readSet; }
+    uint32_t GetLevelCount() const { return _target.levelCount; }
+
+public:
+    static constexpr uint32_t WorkgroupSize = 8;    // local_size_x / local_size_y in hiz.comp
+    static constexpr VkFormat Format = VK_FORMAT_R32_SFLOAT;    // storage image support is mandatory
+
+private:
+    void CreatePipeline( DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const MappedFile& shaderCode );
+    void CreateDescriptorSets( Target& target, VkImageView depthView );
+    void SubmitClear( const Target& target );
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    MemoryAllocator* _allocator = nullptr;
+    VkQueue _queue = VK_NULL_HANDLE;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer _commandBuffer = VK_NULL_HANDLE;    // the clear of a new pyramid
+    VkFence _fence = VK_NULL_HANDLE;                    // ... and its last submission
+    VkSampler _sampler = VK_NULL_HANDLE;    // nearest, clamped: the shaders only texelFetch
+
+    VkDescriptorSetLayout _reduceLayout = VK_NULL_HANDLE;   // owned by the layout cache
+    VkDescriptorSetLayout _readLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+
+    Target _target;
+};
@@ -0,0 +1,85 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace
+{
+    // madvise works on whole pages
+    void AdviseRange( const char* data, size_t fileSize, size_t offset, size_t size, int advice )
+    {
+        if( data == nullptr || offset >= fileSize )
+            return;
+
+        const size_t pageSize = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+        const size_t end = std::min( offset + size, fileSize );
+        const size_t begin = offset - offset % pageSize;
+        madvise( const_cast<char*>( data ) + begin, end - begin, advice );
+    }
+}
+
+MappedFile::MappedFile( const std::string& path )
+    : _path( path )
+{
+    const int fd = open( _path.c_str(), O_RDONLY | O_CLOEXEC );
+    if( fd < 0 )
+        throw std::runtime_error( "Failed to open " + _path + "!" );
+
+    struct stat info{};
+    if( fstat( fd, &info ) != 0 )
+    {
+        close( fd );
+        throw std::runtime_error( "Failed to stat " + _path + "!" );
+    }
+
+    _size = static_cast<size_t>( info.st_size );
+    if( _size > 0 )
+    {
+        void* mapping = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( mapping == MAP_FAILED )
+        {
+            close( fd );
+            throw std::runtime_error( "Failed to map " + _path + "!" );
+        }
+        _data = static_cast<const char*>( mapping );
+    }
+
+    close( fd );    // the mapping keeps the file alive
+}
+
+MappedFile::~MappedFile()
+{
+    if( _data != nullptr )
+        munmap( const_cast<char*>( _data ), _size );
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open( const std::string& path )
+{
+    return std::make_shared<const MappedFile>( path );
+}
+
+const uint32_t* MappedFile::Spirv() const
+{
+    if( _size == 0 || _size % sizeof(uint32_t) != 0 )
+        throw std::runtime_error( _path + " is not SPIR-V (size)!" );
+
+    const uint32_t* words = View<uint32_t>( 0, _size / sizeof(uint32_t) );
+    if( words[0] != MappedFile::SpirvMagic )
+        throw std::runtime_error( _path + " is not SPIR-V (magic number)!" );
+    return words;
+}
+
+void MappedFile::Prefetch( size_t offset, size_t size ) const
+{
+    AdviseRange( _data, _size, offset, size, MADV_WILLNEED );
+}
+
+void MappedFile::Evict( size_t offset, size_t size ) const
+{
+    // read-only private pages: dropping them only means re-reading from the page cache if touched again
+    AdviseRange( _data, _size, offset, size, MADV_DONTNEED );
+}
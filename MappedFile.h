@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// Read-only memory mapping of a whole file (mmap).
+// The bytes are used where they are: shader modules take pCode straight from the mapping and
+// uploads memcpy from it into the staging ring, so no heap copy of the file is ever made.
+//
+// Mapped MAP_PRIVATE from the inode that was opened: replacing the file through a rename
+// (the shader hot reload, editors) leaves an existing mapping intact.
+class MappedFile
+{
+public:
+    // throws std::runtime_error when the file can't be opened or mapped
+    explicit MappedFile( const std::string& path );
+    ~MappedFile();
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    // shared, so descriptions holding shader code copy a pointer instead of the code
+    static std::shared_ptr<const MappedFile> Open( const std::string& path );
+
+    const char* Data() const { return _data; }
+    size_t Size() const { return _size; }
+    const std::string& GetPath() const { return _path; }
+
+    // count T's at offset; throws when the range is out of the file or not aligned for T
+    // (a page aligned mapping only keeps offsets that are multiples of alignof(T) aligned)
+    template<typename T>
+    const T* View( size_t offset, size_t count ) const
+    {
+        if( offset > _size || count > (_size - offset) / sizeof(T) )
+            throw std::runtime_error( "Read past the end of " + _path + "!" );
+        if( (reinterpret_cast<uintptr_t>( _data ) + offset) % alignof(T) != 0 )
+            throw std::runtime_error( "Misaligned data in " + _path + "!" );
+        return reinterpret_cast<const T*>( _data + offset );
+    }
+
+    // the words of a SPIR-V module (VkShaderModuleCreateInfo::pCode, codeSize = Size());
+    // throws when the size isn't a multiple of 4 or the magic number is missing
+    const uint32_t* Spirv() const;
+
+    // page cache hints for streaming: read a range ahead / let go of a range already consumed
+    void Prefetch( size_t offset, size_t size ) const;
+    void Evict( size_t offset, size_t size ) const;
+
+public:
+    static constexpr uint32_t SpirvMagic = 0x07230203;
+
+private:
+    std::string _path;
+    const char* _data = nullptr;    // null for an empty file
+    size_t _size = 0;
+};
@@ -0,0 +1,227 @@
+#include "MemoryAllocator.h"
+
+#include <stdexcept>
+
+#include "utilities.h"
+
+void MemoryAllocator::Init( VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize )
+{
+    _device = device;
+    _blockSize = blockSize;
+
+    vkGetPhysicalDeviceMemoryProperties( physicalDevice, &_memProps );
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+    _maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+}
+
+void MemoryAllocator::Destroy()
+{
+    for( auto& block : _blocks )
+    {
+        if( block.memory != VK_NULL_HANDLE )
+            FreeDeviceMemory( block.memory, block.mapped );
+    }
+    _blocks.clear();
+    _freeBlockSlots.clear();
+    _pools.clear();
+
+    // dedicated allocations are owned by their buffers and must have been freed already
+}
+
+Allocation MemoryAllocator::Allocate( const VkMemoryRequirements& memReq, VkMemoryPropertyFlags memPropFlags,
+                                        ResourceKind kind )
+{
+    int32_t memoryType = Buffer::FindProperties( &_memProps, memReq.memoryTypeBits, memPropFlags );
+    if( memoryType < 0 )
+        throw std::runtime_error( "Failed to find suitable memory type!" );
+
+    Allocation allocation{};
+    allocation.memoryType = static_cast<uint32_t>( memoryType );
+    allocation.size = memReq.size;
+
+    // big requests would waste most of a block, so they get their own memory
+    if( memReq.size > _blockSize / 2 )
+    {
+        allocation.memory = AllocateDeviceMemory( memReq.size, allocation.memoryType, &allocation.mapped );
+        ++_dedicatedCount;
+        _dedicatedBytes += memReq.size;
+        return allocation;
+    }
+
+    Pool& pool = GetPool( allocation.memoryType, kind );
+    VkDeviceSize poolOffset = 0;
+    if( !pool.ranges.Allocate( memReq.size, memReq.alignment, poolOffset ) )
+    {
+        CreateBlock( allocation.memoryType, kind, memReq.size );
+        if( !pool.ranges.Allocate( memReq.size, memReq.alignment, poolOffset ) )
+            throw std::runtime_error( "Failed to sub-allocate from a fresh memory block!" );
+    }
+    allocation.blockIndex = static_cast<uint32_t>( poolOffset / BlockStride );
+    allocation.offset = poolOffset % BlockStride;
+
+    Block& block = _blocks[allocation.blockIndex];
+    ++block.allocationCount;
+    allocation.memory = block.memory;
+    if( block.mapped != nullptr )
+        allocation.mapped = static_cast<char*>( block.mapped ) + allocation.offset;
+
+    return allocation;
+}
+
+void MemoryAllocator::Free( Allocation& allocation )
+{
+    if( allocation.memory == VK_NULL_HANDLE )
+        return;
+
+    if( allocation.blockIndex == UINT32_MAX )
+    {
+        FreeDeviceMemory( allocation.memory, allocation.mapped );
+        --_dedicatedCount;
+        _dedicatedBytes -= allocation.size;
+        allocation = Allocation{};
+        return;
+    }
+
+    const uint32_t blockIndex = allocation.blockIndex;
+    Block& block = _blocks[blockIndex];
+    Pool& pool = GetPool( block.memoryType, block.kind );
+    pool.ranges.Free( blockIndex * BlockStride + allocation.offset, allocation.size );
+    --block.allocationCount;
+
+    // give an empty block back to the driver, but keep at least one block per memory type around
+    // so a create/destroy loop doesn't end up calling vkAllocateMemory every time
+    if( block.allocationCount == 0 && pool.blockCount > 1 )
+    {
+        // all of it is free, so it is a single range again
+        if( !pool.ranges.RemoveRange( blockIndex * BlockStride, block.size ) )
+            throw std::runtime_error( "Failed to release an empty memory block!" );
+
+        FreeDeviceMemory( block.memory, block.mapped );
+        block = Block{};
+        --pool.blockCount;
+        _freeBlockSlots.push_back( blockIndex );
+    }
+
+    allocation = Allocation{};
+}
+
+MemoryStats MemoryAllocator::GetStats() const
+{
+    MemoryStats stats{};
+    stats.dedicatedCount = _dedicatedCount;
+    stats.allocationCount = _dedicatedCount;
+    stats.bytesReserved = _dedicatedBytes;
+    stats.bytesUsed = _dedicatedBytes;
+
+    for( const auto& block : _blocks )
+        stats.allocationCount += block.allocationCount;
+
+    for( const auto& entry : _pools )
+    {
+        const Pool& pool = entry.second;
+        stats.blockCount += pool.blockCount;
+        stats.bytesReserved += pool.ranges.GetCapacity();
+        stats.bytesUsed += pool.ranges.GetUsed();
+        stats.freeRangeCount += pool.ranges.GetFreeRangeCount();
+
+        VkDeviceSize largest = pool.ranges.GetLargestFreeRange();
+        if( largest > stats.largestFreeRange )
+            stats.largestFreeRange = largest;
+    }
+
+    return stats;
+}
+
+VkDeviceMemory MemoryAllocator::AllocateDeviceMemory( VkDeviceSize size, uint32_t memoryType, void** ppMapped )
+{
+    if( _maxAllocationCount > 0 && _deviceAllocationCount >= _maxAllocationCount )
+        throw std::runtime_error( "Failed to allocate memory: maxMemoryAllocationCount reached!" );
+
+    VkMemoryAllocateInfo allocateInfo{};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = size;
+    allocateInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory;
+    if( vkAllocateMemory( _device, &allocateInfo, nullptr, &memory )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to allocate device memory block!" );
+    }
+    ++_deviceAllocationCount;
+
+    // persistent mapping: map once here instead of map/unmap around every copy
+    *ppMapped = nullptr;
+    if( _memProps.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT )
+    {
+        if( vkMapMemory( _device, memory, 0, VK_WHOLE_SIZE, 0, ppMapped )
+            != VK_SUCCESS )
+        {
+            throw std::runtime_error( "Failed to map device memory block!" );
+        }
+    }
+
+    return memory;
+}
+
+void MemoryAllocator::FreeDeviceMemory( VkDeviceMemory memory, void* mapped )
+{
+    if( mapped != nullptr )
+        vkUnmapMemory( _device, memory );
+
+    vkFreeMemory( _device, memory, nullptr );
+    --_deviceAllocationCount;
+}
+
+uint32_t MemoryAllocator::CreateBlock( uint32_t memoryType, ResourceKind kind, VkDeviceSize minSize )
+{
+    // small heaps (e.g. 256MB BAR memory) shouldn't be eaten by a single block
+    VkDeviceSize blockSize = _blockSize;
+    const VkDeviceSize heapSize = _memProps.memoryHeaps[_memProps.memoryTypes[memoryType].heapIndex].size;
+    if( heapSize / 8 < blockSize )
+        blockSize = heapSize / 8;
+    if( blockSize < minSize )
+        blockSize = minSize;
+
+    Block block{};
+    block.memoryType = memoryType;
+    block.kind = kind;
+    block.size = blockSize;
+    block.memory = AllocateDeviceMemory( blockSize, memoryType, &block.mapped );
+
+    // re-use the slot of a block that was given back earlier
+    uint32_t blockIndex;
+    if( !_freeBlockSlots.empty() )
+    {
+        blockIndex = _freeBlockSlots.back();
+        _freeBlockSlots.pop_back();
+        _blocks[blockIndex] = block;
+    }
+    else
+    {
+        blockIndex = static_cast<uint32_t>( _blocks.size() );
+        _blocks.push_back( block );
+    }
+
+    Pool& pool = GetPool( memoryType, kind );
+    pool.ranges.AddRange( blockIndex * BlockStride, blockSize );
+    ++pool.blockCount;
+    return blockIndex;
+}
+
+MemoryAllocator::Pool& MemoryAllocator::GetPool( uint32_t memoryType, ResourceKind kind )
+{
+    return _pools[memoryType * 2 + static_cast<uint32_t>( kind )];
+}
+
+std::ostream& operator<<( std::ostream& os, const MemoryStats& stats )
+{
+    os << "memory: " << stats.allocationCount << " allocations in "
+       << stats.blockCount << " blocks + " << stats.dedicatedCount << " dedicated, "
+       << stats.bytesUsed / 1024 << " KiB used / " << stats.bytesReserved / 1024 << " KiB reserved, "
+       << stats.freeRangeCount << " free ranges (largest " << stats.largestFreeRange / 1024 << " KiB), "
+       << "fragmentation " << stats.Fragmentation();
+    return os;
+}
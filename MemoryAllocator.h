@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "RangeAllocator.h"
+
+// a sub-range of one VkDeviceMemory block
+struct Allocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryType = 0;
+    uint32_t blockIndex = UINT32_MAX;   // UINT32_MAX: dedicated allocation (too big for a block)
+    void* mapped = nullptr;             // host-visible memory stays mapped for the whole block lifetime
+};
+
+struct MemoryStats
+{
+    uint32_t blockCount = 0;            // vkAllocateMemory calls that back the sub-allocations
+    uint32_t dedicatedCount = 0;        // vkAllocateMemory calls for oversized requests
+    uint32_t allocationCount = 0;       // live sub-allocations handed out
+    VkDeviceSize bytesReserved = 0;     // memory taken from the driver
+    VkDeviceSize bytesUsed = 0;         // memory handed out to buffers
+    VkDeviceSize largestFreeRange = 0;
+    size_t freeRangeCount = 0;
+
+    // 0 = all free memory is one range, close to 1 = free memory is scattered in small holes
+    float Fragmentation() const
+    {
+        const VkDeviceSize bytesFree = bytesReserved - bytesUsed;
+        return bytesFree == 0 ? 0.0f : 1.0f - float(largestFreeRange) / float(bytesFree);
+    }
+};
+
+std::ostream& operator<<( std::ostream& os, const MemoryStats& stats );
+
+// buffers and optimal-tiling images never share a block, so bufferImageGranularity never applies
+enum class ResourceKind
+{
+    Buffer,
+    Image
+};
+
+
+// Grabs big VkDeviceMemory blocks per memory type and hands out aligned sub-ranges of them,
+// so creating a buffer (or image) costs a free-list lookup instead of a vkAllocateMemory call.
+// All blocks of a memory type and resource kind share one RangeAllocator: block i owns
+// [i * BlockStride, i * BlockStride + size) of it, so one lookup searches every block at once.
+class MemoryAllocator
+{
+public:
+    void Init( VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DefaultBlockSize );
+    void Destroy();
+
+    Allocation Allocate( const VkMemoryRequirements& memReq, VkMemoryPropertyFlags memPropFlags,
+                            ResourceKind kind = ResourceKind::Buffer );
+    void Free( Allocation& allocation );
+
+    MemoryStats GetStats() const;
+
+public:
+    static constexpr VkDeviceSize DefaultBlockSize = 64ULL * 1024 * 1024;
+
+private:
+    // bigger than any heap, and a power of two: an aligned offset in the pool is aligned in its block
+    // (Vulkan alignments are powers of two), and blocks never touch, so their free ranges never merge
+    static constexpr VkDeviceSize BlockStride = 1ULL << 40;
+
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint32_t memoryType = 0;
+        ResourceKind kind = ResourceKind::Buffer;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        uint32_t allocationCount = 0;
+    };
+
+    // the blocks of one (memory type, resource kind)
+    struct Pool
+    {
+        RangeAllocator ranges;
+        uint32_t blockCount = 0;
+    };
+
+    VkDeviceMemory AllocateDeviceMemory( VkDeviceSize size, uint32_t memoryType, void** ppMapped );
+    void FreeDeviceMemory( VkDeviceMemory memory, void* mapped );
+    Pool& GetPool( uint32_t memoryType, ResourceKind kind );
+    uint32_t CreateBlock( uint32_t memoryType, ResourceKind kind, VkDeviceSize minSize );
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties _memProps{};
+    uint32_t _maxAllocationCount = 0;   // limits.maxMemoryAllocationCount
+    uint32_t _deviceAllocationCount = 0;
+    VkDeviceSize _blockSize = DefaultBlockSize;
+
+    std::vector<Block> _blocks;         // freed blocks keep their slot (memory == VK_NULL_HANDLE) so blockIndex stays valid
+    std::vector<uint32_t> _freeBlockSlots;
+    std::unordered_map<uint32_t, Pool> _pools;     // memoryType * 2 + kind
+    uint32_t _dedicatedCount = 0;
+    VkDeviceSize _dedicatedBytes = 0;
+};
@@ -1,120 +1,75 @@
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
+#pragma once
 
-#include <vector>
-#include <array>
-#include <memory.h>
-
-#include "utilities.h"
+#include <vulkan/vulkan.h>
 
+// Lightweight handle to a mesh living inside a GeometryPool page.
+// All meshes of a page share one buffer, so drawing them only differs by these offsets:
+//      vkCmdDrawIndexed( cmd, mesh.GetIndexCount(), mesh.GetInstanceCount(), mesh.GetFirstIndex(),
+//                        mesh.GetVertexOffset(), mesh.GetFirstInstance() )
+// (after binding the page with the mesh's index type and its instance page, see GeometryPool::Bind / BindInstances)
+// Without GeometryPool::SetInstances a mesh draws once, through the pool's shared identity instance.
 class Mesh
 {
 public:
-    // bufferUsage
-    enum struct UsageBuffer // it's the same as bufferUsage, but I swap the name in order to not make confusion with bufferUsage
+    Mesh() = default;
+
+    uint32_t GetIndexCount() const    // for cmd buffer record
     {
-        VERTEX_BUFFER,
-        INDEX_BUFFER
-    };
-private:
-    struct Content
+        return _indexCount;
+    }
+    uint32_t GetFirstIndex() const
     {
-        int count;
-        VkBuffer buffer;
-        VkDeviceMemory bufferMemory;
-    };
-
-
-public:
-    Mesh() = default;
-    template <typename T>
-    Mesh( VkPhysicalDevice physicalDevice, VkDevice device, VkQueue transferQueue, VkCommandPool cmdPool, UsageBuffer usage, std::vector<T>& list )
-        :
-        _physicalDevice( physicalDevice ),
-        _device( device )
+        return _firstIndex;
+    }
+    int32_t GetVertexOffset() const
     {
-        _content.count = (int)list.size();
-        CreateVertexBuffer( transferQueue, cmdPool, usage, list );
+        return _vertexOffset;
     }
-    int GetCount()    // for cmd buffer record
+    uint32_t GetVertexCount() const
     {
-        return _content.count;
+        return _vertexCount;
     }
-    VkBuffer GetBuffer()
+    uint32_t GetPage() const
     {
-        return _content.buffer;
+        return _page;
     }
-
-    void DestroyMeshesContent()
+    VkIndexType GetIndexType() const  // UINT16 whenever the vertex count fits
     {
-        // destroy the buffer
-        vkDestroyBuffer( _device, _content.buffer, nullptr );
-
-        // freeing vertex buffer memory
-        vkFreeMemory( _device, _content.bufferMemory, nullptr );
+        return _indexType;
     }
-
-private:
-    template<typename T>
-    void CreateVertexBuffer( VkQueue transferQueue, VkCommandPool cmdPool, UsageBuffer usage, std::vector<T>& list )
+    uint32_t GetInstanceCount() const
     {
-        VkDeviceSize bufferSize = sizeof(Vertex) * list.size();
-        
-
-        // --- Staging Buffer (src buffer, store in CPU memory, CPU-GPU visible) ---
-        VkBuffer staggingBuffer;
-        VkDeviceMemory staggingBufferMemory;
-        VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        VkMemoryPropertyFlags staggingMemPropFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-
-        Buffer::Create( _physicalDevice, _device, bufferSize, transferUsage, staggingMemPropFlags, staggingBuffer, staggingBufferMemory );
-
-        // mapping the memory (yang baru saja dialokasikan) to vertex buffer
-        void * data;
-        vkMapMemory( _device, staggingBufferMemory, 0, bufferSize, 0, &data );
-        memcpy( data, list.data(), size_t(bufferSize) );
-        vkUnmapMemory( _device, staggingBufferMemory );
-        // ----------------------
-
-        // --- Vertex Buffer (dst buffer, store in GPU memory, GPU only visible) ---
-        VkBufferUsageFlags bufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | usagebufferlist[size_t(usage)];
-        VkMemoryPropertyFlags memPropFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-        
-        Buffer::Create( _physicalDevice, _device, bufferSize, bufferUsage,
-                               memPropFlags, _content.buffer, _content.bufferMemory );
-        // ----------------------------------
-
-        // copying stagging buffer to vertex buffer
-        Buffer::Copy( _device, transferQueue, cmdPool, bufferSize, staggingBuffer, _content.buffer );
-        
-
-        // because the content of stagging buffer has been copying to vertex buffer,
-        // the stagging buffer and memory buffer now not needed at all 
-        vkDestroyBuffer( _device, staggingBuffer, nullptr );
-        vkFreeMemory( _device, staggingBufferMemory, nullptr );
-
-
-        // note :
-        // I think in this function, the "Host" and "Device" is meaning this: 
-        //      Host: is the CPU-GPU
-        //      Device: is the GPU
+        return _instanceCount;
+    }
+    uint32_t GetFirstInstance() const   // in instances, from the start of the instance page
+    {
+        return _firstInstance;
+    }
+    uint32_t GetInstancePage() const
+    {
+        return _instancePage;
+    }
+    bool IsValid() const
+    {
+        return _indexCount > 0;
     }
-
-
 
 private:
-    Content _content;
-    std::array<VkBufferUsageFlagBits, 2> usagebufferlist = {
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,      // usagebuffer ke - 0
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT        // usagebuffer ke - 1
-    };
-
-    VkPhysicalDevice _physicalDevice;
-    VkDevice _device;
+    friend class GeometryPool;
+
+    uint32_t _page = 0;             // which pool buffer the mesh lives in
+    uint32_t _firstIndex = 0;       // in indices, from the start of the page's index region
+    uint32_t _indexCount = 0;
+    int32_t _vertexOffset = 0;      // in vertices, from the start of the page's vertex region
+    uint32_t _vertexCount = 0;
+    VkIndexType _indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t _instancePage = 0;     // which pool instance buffer the instances live in
+    uint32_t _firstInstance = 0;    // 0 on page 0 = the shared identity instance
+    uint32_t _instanceCount = 1;
 
 /*
  *  from udemy :
  *      vertex input
  *      Index Buffer and Staging Buffer
 */
-};
\ No newline at end of file
+};
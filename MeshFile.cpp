@@ -0,0 +1,240 @@
+#include "MeshFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include "GpuCuller.h"
+#include "MappedFile.h"
+
+namespace
+{
+    using EmitChunk = std::function<void( const std::vector<Vertex>&, const std::vector<uint32_t>&, uint32_t )>;
+
+    // greedy split in triangle order, so an optimized order survives inside every chunk;
+    // each chunk's vertices are renumbered in first-use order (which is also the fetch order)
+    void Split( const MeshData& mesh, uint32_t sourceMesh, uint32_t maxVertices, const EmitChunk& emit )
+    {
+        if( mesh.vertices.size() <= maxVertices )
+        {
+            emit( mesh.vertices, mesh.indices, sourceMesh );
+            return;
+        }
+
+        std::vector<uint32_t> owner( mesh.vertices.size(), UINT32_MAX );   // the chunk a vertex was last copied into
+        std::vector<uint32_t> slot( mesh.vertices.size(), 0 );             // its index in that chunk
+        uint32_t chunk = 0;
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        for( size_t triangle = 0; triangle + 2 < mesh.indices.size(); triangle += 3 )
+        {
+            uint32_t fresh = 0;
+            for( size_t corner = 0; corner < 3; ++corner )
+            {
+                if( owner[mesh.indices[triangle + corner]] != chunk )
+                    ++fresh;
+            }
+
+            if( vertices.size() + fresh > maxVertices )
+            {
+                emit( vertices, indices, sourceMesh );
+                vertices.clear();
+                indices.clear();
+                ++chunk;
+            }
+
+            for( size_t corner = 0; corner < 3; ++corner )
+            {
+                const uint32_t index = mesh.indices[triangle + corner];
+                if( owner[index] != chunk )
+                {
+                    owner[index] = chunk;
+                    slot[index] = static_cast<uint32_t>( vertices.size() );
+                    vertices.push_back( mesh.vertices[index] );
+                }
+                indices.push_back( slot[index] );
+            }
+        }
+
+        if( !indices.empty() )
+            emit( vertices, indices, sourceMesh );
+    }
+
+    const char* ToString( VertexFormat format )
+    {
+        return format == VertexFormat::Compact ? "compact" : "full";
+    }
+}
+
+std::ostream& operator<<( std::ostream& os, const MeshLoadStats& stats )
+{
+    os << "mesh file: " << stats.chunkCount << " chunks, " << stats.bytesStreamed / 1024 << " KiB streamed of "
+       << stats.fileBytes / 1024 << " KiB in " << stats.seconds * 1000.0 << " ms ("
+       << stats.MegabytesPerSecond() << " MB/s)";
+    return os;
+}
+
+uint32_t MeshFile::Write( const std::string& path, const std::vector<MeshData>& meshes, VertexFormat format,
+                            uint32_t maxChunkVertices )
+{
+    if( maxChunkVertices < 3 )
+        throw std::runtime_error( "Mesh file chunks need room for at least one triangle!" );
+
+    // into a temporary file first: a failed write must not leave a half written mesh behind
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream file( temporaryPath, std::ios::binary | std::ios::trunc );
+    if( !file.is_open() )
+        throw std::runtime_error( "Failed to open " + temporaryPath + " for writing!" );
+
+    Header header{};
+    header.magic = MeshFile::Magic;
+    header.version = MeshFile::Version;
+    header.vertexFormat = static_cast<uint32_t>( format );
+    header.vertexStride = VertexLayout::Stride( format );
+
+    const std::vector<VkVertexInputAttributeDescription> attributes = VertexLayout::Attributes( format );
+    header.attributeCount = static_cast<uint32_t>( attributes.size() );
+    for( size_t i = 0; i < attributes.size(); ++i )
+        header.attributes[i] = { attributes[i].location, static_cast<uint32_t>( attributes[i].format ), attributes[i].offset };
+
+    // the header is rewritten at the end, once the chunk table's place is known
+    file.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    uint64_t offset = sizeof(header);
+
+    auto align = [&]() {
+        static const char zeros[MeshFile::BlobAlignment] = {};
+        const uint64_t padding = (MeshFile::BlobAlignment - offset % MeshFile::BlobAlignment) % MeshFile::BlobAlignment;
+        file.write( zeros, std::streamsize( padding ) );
+        offset += padding;
+    };
+    auto writeBlob = [&]( const void* data, size_t size ) -> uint64_t {
+        align();
+        const uint64_t blobOffset = offset;
+        file.write( static_cast<const char*>( data ), std::streamsize( size ) );
+        offset += size;
+        return blobOffset;
+    };
+
+    std::vector<Chunk> chunks;
+    std::vector<uint16_t> narrowIndices;
+    auto emit = [&]( const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t sourceMesh ) {
+        Chunk chunk{};
+        chunk.vertexCount = static_cast<uint32_t>( vertices.size() );
+        chunk.indexCount = static_cast<uint32_t>( indices.size() );
+        chunk.sourceMesh = sourceMesh;
+
+        if( format == VertexFormat::Compact )
+        {
+            const std::vector<CompactVertex> compact = VertexCompression::Compress( vertices );
+            chunk.vertexOffset = writeBlob( compact.data(), compact.size() * sizeof(CompactVertex) );
+        }
+        else
+        {
+            chunk.vertexOffset = writeBlob( vertices.data(), vertices.size() * sizeof(Vertex) );
+        }
+
+        // already in the width GeometryPool would pick, so loading converts nothing
+        if( vertices.size() <= 65536 )
+        {
+            narrowIndices.assign( indices.begin(), indices.end() );
+            chunk.indexType = VK_INDEX_TYPE_UINT16;
+            chunk.indexOffset = writeBlob( narrowIndices.data(), narrowIndices.size() * sizeof(uint16_t) );
+        }
+        else
+        {
+            chunk.indexType = VK_INDEX_TYPE_UINT32;
+            chunk.indexOffset = writeBlob( indices.data(), indices.size() * sizeof(uint32_t) );
+        }
+
+        const glm::vec4 sphere = GpuCuller::ComputeBoundingSphere( vertices );
+        for( int i = 0; i < 4; ++i )
+            chunk.boundingSphere[i] = sphere[i];
+
+        chunks.push_back( chunk );
+    };
+
+    for( size_t i = 0; i < meshes.size(); ++i )
+    {
+        if( !meshes[i].indices.empty() )
+            Split( meshes[i], static_cast<uint32_t>( i ), maxChunkVertices, emit );
+    }
+
+    header.chunkCount = static_cast<uint32_t>( chunks.size() );
+    header.chunkTableOffset = writeBlob( chunks.data(), chunks.size() * sizeof(Chunk) );
+    header.fileSize = offset;
+
+    file.seekp( 0 );
+    file.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    file.close();
+
+    if( !file || std::rename( temporaryPath.c_str(), path.c_str() ) != 0 )
+    {
+        std::remove( temporaryPath.c_str() );
+        throw std::runtime_error( "Failed to write " + path + "!" );
+    }
+
+    return header.chunkCount;
+}
+
+MeshFile::Contents MeshFile::Load( const std::string& path, VertexFormat format, GeometryPool& pool, StagingUploader& uploader )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const MappedFile file( path );
+    const Header& header = *file.View<Header>( 0, 1 );
+
+    if( header.magic != MeshFile::Magic )
+        throw std::runtime_error( path + " is not a mesh file!" );
+    if( header.version != MeshFile::Version )
+        throw std::runtime_error( "Unsupported mesh file version " + std::to_string( header.version ) + " in " + path + "!" );
+    if( header.fileSize != file.Size() )
+        throw std::runtime_error( path + " is truncated!" );
+
+    // the blobs are copied as they are, so the file has to be in exactly the layout the pipeline reads
+    const std::vector<VkVertexInputAttributeDescription> attributes = VertexLayout::Attributes( format );
+    bool layoutMatches = header.vertexFormat == static_cast<uint32_t>( format ) &&
+                         header.vertexStride == VertexLayout::Stride( format ) &&
+                         header.attributeCount == attributes.size();
+    for( size_t i = 0; layoutMatches && i < attributes.size(); ++i )
+    {
+        const Attribute& attribute = header.attributes[i];
+        layoutMatches = attribute.location == attributes[i].location &&
+                        attribute.format == static_cast<uint32_t>( attributes[i].format ) &&
+                        attribute.offset == attributes[i].offset;
+    }
+    if( !layoutMatches )
+    {
+        throw std::runtime_error( "The vertex layout of " + path + " doesn't match the pipeline's (" +
+                                    ToString( format ) + " vertices), convert it again in that format!" );
+    }
+
+    // indices aren't range checked: that would mean reading them, the files come from MeshFile::Write
+    const Chunk* chunks = file.View<Chunk>( size_t( header.chunkTableOffset ), header.chunkCount );
+
+    Contents contents;
+    contents.meshes.reserve( header.chunkCount );
+    contents.boundingSpheres.reserve( header.chunkCount );
+    for( uint32_t i = 0; i < header.chunkCount; ++i )
+    {
+        const Chunk& chunk = chunks[i];
+        const VkIndexType indexType = static_cast<VkIndexType>( chunk.indexType );
+
+        contents.meshes.push_back( pool.Add( uploader, file, size_t( chunk.vertexOffset ), chunk.vertexCount,
+                                                size_t( chunk.indexOffset ), chunk.indexCount, indexType ) );
+        contents.boundingSpheres.push_back( glm::vec4( chunk.boundingSphere[0], chunk.boundingSphere[1],
+                                                        chunk.boundingSphere[2], chunk.boundingSphere[3] ) );
+
+        contents.stats.bytesStreamed += uint64_t(chunk.vertexCount) * header.vertexStride +
+                                        uint64_t(chunk.indexCount) * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+    }
+
+    uploader.Flush();
+
+    contents.stats.chunkCount = header.chunkCount;
+    contents.stats.fileBytes = file.Size();
+    contents.stats.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    return contents;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "GeometryPool.h"
+#include "Mesh.h"
+#include "StagingUploader.h"
+#include "SyntheticScene.h"
+#include "utilities.h"
+
+struct MeshLoadStats
+{
+    uint32_t chunkCount = 0;
+    uint64_t fileBytes = 0;
+    uint64_t bytesStreamed = 0;     // vertex + index blobs handed to the uploader
+    double seconds = 0.0;           // open to the last copy submitted (the uploader stalls when the GPU falls behind)
+
+    double MegabytesPerSecond() const
+    {
+        return seconds > 0.0 ? double(bytesStreamed) / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+};
+
+std::ostream& operator<<( std::ostream& os, const MeshLoadStats& stats );
+
+
+// Binary mesh files (.mesh): geometry stored exactly the way the geometry pool keeps it, so loading
+// is a header check and one streamed copy per blob instead of parsing text and converting vertices.
+//
+// Layout (native endianness, every blob aligned to BlobAlignment so it can be read in place):
+//      Header                  vertex format, stride and attribute layout, where the chunk table is
+//      vertex / index blobs    per chunk: vertices in the header's layout, indices in the chunk's index type
+//      Chunk[chunkCount]       at Header::chunkTableOffset, written last
+//
+// A chunk is what becomes one Mesh. Meshes are split into chunks of at most MaxChunkVertices vertices
+// when they are written, so every chunk gets 16-bit indices; the converter (tools/MeshConverter.cpp)
+// also runs the mesh optimizer before writing, so none of that work is left for load time.
+namespace MeshFile
+{
+    static constexpr uint32_t Magic = 0x4853454D;  // "MESH"
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t MaxAttributes = 8;
+    static constexpr uint32_t BlobAlignment = 16;
+    static constexpr uint32_t MaxChunkVertices = 65536;
+
+    struct Attribute
+    {
+        uint32_t location;
+        uint32_t format;        // VkFormat
+        uint32_t offset;
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexFormat;  // VertexFormat
+        uint32_t vertexStride;
+        uint32_t attributeCount;
+        Attribute attributes[MaxAttributes];
+        uint32_t chunkCount;
+        uint64_t chunkTableOffset;
+        uint64_t fileSize;      // catches truncated files before anything is uploaded
+    };
+    static_assert( sizeof(Header) == 136, "MeshFile::Header is an on-disk layout" );
+
+    struct Chunk
+    {
+        uint64_t vertexOffset;  // from the start of the file
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexType;     // VkIndexType
+        uint32_t sourceMesh;    // which of the written meshes the chunk came from
+        float boundingSphere[4];    // center, radius (for the GPU culler)
+    };
+    static_assert( sizeof(Chunk) == 48, "MeshFile::Chunk is an on-disk layout" );
+
+    struct Contents
+    {
+        std::vector<Mesh> meshes;                   // one per chunk
+        std::vector<glm::vec4> boundingSpheres;     // one per mesh
+        MeshLoadStats stats;
+    };
+
+    // writes meshes in format, splitting the ones bigger than maxChunkVertices; returns the chunk count.
+    // Blobs are written as they are produced, so the file never has to fit in memory at once.
+    // Throws std::runtime_error when the file can't be written.
+    uint32_t Write( const std::string& path, const std::vector<MeshData>& meshes, VertexFormat format,
+                        uint32_t maxChunkVertices = MaxChunkVertices );
+
+    // checks the header and that the file's vertex layout is format's, then streams every chunk from the
+    // mapping into the pool (GeometryPool::Add from a MappedFile) and flushes the uploader.
+    // Throws std::runtime_error on a malformed file or a layout mismatch.
+    Contents Load( const std::string& path, VertexFormat format, GeometryPool& pool, StagingUploader& uploader );
+}
@@ -0,0 +1,351 @@
+#include "MeshOptimizer.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // --- Forsyth scoring (values from the original article) ---
+    constexpr int32_t CacheSize = 32;
+    constexpr float CacheDecayPower = 1.5f;
+    constexpr float LastTriScore = 0.75f;
+    constexpr float ValenceBoostScale = 2.0f;
+    constexpr float ValenceBoostPower = 0.5f;
+
+    float VertexScore( int32_t cachePosition, uint32_t remainingTriangles )
+    {
+        if( remainingTriangles == 0 )
+            return -1.0f;   // no triangle needs it anymore
+
+        float score = 0.0f;
+        if( cachePosition >= 0 )
+        {
+            if( cachePosition < 3 )
+            {
+                // used by the last triangle: a fixed score so the strip doesn't just keep going the same way
+                score = LastTriScore;
+            }
+            else
+            {
+                const float scaler = 1.0f / float(CacheSize - 3);
+                score = std::pow( 1.0f - float(cachePosition - 3) * scaler, CacheDecayPower );
+            }
+        }
+
+        // favour vertices with few triangles left, so that lone triangles don't get stranded
+        score += ValenceBoostScale * std::pow( float(remainingTriangles), -ValenceBoostPower );
+        return score;
+    }
+
+    void ValidateIndices( const std::vector<uint32_t>& indices, uint32_t vertexCount )
+    {
+        if( indices.size() % 3 != 0 )
+            throw std::runtime_error( "Mesh optimizer expects a triangle list!" );
+
+        for( auto index : indices )
+        {
+            if( index >= vertexCount )
+                throw std::runtime_error( "Mesh optimizer: index out of range!" );
+        }
+    }
+}
+
+void MeshOptimizer::OptimizeVertexCache( std::vector<uint32_t>& indices, uint32_t vertexCount )
+{
+    ValidateIndices( indices, vertexCount );
+
+    const uint32_t triangleCount = static_cast<uint32_t>( indices.size() / 3 );
+    if( triangleCount == 0 )
+        return;
+
+    // --- vertex -> triangle adjacency (CSR layout) ---
+    std::vector<uint32_t> remaining( vertexCount, 0 );     // triangles not emitted yet, per vertex
+    for( auto index : indices )
+        ++remaining[index];
+
+    std::vector<uint32_t> adjacencyOffset( vertexCount + 1, 0 );
+    for( uint32_t v = 0; v < vertexCount; ++v )
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+    std::vector<uint32_t> adjacency( indices.size() );
+    {
+        std::vector<uint32_t> fill( adjacencyOffset.begin(), adjacencyOffset.end() - 1 );
+        for( uint32_t t = 0; t < triangleCount; ++t )
+        {
+            for( uint32_t k = 0; k < 3; ++k )
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    // --- initial scores ---
+    std::vector<int32_t> cachePosition( vertexCount, -1 );
+    std::vector<float> vertexScore( vertexCount );
+    for( uint32_t v = 0; v < vertexCount; ++v )
+        vertexScore[v] = VertexScore( -1, remaining[v] );
+
+    std::vector<float> triangleScore( triangleCount );
+    std::vector<bool> emitted( triangleCount, false );
+    for( uint32_t t = 0; t < triangleCount; ++t )
+    {
+        triangleScore[t] = vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve( indices.size() );
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve( CacheSize + 3 );
+    newCache.reserve( CacheSize + 3 );
+
+    uint32_t bestTriangle = static_cast<uint32_t>( std::max_element( triangleScore.begin(), triangleScore.end() ) - triangleScore.begin() );
+    uint32_t scanCursor = 0;    // for the (rare) restarts when nothing in the cache is left to draw
+
+    for( uint32_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount )
+    {
+        if( bestTriangle == UINT32_MAX )
+        {
+            while( emitted[scanCursor] )
+                ++scanCursor;
+            bestTriangle = scanCursor;
+        }
+
+        // --- emit the triangle and take it out of its vertices' adjacency ---
+        emitted[bestTriangle] = true;
+        const uint32_t* tri = &indices[bestTriangle * 3];
+        for( uint32_t k = 0; k < 3; ++k )
+        {
+            const uint32_t v = tri[k];
+            output.push_back( v );
+
+            uint32_t* begin = &adjacency[adjacencyOffset[v]];
+            uint32_t* end = begin + remaining[v];
+            std::iter_swap( std::find( begin, end, bestTriangle ), end - 1 );
+            --remaining[v];
+        }
+
+        // --- LRU cache update: the triangle's vertices go to the front ---
+        newCache.clear();
+        for( uint32_t k = 0; k < 3; ++k )
+        {
+            if( std::find( newCache.begin(), newCache.end(), tri[k] ) == newCache.end() )
+                newCache.push_back( tri[k] );
+        }
+        for( auto v : cache )
+        {
+            if( std::find( newCache.begin(), newCache.end(), v ) == newCache.end() )
+                newCache.push_back( v );
+        }
+
+        // vertices falling out of the cache lose their position score
+        for( size_t i = CacheSize; i < newCache.size(); ++i )
+        {
+            cachePosition[newCache[i]] = -1;
+            vertexScore[newCache[i]] = VertexScore( -1, remaining[newCache[i]] );
+        }
+        if( newCache.size() > size_t(CacheSize) )
+            newCache.resize( CacheSize );
+
+        for( size_t i = 0; i < newCache.size(); ++i )
+        {
+            cachePosition[newCache[i]] = static_cast<int32_t>( i );
+            vertexScore[newCache[i]] = VertexScore( static_cast<int32_t>( i ), remaining[newCache[i]] );
+        }
+        cache.swap( newCache );
+
+        // --- rescore the triangles touching the cache and pick the best of them ---
+        bestTriangle = UINT32_MAX;
+        float bestScore = -1.0f;
+        for( auto v : cache )
+        {
+            for( uint32_t a = 0; a < remaining[v]; ++a )
+            {
+                const uint32_t t = adjacency[adjacencyOffset[v] + a];
+                const float score = vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                triangleScore[t] = score;
+
+                if( score > bestScore )
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    indices.swap( output );
+
+/*
+ *  from :
+ *      Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+*/
+}
+
+void MeshOptimizer::OptimizeOverdraw( std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions )
+{
+    const uint32_t vertexCount = static_cast<uint32_t>( positions.size() );
+    ValidateIndices( indices, vertexCount );
+
+    const uint32_t triangleCount = static_cast<uint32_t>( indices.size() / 3 );
+    if( triangleCount < 2 )
+        return;
+
+    // --- clusters: a new one starts wherever the cache order restarts (all 3 vertices miss) ---
+    std::vector<uint32_t> clusterStart;
+    {
+        std::vector<uint32_t> cacheTimestamp( vertexCount, 0 );
+        uint32_t time = AnalyzeCacheSize + 1;
+        for( uint32_t t = 0; t < triangleCount; ++t )
+        {
+            uint32_t misses = 0;
+            for( uint32_t k = 0; k < 3; ++k )
+            {
+                const uint32_t v = indices[t * 3 + k];
+                if( time - cacheTimestamp[v] > AnalyzeCacheSize )
+                {
+                    cacheTimestamp[v] = time++;
+                    ++misses;
+                }
+            }
+
+            if( t == 0 || misses == 3 )
+                clusterStart.push_back( t );
+        }
+    }
+
+    if( clusterStart.size() < 2 )
+        return;
+
+    // --- mesh centroid ---
+    glm::vec3 meshCentroid( 0.0f );
+    float meshArea = 0.0f;
+    for( uint32_t t = 0; t < triangleCount; ++t )
+    {
+        const glm::vec3& p0 = positions[indices[t * 3 + 0]];
+        const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+        const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+        const float area = glm::length( glm::cross( p1 - p0, p2 - p0 ) );
+
+        meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+        meshArea += area;
+    }
+    if( meshArea > 0.0f )
+        meshCentroid = meshCentroid / meshArea;
+
+    // --- sort key per cluster: how much it faces away from the centre ---
+    struct Cluster
+    {
+        uint32_t begin;
+        uint32_t end;
+        float key;
+    };
+    std::vector<Cluster> clusters( clusterStart.size() );
+
+    for( size_t c = 0; c < clusterStart.size(); ++c )
+    {
+        Cluster& cluster = clusters[c];
+        cluster.begin = clusterStart[c];
+        cluster.end = c + 1 < clusterStart.size() ? clusterStart[c + 1] : triangleCount;
+
+        glm::vec3 centroid( 0.0f );
+        glm::vec3 normal( 0.0f );   // area weighted
+        float area = 0.0f;
+        for( uint32_t t = cluster.begin; t < cluster.end; ++t )
+        {
+            const glm::vec3& p0 = positions[indices[t * 3 + 0]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+            const glm::vec3 n = glm::cross( p1 - p0, p2 - p0 );
+            const float a = glm::length( n );
+
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+
+        const float normalLength = glm::length( normal );
+        if( area > 0.0f && normalLength > 0.0f )
+            cluster.key = glm::dot( centroid / area - meshCentroid, normal / normalLength );
+        else
+            cluster.key = 0.0f;
+    }
+
+    // outward facing clusters first: from most view directions they are in front of the rest
+    std::stable_sort( clusters.begin(), clusters.end(),
+                        []( const Cluster& a, const Cluster& b ) { return a.key > b.key; } );
+
+    std::vector<uint32_t> output;
+    output.reserve( indices.size() );
+    for( const auto& cluster : clusters )
+        output.insert( output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3 );
+
+    indices.swap( output );
+}
+
+std::vector<uint32_t> MeshOptimizer::BuildFetchRemap( const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t& newVertexCount )
+{
+    ValidateIndices( indices, vertexCount );
+
+    std::vector<uint32_t> remap( vertexCount, UINT32_MAX );
+    newVertexCount = 0;
+    for( auto index : indices )
+    {
+        if( remap[index] == UINT32_MAX )
+            remap[index] = newVertexCount++;
+    }
+
+    return remap;
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache( const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize )
+{
+    ValidateIndices( indices, vertexCount );
+
+    VertexCacheStats stats{};
+
+    // FIFO: a vertex is a hit if it was inserted less than cacheSize insertions ago
+    std::vector<uint32_t> cacheTimestamp( vertexCount, 0 );
+    uint32_t time = cacheSize + 1;
+    for( auto index : indices )
+    {
+        if( time - cacheTimestamp[index] > cacheSize )
+        {
+            cacheTimestamp[index] = time++;
+            ++stats.transformedVertices;
+        }
+    }
+
+    const size_t triangleCount = indices.size() / 3;
+    stats.acmr = triangleCount ? float(stats.transformedVertices) / float(triangleCount) : 0.0f;
+    stats.atvr = vertexCount ? float(stats.transformedVertices) / float(vertexCount) : 0.0f;
+    return stats;
+}
+
+void MeshOptimizeReport::Merge( const MeshOptimizeReport& other )
+{
+    triangleCount += other.triangleCount;
+    vertexCountBefore += other.vertexCountBefore;
+    vertexCountAfter += other.vertexCountAfter;
+    before.transformedVertices += other.before.transformedVertices;
+    after.transformedVertices += other.after.transformedVertices;
+    milliseconds += other.milliseconds;
+
+    auto ratios = [this]( VertexCacheStats& stats, uint32_t vertexCount ) {
+        stats.acmr = triangleCount ? float(stats.transformedVertices) / float(triangleCount) : 0.0f;
+        stats.atvr = vertexCount ? float(stats.transformedVertices) / float(vertexCount) : 0.0f;
+    };
+    ratios( before, vertexCountBefore );
+    ratios( after, vertexCountAfter );
+}
+
+std::ostream& operator<<( std::ostream& os, const MeshOptimizeReport& report )
+{
+    os << "mesh optimize: ACMR " << report.before.acmr << " -> " << report.after.acmr
+       << ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+       << ", vertices " << report.vertexCountBefore << " -> " << report.vertexCountAfter
+       << " (" << report.milliseconds << " ms)";
+    return os;
+}
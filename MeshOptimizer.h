@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// post-transform vertex cache efficiency of an index buffer (FIFO cache simulation)
+struct VertexCacheStats
+{
+    uint32_t transformedVertices = 0;   // cache misses
+    float acmr = 0.0f;      // average cache miss ratio: misses per triangle (0.5 is the ideal for big grids, 3 the worst)
+    float atvr = 0.0f;      // average transformed vertex ratio: misses per vertex (1.0 is the ideal)
+};
+
+struct MeshOptimizeReport
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t triangleCount = 0;
+    uint32_t vertexCountBefore = 0;
+    uint32_t vertexCountAfter = 0;      // unreferenced vertices are dropped by the fetch remap
+    double milliseconds = 0.0;
+
+    // sums another mesh's report into this one (ratios are recomputed over the totals)
+    void Merge( const MeshOptimizeReport& other );
+};
+
+std::ostream& operator<<( std::ostream& os, const MeshOptimizeReport& report );
+
+
+// Index/vertex reordering run on the CPU before a mesh is uploaded.
+// None of it changes what is drawn, only the order the GPU fetches and shades it in.
+namespace MeshOptimizer
+{
+    static constexpr uint32_t AnalyzeCacheSize = 16;    // a conservative guess for real hardware
+
+    // Forsyth's linear-speed vertex cache optimisation: reorders triangles so that
+    // consecutive triangles reuse recently transformed vertices
+    void OptimizeVertexCache( std::vector<uint32_t>& indices, uint32_t vertexCount );
+
+    // splits the (cache optimized) triangle order into clusters at cache restarts and sorts
+    // the clusters so the outward facing ones come first, which lets early-z reject more of the rest;
+    // keeps the cache order inside each cluster
+    void OptimizeOverdraw( std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions );
+
+    // remap so vertices are stored in the order the index buffer first uses them;
+    // returns the new index of each old vertex (UINT32_MAX = unreferenced) and the new vertex count
+    std::vector<uint32_t> BuildFetchRemap( const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t& newVertexCount );
+
+    VertexCacheStats AnalyzeVertexCache( const std::vector<uint32_t>& indices, uint32_t vertexCount,
+                                            uint32_t cacheSize = AnalyzeCacheSize );
+
+    template<typename V>
+    void OptimizeVertexFetch( std::vector<V>& vertices, std::vector<uint32_t>& indices )
+    {
+        uint32_t newVertexCount = 0;
+        std::vector<uint32_t> remap = BuildFetchRemap( indices, static_cast<uint32_t>( vertices.size() ), newVertexCount );
+
+        std::vector<V> reordered( newVertexCount );
+        for( size_t i = 0; i < vertices.size(); ++i )
+        {
+            if( remap[i] != UINT32_MAX )
+                reordered[remap[i]] = vertices[i];
+        }
+
+        for( auto& index : indices )
+            index = remap[index];
+
+        vertices.swap( reordered );
+    }
+
+    // the whole stage: vertex cache, optionally overdraw, then vertex fetch; V needs a glm::vec3 pos
+    template<typename V>
+    MeshOptimizeReport Optimize( std::vector<V>& vertices, std::vector<uint32_t>& indices, bool optimizeOverdraw )
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MeshOptimizeReport report;
+        report.triangleCount = static_cast<uint32_t>( indices.size() / 3 );
+        report.vertexCountBefore = static_cast<uint32_t>( vertices.size() );
+        report.before = AnalyzeVertexCache( indices, report.vertexCountBefore );
+
+        OptimizeVertexCache( indices, report.vertexCountBefore );
+
+        if( optimizeOverdraw )
+        {
+            std::vector<glm::vec3> positions( vertices.size() );
+            for( size_t i = 0; i < vertices.size(); ++i )
+                positions[i] = vertices[i].pos;
+
+            OptimizeOverdraw( indices, positions );
+        }
+
+        OptimizeVertexFetch( vertices, indices );
+
+        report.vertexCountAfter = static_cast<uint32_t>( vertices.size() );
+        report.after = AnalyzeVertexCache( indices, report.vertexCountAfter );
+        report.milliseconds = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+        return report;
+    }
+}
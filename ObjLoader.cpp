@@ -0,0 +1,186 @@
+#include "ObjLoader.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "MappedFile.h"
+
+namespace
+{
+    struct Position
+    {
+        glm::vec3 pos;
+        glm::vec3 col;
+        bool hasColor;
+    };
+
+    bool IsSpace( char c )
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // next whitespace separated token of line, starting at cursor
+    std::string NextToken( const std::string& line, size_t& cursor )
+    {
+        while( cursor < line.size() && IsSpace( line[cursor] ) )
+            ++cursor;
+        const size_t begin = cursor;
+        while( cursor < line.size() && !IsSpace( line[cursor] ) )
+            ++cursor;
+        return line.substr( begin, cursor - begin );
+    }
+
+    // the position part of a face corner ("7", "7/2", "7//3", "-1/2/3") as a 0-based index
+    uint32_t ParseCorner( const std::string& corner, size_t positionCount, const std::string& path, size_t lineNumber )
+    {
+        char* end = nullptr;
+        const long index = std::strtol( corner.c_str(), &end, 10 );
+        const long resolved = index < 0 ? long(positionCount) + index : index - 1;
+        if( end == corner.c_str() || index == 0 || resolved < 0 || size_t(resolved) >= positionCount )
+            throw std::runtime_error( "Invalid face index '" + corner + "' in " + path + ":" + std::to_string( lineNumber ) + "!" );
+        return static_cast<uint32_t>( resolved );
+    }
+}
+
+std::vector<MeshData> ObjLoader::Load( const std::string& path )
+{
+    const MappedFile file( path );
+
+    std::vector<Position> positions;
+    std::vector<std::vector<uint32_t>> meshIndices( 1 );   // into positions, one list per mesh
+
+    // the file is read through the mapping; each line is copied out (they are short) so strtof
+    // always finds a terminator, even on a last line without one at the very end of the mapping
+    std::string line;
+    std::vector<uint32_t> polygon;
+    size_t lineNumber = 0;
+    for( size_t lineStart = 0; lineStart < file.Size(); )
+    {
+        const char* data = file.Data() + lineStart;
+        const char* newline = static_cast<const char*>( std::memchr( data, '\n', file.Size() - lineStart ) );
+        const size_t length = newline ? size_t(newline - data) : file.Size() - lineStart;
+        line.assign( data, length );
+        lineStart += length + 1;
+        ++lineNumber;
+
+        size_t cursor = 0;
+        const std::string keyword = NextToken( line, cursor );
+
+        if( keyword == "v" )
+        {
+            float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+            int count = 0;
+            const char* text = line.c_str() + cursor;
+            for( char* end = nullptr; count < 6; ++count, text = end )
+            {
+                values[count] = std::strtof( text, &end );
+                if( end == text )
+                    break;
+            }
+            if( count < 3 )
+                throw std::runtime_error( "Invalid vertex in " + path + ":" + std::to_string( lineNumber ) + "!" );
+
+            positions.push_back( { glm::vec3( values[0], values[1], values[2] ),
+                                   glm::vec3( values[3], values[4], values[5] ), count >= 6 } );
+        }
+        else if( keyword == "f" )
+        {
+            polygon.clear();
+            for( std::string corner = NextToken( line, cursor ); !corner.empty(); corner = NextToken( line, cursor ) )
+                polygon.push_back( ParseCorner( corner, positions.size(), path, lineNumber ) );
+
+            if( polygon.size() < 3 )
+                throw std::runtime_error( "Face with less than 3 corners in " + path + ":" + std::to_string( lineNumber ) + "!" );
+
+            // fan: (0, i, i + 1)
+            auto& indices = meshIndices.back();
+            for( size_t i = 1; i + 1 < polygon.size(); ++i )
+            {
+                indices.push_back( polygon[0] );
+                indices.push_back( polygon[i] );
+                indices.push_back( polygon[i + 1] );
+            }
+        }
+        else if( keyword == "o" || keyword == "g" )
+        {
+            if( !meshIndices.back().empty() )
+                meshIndices.emplace_back();
+        }
+    }
+
+    // the bounding box, for the fallback colors
+    glm::vec3 lo( 0.0f ), hi( 0.0f );
+    if( !positions.empty() )
+    {
+        lo = hi = positions[0].pos;
+        for( const auto& position : positions )
+        {
+            lo = glm::min( lo, position.pos );
+            hi = glm::max( hi, position.pos );
+        }
+    }
+    const glm::vec3 extent = glm::max( hi - lo, glm::vec3( 1e-6f ) );
+
+    // positions are shared by the whole file, each mesh gets its own copy of the ones it uses
+    std::vector<MeshData> meshes;
+    std::vector<uint32_t> owner( positions.size(), UINT32_MAX );
+    std::vector<uint32_t> slot( positions.size(), 0 );
+    for( const auto& indices : meshIndices )
+    {
+        if( indices.empty() )
+            continue;
+
+        const uint32_t meshIndex = static_cast<uint32_t>( meshes.size() );
+        MeshData mesh;
+        mesh.indices.reserve( indices.size() );
+        for( uint32_t index : indices )
+        {
+            if( owner[index] != meshIndex )
+            {
+                owner[index] = meshIndex;
+                slot[index] = static_cast<uint32_t>( mesh.vertices.size() );
+
+                const Position& position = positions[index];
+                mesh.vertices.push_back( { position.pos, position.hasColor ? position.col : (position.pos - lo) / extent } );
+            }
+            mesh.indices.push_back( slot[index] );
+        }
+        meshes.push_back( std::move( mesh ) );
+    }
+
+    return meshes;
+}
+
+void ObjLoader::FitToClipSpace( std::vector<MeshData>& meshes, float extent )
+{
+    glm::vec3 lo( INFINITY ), hi( -INFINITY );
+    for( const auto& mesh : meshes )
+    {
+        for( const auto& vertex : mesh.vertices )
+        {
+            lo = glm::min( lo, vertex.pos );
+            hi = glm::max( hi, vertex.pos );
+        }
+    }
+    if( lo.x > hi.x )
+        return;     // no vertices
+
+    const glm::vec3 center = (lo + hi) * 0.5f;
+    const glm::vec3 size = glm::max( hi - lo, glm::vec3( 1e-6f ) );
+    const float scale = 2.0f * extent / std::max( size.x, size.y );
+
+    for( auto& mesh : meshes )
+    {
+        for( auto& vertex : mesh.vertices )
+        {
+            vertex.pos.x = (vertex.pos.x - center.x) * scale;
+            vertex.pos.y = (vertex.pos.y - center.y) * scale;
+            vertex.pos.z = 0.1f + 0.8f * (vertex.pos.z - lo.z) / size.z;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "SyntheticScene.h"
+
+// Wavefront OBJ import for the mesh converter (tools/MeshConverter.cpp); the renderer itself only
+// loads .mesh files (MeshFile::Load).
+//
+// Reads positions ("v x y z", with an optional "r g b" vertex color) and faces ("f", any of the
+// v, v/vt, v//vn, v/vt/vn forms, negative indices included); polygons are fanned into triangles.
+// Every "o" / "g" starts a new mesh. Texture coordinates, normals and materials are ignored:
+// Vertex has no room for them. Vertices without a color get one from their position in the
+// model's bounding box, so the shape stays readable without lighting.
+namespace ObjLoader
+{
+    // throws std::runtime_error when the file can't be read or a face is malformed
+    std::vector<MeshData> Load( const std::string& path );
+
+    // scales and moves every mesh (all by the same transform) so the model fills clip space:
+    // x / y into [-extent, extent] keeping the aspect ratio, z into [0.1, 0.9]
+    void FitToClipSpace( std::vector<MeshData>& meshes, float extent = 0.9f );
+}
@@ -0,0 +1,188 @@
+#include "PipelineCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "utilities.h"
+
+namespace
+{
+    // the header every driver puts in front of its data (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    struct DriverHeader
+    {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+}
+
+std::ostream& operator<<( std::ostream& os, const PipelineCacheStats& stats )
+{
+    os << "pipeline cache: " << (stats.warm ? "warm" : "cold");
+    if( !stats.rejectReason.empty() )
+        os << " (file rejected: " << stats.rejectReason << ")";
+    os << ", loaded " << stats.loadedBytes << " bytes in " << stats.loadMs << " ms"
+       << ", saved " << stats.savedBytes << " bytes in " << stats.saveMs << " ms";
+    return os;
+}
+
+void PipelineCache::Init( VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path )
+{
+    _device = device;
+    _path = path;
+    _stats = PipelineCacheStats{};
+    vkGetPhysicalDeviceProperties( physicalDevice, &_properties );
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<char> file;
+    if( !_path.empty() )
+    {
+        std::ifstream in( _path, std::ios::ate | std::ios::binary );
+        if( in.is_open() )
+        {
+            file.resize( static_cast<size_t>( in.tellg() ) );
+            in.seekg( 0 );
+            in.read( file.data(), file.size() );
+            if( !in )
+                file.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if( !file.empty() )
+    {
+        _stats.rejectReason = Validate( file );
+        if( _stats.rejectReason.empty() )
+        {
+            cacheInfo.initialDataSize = file.size() - sizeof(FileHeader);
+            cacheInfo.pInitialData = file.data() + sizeof(FileHeader);
+            _stats.warm = true;
+            _stats.loadedBytes = cacheInfo.initialDataSize;
+        }
+    }
+
+    if( vkCreatePipelineCache( _device, &cacheInfo, nullptr, &_cache )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create pipeline cache!" );
+    }
+
+    _stats.loadMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void PipelineCache::Save()
+{
+    if( _cache == VK_NULL_HANDLE || _path.empty() )
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    size_t size = 0;
+    std::vector<char> data;
+    if( vkGetPipelineCacheData( _device, _cache, &size, nullptr ) == VK_SUCCESS )
+    {
+        data.resize( size );
+        if( vkGetPipelineCacheData( _device, _cache, &size, data.data() ) != VK_SUCCESS )
+            data.clear();
+        data.resize( std::min( size, data.size() ) );
+    }
+    if( data.empty() )
+    {
+        std::cout << "pipeline cache: no data to save" << std::endl;
+        return;
+    }
+
+    const FileHeader header = MakeHeader( data );
+    const std::string tempPath = _path + ".tmp";
+    {
+        std::ofstream out( tempPath, std::ios::binary | std::ios::trunc );
+        out.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+        out.write( data.data(), data.size() );
+        if( !out )
+        {
+            std::cout << "pipeline cache: failed to write " << tempPath << std::endl;
+            std::remove( tempPath.c_str() );
+            return;
+        }
+    }
+    if( std::rename( tempPath.c_str(), _path.c_str() ) != 0 )
+    {
+        std::cout << "pipeline cache: failed to replace " << _path << std::endl;
+        std::remove( tempPath.c_str() );
+        return;
+    }
+
+    _stats.savedBytes = data.size();
+    _stats.saveMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void PipelineCache::Destroy()
+{
+    if( _cache != VK_NULL_HANDLE )
+        vkDestroyPipelineCache( _device, _cache, nullptr );
+    _cache = VK_NULL_HANDLE;
+}
+
+PipelineCache::FileHeader PipelineCache::MakeHeader( const std::vector<char>& data ) const
+{
+    FileHeader header{};
+    header.magic = PipelineCache::Magic;
+    header.fileVersion = PipelineCache::FileVersion;
+    header.vendorID = _properties.vendorID;
+    header.deviceID = _properties.deviceID;
+    header.driverVersion = _properties.driverVersion;
+    std::memcpy( header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE );
+    header.dataSize = data.size();
+    Hasher hasher;
+    hasher.Add( data.data(), data.size() );
+    header.dataHash = hasher.Get();
+    return header;
+}
+
+std::string PipelineCache::Validate( const std::vector<char>& file ) const
+{
+    if( file.size() < sizeof(FileHeader) + sizeof(DriverHeader) )
+        return "too small";
+
+    FileHeader header;
+    std::memcpy( &header, file.data(), sizeof(header) );
+    if( header.magic != PipelineCache::Magic || header.fileVersion != PipelineCache::FileVersion )
+        return "not a pipeline cache file of this version";
+    if( header.vendorID != _properties.vendorID || header.deviceID != _properties.deviceID )
+        return "different device";
+    if( header.driverVersion != _properties.driverVersion )
+        return "different driver version";
+    if( std::memcmp( header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE ) != 0 )
+        return "different pipeline cache UUID";
+
+    const char* data = file.data() + sizeof(FileHeader);
+    const size_t dataSize = file.size() - sizeof(FileHeader);
+    if( header.dataSize != dataSize )
+        return "truncated";
+    Hasher hasher;
+    hasher.Add( data, dataSize );
+    if( header.dataHash != hasher.Get() )
+        return "corrupt (hash mismatch)";
+
+    // the driver's own header has to agree as well
+    DriverHeader driverHeader;
+    std::memcpy( &driverHeader, data, sizeof(driverHeader) );
+    if( driverHeader.headerSize < sizeof(DriverHeader) || driverHeader.headerSize > dataSize
+        || driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        || driverHeader.vendorID != _properties.vendorID || driverHeader.deviceID != _properties.deviceID
+        || std::memcmp( driverHeader.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE ) != 0 )
+    {
+        return "driver header mismatch";
+    }
+
+    return {};
+}
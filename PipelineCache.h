@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct PipelineCacheStats
+{
+    bool warm = false;              // started from a valid file on disk
+    std::string rejectReason;       // why the file wasn't used (empty when warm or there was none)
+    size_t loadedBytes = 0;
+    size_t savedBytes = 0;
+    double loadMs = 0.0;
+    double saveMs = 0.0;
+};
+
+std::ostream& operator<<( std::ostream& os, const PipelineCacheStats& stats );
+
+
+// VkPipelineCache persisted between runs, so pipelines compiled once aren't recompiled at every launch.
+//
+// The file is the driver's cache data behind a small header of our own (device, driver version, size, hash).
+// A file from another device / driver, or a truncated or corrupt one, is rejected before it reaches
+// the driver (not every driver checks the data it is given) and the run starts with an empty cache.
+// Saved through a temporary file + rename, so a crash mid-write can't leave a half written cache behind.
+class PipelineCache
+{
+public:
+    // path empty: in-memory only (nothing loaded or saved)
+    void Init( VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path );
+    // writes the cache back (call after the last pipeline is created); failures are reported, not thrown
+    void Save();
+    void Destroy();
+
+    VkPipelineCache Get() const { return _cache; }
+    const PipelineCacheStats& GetStats() const { return _stats; }
+
+public:
+    static constexpr uint32_t Magic = 0x48434C50;   // "PLCH"
+    static constexpr uint32_t FileVersion = 1;
+
+private:
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t fileVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    FileHeader MakeHeader( const std::vector<char>& data ) const;
+    // empty = usable
+    std::string Validate( const std::vector<char>& file ) const;
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties _properties{};
+    std::string _path;
+    VkPipelineCache _cache = VK_NULL_HANDLE;
+    PipelineCacheStats _stats;
+};
@@ -0,0 +1,350 @@
+#include "PipelineLibrary.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "utilities.h"
+
+namespace
+{
+    // a shader's SPIR-V, its size first
+    void AddFile( Hasher& hasher, const MappedFile& file )
+    {
+        hasher.Add( static_cast<uint64_t>( file.Size() ) );
+        hasher.Add( file.Data(), file.Size() );
+    }
+
+    VkShaderModule CreateShaderModule( VkDevice device, const MappedFile& code )
+    {
+        // straight from the mapping
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.Size();
+        moduleInfo.pCode = code.Spirv();
+
+        VkShaderModule shaderModule;
+        if( vkCreateShaderModule( device, &moduleInfo, nullptr, &shaderModule )
+            != VK_SUCCESS )
+        {
+            throw std::runtime_error( "Failed to create shader module!" );
+        }
+        return shaderModule;
+    }
+}
+
+std::ostream& operator<<( std::ostream& os, const PipelineLibraryStats& stats )
+{
+    os << "pipelines: " << stats.pipelineCount << " (" << stats.syncCompiles << " compiled blocking, "
+       << stats.asyncCompiles << " in the background, " << stats.failedCompiles << " failed) in "
+       << stats.compileMs << " ms, " << stats.hits << " hits, " << stats.notReady << " requests not ready yet";
+    return os;
+}
+
+PipelineLibrary::~PipelineLibrary()
+{
+    Destroy();
+}
+
+void PipelineLibrary::Init( VkDevice device, VkPipelineCache pipelineCache, uint32_t compileThreads )
+{
+    _device = device;
+    _pipelineCache = pipelineCache;
+    _stop = false;
+
+    for( uint32_t i = 0; i < compileThreads; ++i )
+        _workers.emplace_back( &PipelineLibrary::WorkerLoop, this );
+}
+
+void PipelineLibrary::Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _stop = true;
+        _queue.clear();
+    }
+    _wake.notify_all();
+    for( auto& worker : _workers )
+        worker.join();
+    _workers.clear();
+
+    for( auto& entry : _pipelines )
+        vkDestroyPipeline( _device, entry.second, nullptr );
+    _pipelines.clear();
+    _pending.clear();
+    _failed.clear();
+}
+
+VkPipeline PipelineLibrary::Get( const GraphicsPipelineDesc& desc )
+{
+    const uint64_t key = Hash( desc );
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+
+        auto found = _pipelines.find( key );
+        if( found != _pipelines.end() )
+        {
+            ++_stats.hits;
+            return found->second;
+        }
+
+        // already queued: take it over rather than waiting behind the other jobs
+        for( auto job = _queue.begin(); job != _queue.end(); ++job )
+        {
+            if( job->first == key )
+            {
+                _queue.erase( job );
+                _pending.erase( key );
+                break;
+            }
+        }
+
+        // being compiled right now: wait for that one
+        _compiled.wait( lock, [&]{ return _pending.count( key ) == 0; } );
+        found = _pipelines.find( key );
+        if( found != _pipelines.end() )
+        {
+            ++_stats.hits;
+            return found->second;
+        }
+        _pending.insert( key );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try{
+        pipeline = Compile( desc );
+    }
+    catch( std::exception& )
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _pending.erase( key );
+        ++_stats.failedCompiles;
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _pending.erase( key );
+    _failed.erase( key );
+    _pipelines[key] = pipeline;
+    ++_stats.syncCompiles;
+    _stats.compileMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    _compiled.notify_all();
+    return pipeline;
+}
+
+VkPipeline PipelineLibrary::Request( const GraphicsPipelineDesc& desc )
+{
+    const uint64_t key = Hash( desc );
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+
+        auto found = _pipelines.find( key );
+        if( found != _pipelines.end() )
+        {
+            ++_stats.hits;
+            return found->second;
+        }
+
+        ++_stats.notReady;
+        if( _pending.count( key ) > 0 || _failed.count( key ) > 0 )
+            return VK_NULL_HANDLE;
+
+        _pending.insert( key );
+        _queue.emplace_back( key, desc );
+    }
+    _wake.notify_one();
+    return VK_NULL_HANDLE;
+}
+
+PipelineLibraryStats PipelineLibrary::GetStats() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    PipelineLibraryStats stats = _stats;
+    stats.pipelineCount = static_cast<uint32_t>( _pipelines.size() );
+    return stats;
+}
+
+uint64_t PipelineLibrary::Hash( const GraphicsPipelineDesc& desc )
+{
+    Hasher hasher;
+    AddFile( hasher, *desc.vertexShader );
+    if( desc.fragmentShader )
+        AddFile( hasher, *desc.fragmentShader );
+    else
+        hasher.Add( uint64_t(0) );     // as an empty file
+
+    // binding / attribute descriptions are plain uint32 / enum fields without padding
+    hasher.AddVector( desc.bindings );
+    hasher.AddVector( desc.attributes );
+
+    hasher.Add( desc.inputAssembly.topology );
+    hasher.Add( desc.inputAssembly.primitiveRestartEnable );
+
+    const VkPipelineRasterizationStateCreateInfo& rasterizer = desc.rasterizer;
+    hasher.Add( rasterizer.depthClampEnable );
+    hasher.Add( rasterizer.rasterizerDiscardEnable );
+    hasher.Add( rasterizer.polygonMode );
+    hasher.Add( rasterizer.cullMode );
+    hasher.Add( rasterizer.frontFace );
+    hasher.Add( rasterizer.depthBiasEnable );
+    hasher.Add( rasterizer.depthBiasConstantFactor );
+    hasher.Add( rasterizer.depthBiasClamp );
+    hasher.Add( rasterizer.depthBiasSlopeFactor );
+    hasher.Add( rasterizer.lineWidth );
+
+    hasher.Add( desc.multisample.rasterizationSamples );
+    hasher.Add( desc.multisample.sampleShadingEnable );
+    hasher.Add( desc.multisample.minSampleShading );
+    hasher.Add( desc.multisample.alphaToCoverageEnable );
+    hasher.Add( desc.multisample.alphaToOneEnable );
+
+    const VkPipelineDepthStencilStateCreateInfo& depthStencil = desc.depthStencil;
+    hasher.Add( depthStencil.sType );
+    hasher.Add( depthStencil.depthTestEnable );
+    hasher.Add( depthStencil.depthWriteEnable );
+    hasher.Add( depthStencil.depthCompareOp );
+    hasher.Add( depthStencil.depthBoundsTestEnable );
+    hasher.Add( depthStencil.stencilTestEnable );
+    hasher.Add( depthStencil.front );       // uint32 / enum fields only
+    hasher.Add( depthStencil.back );
+    hasher.Add( depthStencil.minDepthBounds );
+    hasher.Add( depthStencil.maxDepthBounds );
+
+    hasher.Add( desc.colorBlendAttachment );    // uint32 / enum fields only
+    hasher.Add( desc.colorBlend.logicOpEnable );
+    hasher.Add( desc.colorBlend.logicOp );
+    hasher.Add( desc.colorBlend.blendConstants );
+
+    hasher.AddVector( desc.dynamicStates );
+    hasher.Add( desc.layout );
+    hasher.Add( desc.renderPass );
+    hasher.Add( desc.subpass );
+    return hasher.Get();
+}
+
+VkPipeline PipelineLibrary::Compile( const GraphicsPipelineDesc& desc )
+{
+    VkShaderModule vertShaderModule = CreateShaderModule( _device, *desc.vertexShader );
+    VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+    try{
+        if( desc.fragmentShader )
+            fragShaderModule = CreateShaderModule( _device, *desc.fragmentShader );
+    }
+    catch( std::exception& )
+    {
+        vkDestroyShaderModule( _device, vertShaderModule, nullptr );
+        throw;
+    }
+
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>( desc.bindings.size() );
+    vertexInputInfo.pVertexBindingDescriptions = desc.bindings.data();
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>( desc.attributes.size() );
+    vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+
+    // viewport and scissor are dynamic: only the counts matter
+    VkPipelineViewportStateCreateInfo viewportInfo{};
+    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportInfo.viewportCount = 1;
+    viewportInfo.scissorCount = 1;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendInfo = desc.colorBlend;
+    colorBlendInfo.attachmentCount = 1;
+    colorBlendInfo.pAttachments = &desc.colorBlendAttachment;
+
+    VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
+    dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>( desc.dynamicStates.size() );
+    dynamicStateInfo.pDynamicStates = desc.dynamicStates.data();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = fragShaderModule != VK_NULL_HANDLE ? 2 : 1;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &desc.inputAssembly;
+    pipelineInfo.pViewportState = &viewportInfo;
+    pipelineInfo.pRasterizationState = &desc.rasterizer;
+    pipelineInfo.pMultisampleState = &desc.multisample;
+    pipelineInfo.pDepthStencilState = desc.depthStencil.sType == VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO ? &desc.depthStencil : nullptr;
+    pipelineInfo.pColorBlendState = &colorBlendInfo;
+    pipelineInfo.pDynamicState = &dynamicStateInfo;
+    pipelineInfo.layout = desc.layout;
+    pipelineInfo.renderPass = desc.renderPass;
+    pipelineInfo.subpass = desc.subpass;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    const VkResult result = vkCreateGraphicsPipelines( _device, _pipelineCache, 1, &pipelineInfo, nullptr, &pipeline );
+    vkDestroyShaderModule( _device, vertShaderModule, nullptr );
+    vkDestroyShaderModule( _device, fragShaderModule, nullptr );
+    if( result != VK_SUCCESS )
+        throw std::runtime_error( "Failed to create graphics pipeline! (VkResult " + std::to_string( result ) + ")" );
+    return pipeline;
+}
+
+void PipelineLibrary::WorkerLoop()
+{
+    while( true )
+    {
+        uint64_t key;
+        GraphicsPipelineDesc desc;
+        {
+            std::unique_lock<std::mutex> lock( _mutex );
+            _wake.wait( lock, [this]{ return _stop || !_queue.empty(); } );
+            if( _stop )
+                return;
+
+            key = _queue.front().first;
+            desc = std::move( _queue.front().second );
+            _queue.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::string error;
+        try{
+            pipeline = Compile( desc );
+        }
+        catch( std::exception& e )
+        {
+            error = e.what();
+        }
+        const double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _pending.erase( key );
+            _stats.compileMs += ms;
+            if( pipeline != VK_NULL_HANDLE )
+            {
+                _pipelines[key] = pipeline;
+                ++_stats.asyncCompiles;
+            }
+            else
+            {
+                _failed.insert( key );
+                ++_stats.failedCompiles;
+            }
+        }
+        _compiled.notify_all();
+
+        if( !error.empty() )
+            std::cout << "pipeline library: background compile failed, keeping the old pipeline: " << error << std::endl;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "MappedFile.h"
+
+// everything a graphics pipeline is built from, by value (the shader code is immutable and shared),
+// so it can be hashed and handed to a compile thread
+struct GraphicsPipelineDesc
+{
+    std::shared_ptr<const MappedFile> vertexShader;     // SPIR-V, shared (copying a desc doesn't copy code)
+    std::shared_ptr<const MappedFile> fragmentShader;   // null: vertex only (depth-only passes)
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisample{};     // pSampleMask is not supported
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};   // sType 0: the render pass has no depth attachment
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    VkPipelineColorBlendStateCreateInfo colorBlend{};       // one attachment: colorBlendAttachment
+    std::vector<VkDynamicState> dynamicStates;              // viewport and scissor have to be among them
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+};
+
+struct PipelineLibraryStats
+{
+    uint32_t pipelineCount = 0;
+    uint32_t hits = 0;              // Get / Request answered from the library
+    uint32_t syncCompiles = 0;      // compiled by a blocking Get
+    uint32_t asyncCompiles = 0;     // compiled on a background thread
+    uint32_t failedCompiles = 0;
+    uint32_t notReady = 0;          // Request returned VK_NULL_HANDLE (caller fell back / skipped)
+    double compileMs = 0.0;         // summed over every compile, whichever thread
+};
+
+std::ostream& operator<<( std::ostream& os, const PipelineLibraryStats& stats );
+
+
+// Graphics pipelines keyed by a hash of their full description.
+// Identical descriptions share one VkPipeline; a new one is either compiled right away (Get, for startup)
+// or queued for the background threads (Request), which returns VK_NULL_HANDLE until it is ready,
+// so the render loop keeps drawing with what it has instead of stalling on the compiler.
+// Compiles go through the shared VkPipelineCache (internally synchronized).
+class PipelineLibrary
+{
+public:
+    PipelineLibrary() = default;
+    ~PipelineLibrary();
+    PipelineLibrary( const PipelineLibrary& ) = delete;
+    PipelineLibrary& operator=( const PipelineLibrary& ) = delete;
+
+    void Init( VkDevice device, VkPipelineCache pipelineCache, uint32_t compileThreads = DefaultCompileThreads );
+    // waits for the compiles in progress, drops the queued ones, destroys every pipeline
+    void Destroy();
+
+    // blocks until the pipeline exists (compiles on this thread if nobody is at it); throws when it fails
+    VkPipeline Get( const GraphicsPipelineDesc& desc );
+    // never blocks: the pipeline, or VK_NULL_HANDLE while it compiles (queued on the first call)
+    // or if its compile failed
+    VkPipeline Request( const GraphicsPipelineDesc& desc );
+
+    PipelineLibraryStats GetStats() const;
+
+    static uint64_t Hash( const GraphicsPipelineDesc& desc );
+
+public:
+    static constexpr uint32_t DefaultCompileThreads = 2;
+
+private:
+    VkPipeline Compile( const GraphicsPipelineDesc& desc );     // throws std::runtime_error
+    void WorkerLoop();
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;      // workers: a job was queued (or shutdown)
+    std::condition_variable _compiled;  // Get: a background compile finished
+    std::unordered_map<uint64_t, VkPipeline> _pipelines;
+    std::unordered_set<uint64_t> _pending;      // queued or compiling
+    std::unordered_set<uint64_t> _failed;       // not retried
+    std::deque<std::pair<uint64_t, GraphicsPipelineDesc>> _queue;
+    std::vector<std::thread> _workers;
+    bool _stop = false;
+    PipelineLibraryStats _stats;
+};
@@ -0,0 +1,316 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    Percentiles ComputePercentiles( std::vector<double> samples )
+    {
+        Percentiles result{};
+        if( samples.empty() )
+            return result;
+
+        std::sort( samples.begin(), samples.end() );
+
+        double sum = 0.0;
+        for( auto sample : samples )
+            sum += sample;
+
+        // nearest rank
+        auto rank = [&samples]( double p ) {
+            size_t index = static_cast<size_t>( p * double(samples.size() - 1) + 0.5 );
+            return samples[std::min( index, samples.size() - 1 )];
+        };
+
+        result.mean = sum / double(samples.size());
+        result.p50 = rank( 0.50 );
+        result.p95 = rank( 0.95 );
+        result.p99 = rank( 0.99 );
+        result.max = samples.back();
+        return result;
+    }
+
+    void WritePercentilesJson( std::ostream& out, const Percentiles& p )
+    {
+        out << "{ \"mean\": " << p.mean << ", \"p50\": " << p.p50 << ", \"p95\": " << p.p95
+            << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << " }";
+    }
+}
+
+const char* ToString( ProfilePhase phase )
+{
+    switch( phase )
+    {
+    case ProfilePhase::FenceWait:   return "fence_wait";
+    case ProfilePhase::Pacing:      return "pacing";
+    case ProfilePhase::Uniforms:    return "uniforms";
+    case ProfilePhase::Upload:      return "upload";
+    case ProfilePhase::Acquire:     return "acquire";
+    case ProfilePhase::Submit:      return "submit";
+    case ProfilePhase::Present:     return "present";
+    default:                        return "unknown";
+    }
+}
+
+const char* ProfileSummary::Bottleneck() const
+{
+    if( frameCount == 0 )
+        return "unknown";
+
+    // the limiter sleeps the frame away: neither side is the limit
+    if( phaseMs[size_t(ProfilePhase::Pacing)].p50 > 0.5 * frameMs.p50 )
+        return "paced";
+
+    // the CPU blocks on the fence (or acquire) when the GPU is behind
+    const double waitMs = phaseMs[size_t(ProfilePhase::FenceWait)].p50 + phaseMs[size_t(ProfilePhase::Acquire)].p50;
+    if( waitMs > 0.5 * frameMs.p50 || (gpuSampleCount > 0 && gpuMs.p50 > 0.9 * frameMs.p50) )
+        return "GPU-bound";
+    return "CPU-bound";
+}
+
+std::ostream& operator<<( std::ostream& os, const ProfileSummary& summary )
+{
+    os << "profile: " << summary.frameCount << " frames, " << summary.fps << " fps, frame ms p50 "
+       << summary.frameMs.p50 << " / p95 " << summary.frameMs.p95 << " / p99 " << summary.frameMs.p99;
+
+    if( summary.gpuSampleCount > 0 )
+        os << ", gpu ms p50 " << summary.gpuMs.p50 << " / p95 " << summary.gpuMs.p95 << " / p99 " << summary.gpuMs.p99;
+    if( summary.latencySampleCount > 0 )
+        os << ", input->gpu done ms p50 " << summary.latencyMs.p50 << " / p95 " << summary.latencyMs.p95 << " / p99 " << summary.latencyMs.p99;
+
+    os << " [";
+    for( size_t i = 0; i < summary.phaseMs.size(); ++i )
+        os << (i ? ", " : "") << ToString( ProfilePhase(i) ) << " " << summary.phaseMs[i].p50;
+    os << "] -> " << summary.Bottleneck();
+    return os;
+}
+
+
+// --- Scope ---
+Profiler::Scope::Scope( Profiler& profiler, ProfilePhase phase )
+    : _profiler( profiler ), _phase( phase ), _start( Clock::now() )
+{
+}
+
+Profiler::Scope::~Scope()
+{
+    if( !_profiler._enabled )
+        return;
+
+    _profiler._currentPhaseMs[size_t(_phase)] +=
+        std::chrono::duration<double, std::milli>( Clock::now() - _start ).count();
+}
+
+
+// --- Profiler ---
+void Profiler::Init( bool enabled, uint32_t reportInterval )
+{
+    _enabled = enabled;
+    _reportInterval = reportInterval;
+}
+
+void Profiler::InitGpu( VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t slotCount )
+{
+    if( !_enabled )
+        return;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &familyCount, nullptr );
+    std::vector<VkQueueFamilyProperties> families( familyCount );
+    vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &familyCount, families.data() );
+
+    const uint32_t validBits = families[queueFamily].timestampValidBits;
+    if( validBits == 0 )
+    {
+        std::cout << "profile: no timestamp support on the graphics queue, GPU timing disabled" << std::endl;
+        return;
+    }
+    _timestampMask = validBits >= 64 ? ~0ULL : ((1ULL << validBits) - 1);
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties( physicalDevice, &properties );
+    _timestampPeriodNs = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = slotCount * 2;
+
+    _device = device;
+    _slotCount = slotCount;
+    if( vkCreateQueryPool( _device, &queryPoolInfo, nullptr, &_queryPool )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create timestamp query pool!" );
+    }
+}
+
+void Profiler::DestroyGpu()
+{
+    if( _queryPool != VK_NULL_HANDLE )
+        vkDestroyQueryPool( _device, _queryPool, nullptr );
+    _queryPool = VK_NULL_HANDLE;
+}
+
+void Profiler::CmdBeginGpu( VkCommandBuffer commandBuffer, uint32_t slot )
+{
+    if( _queryPool == VK_NULL_HANDLE || slot >= _slotCount )
+        return;
+
+    // reset has to happen outside the render pass, so it lives in the command buffer itself
+    vkCmdResetQueryPool( commandBuffer, _queryPool, slot * 2, 2 );
+    vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, slot * 2 );
+}
+
+void Profiler::CmdEndGpu( VkCommandBuffer commandBuffer, uint32_t slot )
+{
+    if( _queryPool == VK_NULL_HANDLE || slot >= _slotCount )
+        return;
+
+    vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, slot * 2 + 1 );
+}
+
+void Profiler::CollectGpu( uint32_t slot )
+{
+    if( _queryPool == VK_NULL_HANDLE || slot >= _slotCount )
+        return;
+
+    // { begin, availability, end, availability }; no WAIT: if the slot was re-submitted
+    // meanwhile the result just isn't available and this frame gets no GPU sample
+    uint64_t results[4] = {};
+    VkResult result = vkGetQueryPoolResults( _device, _queryPool, slot * 2, 2, sizeof(results), results, sizeof(uint64_t) * 2,
+                                                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+    if( result != VK_SUCCESS || results[1] == 0 || results[3] == 0 )
+        return;
+
+    const uint64_t ticks = ( (results[2] & _timestampMask) - (results[0] & _timestampMask) ) & _timestampMask;
+    _currentGpuMs = double(ticks) * _timestampPeriodNs / 1e6;
+}
+
+void Profiler::Start()
+{
+    _lastFrameEnd = Clock::now();
+}
+
+void Profiler::EndFrame()
+{
+    if( !_enabled )
+        return;
+
+    const Clock::time_point now = Clock::now();
+    _frameMs.push_back( std::chrono::duration<double, std::milli>( now - _lastFrameEnd ).count() );
+    _lastFrameEnd = now;
+
+    for( size_t i = 0; i < _currentPhaseMs.size(); ++i )
+        _phaseMs[i].push_back( _currentPhaseMs[i] );
+    _gpuMs.push_back( _currentGpuMs );
+    _latencyMs.push_back( _currentLatencyMs );
+
+    _currentPhaseMs.fill( 0.0 );
+    _currentGpuMs = -1.0;
+    _currentLatencyMs = -1.0;
+
+    const uint32_t frameCount = GetFrameCount();
+    if( _reportInterval > 0 && frameCount % _reportInterval == 0 )
+        std::cout << Summarize( frameCount - _reportInterval, frameCount ) << std::endl;
+}
+
+ProfileSummary Profiler::Summarize( uint32_t firstFrame, uint32_t lastFrame ) const
+{
+    ProfileSummary summary{};
+    lastFrame = std::min( lastFrame, GetFrameCount() );
+    if( firstFrame >= lastFrame )
+        return summary;
+
+    summary.frameCount = lastFrame - firstFrame;
+
+    std::vector<double> frames( _frameMs.begin() + firstFrame, _frameMs.begin() + lastFrame );
+    double totalMs = 0.0;
+    for( auto ms : frames )
+        totalMs += ms;
+    summary.fps = totalMs > 0.0 ? 1000.0 * double(summary.frameCount) / totalMs : 0.0;
+    summary.frameMs = ComputePercentiles( std::move( frames ) );
+
+    for( size_t i = 0; i < _phaseMs.size(); ++i )
+        summary.phaseMs[i] = ComputePercentiles( std::vector<double>( _phaseMs[i].begin() + firstFrame, _phaseMs[i].begin() + lastFrame ) );
+
+    std::vector<double> gpu;
+    for( uint32_t i = firstFrame; i < lastFrame; ++i )
+    {
+        if( _gpuMs[i] >= 0.0 )
+            gpu.push_back( _gpuMs[i] );
+    }
+    summary.gpuSampleCount = static_cast<uint32_t>( gpu.size() );
+    summary.gpuMs = ComputePercentiles( std::move( gpu ) );
+
+    std::vector<double> latency;
+    for( uint32_t i = firstFrame; i < lastFrame; ++i )
+    {
+        if( _latencyMs[i] >= 0.0 )
+            latency.push_back( _latencyMs[i] );
+    }
+    summary.latencySampleCount = static_cast<uint32_t>( latency.size() );
+    summary.latencyMs = ComputePercentiles( std::move( latency ) );
+
+    return summary;
+}
+
+void Profiler::Write( const std::string& path ) const
+{
+    std::ofstream out( path );
+    if( !out.is_open() )
+        throw std::runtime_error( "Failed to open " + path + " for writing!" );
+
+    const bool json = path.size() >= 5 && path.compare( path.size() - 5, 5, ".json" ) == 0;
+    if( json )
+        WriteJson( out );
+    else
+        WriteCsv( out );
+}
+
+void Profiler::WriteCsv( std::ostream& out ) const
+{
+    // gpu_ms / input_to_gpu_done_ms belong to the latest completed frame (they lag by the frames in flight), -1 = none
+    out << "frame,frame_ms";
+    for( size_t i = 0; i < _phaseMs.size(); ++i )
+        out << "," << ToString( ProfilePhase(i) ) << "_ms";
+    out << ",gpu_ms,input_to_gpu_done_ms\n";
+
+    for( size_t frame = 0; frame < _frameMs.size(); ++frame )
+    {
+        out << frame << "," << _frameMs[frame];
+        for( const auto& phase : _phaseMs )
+            out << "," << phase[frame];
+        out << "," << _gpuMs[frame] << "," << _latencyMs[frame] << "\n";
+    }
+}
+
+void Profiler::WriteJson( std::ostream& out ) const
+{
+    const ProfileSummary summary = Summarize();
+
+    out << "{\n";
+    out << "  \"frames\": " << summary.frameCount << ",\n";
+    out << "  \"fps\": " << summary.fps << ",\n";
+    out << "  \"bottleneck\": \"" << summary.Bottleneck() << "\",\n";
+    out << "  \"frame_ms\": ";
+    WritePercentilesJson( out, summary.frameMs );
+    out << ",\n  \"gpu_ms\": ";
+    WritePercentilesJson( out, summary.gpuMs );
+    out << ",\n  \"gpu_samples\": " << summary.gpuSampleCount << ",\n";
+    out << "  \"input_to_gpu_done_ms\": ";
+    WritePercentilesJson( out, summary.latencyMs );
+    out << ",\n  \"input_to_gpu_done_samples\": " << summary.latencySampleCount << ",\n";
+    out << "  \"phases_ms\": {\n";
+    for( size_t i = 0; i < summary.phaseMs.size(); ++i )
+    {
+        out << "    \"" << ToString( ProfilePhase(i) ) << "\": ";
+        WritePercentilesJson( out, summary.phaseMs[i] );
+        out << (i + 1 < summary.phaseMs.size() ? ",\n" : "\n");
+    }
+    out << "  }\n";
+    out << "}\n";
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// CPU phases of a frame, in DrawFrame order
+enum class ProfilePhase : uint32_t
+{
+    FenceWait,      // waiting for the frame slot to come back from the GPU
+    Pacing,         // frame limiter sleep (--target-frame-ms)
+    Uniforms,       // camera + object transforms into the frame slot's slice
+    Upload,         // staging uploader flush
+    Acquire,        // vkAcquireNextImageKHR
+    Submit,         // vkQueueSubmit
+    Present,        // vkQueuePresentKHR
+    Count
+};
+
+const char* ToString( ProfilePhase phase );
+
+struct Percentiles
+{
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+struct ProfileSummary
+{
+    uint32_t frameCount = 0;
+    double fps = 0.0;
+    Percentiles frameMs;                    // CPU frame-to-frame time
+    std::array<Percentiles, size_t(ProfilePhase::Count)> phaseMs;
+    Percentiles gpuMs;                      // render pass, from timestamps
+    uint32_t gpuSampleCount = 0;
+    Percentiles latencyMs;                  // input sampled -> GPU finished the frame (fence seen signalled), not presented
+    uint32_t latencySampleCount = 0;
+
+    // where the time goes: waiting on the GPU most of the frame means GPU-bound
+    const char* Bottleneck() const;
+};
+
+std::ostream& operator<<( std::ostream& os, const ProfileSummary& summary );
+
+
+// Per-frame CPU phase timings plus GPU render pass time (vkCmdWriteTimestamp),
+// kept for the whole run so the percentiles can be taken over any frame range.
+class Profiler
+{
+public:
+    // times one phase of the current frame
+    class Scope
+    {
+    public:
+        Scope( Profiler& profiler, ProfilePhase phase );
+        ~Scope();
+        Scope( const Scope& ) = delete;
+        Scope& operator=( const Scope& ) = delete;
+
+    private:
+        Profiler& _profiler;
+        ProfilePhase _phase;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+public:
+    void Init( bool enabled, uint32_t reportInterval );
+
+    // GPU timing is skipped (without error) when the queue family has no timestamp support
+    void InitGpu( VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t slotCount );
+    void DestroyGpu();
+
+    // recorded around the render pass; slot = the command buffer's index
+    // (slots past slotCount, e.g. images of a recreated swapchain with more images, are not timed)
+    void CmdBeginGpu( VkCommandBuffer commandBuffer, uint32_t slot );
+    void CmdEndGpu( VkCommandBuffer commandBuffer, uint32_t slot );
+    // call once the submission that used the slot is known to be complete
+    void CollectGpu( uint32_t slot );
+
+    // latency of an earlier frame that just completed, attributed to the current frame (like the GPU time);
+    // when several complete at once, the current frame keeps the longest
+    void AddLatency( double ms ) { _currentLatencyMs = std::max( _currentLatencyMs, ms ); }
+
+    // starts the frame clock (call right before the first frame)
+    void Start();
+    // closes the current frame; prints a rolling summary every reportInterval frames
+    void EndFrame();
+
+    ProfileSummary Summarize( uint32_t firstFrame, uint32_t lastFrame ) const;     // [first, last)
+    ProfileSummary Summarize() const { return Summarize( 0, GetFrameCount() ); }
+    uint32_t GetFrameCount() const { return static_cast<uint32_t>( _frameMs.size() ); }
+    bool IsEnabled() const { return _enabled; }
+
+    // .json: summary; anything else: one CSV row per frame
+    void Write( const std::string& path ) const;
+
+private:
+    void WriteCsv( std::ostream& out ) const;
+    void WriteJson( std::ostream& out ) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool _enabled = false;
+    uint32_t _reportInterval = 0;
+
+    // per frame samples (ms); frames without a GPU / latency sample store -1
+    std::vector<double> _frameMs;
+    std::array<std::vector<double>, size_t(ProfilePhase::Count)> _phaseMs;
+    std::vector<double> _gpuMs;
+    std::vector<double> _latencyMs;
+    std::array<double, size_t(ProfilePhase::Count)> _currentPhaseMs{};
+    double _currentGpuMs = -1.0;
+    double _currentLatencyMs = -1.0;
+    Clock::time_point _lastFrameEnd{};
+
+    // GPU timestamps: 2 queries (begin, end) per slot
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueryPool _queryPool = VK_NULL_HANDLE;
+    uint32_t _slotCount = 0;
+    double _timestampPeriodNs = 0.0;
+    uint64_t _timestampMask = 0;
+};
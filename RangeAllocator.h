@@ -0,0 +1,288 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// TLSF-style (two-level segregated fit) free-list over a [0, capacity) range.
+// Used to sub-allocate big VkDeviceMemory blocks without calling into the driver.
+//
+// Free ranges are binned by size: the first level is the power of two, the second splits it into
+// SecondLevelCount linear steps. Two bitmaps say which bins hold anything, so finding a range that fits
+// is a couple of bit scans, whatever the number of free ranges. Freed ranges are merged with their
+// neighbours through hash maps keyed by their begin and end offsets.
+class RangeAllocator
+{
+public:
+    RangeAllocator() = default;
+    explicit RangeAllocator( VkDeviceSize capacity )
+    {
+        AddRange( 0, capacity );
+    }
+
+    // good-fit: returns false when no free range can hold an aligned sub-range of `size` bytes
+    bool Allocate( VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset )
+    {
+        if( alignment == 0 ) alignment = 1;
+
+        // every range of a bin at least this big fits, whatever its alignment
+        uint32_t node = FindFree( size + alignment - 1 );
+        // then none is that big: the bins from the size itself up may still hold one that fits at its alignment
+        if( node == InvalidNode )
+            node = FindFreeAligned( size, alignment );
+        if( node == InvalidNode )
+            return false;
+
+        const VkDeviceSize rangeBegin = _nodes[node].offset;
+        const VkDeviceSize rangeEnd = rangeBegin + _nodes[node].size;
+        const VkDeviceSize alignedBegin = AlignUp( rangeBegin, alignment );
+        RemoveFree( node );
+
+        // the padding in front of the aligned offset and the tail stay free
+        if( alignedBegin > rangeBegin )
+            InsertFree( rangeBegin, alignedBegin - rangeBegin );
+        if( alignedBegin + size < rangeEnd )
+            InsertFree( alignedBegin + size, rangeEnd - (alignedBegin + size) );
+
+        _used += size;
+        offset = alignedBegin;
+        return true;
+    }
+
+    // give [offset, offset + size) back and merge it with its free neighbours
+    void Free( VkDeviceSize offset, VkDeviceSize size )
+    {
+        if( size == 0 ) return;
+        _used -= size;
+
+        auto next = _byBegin.find( offset + size );
+        if( next != _byBegin.end() )
+        {
+            const uint32_t node = next->second;
+            size += _nodes[node].size;
+            RemoveFree( node );
+        }
+
+        auto prev = _byEnd.find( offset );
+        if( prev != _byEnd.end() )
+        {
+            const uint32_t node = prev->second;
+            offset = _nodes[node].offset;
+            size += _nodes[node].size;
+            RemoveFree( node );
+        }
+
+        InsertFree( offset, size );
+    }
+
+    // makes [offset, offset + size) (outside every range added so far) available;
+    // ranges added next to each other merge like freed ones
+    void AddRange( VkDeviceSize offset, VkDeviceSize size )
+    {
+        if( size == 0 ) return;
+        _capacity += size;
+        _used += size;
+        Free( offset, size );
+    }
+
+    // takes [offset, offset + size) away again; only works while it is exactly one free range
+    bool RemoveRange( VkDeviceSize offset, VkDeviceSize size )
+    {
+        auto it = _byBegin.find( offset );
+        if( it == _byBegin.end() || _nodes[it->second].size != size )
+            return false;
+
+        RemoveFree( it->second );
+        _capacity -= size;
+        return true;
+    }
+
+    bool IsEmpty() const { return _used == 0; }
+    VkDeviceSize GetCapacity() const { return _capacity; }
+    VkDeviceSize GetUsed() const { return _used; }
+    size_t GetFreeRangeCount() const { return _byBegin.size(); }
+
+    VkDeviceSize GetLargestFreeRange() const
+    {
+        if( _firstLevelMap == 0 )
+            return 0;
+
+        // the biggest ranges are in the highest non-empty bin
+        const uint32_t firstLevel = 63 - static_cast<uint32_t>( __builtin_clzll( _firstLevelMap ) );
+        const uint32_t secondLevel = 31 - static_cast<uint32_t>( __builtin_clz( _secondLevelMaps[firstLevel] ) );
+
+        VkDeviceSize largest = 0;
+        for( uint32_t node = _bins[firstLevel * SecondLevelCount + secondLevel]; node != InvalidNode; node = _nodes[node].next )
+            largest = _nodes[node].size > largest ? _nodes[node].size : largest;
+        return largest;
+    }
+
+    static VkDeviceSize AlignUp( VkDeviceSize value, VkDeviceSize alignment )
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+private:
+    static constexpr uint32_t SecondLevelBits = 4;
+    static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+    static constexpr uint32_t FirstLevelCount = 64 - SecondLevelBits + 1;
+    static constexpr uint32_t InvalidNode = UINT32_MAX;
+    static constexpr uint32_t InvalidBin = UINT32_MAX;
+
+    // a free range, linked into the list of its bin
+    struct FreeRange
+    {
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint32_t bin = 0;
+        uint32_t prev = InvalidNode;
+        uint32_t next = InvalidNode;
+    };
+
+    // the bin size belongs to: sizes below SecondLevelCount get one bin each, the rest
+    // the power of two and the SecondLevelBits bits after the leading one
+    static void MapSize( VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel )
+    {
+        if( size < SecondLevelCount )
+        {
+            firstLevel = 0;
+            secondLevel = static_cast<uint32_t>( size );
+            return;
+        }
+
+        const uint32_t log2 = 63 - static_cast<uint32_t>( __builtin_clzll( size ) );
+        firstLevel = log2 - SecondLevelBits + 1;
+        secondLevel = static_cast<uint32_t>( size >> (log2 - SecondLevelBits) ) - SecondLevelCount;
+    }
+
+    // the first range of the smallest bin whose ranges are all at least size bytes
+    uint32_t FindFree( VkDeviceSize size ) const
+    {
+        // round up to the next bin boundary so anything in the bin is big enough
+        if( size >= SecondLevelCount )
+        {
+            const uint32_t log2 = 63 - static_cast<uint32_t>( __builtin_clzll( size ) );
+            const VkDeviceSize step = VkDeviceSize(1) << (log2 - SecondLevelBits);
+            if( size > UINT64_MAX - (step - 1) )
+                return InvalidNode;
+            size += step - 1;
+        }
+
+        uint32_t firstLevel, secondLevel;
+        MapSize( size, firstLevel, secondLevel );
+
+        const uint32_t bin = FindBin( firstLevel * SecondLevelCount + secondLevel );
+        return bin == InvalidBin ? InvalidNode : _bins[bin];
+    }
+
+    // the first non-empty bin from bin up (the bins are in size order)
+    uint32_t FindBin( uint32_t bin ) const
+    {
+        uint32_t firstLevel = bin / SecondLevelCount;
+        if( firstLevel >= FirstLevelCount )
+            return InvalidBin;
+
+        uint32_t secondLevelMap = _secondLevelMaps[firstLevel] & (~0u << (bin % SecondLevelCount));
+        if( secondLevelMap == 0 )
+        {
+            const uint64_t firstLevelMap = firstLevel + 1 < 64 ? _firstLevelMap & (~0ull << (firstLevel + 1)) : 0;
+            if( firstLevelMap == 0 )
+                return InvalidBin;
+
+            firstLevel = static_cast<uint32_t>( __builtin_ctzll( firstLevelMap ) );
+            secondLevelMap = _secondLevelMaps[firstLevel];
+        }
+
+        return firstLevel * SecondLevelCount + static_cast<uint32_t>( __builtin_ctz( secondLevelMap ) );
+    }
+
+    // a range that holds size bytes at alignment, from the bins between size's own and the ones FindFree
+    // searched (those are empty when it comes to this), range by range
+    uint32_t FindFreeAligned( VkDeviceSize size, VkDeviceSize alignment ) const
+    {
+        uint32_t firstLevel, secondLevel;
+        MapSize( size, firstLevel, secondLevel );
+
+        for( uint32_t bin = FindBin( firstLevel * SecondLevelCount + secondLevel ); bin != InvalidBin; bin = FindBin( bin + 1 ) )
+        {
+            for( uint32_t node = _bins[bin]; node != InvalidNode; node = _nodes[node].next )
+            {
+                if( AlignUp( _nodes[node].offset, alignment ) + size <= _nodes[node].offset + _nodes[node].size )
+                    return node;
+            }
+        }
+        return InvalidNode;
+    }
+
+    void InsertFree( VkDeviceSize offset, VkDeviceSize size )
+    {
+        if( _bins.empty() )
+            _bins.assign( FirstLevelCount * SecondLevelCount, InvalidNode );
+
+        uint32_t node;
+        if( !_unusedNodes.empty() )
+        {
+            node = _unusedNodes.back();
+            _unusedNodes.pop_back();
+        }
+        else
+        {
+            node = static_cast<uint32_t>( _nodes.size() );
+            _nodes.emplace_back();
+        }
+
+        uint32_t firstLevel, secondLevel;
+        MapSize( size, firstLevel, secondLevel );
+
+        FreeRange& range = _nodes[node];
+        range.offset = offset;
+        range.size = size;
+        range.bin = firstLevel * SecondLevelCount + secondLevel;
+        range.prev = InvalidNode;
+        range.next = _bins[range.bin];
+        if( range.next != InvalidNode )
+            _nodes[range.next].prev = node;
+        _bins[range.bin] = node;
+
+        _firstLevelMap |= 1ull << firstLevel;
+        _secondLevelMaps[firstLevel] |= 1u << secondLevel;
+        _byBegin[offset] = node;
+        _byEnd[offset + size] = node;
+    }
+
+    void RemoveFree( uint32_t node )
+    {
+        FreeRange& range = _nodes[node];
+        if( range.prev != InvalidNode )
+            _nodes[range.prev].next = range.next;
+        else
+            _bins[range.bin] = range.next;
+        if( range.next != InvalidNode )
+            _nodes[range.next].prev = range.prev;
+
+        if( _bins[range.bin] == InvalidNode )
+        {
+            const uint32_t firstLevel = range.bin / SecondLevelCount;
+            _secondLevelMaps[firstLevel] &= ~(1u << (range.bin % SecondLevelCount));
+            if( _secondLevelMaps[firstLevel] == 0 )
+                _firstLevelMap &= ~(1ull << firstLevel);
+        }
+
+        _byBegin.erase( range.offset );
+        _byEnd.erase( range.offset + range.size );
+        _unusedNodes.push_back( node );
+    }
+
+private:
+    std::vector<FreeRange> _nodes;          // free ranges; slots of merged / allocated ones are reused
+    std::vector<uint32_t> _unusedNodes;
+    std::vector<uint32_t> _bins;            // first node per (first level, second level) bin, created on first use
+    uint64_t _firstLevelMap = 0;            // bit per first level with any non-empty bin
+    uint32_t _secondLevelMaps[FirstLevelCount] = {};    // bit per non-empty bin
+    std::unordered_map<VkDeviceSize, uint32_t> _byBegin;    // offset -> node
+    std::unordered_map<VkDeviceSize, uint32_t> _byEnd;      // offset + size -> node
+    VkDeviceSize _capacity = 0;
+    VkDeviceSize _used = 0;
+};
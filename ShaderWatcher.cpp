@@ -0,0 +1,177 @@
+#include "ShaderWatcher.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+
+namespace
+{
+    std::string FileName( const std::string& path )
+    {
+        const size_t slash = path.find_last_of( '/' );
+        return slash == std::string::npos ? path : path.substr( slash + 1 );
+    }
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    Stop();
+}
+
+void ShaderWatcher::Start( const std::string& directory, const std::vector<Shader>& shaders, const std::string& compiler )
+{
+    _directory = directory;
+    _shaders = shaders;
+    _compiler = compiler;
+
+    _inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    _wakeFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if( _inotify < 0 || _wakeFd < 0 )
+    {
+        Stop();
+        throw std::runtime_error( "Failed to create inotify instance for shader hot reload!" );
+    }
+
+    // the directory, not the files: editors often save through a temporary file + rename,
+    // which would leave a watch on the file itself pointing at the old inode
+    if( inotify_add_watch( _inotify, _directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0 )
+    {
+        Stop();
+        throw std::runtime_error( "Failed to watch " + _directory + " for shader changes!" );
+    }
+
+    _thread = std::thread( &ShaderWatcher::WatchLoop, this );
+    std::cout << "shader hot reload: watching " << _directory << " (" << _shaders.size() << " shaders)" << std::endl;
+}
+
+void ShaderWatcher::Stop()
+{
+    if( _thread.joinable() )
+    {
+        const uint64_t one = 1;
+        if( write( _wakeFd, &one, sizeof(one) ) < 0 )
+            std::cout << "shader hot reload: failed to wake the watch thread" << std::endl;
+        _thread.join();
+    }
+
+    if( _inotify >= 0 )
+        close( _inotify );
+    if( _wakeFd >= 0 )
+        close( _wakeFd );
+    _inotify = -1;
+    _wakeFd = -1;
+}
+
+std::vector<ShaderWatcher::Reloaded> ShaderWatcher::Poll()
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    std::vector<Reloaded> reloaded;
+    reloaded.swap( _reloaded );
+    return reloaded;
+}
+
+void ShaderWatcher::WatchLoop()
+{
+    std::set<size_t> changed;   // indices into _shaders
+
+    while( true )
+    {
+        // block until something happens; once changes are pending, only wait out the debounce window
+        pollfd fds[2] = { { _inotify, POLLIN, 0 }, { _wakeFd, POLLIN, 0 } };
+        const int ready = poll( fds, 2, changed.empty() ? -1 : ShaderWatcher::DebounceMs );
+        if( ready < 0 )
+            continue;   // EINTR
+        if( fds[1].revents & POLLIN )
+            return;     // Stop()
+
+        if( fds[0].revents & POLLIN )
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while( (length = read( _inotify, buffer, sizeof(buffer) )) > 0 )
+            {
+                for( ssize_t offset = 0; offset < length; )
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>( buffer + offset );
+                    if( event->len > 0 )
+                    {
+                        for( size_t i = 0; i < _shaders.size(); ++i )
+                        {
+                            if( FileName( _shaders[i].source ) == event->name )
+                                changed.insert( i );
+                        }
+                    }
+                    offset += sizeof(inotify_event) + event->len;
+                }
+            }
+            continue;   // restart the debounce window
+        }
+
+        // quiet for DebounceMs: compile everything that changed
+        for( size_t index : changed )
+        {
+            const Shader& shader = _shaders[index];
+
+            std::string log;
+            Reloaded reloaded;
+            reloaded.spirv = shader.spirv;
+            bool compiled = Compile( shader, log );
+            if( compiled )
+            {
+                try{
+                    reloaded.code = MappedFile::Open( shader.spirv );
+                    reloaded.code->Spirv();     // checks it is SPIR-V at all
+                }
+                catch( std::exception& e )
+                {
+                    log += e.what();
+                    compiled = false;
+                }
+            }
+            if( !compiled )
+            {
+                std::cout << "shader hot reload: " << shader.source << " failed, keeping the old one\n" << log << std::endl;
+                continue;
+            }
+
+            std::cout << "shader hot reload: " << shader.source << " -> " << shader.spirv << std::endl;
+            std::lock_guard<std::mutex> lock( _mutex );
+            _reloaded.push_back( std::move( reloaded ) );
+        }
+        changed.clear();
+    }
+}
+
+bool ShaderWatcher::Compile( const Shader& shader, std::string& log ) const
+{
+    // into a temporary file first: a failed compile must not leave a broken .spv behind
+    const std::string output = shader.spirv + ".tmp";
+    const std::string command = _compiler + " '" + shader.source + "' -o '" + output + "' 2>&1";
+
+    FILE* pipe = popen( command.c_str(), "r" );
+    if( pipe == nullptr )
+    {
+        log = "failed to run " + _compiler;
+        return false;
+    }
+
+    char line[256];
+    while( fgets( line, sizeof(line), pipe ) != nullptr )
+        log += line;
+
+    const int status = pclose( pipe );
+    if( status != 0 || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+    {
+        std::remove( output.c_str() );
+        return false;
+    }
+
+    return std::rename( output.c_str(), shader.spirv.c_str() ) == 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Shader hot reload: watches the shader sources (inotify on their directory), recompiles the
+// ones that changed with glslc on a background thread and hands the new SPIR-V to the render
+// thread, which swaps the pipeline in at a frame boundary (see PipelineLibrary::Request).
+// A source that fails to compile only prints the compiler output; the old SPIR-V stays in use.
+//
+// Linux only (inotify); glslc has to be on the PATH.
+class ShaderWatcher
+{
+public:
+    struct Shader
+    {
+        std::string source;     // e.g. shaders/shader.vert
+        std::string spirv;      // e.g. shaders/vert.spv (rewritten, so the next launch starts from it too)
+    };
+
+    struct Reloaded
+    {
+        std::string spirv;      // Shader::spirv of the reloaded shader
+        std::shared_ptr<const MappedFile> code;
+    };
+
+public:
+    ShaderWatcher() = default;
+    ~ShaderWatcher();
+    ShaderWatcher( const ShaderWatcher& ) = delete;
+    ShaderWatcher& operator=( const ShaderWatcher& ) = delete;
+
+    // every source has to live in directory; throws std::runtime_error when it can't be watched
+    void Start( const std::string& directory, const std::vector<Shader>& shaders, const std::string& compiler = "glslc" );
+    void Stop();
+
+    // shaders recompiled since the last call (render thread, once per frame)
+    std::vector<Reloaded> Poll();
+
+    bool IsRunning() const { return _thread.joinable(); }
+
+public:
+    // editors save in bursts (write, rename, chmod...): changes are collected this long before compiling
+    static constexpr int DebounceMs = 50;
+
+private:
+    void WatchLoop();
+    // compiles one shader into its .spv; false (with the compiler output in log) on failure
+    bool Compile( const Shader& shader, std::string& log ) const;
+
+private:
+    std::string _directory;
+    std::vector<Shader> _shaders;
+    std::string _compiler;
+
+    int _inotify = -1;
+    int _wakeFd = -1;       // eventfd: wakes the watch thread up for Stop()
+    std::thread _thread;
+
+    std::mutex _mutex;
+    std::vector<Reloaded> _reloaded;
+};
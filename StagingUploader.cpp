@@ -0,0 +1,473 @@
+#include "StagingUploader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "utilities.h"
+
+void StagingUploader::Init( VkDevice device, MemoryAllocator& allocator,
+                            uint32_t transferFamily, VkQueue transferQueue,
+                            uint32_t graphicsFamily, VkQueue graphicsQueue,
+                            VkDeviceSize capacity )
+{
+    _device = device;
+    _allocator = &allocator;
+    _transferFamily = transferFamily;
+    _transferQueue = transferQueue;
+    _graphicsFamily = graphicsFamily;
+    _graphicsQueue = graphicsQueue;
+    _ownershipTransfer = transferFamily != graphicsFamily;
+    _capacity = capacity;
+
+    // ring buffer (host visible, mapped once by the allocator and never unmapped)
+    Buffer::Create( _device, *_allocator, _capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    _ringBuffer, _ringAllocation );
+
+    // command pools: batch command buffers are reset one by one and live only for one submission
+    std::array<VkCommandBuffer, BatchCount> commandBuffers;
+    std::array<VkCommandBuffer, BatchCount> acquireCommandBuffers{};
+    CreateCommandBuffers( _transferFamily, _commandPool, commandBuffers.data() );
+    if( _ownershipTransfer )
+        CreateCommandBuffers( _graphicsFamily, _acquireCommandPool, acquireCommandBuffers.data() );
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for( uint32_t i = 0; i < BatchCount; ++i )
+    {
+        _batches[i] = Batch{};
+        _batches[i].commandBuffer = commandBuffers[i];
+        _batches[i].acquireCommandBuffer = acquireCommandBuffers[i];
+        if( vkCreateFence( _device, &fenceInfo, nullptr, &_batches[i].fence )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to create upload fence!" );
+
+        if( _ownershipTransfer &&
+            vkCreateSemaphore( _device, &semaphoreInfo, nullptr, &_batches[i].transferDone ) != VK_SUCCESS )
+        throw std::runtime_error( "Failed to create upload semaphore!" );
+    }
+}
+
+void StagingUploader::CreateCommandBuffers( uint32_t queueFamily, VkCommandPool& commandPool, VkCommandBuffer* pCommandBuffers )
+{
+    VkCommandPoolCreateInfo commandPoolInfo{};
+    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolInfo.queueFamilyIndex = queueFamily;
+    if( vkCreateCommandPool( _device, &commandPoolInfo, nullptr, &commandPool )
+        != VK_SUCCESS )
+    throw std::runtime_error( "Failed to create upload command pool!" );
+
+    VkCommandBufferAllocateInfo cmdBuffAllocInfo{};
+    cmdBuffAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdBuffAllocInfo.commandPool = commandPool;
+    cmdBuffAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdBuffAllocInfo.commandBufferCount = BatchCount;
+    if( vkAllocateCommandBuffers( _device, &cmdBuffAllocInfo, pCommandBuffers )
+        != VK_SUCCESS )
+    throw std::runtime_error( "Failed to allocate upload command buffers!" );
+}
+
+void StagingUploader::Destroy()
+{
+    WaitIdle();
+
+    for( auto& batch : _batches )
+    {
+        vkDestroyFence( _device, batch.fence, nullptr );
+        if( batch.transferDone != VK_NULL_HANDLE )
+            vkDestroySemaphore( _device, batch.transferDone, nullptr );
+    }
+
+    vkDestroyCommandPool( _device, _commandPool, nullptr );     // command pool & batch command buffers
+    if( _acquireCommandPool != VK_NULL_HANDLE )
+        vkDestroyCommandPool( _device, _acquireCommandPool, nullptr );
+    Buffer::Destroy( _device, *_allocator, _ringBuffer, _ringAllocation );
+}
+
+void StagingUploader::Upload( const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset )
+{
+    const auto start = Clock::now();
+    const char* src = static_cast<const char*>( data );
+
+    // anything bigger than half the ring goes in pieces, so a piece always fits once the GPU caught up
+    while( size > 0 )
+    {
+        const VkDeviceSize chunkSize = std::min( size, _capacity / 2 );
+        const VkDeviceSize ringOffset = Reserve( chunkSize );
+
+        memcpy( static_cast<char*>( _ringAllocation.mapped ) + ringOffset, src, size_t(chunkSize) );
+
+        Batch& batch = _batches[_currentBatch];     // (Reserve may have flushed the previous one)
+        if( !batch.recording )
+            BeginBatch();
+
+        VkBufferCopy bufferCopyRegion{};
+        bufferCopyRegion.srcOffset = ringOffset;
+        bufferCopyRegion.dstOffset = dstOffset;
+        bufferCopyRegion.size = chunkSize;
+        vkCmdCopyBuffer( batch.commandBuffer, _ringBuffer, dstBuffer, 1, &bufferCopyRegion );
+        ++batch.copyCount;
+
+        if( _ownershipTransfer )
+        {
+            VkBufferMemoryBarrier ownershipBarrier{};
+            ownershipBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            ownershipBarrier.srcQueueFamilyIndex = _transferFamily;
+            ownershipBarrier.dstQueueFamilyIndex = _graphicsFamily;
+            ownershipBarrier.buffer = dstBuffer;
+            ownershipBarrier.offset = dstOffset;
+            ownershipBarrier.size = chunkSize;
+            batch.ownershipBarriers.push_back( ownershipBarrier );
+        }
+
+        src += chunkSize;
+        dstOffset += chunkSize;
+        size -= chunkSize;
+        _stats.bytesUploaded += chunkSize;
+    }
+
+    ++_stats.uploadCount;
+    _stats.busySeconds += std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+void StagingUploader::Upload( const MappedFile& file, size_t offset, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset )
+{
+    const char* src = file.View<char>( offset, size_t(size) );     // bounds check of the whole range
+
+    file.Prefetch( offset, size_t( std::min( size, StagingUploader::StreamChunkSize ) ) );
+    while( size > 0 )
+    {
+        const VkDeviceSize chunkSize = std::min( size, StagingUploader::StreamChunkSize );
+        file.Prefetch( offset + size_t(chunkSize), size_t( std::min( size - chunkSize, StagingUploader::StreamChunkSize ) ) );
+
+        Upload( src, chunkSize, dstBuffer, dstOffset );
+        file.Evict( offset, size_t(chunkSize) );    // it is in the ring now
+
+        src += chunkSize;
+        offset += size_t(chunkSize);
+        dstOffset += chunkSize;
+        size -= chunkSize;
+    }
+}
+
+void StagingUploader::UploadImage( const void* data, VkDeviceSize size, VkImage dstImage, VkFormat format,
+                                    uint32_t mipLevel, uint32_t width, uint32_t height )
+{
+    const auto start = Clock::now();
+    const char* src = static_cast<const char*>( data );
+
+    const FormatBlock::Info block = FormatBlock::Get( format );
+    const uint32_t blocksWide = (width + block.width - 1) / block.width;
+    const uint32_t blockRows = (height + block.height - 1) / block.height;
+    const VkDeviceSize rowBytes = VkDeviceSize(blocksWide) * block.bytes;
+    if( rowBytes * blockRows != size )
+        throw std::runtime_error( "Image level size doesn't match its extent!" );
+
+    VkImageSubresourceRange levelRange{};
+    levelRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    levelRange.baseMipLevel = mipLevel;
+    levelRange.levelCount = 1;
+    levelRange.baseArrayLayer = 0;
+    levelRange.layerCount = 1;
+
+    // whole rows of blocks per copy, as many as fit in half the ring; a big level may span several batches,
+    // its transfer layout holds until the last one (earlier submissions on the queue are ordered before it)
+    const uint32_t rowsPerChunk = static_cast<uint32_t>( std::max<VkDeviceSize>( 1, (_capacity / 2) / rowBytes ) );
+    for( uint32_t row = 0; row < blockRows; )
+    {
+        const uint32_t rowCount = std::min( rowsPerChunk, blockRows - row );
+        const VkDeviceSize chunkSize = rowBytes * rowCount;
+        const VkDeviceSize ringOffset = Reserve( chunkSize );
+
+        memcpy( static_cast<char*>( _ringAllocation.mapped ) + ringOffset, src, size_t(chunkSize) );
+
+        Batch& batch = _batches[_currentBatch];     // (Reserve may have flushed the previous one)
+        if( !batch.recording )
+            BeginBatch();
+
+        if( row == 0 )
+        {
+            VkImageMemoryBarrier toTransfer{};
+            toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            toTransfer.srcAccessMask = 0;
+            toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            toTransfer.image = dstImage;
+            toTransfer.subresourceRange = levelRange;
+            vkCmdPipelineBarrier( batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                    0, 0, nullptr, 0, nullptr, 1, &toTransfer );
+        }
+
+        VkBufferImageCopy imageCopyRegion{};
+        imageCopyRegion.bufferOffset = ringOffset;
+        imageCopyRegion.bufferRowLength = 0;        // tightly packed
+        imageCopyRegion.bufferImageHeight = 0;
+        imageCopyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 0, 1 };
+        imageCopyRegion.imageOffset = { 0, int32_t(row * block.height), 0 };
+        imageCopyRegion.imageExtent = { width, std::min( height - row * block.height, rowCount * block.height ), 1 };
+        vkCmdCopyBufferToImage( batch.commandBuffer, _ringBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion );
+        ++batch.copyCount;
+
+        src += chunkSize;
+        row += rowCount;
+        _stats.bytesUploaded += chunkSize;
+    }
+
+    // transitioned (and handed to the graphics family) when the batch is submitted
+    VkImageMemoryBarrier toShaderRead{};
+    toShaderRead.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toShaderRead.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toShaderRead.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    toShaderRead.srcQueueFamilyIndex = _ownershipTransfer ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    toShaderRead.dstQueueFamilyIndex = _ownershipTransfer ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+    toShaderRead.image = dstImage;
+    toShaderRead.subresourceRange = levelRange;
+    _batches[_currentBatch].imageBarriers.push_back( toShaderRead );
+
+    ++_stats.uploadCount;
+    _stats.busySeconds += std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+void StagingUploader::UploadImage( const MappedFile& file, size_t offset, VkDeviceSize size, VkImage dstImage, VkFormat format,
+                                    uint32_t mipLevel, uint32_t width, uint32_t height )
+{
+    const char* src = file.View<char>( offset, size_t(size) );     // bounds check of the whole range
+
+    file.Prefetch( offset, size_t(size) );
+    UploadImage( src, size, dstImage, format, mipLevel, width, height );
+    file.Evict( offset, size_t(size) );     // it is in the ring now
+}
+
+void StagingUploader::Flush()
+{
+    const auto start = Clock::now();
+    Submit();
+    _stats.busySeconds += std::chrono::duration<double>( Clock::now() - start ).count();
+}
+
+void StagingUploader::WaitIdle()
+{
+    Submit();
+
+    while( _batches[_oldestBatch].pending )
+        Retire( true );
+}
+
+void StagingUploader::Submit()
+{
+    Batch& batch = _batches[_currentBatch];
+    if( !batch.recording )
+        return;
+
+    const VkAccessFlags readAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    const VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;   // (transfer: mip generation)
+
+    if( !_ownershipTransfer )
+    {
+        // same queue: make the copies visible to everything that reads geometry (and textures) afterwards
+        for( auto& imageBarrier : batch.imageBarriers )
+        {
+            imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        }
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = readAccess;
+        vkCmdPipelineBarrier( batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, readStages,
+                                0, 1, &barrier, 0, nullptr,
+                                static_cast<uint32_t>( batch.imageBarriers.size() ), batch.imageBarriers.data() );
+    }
+    else
+    {
+        // release half of the queue family ownership transfer
+        for( auto& ownershipBarrier : batch.ownershipBarriers )
+        {
+            ownershipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            ownershipBarrier.dstAccessMask = 0;
+        }
+        for( auto& imageBarrier : batch.imageBarriers )
+        {
+            imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            imageBarrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier( batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                0, 0, nullptr,
+                                static_cast<uint32_t>( batch.ownershipBarriers.size() ), batch.ownershipBarriers.data(),
+                                static_cast<uint32_t>( batch.imageBarriers.size() ), batch.imageBarriers.data() );
+    }
+
+    if( vkEndCommandBuffer( batch.commandBuffer )
+        != VK_SUCCESS )
+    throw std::runtime_error( "Failed to end recording upload command buffer!" );
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    if( !_ownershipTransfer )
+    {
+        if( vkQueueSubmit( _transferQueue, 1, &submitInfo, batch.fence )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to submit upload command buffer!" );
+    }
+    else
+    {
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &batch.transferDone;
+        if( vkQueueSubmit( _transferQueue, 1, &submitInfo, VK_NULL_HANDLE )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to submit upload command buffer!" );
+
+        // acquire half, on the graphics queue; later frame submissions on that queue are ordered after it
+        VkCommandBufferBeginInfo cmdBuffBeginInfo{};
+        cmdBuffBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cmdBuffBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkResetCommandBuffer( batch.acquireCommandBuffer, 0 );
+        if( vkBeginCommandBuffer( batch.acquireCommandBuffer, &cmdBuffBeginInfo )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to begin recording acquire command buffer!" );
+
+        for( auto& ownershipBarrier : batch.ownershipBarriers )
+        {
+            ownershipBarrier.srcAccessMask = 0;
+            ownershipBarrier.dstAccessMask = readAccess;
+        }
+        for( auto& imageBarrier : batch.imageBarriers )
+        {
+            imageBarrier.srcAccessMask = 0;
+            imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+        }
+        vkCmdPipelineBarrier( batch.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, readStages,
+                                0, 0, nullptr,
+                                static_cast<uint32_t>( batch.ownershipBarriers.size() ), batch.ownershipBarriers.data(),
+                                static_cast<uint32_t>( batch.imageBarriers.size() ), batch.imageBarriers.data() );
+
+        if( vkEndCommandBuffer( batch.acquireCommandBuffer )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to end recording acquire command buffer!" );
+
+        VkSubmitInfo acquireSubmitInfo{};
+        acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireSubmitInfo.waitSemaphoreCount = 1;
+        acquireSubmitInfo.pWaitSemaphores = &batch.transferDone;
+        acquireSubmitInfo.pWaitDstStageMask = &readStages;
+        acquireSubmitInfo.commandBufferCount = 1;
+        acquireSubmitInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+
+        // the fence goes on the acquire: it can only signal after the copies are done as well
+        if( vkQueueSubmit( _graphicsQueue, 1, &acquireSubmitInfo, batch.fence )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to submit acquire command buffer!" );
+    }
+
+    batch.recording = false;
+    batch.pending = true;
+    batch.ringEnd = _head;
+    batch.copyCount = 0;
+    ++_stats.submitCount;
+
+    _currentBatch = (_currentBatch + 1) % BatchCount;
+
+    // cheap poll: recycle whatever the GPU already finished
+    Retire( false );
+}
+
+VkDeviceSize StagingUploader::Reserve( VkDeviceSize size )
+{
+    size = RangeAllocator::AlignUp( size, 16 );
+
+    for( ;; )
+    {
+        // a region never wraps around the end of the ring, the leftover bytes are skipped
+        const VkDeviceSize offset = _head % _capacity;
+        const VkDeviceSize padding = offset + size > _capacity ? _capacity - offset : 0;
+
+        if( _head + padding + size - _tail <= _capacity )
+        {
+            _head += padding;
+            const VkDeviceSize ringOffset = _head % _capacity;
+            _head += size;
+            return ringOffset;
+        }
+
+        // ring is full: the space belongs to copies that are either still being recorded
+        // (submit them) or still running on the GPU (wait for the oldest batch)
+        Submit();
+        if( !_batches[_oldestBatch].pending )
+            throw std::runtime_error( "Failed to reserve staging ring space!" );
+
+        ++_stats.stallCount;
+        Retire( true );
+    }
+}
+
+void StagingUploader::BeginBatch()
+{
+    Batch& batch = _batches[_currentBatch];
+
+    // every batch is in flight: wait until this slot comes back
+    while( batch.pending )
+    {
+        ++_stats.stallCount;
+        Retire( true );
+    }
+
+    vkResetFences( _device, 1, &batch.fence );
+    vkResetCommandBuffer( batch.commandBuffer, 0 );
+
+    VkCommandBufferBeginInfo cmdBuffBeginInfo{};
+    cmdBuffBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBuffBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if( vkBeginCommandBuffer( batch.commandBuffer, &cmdBuffBeginInfo )
+        != VK_SUCCESS )
+    throw std::runtime_error( "Failed to begin recording upload command buffer!" );
+
+    batch.recording = true;
+    batch.copyCount = 0;
+    batch.ownershipBarriers.clear();
+    batch.imageBarriers.clear();
+}
+
+void StagingUploader::Retire( bool wait )
+{
+    // batches finish in submission order, so walk from the oldest one
+    while( _batches[_oldestBatch].pending )
+    {
+        Batch& batch = _batches[_oldestBatch];
+
+        if( wait )
+        {
+            vkWaitForFences( _device, 1, &batch.fence, VK_TRUE, UINT64_MAX );
+            wait = false;   // block for one batch at most, then just poll the rest
+        }
+        else if( vkGetFenceStatus( _device, batch.fence ) != VK_SUCCESS )
+        {
+            break;
+        }
+
+        batch.pending = false;
+        _tail = batch.ringEnd;
+        _oldestBatch = (_oldestBatch + 1) % BatchCount;
+    }
+}
+
+std::ostream& operator<<( std::ostream& os, const UploadStats& stats )
+{
+    os << "upload: " << stats.bytesUploaded / 1024 << " KiB in " << stats.uploadCount << " uploads, "
+       << stats.submitCount << " submits, " << stats.stallCount << " stalls, "
+       << stats.MegabytesPerSecond() << " MB/s";
+    return os;
+}
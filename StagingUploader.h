@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MemoryAllocator.h"
+
+struct UploadStats
+{
+    uint64_t bytesUploaded = 0;
+    uint32_t uploadCount = 0;       // Upload() calls
+    uint32_t submitCount = 0;       // vkQueueSubmit calls (one per Flush with pending copies)
+    uint32_t stallCount = 0;        // times the ring was full and we had to wait for the GPU
+    double busySeconds = 0.0;       // CPU time spent inside the uploader, stalls included
+
+    double MegabytesPerSecond() const
+    {
+        return busySeconds > 0.0 ? double(bytesUploaded) / (1024.0 * 1024.0) / busySeconds : 0.0;
+    }
+};
+
+std::ostream& operator<<( std::ostream& os, const UploadStats& stats );
+
+
+// Persistently mapped staging ring buffer.
+// Upload() memcpy's into the ring and records a vkCmdCopyBuffer into the current batch,
+// Flush() submits the whole batch at once; ring space is recycled when the batch fence signals.
+//
+// Copies run on the transfer queue. When that is a dedicated family the batch releases the
+// destination buffers to the graphics family and a small acquire submission on the graphics
+// queue (waiting on the batch semaphore) takes them over, so nothing ever idles a queue.
+class StagingUploader
+{
+public:
+    void Init( VkDevice device, MemoryAllocator& allocator,
+                uint32_t transferFamily, VkQueue transferQueue,
+                uint32_t graphicsFamily, VkQueue graphicsQueue,
+                VkDeviceSize capacity = DefaultCapacity );
+    void Destroy();
+
+    void Upload( const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset );
+    // streams [offset, offset + size) of a mapped file: copied chunk by chunk from the mapping into the ring
+    // (no intermediate buffer), reading ahead and dropping the pages behind so a big asset never stays resident
+    void Upload( const MappedFile& file, size_t offset, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset );
+    // one mip level of a 2D image (tightly packed rows of texel blocks, see FormatBlock); the level goes from
+    // UNDEFINED to TRANSFER_DST_OPTIMAL before the copy and ends up SHADER_READ_ONLY_OPTIMAL on the graphics queue
+    void UploadImage( const void* data, VkDeviceSize size, VkImage dstImage, VkFormat format,
+                        uint32_t mipLevel, uint32_t width, uint32_t height );
+    void UploadImage( const MappedFile& file, size_t offset, VkDeviceSize size, VkImage dstImage, VkFormat format,
+                        uint32_t mipLevel, uint32_t width, uint32_t height );
+    void Flush();
+    void WaitIdle();
+
+    const UploadStats& GetStats() const { return _stats; }
+
+public:
+    static constexpr VkDeviceSize DefaultCapacity = 32ULL * 1024 * 1024;
+    static constexpr uint32_t BatchCount = 4;
+    static constexpr VkDeviceSize StreamChunkSize = 4ULL * 1024 * 1024;     // file uploads, per read-ahead step
+
+private:
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;         // transfer queue: copies (+ release)
+        VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;  // graphics queue: acquire (dedicated transfer family only)
+        VkSemaphore transferDone = VK_NULL_HANDLE;              // copies -> acquire
+        VkFence fence = VK_NULL_HANDLE;                         // signalled by the last submission of the batch
+        std::vector<VkBufferMemoryBarrier> ownershipBarriers;   // one per copy destination
+        std::vector<VkImageMemoryBarrier> imageBarriers;        // one per uploaded image level: -> SHADER_READ_ONLY
+        uint64_t ringEnd = 0;       // ring head when the batch was submitted
+        uint32_t copyCount = 0;
+        bool recording = false;
+        bool pending = false;       // submitted, fence not observed yet
+    };
+
+    void CreateCommandBuffers( uint32_t queueFamily, VkCommandPool& commandPool, VkCommandBuffer* pCommandBuffers );
+    VkDeviceSize Reserve( VkDeviceSize size );
+    void BeginBatch();
+    void Submit();
+    void Retire( bool wait );
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    VkDevice _device = VK_NULL_HANDLE;
+    MemoryAllocator* _allocator = nullptr;
+    VkQueue _transferQueue = VK_NULL_HANDLE;
+    VkQueue _graphicsQueue = VK_NULL_HANDLE;
+    uint32_t _transferFamily = 0;
+    uint32_t _graphicsFamily = 0;
+    bool _ownershipTransfer = false;    // transfer and graphics are different families
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    VkCommandPool _acquireCommandPool = VK_NULL_HANDLE;
+
+    // the ring itself
+    VkBuffer _ringBuffer = VK_NULL_HANDLE;
+    Allocation _ringAllocation{};
+    VkDeviceSize _capacity = 0;
+    uint64_t _head = 0;     // total bytes ever reserved (write position = _head % _capacity)
+    uint64_t _tail = 0;     // everything before _tail has been consumed by the GPU
+
+    std::array<Batch, BatchCount> _batches{};
+    uint32_t _currentBatch = 0;     // the batch being recorded
+    uint32_t _oldestBatch = 0;      // the oldest batch that may still be pending
+
+    UploadStats _stats{};
+};
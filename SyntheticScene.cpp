@@ -0,0 +1,127 @@
+#include "SyntheticScene.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // small deterministic hash -> [0, 1) so colors don't depend on the platform's rand()
+    float Hash01( uint32_t value )
+    {
+        value ^= value >> 16;
+        value *= 0x7FEB352Du;
+        value ^= value >> 15;
+        value *= 0x846CA68Bu;
+        value ^= value >> 16;
+        return float(value >> 8) / float(1u << 24);
+    }
+
+    // tiles clip space [-1, 1] with a small gap between objects (gapless: they cover it completely)
+    struct Tiling
+    {
+        explicit Tiling( uint32_t objectCount, bool gapless = false )
+            : tiles( std::max<uint32_t>( 1, static_cast<uint32_t>( std::ceil( std::sqrt( double(objectCount) ) ) ) ) )
+            , tileSize( 2.0f / float(tiles) )
+            , objectSize( gapless ? tileSize : tileSize * 0.9f )
+        {
+        }
+
+        float X0( uint32_t i ) const { return -1.0f + float(i % tiles) * tileSize; }
+        float Y0( uint32_t i ) const { return -1.0f + float(i / tiles) * tileSize; }
+
+        uint32_t tiles;
+        float tileSize;
+        float objectSize;
+    };
+}
+
+MeshData SyntheticScene::GenerateGrid( uint32_t triangleCount, float x0, float y0, float size, uint32_t seed, float z )
+{
+    MeshData mesh;
+    if( triangleCount == 0 )
+        return mesh;
+
+    // as square as possible, 2 triangles per cell; the last row may end early
+    const uint32_t cellCount = (triangleCount + 1) / 2;
+    const uint32_t columns = static_cast<uint32_t>( std::ceil( std::sqrt( double(cellCount) ) ) );
+    const uint32_t rows = (cellCount + columns - 1) / columns;
+
+    const glm::vec3 baseColor( Hash01( seed * 3 + 0 ), Hash01( seed * 3 + 1 ), Hash01( seed * 3 + 2 ) );
+
+    mesh.vertices.reserve( size_t(columns + 1) * (rows + 1) );
+    for( uint32_t y = 0; y <= rows; ++y )
+    {
+        for( uint32_t x = 0; x <= columns; ++x )
+        {
+            const float u = float(x) / float(columns);
+            const float v = float(y) / float(rows);
+
+            Vertex vertex;
+            vertex.pos = glm::vec3( x0 + u * size, y0 + v * size, z );
+            vertex.col = glm::vec3( baseColor.x * (0.5f + 0.5f * u), baseColor.y * (0.5f + 0.5f * v), baseColor.z );
+            mesh.vertices.push_back( vertex );
+        }
+    }
+
+    mesh.indices.reserve( size_t(triangleCount) * 3 );
+    for( uint32_t cell = 0; cell < cellCount; ++cell )
+    {
+        const uint32_t x = cell % columns;
+        const uint32_t y = cell / columns;
+        const uint32_t topLeft = y * (columns + 1) + x;
+        const uint32_t bottomLeft = topLeft + columns + 1;
+
+        mesh.indices.insert( mesh.indices.end(), { topLeft, bottomLeft, topLeft + 1 } );
+        if( mesh.indices.size() / 3 < triangleCount )
+            mesh.indices.insert( mesh.indices.end(), { topLeft + 1, bottomLeft, bottomLeft + 1 } );
+    }
+
+    return mesh;
+}
+
+std::vector<MeshData> SyntheticScene::Generate( uint32_t objectCount, uint32_t trianglesPerObject, uint32_t layers )
+{
+    std::vector<MeshData> meshes;
+    meshes.reserve( objectCount );
+
+    // layer l at depth 1 - (l + 1) / (layers + 1): the first one farthest, all of them inside [0, 1]
+    layers = std::max<uint32_t>( 1, layers );
+    const uint32_t objectsPerLayer = (objectCount + layers - 1) / layers;
+    // layers without gaps: a full layer hides everything behind it (what occlusion culling can skip)
+    const Tiling tiling( objectsPerLayer, layers > 1 );
+    for( uint32_t i = 0; i < objectCount; ++i )
+    {
+        const uint32_t layer = i / objectsPerLayer;
+        const float z = layers > 1 ? 1.0f - float(layer + 1) / float(layers + 1) : 0.0f;
+        const uint32_t tile = i % objectsPerLayer;
+        meshes.push_back( GenerateGrid( trianglesPerObject, tiling.X0( tile ), tiling.Y0( tile ), tiling.objectSize, i, z ) );
+    }
+
+    return meshes;
+}
+
+MeshData SyntheticScene::GenerateInstancedMesh( uint32_t trianglesPerObject )
+{
+    return GenerateGrid( trianglesPerObject, 0.0f, 0.0f, 1.0f, 0 );
+}
+
+std::vector<InstanceData> SyntheticScene::GenerateInstances( uint32_t instanceCount )
+{
+    std::vector<InstanceData> instances( instanceCount );
+
+    const Tiling tiling( instanceCount );
+    for( uint32_t i = 0; i < instanceCount; ++i )
+    {
+        // scale the unit square to the tile, then move it there
+        glm::mat4 transform( 1.0f );
+        transform[0][0] = tiling.objectSize;
+        transform[1][1] = tiling.objectSize;
+        transform[3] = glm::vec4( tiling.X0( i ), tiling.Y0( i ), 0.0f, 1.0f );
+
+        instances[i].transform = transform;
+        instances[i].color = glm::vec4( 0.5f + 0.5f * Hash01( i * 3 + 0 ), 0.5f + 0.5f * Hash01( i * 3 + 1 ),
+                                        0.5f + 0.5f * Hash01( i * 3 + 2 ), 1.0f );
+    }
+
+    return instances;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "utilities.h"
+
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Procedural test geometry for benchmarks: flat grids laid out side by side so they all land
+// on screen. Same arguments -> same data, so results are comparable from run to run.
+// Depth is clip space z (the camera doesn't project): 0 unless the objects are stacked in layers.
+namespace SyntheticScene
+{
+    // a grid of exactly triangleCount triangles filling the square [x0, x0 + size] x [y0, y0 + size] at depth z
+    MeshData GenerateGrid( uint32_t triangleCount, float x0, float y0, float size, uint32_t seed, float z = 0.0f );
+
+    // objectCount grids of trianglesPerObject triangles each, tiled over clip space; with layers > 1 the objects
+    // are split over that many layers, each tiling the whole screen at its own depth without gaps, listed from the
+    // farthest layer to the nearest (what a painter's algorithm would draw: the worst order for early-z)
+    std::vector<MeshData> Generate( uint32_t objectCount, uint32_t trianglesPerObject, uint32_t layers = 1 );
+
+    // instanced variant: one grid over the unit square [0, 1] x [0, 1] ...
+    MeshData GenerateInstancedMesh( uint32_t trianglesPerObject );
+    // ... and instanceCount transforms placing it on the same tiles as Generate(), each with its own tint
+    std::vector<InstanceData> GenerateInstances( uint32_t instanceCount );
+}
@@ -0,0 +1,198 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint32_t LevelAlignment = 4;      // lcm( texel block size, 4 ) for the formats written here
+
+    // basic data format descriptor (Khronos Data Format spec) of 8 bit RGBA: the DFD is mandatory in KTX2
+    std::vector<uint32_t> BuildRgba8Dfd( bool srgb )
+    {
+        constexpr uint32_t SampleCount = 4;
+        constexpr uint32_t BlockSize = 24 + 16 * SampleCount;
+        constexpr uint32_t ChannelIds[SampleCount] = { 0, 1, 2, 15 };     // R, G, B, A
+        constexpr uint32_t QualifierLinear = 0x10;
+
+        std::vector<uint32_t> dfd;
+        dfd.push_back( 4 + BlockSize );                 // dfdTotalSize
+        dfd.push_back( 0 );                             // vendor KHRONOS, descriptor type basic
+        dfd.push_back( 2 | (BlockSize << 16) );         // version 2
+        dfd.push_back( 1 | (1 << 8) | ((srgb ? 2u : 1u) << 16) );     // RGBSDA, BT709 primaries, sRGB / linear transfer
+        dfd.push_back( 0 );                             // 1x1x1x1 texel block
+        dfd.push_back( 4 );                             // 4 bytes in plane 0
+        dfd.push_back( 0 );
+        for( uint32_t sample = 0; sample < SampleCount; ++sample )
+        {
+            // alpha stays linear in sRGB formats
+            const uint32_t qualifiers = (srgb && ChannelIds[sample] == 15) ? QualifierLinear : 0;
+            dfd.push_back( (sample * 8) | (7 << 16) | ((ChannelIds[sample] | qualifiers) << 24) );   // 8 bits at sample * 8
+            dfd.push_back( 0 );                         // sample position
+            dfd.push_back( 0 );                         // lower
+            dfd.push_back( 255 );                       // upper
+        }
+        return dfd;
+    }
+
+    uint64_t AlignUp( uint64_t value, uint64_t alignment )
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+uint32_t TextureFile::FullChainLength( uint32_t width, uint32_t height )
+{
+    uint32_t levels = 1;
+    for( uint32_t size = std::max( width, height ); size > 1; size /= 2 )
+        ++levels;
+    return levels;
+}
+
+TextureFile::Description TextureFile::Read( const MappedFile& file )
+{
+    const std::string& path = file.GetPath();
+    const Header& header = *file.View<Header>( 0, 1 );
+
+    if( std::memcmp( header.identifier, Identifier, sizeof(Identifier) ) != 0 )
+        throw std::runtime_error( path + " is not a KTX2 file!" );
+    if( header.supercompressionScheme != 0 )
+        throw std::runtime_error( path + " is supercompressed, only plain KTX2 is supported!" );
+    if( header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1 )
+        throw std::runtime_error( path + " is not a 2D texture!" );
+
+    Description description;
+    description.format = static_cast<VkFormat>( header.vkFormat );
+    description.width = header.pixelWidth;
+    description.height = header.pixelHeight;
+    description.generateMips = header.levelCount == 0;
+    if( FormatBlock::Get( description.format ).bytes == 0 )
+        throw std::runtime_error( "Unsupported texture format " + std::to_string( header.vkFormat ) + " in " + path + "!" );
+
+    const uint32_t levelCount = std::max<uint32_t>( 1, header.levelCount );
+    if( levelCount > FullChainLength( description.width, description.height ) )
+        throw std::runtime_error( path + " has more mip levels than its size allows!" );
+
+    const LevelIndex* index = file.View<LevelIndex>( sizeof(Header), levelCount );
+    for( uint32_t level = 0; level < levelCount; ++level )
+    {
+        Level entry;
+        entry.width = std::max<uint32_t>( 1, description.width >> level );
+        entry.height = std::max<uint32_t>( 1, description.height >> level );
+        entry.offset = size_t( index[level].byteOffset );
+        entry.size = index[level].byteLength;
+
+        // what the uploader is going to copy, in bounds: the upload reads straight from the mapping
+        if( entry.size != FormatBlock::LevelSize( description.format, entry.width, entry.height ) )
+            throw std::runtime_error( "Mip level " + std::to_string( level ) + " of " + path + " has the wrong size!" );
+        file.View<char>( entry.offset, size_t( entry.size ) );
+
+        description.levels.push_back( entry );
+    }
+    return description;
+}
+
+void TextureFile::Write( const std::string& path, VkFormat format, uint32_t width, uint32_t height,
+                            const std::vector<std::vector<uint8_t>>& levels )
+{
+    if( format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB )
+        throw std::runtime_error( "Only RGBA8 textures can be written!" );
+    if( levels.empty() || levels.size() > FullChainLength( width, height ) )
+        throw std::runtime_error( "Wrong mip level count for " + path + "!" );
+
+    const std::vector<uint32_t> dfd = BuildRgba8Dfd( format == VK_FORMAT_R8G8B8A8_SRGB );
+
+    Header header{};
+    std::memcpy( header.identifier, Identifier, sizeof(Identifier) );
+    header.vkFormat = static_cast<uint32_t>( format );
+    header.typeSize = 1;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.faceCount = 1;
+    header.levelCount = levels.size() == 1 ? 0 : static_cast<uint32_t>( levels.size() );
+    header.dfdByteOffset = static_cast<uint32_t>( sizeof(Header) + levels.size() * sizeof(LevelIndex) );
+    header.dfdByteLength = static_cast<uint32_t>( dfd.size() * sizeof(uint32_t) );
+
+    // level data after the DFD, smallest level first
+    std::vector<LevelIndex> index( levels.size() );
+    uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+    for( size_t level = levels.size(); level-- > 0; )
+    {
+        const uint32_t levelWidth = std::max<uint32_t>( 1, width >> level );
+        const uint32_t levelHeight = std::max<uint32_t>( 1, height >> level );
+        if( levels[level].size() != FormatBlock::LevelSize( format, levelWidth, levelHeight ) )
+            throw std::runtime_error( "Mip level " + std::to_string( level ) + " for " + path + " has the wrong size!" );
+
+        offset = AlignUp( offset, LevelAlignment );
+        index[level] = { offset, levels[level].size(), levels[level].size() };
+        offset += levels[level].size();
+    }
+
+    // into a temporary file first: a failed write must not leave a half written texture behind
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream file( temporaryPath, std::ios::binary | std::ios::trunc );
+    if( !file.is_open() )
+        throw std::runtime_error( "Failed to open " + temporaryPath + " for writing!" );
+
+    file.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    file.write( reinterpret_cast<const char*>( index.data() ), std::streamsize( index.size() * sizeof(LevelIndex) ) );
+    file.write( reinterpret_cast<const char*>( dfd.data() ), std::streamsize( header.dfdByteLength ) );
+    uint64_t written = header.dfdByteOffset + header.dfdByteLength;
+    for( size_t level = levels.size(); level-- > 0; )
+    {
+        static const char zeros[LevelAlignment] = {};
+        file.write( zeros, std::streamsize( index[level].byteOffset - written ) );
+        file.write( reinterpret_cast<const char*>( levels[level].data() ), std::streamsize( levels[level].size() ) );
+        written = index[level].byteOffset + index[level].byteLength;
+    }
+    file.close();
+
+    if( !file || std::rename( temporaryPath.c_str(), path.c_str() ) != 0 )
+    {
+        std::remove( temporaryPath.c_str() );
+        throw std::runtime_error( "Failed to write " + path + "!" );
+    }
+}
+
+std::vector<std::vector<uint8_t>> TextureFile::BuildMipChain( std::vector<uint8_t> rgba, uint32_t width, uint32_t height )
+{
+    if( rgba.size() != size_t(width) * height * 4 )
+        throw std::runtime_error( "RGBA8 image data doesn't match its size!" );
+
+    std::vector<std::vector<uint8_t>> levels;
+    levels.push_back( std::move( rgba ) );
+    while( width > 1 || height > 1 )
+    {
+        const uint32_t nextWidth = std::max<uint32_t>( 1, width / 2 );
+        const uint32_t nextHeight = std::max<uint32_t>( 1, height / 2 );
+        const std::vector<uint8_t>& source = levels.back();
+        std::vector<uint8_t> next( size_t(nextWidth) * nextHeight * 4 );
+
+        for( uint32_t y = 0; y < nextHeight; ++y )
+        {
+            for( uint32_t x = 0; x < nextWidth; ++x )
+            {
+                // the 2x2 footprint, clamped where the source is 1 texel wide or high
+                const std::array<uint32_t, 2> xs = { std::min( x * 2, width - 1 ), std::min( x * 2 + 1, width - 1 ) };
+                const std::array<uint32_t, 2> ys = { std::min( y * 2, height - 1 ), std::min( y * 2 + 1, height - 1 ) };
+                for( uint32_t channel = 0; channel < 4; ++channel )
+                {
+                    uint32_t sum = 0;
+                    for( uint32_t sy : ys )
+                        for( uint32_t sx : xs )
+                            sum += source[(size_t(sy) * width + sx) * 4 + channel];
+                    next[(size_t(y) * nextWidth + x) * 4 + channel] = static_cast<uint8_t>( (sum + 2) / 4 );
+                }
+            }
+        }
+
+        levels.push_back( std::move( next ) );
+        width = nextWidth;
+        height = nextHeight;
+    }
+    return levels;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "utilities.h"
+
+// KTX2 textures (.ktx2): the container keeps every mip level as one blob in the exact layout the GPU
+// copies from (rows of texel blocks), so a level goes from the mapping into the staging ring as it is.
+//
+// Layout (little endian):
+//      Header                  identifier, vkFormat, size, level count, where the DFD / key-values are
+//      Level[levelCount]       level index, level 0 (full size) first
+//      DFD, key/value data     described by the header, not needed to upload (vkFormat says it all)
+//      level data              smallest level first, so a streamed file can be read front to back
+//
+// Supported: 2D, one layer, one face, no supercompression, formats FormatBlock knows (BC1-5/BC7, RGBA8).
+// levelCount 0 in the header means "generate the mips": the file holds level 0 only.
+namespace TextureFile
+{
+    static constexpr uint8_t Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    struct Header
+    {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+    static_assert( sizeof(Header) == 80, "TextureFile::Header is an on-disk layout" );
+
+    struct LevelIndex
+    {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+    static_assert( sizeof(LevelIndex) == 24, "TextureFile::LevelIndex is an on-disk layout" );
+
+    struct Level
+    {
+        size_t offset;          // in the file
+        VkDeviceSize size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct Description
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool generateMips = false;      // the file asked for its mips to be generated (levels holds level 0 only)
+        std::vector<Level> levels;      // levels[0]: full size
+    };
+
+    // checks the header and every level's size and range; throws std::runtime_error on a malformed or unsupported file
+    Description Read( const MappedFile& file );
+
+    // levels[0] full size, each next one half the previous (down to 1x1 for a full chain); a single level
+    // is written with levelCount 0 (mips generated at load). Uncompressed RGBA8 only: there is no BCn encoder
+    // here, compressed files come from the usual tools (toktx, basisu -ktx2 with supercompression off).
+    // Throws std::runtime_error when the file can't be written.
+    void Write( const std::string& path, VkFormat format, uint32_t width, uint32_t height,
+                    const std::vector<std::vector<uint8_t>>& levels );
+
+    // full chain from an RGBA8 image, 2x2 box filter (for Write)
+    std::vector<std::vector<uint8_t>> BuildMipChain( std::vector<uint8_t> rgba, uint32_t width, uint32_t height );
+
+    // levels of a full chain for a width x height image
+    uint32_t FullChainLength( uint32_t width, uint32_t height );
+}
@@ -0,0 +1,459 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "utilities.h"
+
+std::ostream& operator<<( std::ostream& os, const TextureStats& stats )
+{
+    os << "textures: " << stats.textureCount << ", " << stats.residentBytes / 1024 << " KiB resident of a "
+       << stats.budgetBytes / 1024 << " KiB budget (peak " << stats.peakBytes / 1024 << " KiB), "
+       << stats.bytesStreamed / 1024 << " KiB streamed in " << stats.levelsUploaded << " levels, "
+       << stats.levelsGenerated << " levels generated, " << stats.promotions << " promotions, "
+       << stats.evictions << " evictions, " << stats.budgetLimited << " requests limited by the budget";
+    return os;
+}
+
+void TextureStreamer::Init( VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, StagingUploader& uploader,
+                            uint32_t graphicsFamily, VkQueue graphicsQueue, VkDeviceSize budget, uint32_t framesInFlight )
+{
+    _device = device;
+    _physicalDevice = physicalDevice;
+    _allocator = &allocator;
+    _uploader = &uploader;
+    _graphicsQueue = graphicsQueue;
+    _budget = budget;
+    _framesInFlight = std::max<uint32_t>( 1, framesInFlight );
+    _stats.budgetBytes = budget;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = graphicsFamily;
+    if( vkCreateCommandPool( _device, &poolInfo, nullptr, &_commandPool )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create texture command pool!" );
+    }
+
+    // trilinear, over whatever levels the view holds
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if( vkCreateSampler( _device, &samplerInfo, nullptr, &_sampler )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create texture sampler!" );
+    }
+}
+
+void TextureStreamer::Destroy()
+{
+    for( auto& texture : _textures )
+    {
+        vkDestroyImageView( _device, texture.view, nullptr );
+        Image::Destroy( _device, *_allocator, texture.image, texture.allocation );
+    }
+    _textures.clear();
+    DestroyRetired( UINT64_MAX );
+
+    for( auto& commands : _mipCommands )
+        vkDestroyFence( _device, commands.fence, nullptr );
+    _mipCommands.clear();
+    _pendingMips.clear();
+
+    vkDestroySampler( _device, _sampler, nullptr );
+    vkDestroyCommandPool( _device, _commandPool, nullptr );     // command buffers too
+    _sampler = VK_NULL_HANDLE;
+    _commandPool = VK_NULL_HANDLE;
+}
+
+uint32_t TextureStreamer::Add( const std::string& path )
+{
+    Texture texture;
+    texture.file = std::make_unique<MappedFile>( path );
+    texture.description = TextureFile::Read( *texture.file );
+    const TextureFile::Description& description = texture.description;
+
+    VkFormatProperties properties{};
+    vkGetPhysicalDeviceFormatProperties( _physicalDevice, description.format, &properties );
+    if( (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0 )
+        throw std::runtime_error( "The device can't sample the format of " + path + "!" );
+
+    const uint32_t fileLevels = static_cast<uint32_t>( description.levels.size() );
+    if( description.generateMips )
+    {
+        // compressed formats are never blit destinations: those stay without mips
+        const VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        if( (properties.optimalTilingFeatures & blit) == blit )
+            texture.levelCount = TextureFile::FullChainLength( description.width, description.height );
+        texture.tailLevel = 0;      // only level 0 is in the file: pinned at full size
+    }
+    else
+    {
+        texture.levelCount = fileLevels;
+        texture.tailLevel = fileLevels - 1;
+        while( texture.tailLevel > 0 &&
+                std::max( description.width >> (texture.tailLevel - 1), description.height >> (texture.tailLevel - 1) ) <= TailSize )
+        {
+            --texture.tailLevel;
+        }
+    }
+
+    return Insert( std::move( texture ) );
+}
+
+uint32_t TextureStreamer::AddSolid( uint32_t rgba )
+{
+    Texture texture;
+    texture.description.format = VK_FORMAT_R8G8B8A8_UNORM;
+    texture.description.width = 1;
+    texture.description.height = 1;
+    texture.pixels = { uint8_t( rgba ), uint8_t( rgba >> 8 ), uint8_t( rgba >> 16 ), uint8_t( rgba >> 24 ) };
+    return Insert( std::move( texture ) );
+}
+
+uint32_t TextureStreamer::Insert( Texture texture )
+{
+    // the tail is there from the start: a view always exists (uploads submitted by the next Update at the latest)
+    MakeResident( texture, texture.tailLevel, 0 );
+    _textures.push_back( std::move( texture ) );
+    _stats.textureCount = static_cast<uint32_t>( _textures.size() );
+    return _stats.textureCount - 1;
+}
+
+void TextureStreamer::Request( uint32_t textureIndex, float screenPixels )
+{
+    Texture& texture = _textures[textureIndex];
+
+    // one texel per pixel: every halving of the texture's width past the screen size is a level not worth having
+    const float ratio = float( texture.description.width ) / std::max( screenPixels, 1.0f );
+    uint32_t level = ratio > 1.0f ? static_cast<uint32_t>( std::floor( std::log2( ratio ) ) ) : 0;
+    level = std::min( level, texture.tailLevel );
+    texture.requestedLevel = std::min( texture.requestedLevel, level );
+}
+
+bool TextureStreamer::Update( uint64_t frame )
+{
+    DestroyRetired( frame );
+
+    std::vector<uint32_t> candidates;
+    for( uint32_t i = 0; i < _textures.size(); ++i )
+    {
+        Texture& texture = _textures[i];
+        if( texture.requestedLevel == NoRequest )
+            continue;
+        texture.lastRequested = frame;
+        if( texture.requestedLevel < texture.residentLevel )
+            candidates.push_back( i );
+    }
+
+    // the textures furthest from what they are asked for first
+    std::stable_sort( candidates.begin(), candidates.end(), [this]( uint32_t a, uint32_t b ) {
+        return _textures[a].residentLevel - _textures[a].requestedLevel > _textures[b].residentLevel - _textures[b].requestedLevel;
+    } );
+
+    bool changed = false;
+    VkDeviceSize streamed = 0;
+    for( uint32_t index : candidates )
+    {
+        Texture& texture = _textures[index];
+        const VkDeviceSize residentBytes = Bytes( texture, texture.residentLevel );
+        uint32_t level = texture.requestedLevel;
+
+        // what doesn't fit in this frame's share comes in later frames (the request is repeated)
+        while( streamed > 0 && level < texture.residentLevel && streamed + Bytes( texture, level ) > MaxStreamBytesPerUpdate )
+            ++level;
+
+        // room: textures not drawn this frame give theirs back, least recently drawn first, then the request shrinks
+        while( _stats.residentBytes - residentBytes + Bytes( texture, level ) > _budget && EvictOne( frame ) )
+            changed = true;
+        while( level < texture.residentLevel && _stats.residentBytes - residentBytes + Bytes( texture, level ) > _budget )
+            ++level;
+
+        if( level != texture.requestedLevel )
+            ++_stats.budgetLimited;
+        if( level >= texture.residentLevel )
+            continue;
+
+        MakeResident( texture, level, frame );
+        ++_stats.promotions;
+        changed = true;
+
+        streamed += Bytes( texture, level );
+        if( streamed >= MaxStreamBytesPerUpdate )
+            break;
+    }
+
+    for( auto& texture : _textures )
+        texture.requestedLevel = NoRequest;
+
+    // copies first (the uploader's own submissions), then the blits reading them on the graphics queue
+    _uploader->Flush();
+    SubmitMips();
+    return changed;
+}
+
+VkDeviceSize TextureStreamer::Bytes( const Texture& texture, uint32_t firstLevel ) const
+{
+    const TextureFile::Description& description = texture.description;
+    VkDeviceSize bytes = 0;
+    for( uint32_t level = firstLevel; level < texture.levelCount; ++level )
+    {
+        bytes += FormatBlock::LevelSize( description.format, std::max<uint32_t>( 1, description.width >> level ),
+                                            std::max<uint32_t>( 1, description.height >> level ) );
+    }
+    return bytes;
+}
+
+void TextureStreamer::MakeResident( Texture& texture, uint32_t level, uint64_t frame )
+{
+    const TextureFile::Description& description = texture.description;
+    const VkExtent2D extent = { std::max<uint32_t>( 1, description.width >> level ), std::max<uint32_t>( 1, description.height >> level ) };
+    const uint32_t levelCount = texture.levelCount - level;
+    const uint32_t fileLevels = static_cast<uint32_t>( description.levels.size() );
+    const bool generated = texture.file && texture.levelCount > fileLevels;
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if( generated )
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    VkImage image;
+    Allocation allocation;
+    Image::Create( _device, *_allocator, extent, description.format, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                    image, allocation, levelCount );
+
+    // every level the file has, straight from the mapping; the rest is blitted once these are submitted
+    if( texture.file )
+    {
+        for( uint32_t fileLevel = level; fileLevel < fileLevels; ++fileLevel )
+        {
+            const TextureFile::Level& source = description.levels[fileLevel];
+            _uploader->UploadImage( *texture.file, source.offset, source.size, image, description.format,
+                                    fileLevel - level, source.width, source.height );
+            _stats.bytesStreamed += source.size;
+            ++_stats.levelsUploaded;
+        }
+        if( generated )
+            _pendingMips.push_back( { image, extent.width, extent.height, levelCount } );
+    }
+    else
+    {
+        _uploader->UploadImage( texture.pixels.data(), texture.pixels.size(), image, description.format, 0, 1, 1 );
+    }
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = description.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = levelCount;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    VkImageView view;
+    if( vkCreateImageView( _device, &viewInfo, nullptr, &view )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to create texture image view!" );
+    }
+
+    if( texture.image != VK_NULL_HANDLE )
+    {
+        RetiredImage retired;
+        retired.image = texture.image;
+        retired.allocation = texture.allocation;
+        retired.view = texture.view;
+        retired.bytes = Bytes( texture, texture.residentLevel );
+        retired.frame = frame;
+        _retired.push_back( retired );
+        _retiredBytes += retired.bytes;
+        _stats.residentBytes -= retired.bytes;
+    }
+
+    texture.image = image;
+    texture.allocation = allocation;
+    texture.view = view;
+    texture.residentLevel = level;
+    ++texture.version;
+
+    _stats.residentBytes += Bytes( texture, level );
+    UpdatePeak();
+}
+
+bool TextureStreamer::EvictOne( uint64_t frame )
+{
+    Texture* victim = nullptr;
+    for( auto& texture : _textures )
+    {
+        if( texture.residentLevel < texture.tailLevel && texture.lastRequested < frame &&
+            ( victim == nullptr || texture.lastRequested < victim->lastRequested ) )
+        {
+            victim = &texture;
+        }
+    }
+    if( victim == nullptr )
+        return false;
+
+    MakeResident( *victim, victim->tailLevel, frame );
+    ++_stats.evictions;
+    return true;
+}
+
+void TextureStreamer::DestroyRetired( uint64_t frame )
+{
+    // the frames before the one it was retired for are all done once framesInFlight more have started
+    while( !_retired.empty() && ( frame == UINT64_MAX || _retired.front().frame + _framesInFlight <= frame ) )
+    {
+        RetiredImage& retired = _retired.front();
+        vkDestroyImageView( _device, retired.view, nullptr );
+        Image::Destroy( _device, *_allocator, retired.image, retired.allocation );
+        _retiredBytes -= retired.bytes;
+        _retired.pop_front();
+    }
+}
+
+void TextureStreamer::SubmitMips()
+{
+    if( _pendingMips.empty() )
+        return;
+
+    // a command buffer whose last submission is done, or a new one
+    MipCommands* commands = nullptr;
+    for( auto& candidate : _mipCommands )
+    {
+        if( vkGetFenceStatus( _device, candidate.fence ) == VK_SUCCESS )
+        {
+            vkResetFences( _device, 1, &candidate.fence );
+            commands = &candidate;
+            break;
+        }
+    }
+    if( commands == nullptr )
+    {
+        MipCommands created;
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = _commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if( vkAllocateCommandBuffers( _device, &allocInfo, &created.commandBuffer )
+            != VK_SUCCESS )
+        {
+            throw std::runtime_error( "Failed to allocate mip generation command buffer!" );
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if( vkCreateFence( _device, &fenceInfo, nullptr, &created.fence )
+            != VK_SUCCESS )
+        {
+            throw std::runtime_error( "Failed to create mip generation fence!" );
+        }
+        _mipCommands.push_back( created );
+        commands = &_mipCommands.back();
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer( commands->commandBuffer, &beginInfo );
+    for( const auto& pending : _pendingMips )
+        RecordMips( commands->commandBuffer, pending );
+    vkEndCommandBuffer( commands->commandBuffer );
+
+    // same queue as the frames: they sample the levels only after these blits
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commands->commandBuffer;
+    if( vkQueueSubmit( _graphicsQueue, 1, &submitInfo, commands->fence )
+        != VK_SUCCESS )
+    {
+        throw std::runtime_error( "Failed to submit mip generation!" );
+    }
+
+    _pendingMips.clear();
+}
+
+void TextureStreamer::RecordMips( VkCommandBuffer commandBuffer, const PendingMips& pending )
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = pending.image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // level 0 as the uploader left it (shader read only, acquired on this queue) becomes the first source
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+    int32_t width = static_cast<int32_t>( pending.width );
+    int32_t height = static_cast<int32_t>( pending.height );
+    for( uint32_t level = 1; level < pending.levelCount; ++level )
+    {
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+        const int32_t nextWidth = std::max( 1, width / 2 );
+        const int32_t nextHeight = std::max( 1, height / 2 );
+        VkImageBlit blit{};
+        blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+        blit.srcOffsets[1] = { width, height, 1 };
+        blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+        vkCmdBlitImage( commandBuffer, pending.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        pending.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR );
+
+        // the level just written is the next one's source
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    // the whole chain for sampling
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = pending.levelCount;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                            0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+    _stats.levelsGenerated += pending.levelCount - 1;
+}
+
+void TextureStreamer::UpdatePeak()
+{
+    _stats.peakBytes = std::max<uint64_t>( _stats.peakBytes, _stats.residentBytes + _retiredBytes );
+}
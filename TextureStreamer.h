@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MemoryAllocator.h"
+#include "StagingUploader.h"
+#include "TextureFile.h"
+
+struct TextureStats
+{
+    uint32_t textureCount = 0;
+    uint64_t budgetBytes = 0;
+    uint64_t residentBytes = 0;     // texel data of the resident levels (allocation padding not counted)
+    uint64_t peakBytes = 0;         // resident + replaced images not destroyed yet, the most there ever was
+    uint64_t bytesStreamed = 0;     // level data uploaded from the files
+    uint32_t levelsUploaded = 0;
+    uint32_t levelsGenerated = 0;   // GPU mip generation (blits)
+    uint32_t promotions = 0;        // residency changes to finer levels
+    uint32_t evictions = 0;         // textures sent back to their tail to make room (LRU)
+    uint32_t budgetLimited = 0;     // requests served coarser than asked (or later) because of the budget
+};
+
+std::ostream& operator<<( std::ostream& os, const TextureStats& stats );
+
+
+// Textures streamed by mip level under a memory budget.
+// Every file stays mapped; what is resident of a texture is the tail of its mip chain from some level
+// down to 1x1, and levels no bigger than TailSize always are. Each frame the renderer tells which textures
+// it draws and how big they are on screen (Request); Update moves every texture toward the finest level worth
+// sampling. A texture whose residency changes gets a new image holding the new set of levels, uploaded from
+// the mapping through the staging ring (Vulkan 1.0 has no sparse residency to grow an image in place), and
+// the replaced one is destroyed once no frame in flight can sample it. When the requests don't fit in the
+// budget, the textures requested least recently go back to their tail first; textures requested this frame
+// are never evicted, their request is served coarser instead.
+//
+// Files with a single level and levelCount 0 (TextureFile::Write) get their mips generated on the graphics
+// queue with blits, when the format can be blitted; those can't be streamed (the file has nothing but
+// level 0) and stay resident at full size, like the solid color textures.
+class TextureStreamer
+{
+public:
+    // budget: bytes of texel data resident at once; framesInFlight: how long a replaced image may still be read
+    void Init( VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, StagingUploader& uploader,
+                uint32_t graphicsFamily, VkQueue graphicsQueue, VkDeviceSize budget, uint32_t framesInFlight );
+    // the device has to be idle
+    void Destroy();
+
+    // starts at its tail; throws std::runtime_error on a malformed or unsupported file
+    uint32_t Add( const std::string& path );
+    // 1x1 RGBA8 (0xAABBGGRR), always resident: the texture of draws without one
+    uint32_t AddSolid( uint32_t rgba );
+
+    // the texture is drawn this frame, its width spread over screenPixels (several requests: the biggest wins)
+    void Request( uint32_t texture, float screenPixels );
+    // once per frame, after the frame's fence and before its descriptors are written: destroys replaced images
+    // no frame uses anymore, changes residency toward this frame's requests and submits the uploads;
+    // true when a texture got a new view
+    bool Update( uint64_t frame );
+
+    // a new view (and version) every time residency changes: descriptors written with an older version are stale
+    VkImageView GetView( uint32_t texture ) const { return _textures[texture].view; }
+    uint64_t GetVersion( uint32_t texture ) const { return _textures[texture].version; }
+    VkSampler GetSampler() const { return _sampler; }
+    uint32_t GetResidentLevel( uint32_t texture ) const { return _textures[texture].residentLevel; }
+    uint32_t GetTextureCount() const { return static_cast<uint32_t>( _textures.size() ); }
+    const TextureStats& GetStats() const { return _stats; }
+
+public:
+    static constexpr uint32_t TailSize = 64;                            // levels this big or smaller stay resident
+    static constexpr VkDeviceSize MaxStreamBytesPerUpdate = 32ull << 20;     // spreads big changes over frames
+    static constexpr uint32_t NoRequest = UINT32_MAX;
+
+private:
+    struct Texture
+    {
+        std::unique_ptr<MappedFile> file;       // null for solid textures
+        TextureFile::Description description;
+        std::vector<uint8_t> pixels;            // solid textures: their texel
+        uint32_t levelCount = 1;                // of the image chain (file levels, or the full chain when generated)
+        uint32_t tailLevel = 0;                 // coarsest resident level there is always; 0: pinned
+        uint32_t residentLevel = UINT32_MAX;    // finest level in the image
+        uint32_t requestedLevel = NoRequest;    // this frame
+        uint64_t lastRequested = 0;             // frame of the last request (LRU)
+        uint64_t version = 0;
+
+        VkImage image = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+    };
+
+    // replaced image, destroyed once every frame that could have sampled it is done
+    struct RetiredImage
+    {
+        VkImage image = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDeviceSize bytes = 0;
+        uint64_t frame = 0;         // retired while preparing this frame
+    };
+
+    // a submission of mip generation, its command buffer reused once the fence is signaled
+    struct MipCommands
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+    };
+
+    struct PendingMips
+    {
+        VkImage image;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+    };
+
+private:
+    uint32_t Insert( Texture texture );
+    VkDeviceSize Bytes( const Texture& texture, uint32_t firstLevel ) const;   // texel data of levels [firstLevel, levelCount)
+    void MakeResident( Texture& texture, uint32_t level, uint64_t frame );
+    bool EvictOne( uint64_t frame );    // least recently requested texture not requested this frame, back to its tail
+    void DestroyRetired( uint64_t frame );
+    void SubmitMips();
+    void RecordMips( VkCommandBuffer commandBuffer, const PendingMips& pending );
+    void UpdatePeak();
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    MemoryAllocator* _allocator = nullptr;
+    StagingUploader* _uploader = nullptr;
+    VkQueue _graphicsQueue = VK_NULL_HANDLE;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;    // graphics family: blits need it
+    VkSampler _sampler = VK_NULL_HANDLE;
+    VkDeviceSize _budget = 0;
+    uint32_t _framesInFlight = 1;
+
+    std::vector<Texture> _textures;
+    std::deque<RetiredImage> _retired;
+    VkDeviceSize _retiredBytes = 0;
+    std::vector<PendingMips> _pendingMips;
+    std::vector<MipCommands> _mipCommands;
+    TextureStats _stats;
+};
@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+
+ThreadPool::~ThreadPool()
+{
+    Shutdown();
+}
+
+void ThreadPool::Init( uint32_t workerCount )
+{
+    Shutdown();
+
+    _stop = false;
+    for( uint32_t i = 0; i < workerCount; ++i )
+        _workers.emplace_back( &ThreadPool::WorkerLoop, this, i );
+}
+
+void ThreadPool::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for( auto& worker : _workers )
+        worker.join();
+    _workers.clear();
+}
+
+void ThreadPool::Dispatch( uint32_t taskCount, const Task& task )
+{
+    if( taskCount == 0 )
+        return;
+
+    // no workers: run inline as worker 0
+    if( _workers.empty() )
+    {
+        for( uint32_t i = 0; i < taskCount; ++i )
+            task( i, 0 );
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock( _mutex );
+    _task = &task;
+    _taskCount = taskCount;
+    _nextTask = 0;
+    _finishedTasks = 0;
+    _error = nullptr;
+    ++_batch;
+    _wake.notify_all();
+
+    _done.wait( lock, [this]() { return _finishedTasks == _taskCount; } );
+    _task = nullptr;
+
+    if( _error )
+        std::rethrow_exception( _error );
+}
+
+void ThreadPool::WorkerLoop( uint32_t workerIndex )
+{
+    uint64_t seenBatch = 0;
+
+    std::unique_lock<std::mutex> lock( _mutex );
+    while( true )
+    {
+        _wake.wait( lock, [this, seenBatch]() { return _stop || (_batch != seenBatch && _nextTask < _taskCount); } );
+        if( _stop )
+            return;
+
+        // take tasks until the batch runs dry
+        while( _nextTask < _taskCount )
+        {
+            const uint32_t taskIndex = _nextTask++;
+            const Task& task = *_task;
+
+            lock.unlock();
+            std::exception_ptr error;
+            try{
+                task( taskIndex, workerIndex );
+            }
+            catch( ... )
+            {
+                error = std::current_exception();
+            }
+            lock.lock();
+
+            if( error && !_error )
+                _error = error;
+            if( ++_finishedTasks == _taskCount )
+                _done.notify_one();
+        }
+
+        seenBatch = _batch;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running one batch of indexed tasks at a time.
+// The worker index passed to each task is stable (0 .. GetWorkerCount()-1), so per-thread
+// resources such as command pools can be indexed by it without locking.
+class ThreadPool
+{
+public:
+    using Task = std::function<void( uint32_t taskIndex, uint32_t workerIndex )>;
+
+public:
+    ThreadPool() = default;
+    ~ThreadPool();
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+
+    void Init( uint32_t workerCount );
+    void Shutdown();
+
+    // runs task( 0 .. taskCount-1 ) on the workers and blocks until all of them are done;
+    // the first exception thrown by a task is rethrown here
+    void Dispatch( uint32_t taskCount, const Task& task );
+
+    uint32_t GetWorkerCount() const { return static_cast<uint32_t>( _workers.size() ); }
+
+private:
+    void WorkerLoop( uint32_t workerIndex );
+
+private:
+    std::vector<std::thread> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;      // workers: a new batch (or shutdown)
+    std::condition_variable _done;      // Dispatch: the batch finished
+    const Task* _task = nullptr;
+    uint32_t _taskCount = 0;
+    uint32_t _nextTask = 0;
+    uint32_t _finishedTasks = 0;
+    uint64_t _batch = 0;                // bumped per Dispatch so workers don't run a batch twice
+    bool _stop = false;
+    std::exception_ptr _error;
+};
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AppConfig.h"
+#include "HelloTriangleApp.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "SyntheticScene.h"
+#include "TextureFile.h"
+
+// Runs the renderer headless over a matrix of synthetic scenes (objects x triangles x vertex format x record threads)
+// for a fixed number of frames and writes one JSON record per run.
+// With --mesh-file every scene is written to a .mesh file first and loaded from it (mesh_load_* in the record).
+// With --textures N, N synthetic KTX2 textures are written first and the meshes take them in turn (texture_* in the record).
+// With --layers L the objects are stacked in L layers listed back to front: the overdraw the draw sort (or
+// --no-draw-sort) is measured on, and what --depth-prepass and --occlusion-cull (with --gpu-driven) save;
+// the GPU-driven runs report the objects drawn and culled per frame (objects_* in the record).
+
+namespace
+{
+    const char* BenchmarkMeshPath = "benchmark_scene.mesh";
+    constexpr uint32_t BenchmarkTextureSize = 1024;
+
+    struct BenchmarkOptions
+    {
+        std::vector<uint32_t> objects { 1, 256 };
+        std::vector<uint32_t> triangles { 128, 16384 };
+        std::vector<VertexFormat> formats { VertexFormat::Full, VertexFormat::Compact };
+        std::vector<uint32_t> recordThreads { 0 };
+        uint32_t frames = 300;
+        std::string output = "benchmark.json";
+        bool validation = false;
+        bool dynamicRecording = false;
+        bool gpuDriven = false;
+        bool instanced = false;     // the object counts become instance counts of one mesh
+        bool meshFile = false;      // each scene goes through a .mesh file (written, then loaded with --mesh)
+        bool animate = false;       // every object moves every frame (per-frame transform writes)
+        bool bindless = false;
+        uint32_t layers = 1;        // full screen layers the objects are split over (not with --instanced)
+        bool sortDraws = true;
+        bool depthPrepass = false;
+        bool occlusionCull = false; // needs gpuDriven
+        uint32_t textures = 0;      // synthetic KTX2 files (RGBA8, full mip chain)
+        uint32_t textureBudgetMb = AppConfig::DefaultTextureBudgetMb;
+        uint32_t framesInFlight = AppConfig::DefaultFramesInFlight;
+    };
+
+    uint32_t ParseUint( const std::string& value )
+    {
+        size_t parsed = 0;
+        const unsigned long result = std::stoul( value, &parsed );
+        if( parsed != value.size() || result > UINT32_MAX )
+            throw std::runtime_error( "Invalid number: " + value );
+        return static_cast<uint32_t>( result );
+    }
+
+    std::vector<std::string> Split( const std::string& list )
+    {
+        std::vector<std::string> items;
+        std::stringstream stream( list );
+        std::string item;
+        while( std::getline( stream, item, ',' ) )
+        {
+            if( !item.empty() )
+                items.push_back( item );
+        }
+        return items;
+    }
+
+    BenchmarkOptions ParseOptions( int argc, char** argv )
+    {
+        BenchmarkOptions options;
+
+        for( int i = 1; i < argc; ++i )
+        {
+            const std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if( i + 1 >= argc )
+                    throw std::runtime_error( "Missing value for " + arg );
+                return argv[++i];
+            };
+
+            if( arg == "--objects" || arg == "--triangles" || arg == "--record-threads" )
+            {
+                std::vector<uint32_t> values;
+                for( const auto& item : Split( next() ) )
+                    values.push_back( ParseUint( item ) );
+
+                if( arg == "--objects" )
+                    options.objects = values;
+                else if( arg == "--triangles" )
+                    options.triangles = values;
+                else
+                    options.recordThreads = values;
+            }
+            else if( arg == "--formats" )
+            {
+                options.formats.clear();
+                for( const auto& item : Split( next() ) )
+                {
+                    if( item == "full" )
+                        options.formats.push_back( VertexFormat::Full );
+                    else if( item == "compact" )
+                        options.formats.push_back( VertexFormat::Compact );
+                    else
+                        throw std::runtime_error( "Unknown vertex format: " + item );
+                }
+            }
+            else if( arg == "--frames" )
+                options.frames = ParseUint( next() );
+            else if( arg == "--frames-in-flight" )
+                options.framesInFlight = ParseUint( next() );
+            else if( arg == "--out" )
+                options.output = next();
+            else if( arg == "--validation" )
+                options.validation = true;
+            else if( arg == "--dynamic-recording" )
+                options.dynamicRecording = true;
+            else if( arg == "--gpu-driven" )
+                options.gpuDriven = true;
+            else if( arg == "--instanced" )
+                options.instanced = true;
+            else if( arg == "--mesh-file" )
+                options.meshFile = true;
+            else if( arg == "--animate" )
+                options.animate = true;
+            else if( arg == "--bindless" )
+                options.bindless = true;
+            else if( arg == "--layers" )
+                options.layers = std::max<uint32_t>( 1, ParseUint( next() ) );
+            else if( arg == "--no-draw-sort" )
+                options.sortDraws = false;
+            else if( arg == "--depth-prepass" )
+                options.depthPrepass = true;
+            else if( arg == "--occlusion-cull" )
+                options.occlusionCull = true;
+            else if( arg == "--textures" )
+                options.textures = ParseUint( next() );
+            else if( arg == "--texture-budget-mb" )
+                options.textureBudgetMb = ParseUint( next() );
+            else
+            {
+                throw std::runtime_error( "Unknown option: " + arg + "\n"
+                    "usage: Benchmark [--objects 1,256] [--triangles 128,16384] [--formats full,compact]\n"
+                    "                 [--record-threads 0,4] [--frames 300] [--out benchmark.json] [--validation]\n"
+                    "                 [--dynamic-recording] [--gpu-driven] [--instanced] [--frames-in-flight 2]\n"
+                    "                 [--mesh-file] [--animate] [--bindless] [--textures 0] [--texture-budget-mb 256]\n"
+                    "                 [--layers 1] [--no-draw-sort] [--depth-prepass] [--occlusion-cull]\n" );
+            }
+        }
+
+        if( options.meshFile && options.instanced )
+            throw std::runtime_error( "--mesh-file stores no instances, it can't be combined with --instanced" );
+
+        if( options.framesInFlight == 0 || options.framesInFlight > AppConfig::MaxFramesInFlight )
+            throw std::runtime_error( "--frames-in-flight must be 1.." + std::to_string( AppConfig::MaxFramesInFlight ) );
+        if( options.instanced && options.layers > 1 )
+            throw std::runtime_error( "--layers stacks the objects, an --instanced scene is a single draw" );
+        if( options.occlusionCull && !options.gpuDriven )
+            throw std::runtime_error( "--occlusion-cull needs --gpu-driven" );
+
+        return options;
+    }
+
+    // a checkerboard per texture, each in its own tint, with every level in the file (nothing generated at load)
+    std::vector<std::string> WriteTextures( uint32_t count )
+    {
+        std::vector<std::string> paths;
+        for( uint32_t texture = 0; texture < count; ++texture )
+        {
+            const uint32_t size = BenchmarkTextureSize;
+            std::vector<uint8_t> rgba( size_t(size) * size * 4 );
+            for( uint32_t y = 0; y < size; ++y )
+            {
+                for( uint32_t x = 0; x < size; ++x )
+                {
+                    const bool light = ((x / 64) + (y / 64)) % 2 == 0;
+                    uint8_t* texel = &rgba[(size_t(y) * size + x) * 4];
+                    texel[0] = static_cast<uint8_t>( light ? 255 : 64 + (texture * 53) % 128 );
+                    texel[1] = static_cast<uint8_t>( light ? 255 : 64 + (texture * 97) % 128 );
+                    texel[2] = static_cast<uint8_t>( light ? 255 : 64 + (texture * 29) % 128 );
+                    texel[3] = 255;
+                }
+            }
+
+            paths.push_back( "benchmark_texture_" + std::to_string( texture ) + ".ktx2" );
+            TextureFile::Write( paths.back(), VK_FORMAT_R8G8B8A8_UNORM, size, size, TextureFile::BuildMipChain( std::move( rgba ), size, size ) );
+        }
+        return paths;
+    }
+
+    void WriteResult( std::ostream& out, const AppConfig& config, uint32_t objects, const RunStats& stats )
+    {
+        // per frame averages of the culls read back (0 without --gpu-driven)
+        const double culledFrames = stats.culling.frames > 0 ? double(stats.culling.frames) : 1.0;
+
+        out << "    { \"objects\": " << objects
+            << ", \"instanced\": " << (config.sceneInstances > 0 ? "true" : "false")
+            << ", \"triangles_per_object\": " << config.sceneTriangles
+            << ", \"vertex_format\": \"" << (config.vertexFormat == VertexFormat::Compact ? "compact" : "full") << "\""
+            << ", \"frames\": " << stats.frameCount
+            << ", \"seconds\": " << stats.seconds
+            << ", \"fps\": " << stats.fps
+            << ", \"frame_ms_p50\": " << stats.profile.frameMs.p50
+            << ", \"frame_ms_p99\": " << stats.profile.frameMs.p99
+            << ", \"gpu_ms_p50\": " << stats.profile.gpuMs.p50
+            << ", \"input_to_gpu_done_ms_p50\": " << stats.profile.latencyMs.p50
+            << ", \"input_to_gpu_done_ms_p99\": " << stats.profile.latencyMs.p99
+            << ", \"frames_in_flight\": " << config.framesInFlight
+            << ", \"startup_ms\": " << stats.startupMs
+            << ", \"pipeline_ms\": " << stats.pipelineMs
+            << ", \"pipeline_cache_warm\": " << (stats.pipelineCache.warm ? "true" : "false")
+            << ", \"dynamic_recording\": " << (config.dynamicRecording ? "true" : "false")
+            << ", \"gpu_driven\": " << (config.gpuDriven ? "true" : "false")
+            << ", \"animate\": " << (config.animate ? "true" : "false")
+            << ", \"bindless\": " << (stats.descriptors.bindlessBuffers > 0 ? "true" : "false")     // false when unsupported
+            << ", \"descriptor_sets\": " << stats.descriptors.setsAllocated
+            << ", \"descriptor_pools\": " << stats.descriptors.poolCount
+            << ", \"textures\": " << config.texturePaths.size()
+            << ", \"texture_budget_mb\": " << config.textureBudgetMb
+            << ", \"texture_resident_mb\": " << double(stats.textures.residentBytes) / (1024.0 * 1024.0)
+            << ", \"texture_peak_mb\": " << double(stats.textures.peakBytes) / (1024.0 * 1024.0)
+            << ", \"texture_streamed_mb\": " << double(stats.textures.bytesStreamed) / (1024.0 * 1024.0)
+            << ", \"texture_promotions\": " << stats.textures.promotions
+            << ", \"texture_evictions\": " << stats.textures.evictions
+            << ", \"layers\": " << config.sceneLayers
+            << ", \"draw_sort\": " << (config.sortDraws ? "true" : "false")
+            << ", \"draw_sort_ms\": " << stats.drawSort.sortMs
+            << ", \"depth_prepass\": " << (config.depthPrepass ? "true" : "false")
+            << ", \"occlusion_cull\": " << (config.occlusionCull ? "true" : "false")
+            << ", \"objects_drawn\": " << double(stats.culling.drawn) / culledFrames
+            << ", \"objects_frustum_culled\": " << double(stats.culling.frustumCulled) / culledFrames
+            << ", \"objects_occlusion_culled\": " << double(stats.culling.occlusionCulled) / culledFrames
+            << ", \"record_threads\": " << stats.recordThreads
+            << ", \"record_ms\": " << stats.recordMs
+            << ", \"rerecords\": " << stats.rerecordCount
+            << ", \"draw_calls\": " << stats.drawCalls
+            << ", \"triangles_per_frame\": " << stats.trianglesPerFrame
+            << ", \"upload_mb\": " << double(stats.upload.bytesUploaded) / (1024.0 * 1024.0)
+            << ", \"upload_mb_per_s\": " << stats.upload.MegabytesPerSecond()
+            << ", \"mesh_file\": " << (config.meshPath.empty() ? "false" : "true")
+            << ", \"mesh_load_mb\": " << double(stats.meshLoad.bytesStreamed) / (1024.0 * 1024.0)
+            << ", \"mesh_load_ms\": " << stats.meshLoad.seconds * 1000.0
+            << ", \"mesh_load_mb_per_s\": " << stats.meshLoad.MegabytesPerSecond()
+            << ", \"geometry_bytes\": " << stats.geometry.vertexBytesUsed + stats.geometry.indexBytesUsed
+            << ", \"memory_bytes_used\": " << stats.memory.bytesUsed
+            << ", \"memory_bytes_reserved\": " << stats.memory.bytesReserved
+            << ", \"memory_blocks\": " << stats.memory.blockCount
+            << " }";
+    }
+}
+
+int main( int argc, char** argv )
+{
+    try{
+        const BenchmarkOptions options = ParseOptions( argc, argv );
+
+        std::ofstream out( options.output );
+        if( !out.is_open() )
+            throw std::runtime_error( "Failed to open " + options.output + " for writing!" );
+
+        // written once, every run streams from the same files
+        const std::vector<std::string> texturePaths = WriteTextures( options.textures );
+
+        out << "{\n  \"results\": [\n";
+        bool first = true;
+
+        // the full matrix, flattened
+        struct Run
+        {
+            VertexFormat format;
+            uint32_t objects;
+            uint32_t triangles;
+            uint32_t recordThreads;
+        };
+        std::vector<Run> runs;
+        for( auto format : options.formats )
+            for( auto objects : options.objects )
+                for( auto triangles : options.triangles )
+                    for( auto recordThreads : options.recordThreads )
+                        runs.push_back( { format, objects, triangles, recordThreads } );
+
+        for( const auto& run : runs )
+        {
+            AppConfig config;
+            config.headless = true;
+            config.validation = options.validation;
+            config.frameCount = options.frames;
+            config.framesInFlight = options.framesInFlight;
+            config.vertexFormat = run.format;
+            if( options.instanced )
+                config.sceneInstances = run.objects;
+            else if( options.meshFile )
+            {
+                // the same synthetic scene, written the way MeshConverter would (optimized, chunked, in the
+                // run's vertex format) so the run measures streaming it back in; the file was just written,
+                // so this is the page cache speed unless the caches are dropped in between
+                std::vector<MeshData> meshes = SyntheticScene::Generate( run.objects, run.triangles, options.layers );
+                for( auto& mesh : meshes )
+                    MeshOptimizer::Optimize( mesh.vertices, mesh.indices, false );
+                config.meshPath = BenchmarkMeshPath;
+                MeshFile::Write( config.meshPath, meshes, run.format );
+            }
+            else
+                config.sceneObjects = run.objects;
+            config.sceneLayers = options.layers;    // the --mesh-file scene is stacked when it is written
+            config.sceneTriangles = run.triangles;
+            config.sortDraws = options.sortDraws;
+            config.depthPrepass = options.depthPrepass;
+            config.occlusionCull = options.occlusionCull;
+            config.recordThreads = run.recordThreads;
+            config.dynamicRecording = options.dynamicRecording;
+            config.gpuDriven = options.gpuDriven;
+            config.animate = options.animate;
+            config.bindless = options.bindless;
+            config.texturePaths = texturePaths;
+            config.textureBudgetMb = options.textureBudgetMb;
+            config.profile = true;
+
+            std::cout << "--- " << run.objects << (options.instanced ? " instances x " : " objects x ") << run.triangles << " triangles, "
+                      << (options.meshFile ? "from " + config.meshPath + ", " : std::string())
+                      << (run.format == VertexFormat::Compact ? "compact" : "full") << " vertices, "
+                      << run.recordThreads << " record threads ---" << std::endl;
+
+            HelloTriangleApp app( config );
+            app.Run();
+
+            out << (first ? "" : ",\n");
+            WriteResult( out, config, run.objects, app.GetRunStats() );
+            if( options.meshFile )
+                std::remove( BenchmarkMeshPath );
+            first = false;
+        }
+
+        for( const auto& path : texturePaths )
+            std::remove( path.c_str() );
+
+        out << "\n  ]\n}\n";
+        std::cout << "results written to " << options.output << std::endl;
+    }
+    catch( std::exception& e )
+    {
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,13 @@
 #include <exception>
 #include <iostream>
 
+#include "AppConfig.h"
 #include "HelloTriangleApp.h"
 
-int main()
+int main( int argc, char** argv )
 {
-    HelloTriangleApp app;
-
     try{
+        HelloTriangleApp app( AppConfig::Parse( argc, argv ) );
         app.Run();
     }
     catch( std::exception& e )
@@ -17,4 +17,4 @@ int main()
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
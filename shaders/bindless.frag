@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+// --bindless permutation of shader.frag: the draw's texture comes from the bindless texture
+// array (set 1, see BindlessTable), picked by the index the draw pushes
+
+layout( location = 0 ) in vec3 fragmentColor;
+layout( location = 1 ) in vec2 fragmentUv;
+
+layout( location = 0 ) out vec4 outColor;
+
+layout( set = 1, binding = 1 ) uniform sampler2D textures[];
+
+layout( push_constant ) uniform Object
+{
+    uint objectIndex;
+    uint objectBuffer;
+    uint textureIndex;      // bindless slot of the draw's texture (for the frame slot)
+    vec4 uvTransform;
+} object;
+
+void main()
+{
+    // push constant indices are dynamically uniform: no nonuniformEXT needed
+    outColor = vec4( fragmentColor * texture( textures[object.textureIndex], fragmentUv ).rgb, 1.0f );
+}
@@ -0,0 +1,53 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+// --bindless permutation of shader.vert: the object transforms come from the bindless buffer
+// array (set 1, see BindlessTable) instead of set 0 binding 1; same inputs, same outputs
+
+layout( location = 0 ) in vec3 pos;
+layout( location = 1 ) in vec3 col;
+
+// per instance (binding 1, see InstanceData)
+layout( location = 2 ) in mat4 instanceTransform;     // locations 2..5
+layout( location = 6 ) in vec4 instanceColor;
+layout( location = 7 ) in uint instanceObject;        // 0xFFFFFFFF: none (the shared identity instance)
+
+layout( location = 0 ) out vec3 fragmentColor;
+layout( location = 1 ) out vec2 fragmentUv;
+
+// the depth pre-pass (no fragment shader) and the shading pass have to land on the same depth
+invariant gl_Position;
+
+// per frame (see FrameUniforms)
+layout( std140, set = 0, binding = 0 ) uniform Camera
+{
+    mat4 viewProjection;    // includes the y flip (Vulkan's clip space y points down)
+} camera;
+
+// every bindless buffer; the ones registered by FrameUniforms hold a slice's transforms
+layout( std430, set = 1, binding = 0 ) readonly buffer ObjectBuffer
+{
+    mat4 objects[];
+} buffers[];
+
+layout( push_constant ) uniform Object
+{
+    uint objectIndex;       // 0xFFFFFFFF: none pushed, the instance's (FrameUniforms::NoObject)
+    uint objectBuffer;      // bindless slot of the frame slot's transforms
+    uint textureIndex;      // --bindless only (bindless.frag)
+    vec4 uvTransform;       // the mesh has no texture coordinates: xy * uvTransform.xy + uvTransform.zw
+} object;
+
+void main()
+{
+    // the pushed index, or with none pushed (GPU-driven indirect draws) the one the instance carries;
+    // the buffer index is a push constant, dynamically uniform: no nonuniformEXT needed
+    uint objectIndex = object.objectIndex != 0xFFFFFFFFu ? object.objectIndex : instanceObject;
+    mat4 model = objectIndex == 0xFFFFFFFFu ? mat4( 1.0 ) : buffers[object.objectBuffer].objects[objectIndex];
+    vec4 localPos = instanceTransform * vec4( pos, 1.0 );
+    vec4 worldPos = model * localPos;
+    gl_Position = camera.viewProjection * worldPos;
+    fragmentColor = col * instanceColor.rgb;
+    fragmentUv = localPos.xy * object.uvTransform.xy + object.uvTransform.zw;    // planar, across the mesh's bounds
+}
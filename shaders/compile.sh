@@ -2,9 +2,23 @@
 
 vert_glsl=shader.vert
 vert_spv=vert.spv
+bindless_vert_glsl=bindless.vert
+bindless_vert_spv=bindless_vert.spv
 frag_glsl=shader.frag
 frag_spv=frag.spv
+bindless_frag_glsl=bindless.frag
+bindless_frag_spv=bindless_frag.spv
+cull_glsl=cull.comp
+cull_spv=cull.spv
+cull_occlusion_spv=cull_occlusion.spv
+hiz_glsl=hiz.comp
+hiz_spv=hiz.spv
 
 glslc $vert_glsl -o $vert_spv
+glslc $bindless_vert_glsl -o $bindless_vert_spv
 glslc $frag_glsl -o $frag_spv
+glslc $bindless_frag_glsl -o $bindless_frag_spv
+glslc $cull_glsl -o $cull_spv
+glslc -DOCCLUSION $cull_glsl -o $cull_occlusion_spv
+glslc $hiz_glsl -o $hiz_spv
 
@@ -2,13 +2,17 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout( location = 0 ) in vec3 fragmentColor;
+layout( location = 1 ) in vec2 fragmentUv;
 
 layout( location = 0 ) out vec4 outColor;
 
+// the draw's texture (see TextureStreamer): bound per draw, only the levels resident right now
+layout( set = 1, binding = 0 ) uniform sampler2D albedo;
+
 
 void main()
 {
-    outColor = vec4( fragmentColor, 1.0f );
+    outColor = vec4( fragmentColor * texture( albedo, fragmentUv ).rgb, 1.0f );
 }
 
 /*
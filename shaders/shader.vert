@@ -4,12 +4,46 @@
 layout( location = 0 ) in vec3 pos;
 layout( location = 1 ) in vec3 col;
 
+// per instance (binding 1, see InstanceData)
+layout( location = 2 ) in mat4 instanceTransform;     // locations 2..5
+layout( location = 6 ) in vec4 instanceColor;
+layout( location = 7 ) in uint instanceObject;        // 0xFFFFFFFF: none (the shared identity instance)
+
 layout( location = 0 ) out vec3 fragmentColor;
+layout( location = 1 ) out vec2 fragmentUv;
+
+// the depth pre-pass (no fragment shader) and the shading pass have to land on the same depth
+invariant gl_Position;
+
+// per frame (see FrameUniforms): one slice per frame in flight, rewritten by the CPU through a mapping
+layout( std140, set = 0, binding = 0 ) uniform Camera
+{
+    mat4 viewProjection;    // includes the y flip (Vulkan's clip space y points down)
+} camera;
+
+layout( std430, set = 0, binding = 1 ) readonly buffer Objects
+{
+    mat4 objects[];
+};
+
+layout( push_constant ) uniform Object
+{
+    uint objectIndex;       // 0xFFFFFFFF: none pushed, the instance's (FrameUniforms::NoObject)
+    uint objectBuffer;      // --bindless only (bindless.vert)
+    uint textureIndex;      // --bindless only (bindless.frag)
+    vec4 uvTransform;       // the mesh has no texture coordinates: xy * uvTransform.xy + uvTransform.zw
+} object;
 
 void main()
 {
-    gl_Position = vec4( pos.x, pos.y * (-1.0), pos.z, 1.0 );
-    fragmentColor = col;
+    // the pushed index, or with none pushed (GPU-driven indirect draws) the one the instance carries
+    uint objectIndex = object.objectIndex != 0xFFFFFFFFu ? object.objectIndex : instanceObject;
+    mat4 model = objectIndex == 0xFFFFFFFFu ? mat4( 1.0 ) : objects[objectIndex];
+    vec4 localPos = instanceTransform * vec4( pos, 1.0 );
+    vec4 worldPos = model * localPos;
+    gl_Position = camera.viewProjection * worldPos;
+    fragmentColor = col * instanceColor.rgb;
+    fragmentUv = localPos.xy * object.uvTransform.xy + object.uvTransform.zw;    // planar, across the mesh's bounds
 }
 
 /*
@@ -0,0 +1,286 @@
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "DrawSorter.h"
+#include "MeshOptimizer.h"
+#include "RangeAllocator.h"
+
+// Behavioural checks of the CPU-only building blocks: no window, no Vulkan device (make cpu-tests).
+// Every failed check is printed; the exit code is the number of failures.
+
+namespace
+{
+    int failures = 0;
+
+    void Check( bool condition, const char* what )
+    {
+        if( !condition )
+        {
+            std::cerr << "FAILED: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    // --- MeshOptimizer ---
+
+    struct GridVertex
+    {
+        glm::vec3 pos;
+    };
+
+    // a size x size quad grid, its triangles shuffled (the worst case for the vertex cache)
+    void MakeShuffledGrid( uint32_t size, std::vector<GridVertex>& vertices, std::vector<uint32_t>& indices )
+    {
+        vertices.clear();
+        for( uint32_t y = 0; y <= size; ++y )
+            for( uint32_t x = 0; x <= size; ++x )
+                vertices.push_back( { glm::vec3( float(x), float(y), 0.0f ) } );
+
+        std::vector<std::array<uint32_t, 3>> triangles;
+        for( uint32_t y = 0; y < size; ++y )
+        {
+            for( uint32_t x = 0; x < size; ++x )
+            {
+                const uint32_t corner = y * (size + 1) + x;
+                triangles.push_back( { corner, corner + 1, corner + size + 1 } );
+                triangles.push_back( { corner + 1, corner + size + 2, corner + size + 1 } );
+            }
+        }
+        std::shuffle( triangles.begin(), triangles.end(), std::mt19937( 1 ) );
+
+        indices.clear();
+        for( const auto& triangle : triangles )
+            indices.insert( indices.end(), triangle.begin(), triangle.end() );
+    }
+
+    // the triangles as position triples, rotated to start at the smallest corner (keeps the winding), sorted
+    std::vector<std::array<std::array<float, 3>, 3>> TriangleSet( const std::vector<GridVertex>& vertices, const std::vector<uint32_t>& indices )
+    {
+        std::vector<std::array<std::array<float, 3>, 3>> triangles;
+        for( size_t i = 0; i + 2 < indices.size(); i += 3 )
+        {
+            std::array<std::array<float, 3>, 3> triangle;
+            for( size_t corner = 0; corner < 3; ++corner )
+            {
+                const glm::vec3& pos = vertices[indices[i + corner]].pos;
+                triangle[corner] = { pos.x, pos.y, pos.z };
+            }
+            std::rotate( triangle.begin(), std::min_element( triangle.begin(), triangle.end() ), triangle.end() );
+            triangles.push_back( triangle );
+        }
+        std::sort( triangles.begin(), triangles.end() );
+        return triangles;
+    }
+
+    void TestMeshOptimizer( bool optimizeOverdraw )
+    {
+        std::vector<GridVertex> vertices;
+        std::vector<uint32_t> indices;
+        MakeShuffledGrid( 32, vertices, indices );
+        const auto trianglesBefore = TriangleSet( vertices, indices );
+        const size_t indexCount = indices.size();
+
+        MeshOptimizeReport report = MeshOptimizer::Optimize( vertices, indices, optimizeOverdraw );
+
+        Check( indices.size() == indexCount, "optimize: index count unchanged" );
+        Check( std::all_of( indices.begin(), indices.end(), [&]( uint32_t index ) { return index < vertices.size(); } ),
+                "optimize: every index points at a vertex" );
+        Check( TriangleSet( vertices, indices ) == trianglesBefore, "optimize: same triangles, same winding" );
+        Check( vertices.size() == (32 + 1) * (32 + 1), "optimize: every referenced vertex kept" );
+
+        // vertex fetch order: vertices appear in the order the index buffer first uses them
+        uint32_t nextNew = 0;
+        bool fetchOrdered = true;
+        for( uint32_t index : indices )
+        {
+            if( index > nextNew )
+                fetchOrdered = false;
+            else if( index == nextNew )
+                ++nextNew;
+        }
+        Check( fetchOrdered, "optimize: vertices in first use order" );
+
+        Check( report.after.acmr < report.before.acmr, "optimize: ACMR improves on a shuffled grid" );
+        Check( report.after.acmr < 1.0f, "optimize: ACMR below 1 on a grid" );
+    }
+
+    // --- RangeAllocator ---
+
+    void TestRangeAllocatorAlignment()
+    {
+        RangeAllocator ranges( 1 << 16 );
+        VkDeviceSize padding = 0;
+        Check( ranges.Allocate( 3, 1, padding ), "range: unaligned allocation" );
+
+        const VkDeviceSize alignments[] = { 4, 16, 256, 24, 4096 };     // 24: a vertex stride
+        std::map<VkDeviceSize, VkDeviceSize> live;
+        for( VkDeviceSize alignment : alignments )
+        {
+            VkDeviceSize offset = 0;
+            Check( ranges.Allocate( 100, alignment, offset ), "range: aligned allocation" );
+            Check( offset % alignment == 0, "range: offset is aligned" );
+            live[offset] = 100;
+        }
+        live[padding] = 3;
+
+        VkDeviceSize end = 0;
+        for( const auto& range : live )
+        {
+            Check( range.first >= end, "range: allocations don't overlap" );
+            end = range.first + range.second;
+        }
+        Check( ranges.GetUsed() == 3 + 100 * 5, "range: used bytes" );
+    }
+
+    void TestRangeAllocatorCoalescing()
+    {
+        constexpr VkDeviceSize Capacity = 1 << 20;
+        RangeAllocator ranges( Capacity );
+
+        std::vector<std::pair<VkDeviceSize, VkDeviceSize>> live;
+        std::mt19937 random( 7 );
+        for( uint32_t i = 0; i < 1000; ++i )
+        {
+            const VkDeviceSize size = 1 + random() % 900;
+            VkDeviceSize offset = 0;
+            if( ranges.Allocate( size, 1, offset ) )
+                live.push_back( { offset, size } );
+        }
+        Check( !live.empty(), "coalesce: something allocated" );
+
+        // free every other one (in a random order): each run of neighbours freed has to be one range,
+        // the last one merged with the free tail
+        std::shuffle( live.begin(), live.end(), random );
+        std::map<VkDeviceSize, bool> freed;     // offset -> freed, allocations are back to back from 0
+        VkDeviceSize end = 0;
+        for( size_t i = 0; i < live.size(); ++i )
+        {
+            if( i % 2 == 0 )
+                ranges.Free( live[i].first, live[i].second );
+            freed[live[i].first] = i % 2 == 0;
+            end = std::max( end, live[i].first + live[i].second );
+        }
+
+        size_t runs = 0;
+        bool previousFreed = false;
+        for( const auto& allocation : freed )
+        {
+            if( allocation.second && !previousFreed )
+                ++runs;
+            previousFreed = allocation.second;
+        }
+        if( end < Capacity && !previousFreed )
+            ++runs;
+        Check( ranges.GetFreeRangeCount() == runs, "coalesce: freed neighbours merge" );
+
+        for( size_t i = 1; i < live.size(); i += 2 )
+            ranges.Free( live[i].first, live[i].second );
+        Check( ranges.IsEmpty(), "coalesce: everything freed" );
+        Check( ranges.GetFreeRangeCount() == 1, "coalesce: one free range left" );
+        Check( ranges.GetLargestFreeRange() == Capacity, "coalesce: the whole capacity is one range again" );
+    }
+
+    void TestRangeAllocatorExhaustion()
+    {
+        RangeAllocator ranges( 4096 );
+        VkDeviceSize first = 0, second = 0, third = 0, offset = 0;
+        Check( ranges.Allocate( 1024, 1, first ), "exhaust: first quarter" );
+        Check( ranges.Allocate( 1024, 1, second ), "exhaust: second quarter" );
+        Check( ranges.Allocate( 2048, 1, third ), "exhaust: the rest, exactly" );
+        Check( !ranges.Allocate( 1, 1, offset ), "exhaust: nothing left" );
+
+        // a 1024 byte hole: anything bigger doesn't fit, the same size does (at the hole)
+        ranges.Free( second, 1024 );
+        Check( !ranges.Allocate( 1025, 1, offset ), "exhaust: bigger than the hole" );
+        Check( ranges.Allocate( 1024, 1, offset ) && offset == second, "exhaust: exactly the hole" );
+
+        // an exact fit that only works at its alignment
+        RangeAllocator aligned( 256 );
+        Check( aligned.Allocate( 256, 256, offset ) && offset == 0, "exhaust: whole range at its alignment" );
+
+        // a fit only at its alignment in a range between the size's bin and size + alignment - 1's
+        RangeAllocator padded( 8192 );
+        Check( padded.Allocate( 1, 1, offset ), "exhaust: one byte in front" );
+        Check( padded.Allocate( 4096, 4096, offset ) && offset == 4096, "exhaust: aligned fit in a range smaller than size + alignment" );
+
+        // ranges added later are allocated from, and removed once free again
+        ranges.AddRange( 1 << 20, 512 );
+        Check( ranges.Allocate( 512, 1, offset ) && offset == (1 << 20), "exhaust: added range" );
+        Check( !ranges.RemoveRange( 1 << 20, 512 ), "exhaust: a used range can't be removed" );
+        ranges.Free( offset, 512 );
+        Check( ranges.RemoveRange( 1 << 20, 512 ) && ranges.GetCapacity() == 4096, "exhaust: removed once free" );
+    }
+
+    // --- DrawSorter ---
+
+    void TestDrawSorter()
+    {
+        std::mt19937 random( 3 );
+        std::uniform_real_distribution<float> depths( 0.0f, 1.0f );
+
+        std::vector<float> depth( 500 );
+        std::vector<uint32_t> pipeline( depth.size() );
+        std::vector<uint64_t> keys( depth.size() );
+        for( size_t i = 0; i < keys.size(); ++i )
+        {
+            // every 10th draw shares its depth with the one before: ties
+            depth[i] = i % 10 == 9 ? depth[i - 1] : depths( random );
+            pipeline[i] = i % 3 == 0 ? 1 : 0;
+            keys[i] = DrawSorter::MakeKey( pipeline[i], depth[i], 7 );
+        }
+
+        DrawSorter sorter;
+        const std::vector<uint32_t>& order = sorter.Sort( keys );
+        Check( order.size() == keys.size(), "sort: every draw once" );
+
+        std::vector<uint32_t> seen( order );
+        std::sort( seen.begin(), seen.end() );
+        bool permutation = true;
+        for( size_t i = 0; i < seen.size(); ++i )
+            permutation = permutation && seen[i] == i;
+        Check( permutation, "sort: the order is a permutation" );
+
+        bool pipelinesGrouped = true, frontToBack = true, stable = true;
+        for( size_t i = 1; i < order.size(); ++i )
+        {
+            const uint32_t a = order[i - 1], b = order[i];
+            if( pipeline[a] > pipeline[b] )
+                pipelinesGrouped = false;
+            else if( pipeline[a] == pipeline[b] )
+            {
+                if( depth[a] > depth[b] )
+                    frontToBack = false;
+                if( keys[a] == keys[b] && a > b )
+                    stable = false;
+            }
+        }
+        Check( pipelinesGrouped, "sort: pipelines grouped" );
+        Check( frontToBack, "sort: front to back inside a pipeline" );
+        Check( stable, "sort: equal keys keep their submission order" );
+
+        // depth is clamped: behind the far plane sorts with it, in front of the near plane with it
+        Check( DrawSorter::MakeKey( 0, 2.0f, 0 ) == DrawSorter::MakeKey( 0, 1.0f, 0 ), "sort: depth clamped to far" );
+        Check( DrawSorter::MakeKey( 0, -1.0f, 0 ) == DrawSorter::MakeKey( 0, 0.0f, 0 ), "sort: depth clamped to near" );
+    }
+}
+
+int main()
+{
+    TestMeshOptimizer( false );
+    TestMeshOptimizer( true );
+    TestRangeAllocatorAlignment();
+    TestRangeAllocatorCoalescing();
+    TestRangeAllocatorExhaustion();
+    TestDrawSorter();
+
+    if( failures == 0 )
+        std::cout << "cpu tests: all passed" << std::endl;
+    return failures;
+}
@@ -0,0 +1,101 @@
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+
+// Offline OBJ -> .mesh conversion: everything the renderer would otherwise do at load time
+// (parsing, vertex cache / fetch optimisation, compression, 16-bit index chunking) happens here once.
+
+namespace
+{
+    struct ConverterOptions
+    {
+        std::string input;
+        std::string output;
+        VertexFormat format = VertexFormat::Full;
+        bool optimize = true;
+        bool optimizeOverdraw = false;
+        bool fit = true;
+        uint32_t chunkVertices = MeshFile::MaxChunkVertices;
+    };
+
+    const char* Usage =
+        "usage: MeshConverter INPUT.obj OUTPUT.mesh [options]\n"
+        "  --compact-vertices     store half-float positions + unorm8 colors (load with --compact-vertices)\n"
+        "  --no-mesh-optimize     keep the file's triangle and vertex order\n"
+        "  --optimize-overdraw    also sort triangle clusters to reduce overdraw\n"
+        "  --no-fit               keep the coordinates (default: scaled to fill clip space)\n"
+        "  --chunk-vertices N     vertices per chunk (default 65536, the most 16-bit indices address)\n";
+
+    ConverterOptions ParseOptions( int argc, char** argv )
+    {
+        ConverterOptions options;
+        std::vector<std::string> paths;
+
+        for( int i = 1; i < argc; ++i )
+        {
+            const std::string arg = argv[i];
+
+            if( arg == "--compact-vertices" )
+                options.format = VertexFormat::Compact;
+            else if( arg == "--no-mesh-optimize" )
+                options.optimize = false;
+            else if( arg == "--optimize-overdraw" )
+                options.optimizeOverdraw = true;
+            else if( arg == "--no-fit" )
+                options.fit = false;
+            else if( arg == "--chunk-vertices" && i + 1 < argc )
+                options.chunkVertices = static_cast<uint32_t>( std::stoul( argv[++i] ) );
+            else if( arg.rfind( "--", 0 ) != 0 )
+                paths.push_back( arg );
+            else
+                throw std::runtime_error( "Unknown option: " + arg + "\n" + Usage );
+        }
+
+        if( paths.size() != 2 )
+            throw std::runtime_error( Usage );
+        options.input = paths[0];
+        options.output = paths[1];
+
+        const std::string extension = options.input.substr( options.input.find_last_of( '.' ) + 1 );
+        if( extension != "obj" )
+            throw std::runtime_error( "Only Wavefront .obj input is supported: " + options.input );
+
+        return options;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    try{
+        const ConverterOptions options = ParseOptions( argc, argv );
+
+        std::vector<MeshData> meshes = ObjLoader::Load( options.input );
+        if( options.fit )
+            ObjLoader::FitToClipSpace( meshes );
+
+        if( options.optimize )
+        {
+            MeshOptimizeReport report;
+            for( auto& mesh : meshes )
+                report.Merge( MeshOptimizer::Optimize( mesh.vertices, mesh.indices, options.optimizeOverdraw ) );
+            std::cout << report << std::endl;
+        }
+
+        const uint32_t chunkCount = MeshFile::Write( options.output, meshes, options.format, options.chunkVertices );
+        std::cout << options.input << ": " << meshes.size() << " meshes -> " << options.output << ": " << chunkCount << " chunks ("
+                  << (options.format == VertexFormat::Compact ? "compact" : "full") << " vertices)" << std::endl;
+    }
+    catch( std::exception& e )
+    {
+        std::cout << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -2,10 +2,18 @@
 
 #include <vulkan/vulkan.h>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <optional>
+#include <stdexcept>
 #include <vector>
 
+#include "MemoryAllocator.h"
+
 struct SwapchainSupportDetails
 {
 public:
@@ -35,6 +43,7 @@ public:
 public:
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;  // presentation family
+    std::optional<uint32_t> transferFamily; // dedicated transfer family if the device has one, graphics family otherwise
 };
 
 struct Vertex
@@ -48,6 +57,129 @@ struct Vertex
 */
 };
 
+// per-instance vertex attributes (binding 1, VK_VERTEX_INPUT_RATE_INSTANCE)
+struct InstanceData
+{
+    glm::mat4 transform;    // applied to the vertex position (locations 2..5, one per column)
+    glm::vec4 color;        // multiplies the vertex color (location 6)
+    uint32_t objectIndex = UINT32_MAX;  // the object's transform when the draw pushes none (location 7), UINT32_MAX: none
+};
+
+// which vertex layout the geometry pool stores and the pipeline reads
+enum class VertexFormat
+{
+    Full,       // Vertex: 2 x vec3 float (24 bytes)
+    Compact     // CompactVertex: half-float position + unorm8 color (12 bytes)
+};
+
+// position as RGBA16_SFLOAT (w is always 1.0, there is no mandatory 3 x 16-bit vertex format),
+// color as RGBA8_UNORM (a is always 1.0)
+struct CompactVertex
+{
+    uint16_t pos[4];
+    uint8_t col[4];
+};
+static_assert( sizeof(CompactVertex) == 12, "CompactVertex must stay tightly packed" );
+
+namespace VertexCompression
+{
+    // IEEE 754 binary32 -> binary16, round to nearest even; out of range values become inf
+    static uint16_t FloatToHalf( float value )
+    {
+        uint32_t bits;
+        std::memcpy( &bits, &value, sizeof(bits) );
+
+        const uint32_t sign = (bits >> 16) & 0x8000u;
+        const uint32_t exponent = (bits >> 23) & 0xFFu;
+        uint32_t mantissa = bits & 0x7FFFFFu;
+
+        if( exponent == 0xFFu )     // inf / nan
+            return static_cast<uint16_t>( sign | 0x7C00u | (mantissa ? 0x200u : 0u) );
+
+        const int32_t halfExponent = int32_t(exponent) - 127 + 15;
+        if( halfExponent >= 0x1F )  // too big
+            return static_cast<uint16_t>( sign | 0x7C00u );
+
+        if( halfExponent <= 0 )     // subnormal half (or zero)
+        {
+            if( halfExponent < -10 )
+                return static_cast<uint16_t>( sign );
+
+            mantissa |= 0x800000u;
+            const uint32_t shift = uint32_t(14 - halfExponent);
+            uint32_t half = mantissa >> shift;
+            const uint32_t rest = mantissa & ((1u << shift) - 1u);
+            const uint32_t halfway = 1u << (shift - 1);
+            if( rest > halfway || (rest == halfway && (half & 1u)) )
+                ++half;
+            return static_cast<uint16_t>( sign | half );
+        }
+
+        uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+        const uint32_t rest = mantissa & 0x1FFFu;
+        if( rest > 0x1000u || (rest == 0x1000u && (half & 1u)) )
+            ++half;     // may carry into the exponent, which is still the correct rounding
+        return static_cast<uint16_t>( sign | half );
+    }
+
+    static uint8_t FloatToUnorm8( float value )
+    {
+        const float clamped = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return static_cast<uint8_t>( std::lround( clamped * 255.0f ) );
+    }
+
+    static CompactVertex Compress( const Vertex& vertex )
+    {
+        CompactVertex compact;
+        compact.pos[0] = FloatToHalf( vertex.pos.x );
+        compact.pos[1] = FloatToHalf( vertex.pos.y );
+        compact.pos[2] = FloatToHalf( vertex.pos.z );
+        compact.pos[3] = FloatToHalf( 1.0f );
+        compact.col[0] = FloatToUnorm8( vertex.col.x );
+        compact.col[1] = FloatToUnorm8( vertex.col.y );
+        compact.col[2] = FloatToUnorm8( vertex.col.z );
+        compact.col[3] = 255;
+        return compact;
+    }
+
+    static std::vector<CompactVertex> Compress( const std::vector<Vertex>& vertices )
+    {
+        std::vector<CompactVertex> compact( vertices.size() );
+        for( size_t i = 0; i < vertices.size(); ++i )
+            compact[i] = Compress( vertices[i] );
+        return compact;
+    }
+}
+
+// binding 0 (per vertex) of each VertexFormat: what the pipeline reads and what mesh files are stored in
+namespace VertexLayout
+{
+    static uint32_t Stride( VertexFormat format )
+    {
+        return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    // the formats expand to float in the shader, so the same vertex shader reads both layouts
+    static std::vector<VkVertexInputAttributeDescription> Attributes( VertexFormat format )
+    {
+        std::vector<VkVertexInputAttributeDescription> attDesc( 2 );
+
+        // position attribute
+        attDesc[0].location = 0;
+        attDesc[0].binding = 0;
+        attDesc[0].format = format == VertexFormat::Compact ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32_SFLOAT;
+        attDesc[0].offset = format == VertexFormat::Compact ? offsetof(CompactVertex, pos) : offsetof(Vertex, pos);
+
+        // color attribute
+        attDesc[1].location = 1;
+        attDesc[1].binding = 0;
+        attDesc[1].format = format == VertexFormat::Compact ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+        attDesc[1].offset = format == VertexFormat::Compact ? offsetof(CompactVertex, col) : offsetof(Vertex, col);
+
+        return attDesc;
+    }
+}
+
 namespace Buffer
 {
     static int32_t FindProperties( const VkPhysicalDeviceMemoryProperties* pMemoryProperties,
@@ -73,9 +205,9 @@ namespace Buffer
     }
 
 
-    static void Create( VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize bufferSize,
+    static void Create( VkDevice device, MemoryAllocator& allocator, VkDeviceSize bufferSize,
                             VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags memPropFlags,
-                            VkBuffer& buffer, VkDeviceMemory& bufferMemory )
+                            VkBuffer& buffer, Allocation& bufferAllocation )
     {
         // buffer info (doesn't include assigning memory)
         VkBufferCreateInfo bufferInfo{};
@@ -95,26 +227,18 @@ namespace Buffer
         VkMemoryRequirements memReq{};
         vkGetBufferMemoryRequirements( device, buffer, &memReq );
 
-        // memory allocate info
-        VkMemoryAllocateInfo allocateInfo{};
-        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocateInfo.allocationSize = memReq.size;
-
-        VkPhysicalDeviceMemoryProperties memProps{};
-        vkGetPhysicalDeviceMemoryProperties( physicalDevice, &memProps );
-        int32_t memoryType = FindProperties( &memProps, 
-                                            memReq.memoryTypeBits,
-                                            memPropFlags );
-        
-        allocateInfo.memoryTypeIndex = memoryType;
-        if( vkAllocateMemory( device, &allocateInfo, nullptr, &bufferMemory)
-            != VK_SUCCESS )
-        {
-            throw std::runtime_error( "Failed to allocate memory for vertex buffer!" );
-        }
+        // sub-allocate from one of the allocator blocks (no vkAllocateMemory per buffer)
+        bufferAllocation = allocator.Allocate( memReq, memPropFlags );
 
         // binding vertex buffer with the memory allocation
-        vkBindBufferMemory( device, buffer, bufferMemory, 0 );
+        vkBindBufferMemory( device, buffer, bufferAllocation.memory, bufferAllocation.offset );
+    }
+
+    static void Destroy( VkDevice device, MemoryAllocator& allocator, VkBuffer& buffer, Allocation& bufferAllocation )
+    {
+        vkDestroyBuffer( device, buffer, nullptr );
+        allocator.Free( bufferAllocation );
+        buffer = VK_NULL_HANDLE;
     }
 
     static void Copy( VkDevice device, VkQueue transferQueue, VkCommandPool commandPool, 
@@ -163,13 +287,22 @@ namespace Buffer
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &tempCmdBuff;
 
+        // fence for this copy only (vkQueueWaitIdle would also wait for everything else on the queue)
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkFence copyFence;
+        if( vkCreateFence( device, &fenceInfo, nullptr, &copyFence )
+            != VK_SUCCESS )
+        throw std::runtime_error( "Failed to create copy fence!" );
+
         // submit temporary command buffer to transferQueue
-        if ( vkQueueSubmit( transferQueue, 1, &submitInfo, VK_NULL_HANDLE )
+        if ( vkQueueSubmit( transferQueue, 1, &submitInfo, copyFence )
             != VK_SUCCESS )
         throw std::runtime_error( "Failed to submitting command buffer to transfer queue!" );
 
         // wait to temporary command buffer being executed by transfer queue
-        vkQueueWaitIdle( transferQueue );
+        vkWaitForFences( device, 1, &copyFence, VK_TRUE, UINT64_MAX );
+        vkDestroyFence( device, copyFence, nullptr );
 
         // freeing temporary command buffer
         vkFreeCommandBuffers( device, commandPool, 1, &tempCmdBuff );
@@ -182,3 +315,133 @@ namespace Buffer
 
 }
 
+
+namespace Image
+{
+    // 2D, optimal tiling image (mipLevels levels from extent down) with its memory sub-allocated from the image blocks
+    static void Create( VkDevice device, MemoryAllocator& allocator, VkExtent2D extent, VkFormat format,
+                            VkImageUsageFlags imageUsage, VkMemoryPropertyFlags memPropFlags,
+                            VkImage& image, Allocation& imageAllocation, uint32_t mipLevels = 1 )
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent = { extent.width, extent.height, 1 };
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = imageUsage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if( vkCreateImage( device, &imageInfo, nullptr, &image )
+            != VK_SUCCESS )
+        {
+            throw std::runtime_error( "Failed to create image!" );
+        }
+
+        VkMemoryRequirements memReq{};
+        vkGetImageMemoryRequirements( device, image, &memReq );
+
+        imageAllocation = allocator.Allocate( memReq, memPropFlags, ResourceKind::Image );
+        vkBindImageMemory( device, image, imageAllocation.memory, imageAllocation.offset );
+    }
+
+    static void Destroy( VkDevice device, MemoryAllocator& allocator, VkImage& image, Allocation& imageAllocation )
+    {
+        vkDestroyImage( device, image, nullptr );
+        allocator.Free( imageAllocation );
+        image = VK_NULL_HANDLE;
+    }
+}
+
+namespace FormatBlock
+{
+    // texel block of a format: data is laid out in rows of blocks, each block width x height texels in bytes
+    struct Info
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t bytes = 0;     // 0: a format the texture path doesn't handle
+    };
+
+    static Info Get( VkFormat format )
+    {
+        switch( format )
+        {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return { 1, 1, 4 };
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            return { 4, 4, 8 };
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return { 4, 4, 16 };
+        default:
+            return {};
+        }
+    }
+
+    static bool IsCompressed( VkFormat format )
+    {
+        return Get( format ).width > 1;
+    }
+
+    // bytes of a tightly packed width x height level
+    static VkDeviceSize LevelSize( VkFormat format, uint32_t width, uint32_t height )
+    {
+        const Info block = Get( format );
+        if( block.bytes == 0 )
+            return 0;
+        return VkDeviceSize( (width + block.width - 1) / block.width ) * ( (height + block.height - 1) / block.height ) * block.bytes;
+    }
+}
+
+// FNV-1a, for cache keys and file checksums: feed it explicitly listed fields
+// (never whole Vulkan structs: sType / pNext / padding)
+class Hasher
+{
+public:
+    void Add( const void* data, size_t size )
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>( data );
+        for( size_t i = 0; i < size; ++i )
+        {
+            _hash ^= bytes[i];
+            _hash *= 1099511628211ULL;
+        }
+    }
+
+    template<typename T>
+    void Add( const T& value )
+    {
+        Add( &value, sizeof(value) );
+    }
+
+    // the size first, so neighbouring vectors can't shift bytes into each other
+    template<typename T>
+    void AddVector( const std::vector<T>& values )
+    {
+        Add( static_cast<uint64_t>( values.size() ) );
+        Add( values.data(), values.size() * sizeof(T) );
+    }
+
+    uint64_t Get() const { return _hash; }
+
+private:
+    uint64_t _hash = 14695981039346656037ULL;
+};